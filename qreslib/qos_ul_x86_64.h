@@ -0,0 +1,54 @@
+/** @file
+ *
+ * @brief Composite operations on unsigned long integers for x86_64.
+ *
+ * The intermediate 64-bit results of the 32-bit operations are
+ * computed with the native 64-bit multiply and divide instructions,
+ * both in user and kernel space, where no do_div() is needed. The
+ * 96-bit intermediate results of the 64x32-bit operations use the
+ * 128-bit integer type of gcc, compiled into a single multiply.
+ */
+
+#ifndef __QOS_UL_X86_64_H__
+#define __QOS_UL_X86_64_H__
+
+#ifndef __x86_64__
+#  error "This module only works for x86_64 architectures"
+#endif
+
+#include <linux/types.h>
+
+/** Computes '(num << SHF) / den' as unsigned long (32 bits).
+ *
+ * @see qos_ul_other.h
+ */
+#define ul_shl_div(num, SHF, den) ((__u32) ((((__u64) ((__u32)(num))) << (SHF)) / (__u32)(den)))
+
+/** Computes 'ceil((num << SHF) / den)' as unsigned long (32 bits). */
+#define ul_shl_ceil(num, SHF, den) ({			\
+      __u64 _n = (__u64) (num);				\
+      __u32 _d = (__u32) (den);				\
+      __u32 _r = (__u32) ( ( (_n << (SHF)) + _d - 1) / _d ); \
+      _r;						\
+    })
+
+/** Computes '(x * num) / den' as unsigned long (32 bits). */
+#define ul_mul_div(x, num, den) ((__u32) (((__u64) (x)) * (num) / (__u32)(den)))
+
+/** Computes '(x * y) >> SHF' as unsigned long (32 bits). */
+#define ul_mul_shr(x, y, SHF) ((__u32) ((((__u64) (x)) * (y)) >> (SHF)))
+
+/** Computes '(x * y) >> 32', with x on 64 bits and y on 32 bits.
+ *
+ * The computation is carried on with intermediate result (x*y)
+ * on 96 bits.
+ */
+#define ull_mul_shr32(x, y) ((__u64) ((((unsigned __int128) (__u64) (x)) * (__u32) (y)) >> 32))
+
+/** Computes 'num / den', with num on 64 bits and den on 32 bits. */
+#define ull_div(num, den) (((__u64) (num)) / (__u32) (den))
+
+/** Computes 'num / den', with both num and den on 64 bits. */
+#define ull_div64(num, den) (((__u64) (num)) / (__u64) (den))
+
+#endif
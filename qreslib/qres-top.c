@@ -0,0 +1,157 @@
+/** @file
+ ** @brief Live monitoring of all the QRES servers.
+ **
+ ** Shows a table of the servers, refreshed periodically, or emits it as
+ ** CSV with -b. Each refresh takes the state of all servers with a
+ ** single qres_list_servers(), plus one more when servers were created
+ ** since the previous refresh and the table has to grow.
+ **
+ ** Usage: qres-top [-b] [-d seconds] [-n iterations]
+ **/
+
+#include "qos_debug.h"
+#include "qres_lib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/** Room in the table of states first allocated */
+#define STATS_INIT 256
+
+static qres_server_stat_t *stats = NULL;
+static unsigned int stats_room = 0;
+
+/** Retrieve the states of all servers into stats[], growing it if needed */
+static qos_rv refresh(unsigned int *p_num) {
+  unsigned int num;
+  qos_rv rv;
+
+  for (;;) {
+    num = stats_room;
+    rv = qres_list_servers(stats, &num);
+    if (rv != QOS_OK || num <= stats_room)
+      break;
+    /* Room for some more servers, created in the meantime */
+    free(stats);
+    stats_room = num + num / 4;
+    stats = malloc(stats_room * sizeof(*stats));
+    if (stats == NULL) {
+      stats_room = 0;
+      return QOS_E_NO_MEMORY;
+    }
+  }
+  *p_num = num;
+  return rv;
+}
+
+static int cmp_sid(const void *a, const void *b) {
+  return ((const qres_server_stat_t *) a)->server_id
+    - ((const qres_server_stat_t *) b)->server_id;
+}
+
+static void print_csv_header(void) {
+  printf("time,sid,parent,uid,gid,Q_min,Q,P,appr_budget,curr_budget,"
+	 "consumed,total,throttled,tasks\n");
+}
+
+static void print_csv(double now, qres_server_stat_t *s, unsigned int num) {
+  unsigned int i;
+
+  for (i = 0; i < num; i++, s++)
+    printf("%.3f,%d,%d,%d,%d," QRES_TIME_FMT "," QRES_TIME_FMT "," QRES_TIME_FMT ","
+	   QRES_TIME_FMT "," QRES_TIME_FMT ",%u,%llu,%u,%u\n",
+	   now, s->server_id, s->parent_id, s->uid, s->gid,
+	   s->params.Q_min, s->params.Q, s->params.P, s->appr_budget, s->curr_budget,
+	   s->consumed, (unsigned long long) s->total, s->throttled, s->nr_tasks);
+}
+
+static void print_table(qres_server_stat_t *s, unsigned int num) {
+  unsigned int i;
+  double tot_bw = 0.0;
+
+  for (i = 0; i < num; i++)
+    if (s[i].parent_id == QRES_SID_NULL && s[i].params.P > 0)
+      tot_bw += (double) s[i].appr_budget / s[i].params.P;
+
+  /* Home the cursor and clear the screen */
+  printf("\033[H\033[2J");
+  printf("qres-top - %u servers, %.1f%% approved to top-level ones\n\n", num, tot_bw * 100.0);
+  printf("%6s %6s %6s %6s %9s %9s %9s %9s %9s %9s %6s %5s\n",
+	 "SID", "PARENT", "UID", "GID", "Q_MIN", "Q", "P",
+	 "APPR", "CURR", "USED", "THROT", "TASKS");
+  for (i = 0; i < num; i++, s++) {
+    printf("%6d ", s->server_id);
+    if (s->parent_id == QRES_SID_NULL)
+      printf("%6s ", "-");
+    else
+      printf("%6d ", s->parent_id);
+    printf("%6d %6d %9ld %9ld %9ld %9ld %9ld %9u %6u %5u\n",
+	   s->uid, s->gid, (long) s->params.Q_min, (long) s->params.Q, (long) s->params.P,
+	   (long) s->appr_budget, (long) s->curr_budget, s->consumed,
+	   s->throttled, s->nr_tasks);
+  }
+  fflush(stdout);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-b] [-d seconds] [-n iterations]\n"
+	  "  -b  batch mode, emitting CSV\n"
+	  "  -d  delay between refreshes (default 1.0)\n"
+	  "  -n  number of refreshes, 0 for no limit (default)\n"
+	  "Budgets and runtimes are in usec.\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  int batch = 0, iters = 0, i, opt;
+  double delay = 1.0;
+  unsigned int num;
+  struct timeval tv;
+
+  while ((opt = getopt(argc, argv, "bd:n:h")) != -1) {
+    switch (opt) {
+    case 'b':
+      batch = 1;
+      break;
+    case 'd':
+      delay = atof(optarg);
+      break;
+    case 'n':
+      iters = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : -1;
+    }
+  }
+  if (delay < 0.0 || iters < 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  qos_chk_ok_exit(qres_init());
+  stats_room = STATS_INIT;
+  stats = malloc(stats_room * sizeof(*stats));
+  qos_chk_exit(stats != NULL);
+
+  if (batch)
+    print_csv_header();
+  for (i = 0; iters == 0 || i < iters; i++) {
+    if (i > 0)
+      usleep((useconds_t) (delay * 1000000.0));
+    qos_chk_ok_exit(refresh(&num));
+    qsort(stats, num, sizeof(*stats), cmp_sid);
+    if (batch) {
+      gettimeofday(&tv, NULL);
+      print_csv(tv.tv_sec + tv.tv_usec / 1000000.0, stats, num);
+      fflush(stdout);
+    } else
+      print_table(stats, num);
+  }
+
+  free(stats);
+  qres_cleanup();
+  return 0;
+}
@@ -46,17 +46,121 @@ typedef struct qres_iparams_t {
   qres_params_t params;		/**< Server static parameters		*/
 } qres_iparams_t;
 
+/** Maximum number of servers changed by a single QRES_OP_SET_PARAMS_MULTI */
+#define QRES_MAX_MULTI 64
+
+/** Parameters of multiple servers, to be changed atomically */
+typedef struct qres_multi_iparams_t {
+  unsigned int num;		/**< Number of entries in p_iparams	*/
+  qres_iparams_t *p_iparams;	/**< User-space array of new parameters	*/
+} qres_multi_iparams_t;
+
+/** Parameters for the creation of a sub-reservation within a server */
+typedef struct qres_sub_iparams_t {
+  qres_sid_t server_id;		/**< Created server identifier		*/
+  qres_sid_t parent_id;		/**< Enclosing server identifier	*/
+  qres_params_t params;		/**< Server static parameters		*/
+} qres_sub_iparams_t;
+
 typedef struct qres_timespec_iparams_t {
   qres_sid_t server_id;		/**< Server identifier or QRES_SID_NULL	*/
   struct timespec timespec;	/**< Timespec information		*/
 } qres_timespec_iparams_t;
 
+/** Maximum number of CPUs the budget of a server may be spread over */
+#define QRES_MAX_CPUS 32
+
+/** Per-CPU distribution of the budget of a server */
+typedef struct qres_cpu_iparams_t {
+  qres_sid_t server_id;		/**< Server identifier or QRES_SID_NULL	*/
+  unsigned int cpu_mask;	/**< CPUs the budget is spread over, 0 for all */
+  qres_time_t Q_cpu[QRES_MAX_CPUS]; /**< Per-CPU budgets, all 0 for even spread */
+} qres_cpu_iparams_t;
+
 /** Carries weight information for set/get weight */
 typedef struct qres_weight_iparams_t {
   qres_sid_t server_id;         /**< Server identifier or QRES_SID_NULL */
   unsigned long weight;         /**< Weight information                 */
 } qres_weight_iparams_t;
 
+/** Carries the elasticity of a server for set/get elasticity */
+typedef struct qres_elasticity_iparams_t {
+  qres_sid_t server_id;		/**< Server identifier or QRES_SID_NULL */
+  unsigned int elasticity;	/**< Share of compression in elastic levels */
+} qres_elasticity_iparams_t;
+
+/** Number of generation counters in the page mapped from the QRES device */
+#define QRES_GEN_SLOTS 1024
+
+/** Generation counter slot of server sid */
+#define QRES_GEN_SLOT(sid) ((unsigned int) (sid) % QRES_GEN_SLOTS)
+
+/** Layout of the page mapped from the QRES device: the counter of a slot
+ * is incremented whenever a server in that slot changes its parameters,
+ * or is created or destroyed */
+typedef struct qres_gen_page_t {
+  unsigned int gen[QRES_GEN_SLOTS];
+} qres_gen_page_t;
+
+/** The server consumed all of its approved budget in the period */
+#define QRES_SAMPLE_F_THROTTLED	0x01
+/** Tasks joined or left the server during the period */
+#define QRES_SAMPLE_F_TASKS	0x02
+
+/** Execution of a server over one of its periods */
+typedef struct qres_sample_t {
+  __u64 start;		/**< Start of the period (usec)			*/
+  __u64 total;		/**< Runtime consumed up to the period end (usec) */
+  __u32 consumed;	/**< Runtime consumed in the period (usec)	*/
+  __u32 budget;		/**< Budget approved for the period (usec)	*/
+  __u32 period;		/**< Length of the period (usec)		*/
+  __u32 flags;		/**< Mask of QRES_SAMPLE_F_* flags		*/
+} qres_sample_t;
+
+/** Number of samples kept in the ring of each server */
+#define QRES_SAMPLES_NUM 127
+
+/** Layout of the page holding the ring of samples of a server, mapped
+ * from the QRES device at page offset QRES_SAMPLES_PGOFF() of its sid.
+ * Sample number n is stored at samples[n % QRES_SAMPLES_NUM], and head
+ * is incremented after each sample is complete. The head is 64 bits
+ * wide, so that it never wraps, as QRES_SAMPLES_NUM does not divide
+ * 2^32; readers on 32-bit machines must re-read it until stable */
+typedef struct qres_sample_ring_t {
+  __u64 head;		/**< Number of samples ever written		*/
+  __s32 server_id;	/**< Server the samples refer to		*/
+  __u32 reserved[5];
+  qres_sample_t samples[QRES_SAMPLES_NUM];
+} qres_sample_ring_t;
+
+/** Page offset of the ring of samples of server sid within the device */
+#define QRES_SAMPLES_PGOFF(sid) (1 + (unsigned long) (sid))
+
+/** State of a server, as listed by QRES_OP_LIST_SERVERS */
+typedef struct qres_server_stat_t {
+  qres_sid_t server_id;		/**< Server identifier			*/
+  qres_sid_t parent_id;		/**< Enclosing server, or QRES_SID_NULL	*/
+  __s32 uid;			/**< UID of the owner			*/
+  __s32 gid;			/**< GID of the owner			*/
+  qres_params_t params;		/**< Requested parameters		*/
+  qres_time_t appr_budget;	/**< Budget approved by the supervisor	*/
+  qres_time_t curr_budget;	/**< Budget left in the current period	*/
+  __u32 nr_tasks;		/**< Number of attached threads		*/
+  __u32 throttled;		/**< Periods in which the approved budget
+				     was exhausted, if sampled		*/
+  __u32 consumed;		/**< Runtime consumed in the last sampled
+				     period (usec)			*/
+  __u32 reserved;
+  __u64 total;			/**< Runtime consumed over all sampled
+				     periods (usec)			*/
+} qres_server_stat_t;
+
+/** Servers listed by a single QRES_OP_LIST_SERVERS */
+typedef struct qres_list_iparams_t {
+  unsigned int num;		/**< In: room in p_stats, out: servers	*/
+  qres_server_stat_t *p_stats;	/**< User-space array of states		*/
+} qres_list_iparams_t;
+
 /** Types of operation that can be requested to the QRES module */
 typedef enum {
   QRES_OP_CREATE_SERVER,
@@ -72,9 +176,65 @@ typedef enum {
   QRES_OP_GET_APPR_BUDGET,
   QRES_OP_GET_DEADLINE,
   QRES_OP_SET_WEIGHT,
-  QRES_OP_GET_WEIGHT
+  QRES_OP_GET_WEIGHT,
+  QRES_OP_CREATE_SUBSERVER,
+  QRES_OP_SET_CPU_PARAMS,
+  QRES_OP_GET_CPU_PARAMS,
+  QRES_OP_SET_PARAMS_MULTI,
+  QRES_OP_SET_ELASTICITY,
+  QRES_OP_GET_ELASTICITY,
+  QRES_OP_RING_SETUP,
+  QRES_OP_RING_ENTER,
+  QRES_OP_LIST_SERVERS
 } qres_op_t;
 
+/** Number of entries of each queue of a submission/completion ring */
+#define QRES_RING_ENTRIES 256
+
+/** Payload of an operation submitted through a ring, and of its results */
+typedef union qres_ring_args_t {
+  qres_sid_t server_id;
+  qres_iparams_t iparams;
+  qres_attach_iparams_t attach_iparams;
+  qres_time_iparams_t time_iparams;
+  qres_weight_iparams_t weight_iparams;
+  qres_elasticity_iparams_t elasticity_iparams;
+} qres_ring_args_t;
+
+/** Submission queue entry: the same payload as the ioctl() for op */
+typedef struct qres_ring_sqe_t {
+  __u64 user_data;		/**< Copied as is into the completion	*/
+  __u32 op;			/**< One of qres_op_t			*/
+  __u32 reserved;
+  qres_ring_args_t u;		/**< Input parameters			*/
+} qres_ring_sqe_t;
+
+/** Completion queue entry, posted in submission order */
+typedef struct qres_ring_cqe_t {
+  __u64 user_data;		/**< From the submission queue entry	*/
+  __s32 rv;			/**< Outcome, as a qos_rv integer	*/
+  __u32 reserved;
+  qres_ring_args_t u;		/**< Output parameters, as by ioctl()	*/
+} qres_ring_cqe_t;
+
+/** Layout of the submission and completion queues shared by a process
+ * and the module, mapped from a QRES device file after QRES_OP_RING_SETUP.
+ *
+ * Head and tail are free-running counters, whose value modulo
+ * QRES_RING_ENTRIES is an index into the queue. The process fills
+ * sq[sq_tail], then increments sq_tail, and consumes cq[cq_head], then
+ * increments cq_head. The module does the converse during a
+ * QRES_OP_RING_ENTER. */
+typedef struct qres_ring_t {
+  __u32 sq_head;		/**< Next entry consumed by the module	*/
+  __u32 sq_tail;		/**< Next entry filled by the process	*/
+  __u32 cq_head;		/**< Next completion read by the process */
+  __u32 cq_tail;		/**< Next completion posted by the module */
+  __u32 reserved[12];
+  qres_ring_sqe_t sq[QRES_RING_ENTRIES];
+  qres_ring_cqe_t cq[QRES_RING_ENTRIES];
+} qres_ring_t;
+
 /** Name of the QoS Manager device used to	*
  * communicate with the kernel module		*/
 #define QRES_DEV_NAME "qosres"
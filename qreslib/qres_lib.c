@@ -8,8 +8,10 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
-//#include <unistd.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <string.h>
 #include <errno.h>
 
@@ -30,21 +32,49 @@
 #define IOCTL_OP_GET_DEADLINE          _IOWR(QRES_MAJOR_NUM, QRES_OP_GET_DEADLINE, qres_timespec_iparams_t)
 #define IOCTL_OP_SET_WEIGHT            _IOR (QRES_MAJOR_NUM, QRES_OP_SET_WEIGHT, qres_weight_iparams_t)
 #define IOCTL_OP_GET_WEIGHT            _IOWR(QRES_MAJOR_NUM, QRES_OP_GET_WEIGHT, qres_weight_iparams_t)
+#define IOCTL_OP_CREATE_SUBSERVER      _IOWR(QRES_MAJOR_NUM, QRES_OP_CREATE_SUBSERVER, qres_sub_iparams_t)
+#define IOCTL_OP_SET_CPU_PARAMS        _IOR (QRES_MAJOR_NUM, QRES_OP_SET_CPU_PARAMS, qres_cpu_iparams_t)
+#define IOCTL_OP_GET_CPU_PARAMS        _IOWR(QRES_MAJOR_NUM, QRES_OP_GET_CPU_PARAMS, qres_cpu_iparams_t)
+#define IOCTL_OP_SET_PARAMS_MULTI      _IOR (QRES_MAJOR_NUM, QRES_OP_SET_PARAMS_MULTI, qres_multi_iparams_t)
+#define IOCTL_OP_SET_ELASTICITY        _IOR (QRES_MAJOR_NUM, QRES_OP_SET_ELASTICITY, qres_elasticity_iparams_t)
+#define IOCTL_OP_GET_ELASTICITY        _IOWR(QRES_MAJOR_NUM, QRES_OP_GET_ELASTICITY, qres_elasticity_iparams_t)
+#define IOCTL_OP_RING_SETUP            _IO  (QRES_MAJOR_NUM, QRES_OP_RING_SETUP)
+#define IOCTL_OP_RING_ENTER            _IO  (QRES_MAJOR_NUM, QRES_OP_RING_ENTER)
+#define IOCTL_OP_LIST_SERVERS          _IOWR(QRES_MAJOR_NUM, QRES_OP_LIST_SERVERS, qres_list_iparams_t)
 
 /** File descriptor of the QoS Res Device		*/
 int qres_fd = -1;
 
-/** Server period set with create_server or set_params	*/
-qres_params_t server_params = {
-  .Q = 0,
-  .Q_min = 0,
-  .P = 0,
-  .flags = 0,
-  .timeout = 0
-};
+/** Serializes the opening and closing of the device	*/
+static pthread_mutex_t qres_open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Generation counters mapped from the device, NULL if unavailable */
+static const volatile qres_gen_page_t *qres_gen = NULL;
+
+/** Mapping of the generation counters, never unmapped: other threads may
+ ** still be reading it through qres_gen when qres_cleanup() is called.
+ ** It is reused by the next qres_init(), if any.
+ **/
+static void *qres_gen_map = NULL;
+
+/** Last known parameters of a server.
+ *
+ * Entries are updated with no locks: a writer makes seq odd, which keeps
+ * other writers off, and readers retry (i.e., miss) if seq is odd or has
+ * changed while they were reading. An entry is valid only as long as the
+ * generation counter of its slot is still gen.
+ */
+typedef struct qres_cache_entry_t {
+  volatile unsigned int seq;	/**< Odd while being updated		*/
+  qres_sid_t sid;		/**< Server the params belong to	*/
+  unsigned int gen;		/**< Generation the params were read at	*/
+  qres_params_t params;		/**< Parameters as known by the module	*/
+} qres_cache_entry_t;
+
+/** Per-server parameters cache, indexed by generation slot	*/
+static qres_cache_entry_t qres_cache[QRES_GEN_SLOTS];
 
 
-/** @todo If not open, then open it !			*/
 static inline qos_rv check_open() {
   if (qres_fd == -1) {
     return qres_init();
@@ -53,6 +83,67 @@ static inline qos_rv check_open() {
 }
 
 
+/** Look the parameters of server sid up into the cache	*/
+static qos_bool_t cache_lookup(qres_sid_t sid, qres_params_t *p_params) {
+  qres_cache_entry_t *e = &qres_cache[QRES_GEN_SLOT(sid)];
+  /* Read once, as qres_cleanup() may reset it meanwhile */
+  const volatile qres_gen_page_t *gen = qres_gen;
+  unsigned int seq;
+  qos_bool_t valid;
+
+  if (gen == NULL)
+    return 0;
+  seq = e->seq;
+  __sync_synchronize();
+  if (seq & 1)
+    return 0;
+  valid = (e->sid == sid && e->gen == gen->gen[QRES_GEN_SLOT(sid)]);
+  *p_params = e->params;
+  __sync_synchronize();
+  return valid && e->seq == seq;
+}
+
+
+/** Store the parameters of server sid, read at generation gen, into the
+ ** cache, unless another thread is updating the same entry	*/
+static void cache_store(qres_sid_t sid, unsigned int gen, qres_params_t *p_params) {
+  qres_cache_entry_t *e = &qres_cache[QRES_GEN_SLOT(sid)];
+  unsigned int seq = e->seq;
+
+  if ((seq & 1) || ! __sync_bool_compare_and_swap(&e->seq, seq, seq + 1))
+    return;
+  e->sid = sid;
+  e->gen = gen;
+  e->params = *p_params;
+  __sync_synchronize();
+  e->seq = seq + 2;
+}
+
+
+/** Retrieve the parameters of server sid, from the cache if still valid,
+ ** otherwise from the module, caching them */
+static qos_rv get_params_cached(qres_sid_t sid, qres_params_t *p_params) {
+  const volatile qres_gen_page_t *gen_page = qres_gen;
+  qres_iparams_t iparams;
+  unsigned int gen = 0;
+
+  if (cache_lookup(sid, p_params))
+    return QOS_OK;
+  /* The generation is read first: a change racing with the ioctl()
+   * leaves a stale generation in the cache, hence a later miss */
+  if (gen_page != NULL)
+    gen = gen_page->gen[QRES_GEN_SLOT(sid)];
+  __sync_synchronize();
+  iparams.server_id = sid;
+  if (ioctl(qres_fd, IOCTL_OP_GET_PARAMS, &iparams) < 0)
+    return qos_int_rv(-errno);
+  *p_params = iparams.params;
+  if (gen_page != NULL)
+    cache_store(sid, gen, p_params);
+  return QOS_OK;
+}
+
+
 qos_rv qres_get_sid(pid_t pid, tid_t tid, qres_sid_t *p_sid) {
   qres_attach_iparams_t iparams;
 
@@ -85,7 +176,25 @@ qos_rv qres_create_server(qres_params_t * p_params, qres_sid_t *p_sid) {
   if (p_sid != NULL)
     *p_sid = iparams.server_id;
 
-  server_params = *p_params;
+  return QOS_OK;
+}
+
+
+qos_rv qres_create_subserver(qres_sid_t parent_sid, qres_params_t * p_params, qres_sid_t *p_sid) {
+  qres_sub_iparams_t iparams;
+
+  qos_rv rv = check_open();
+  qos_chk_rv(rv == QOS_OK, rv);
+
+  iparams.parent_id = parent_sid;
+  iparams.params = *p_params;
+
+  if (ioctl(qres_fd, IOCTL_OP_CREATE_SUBSERVER, &iparams) < 0)
+    return qos_int_rv(-errno);
+
+  if (p_sid != NULL)
+    *p_sid = iparams.server_id;
+
   return QOS_OK;
 }
 
@@ -138,26 +247,57 @@ qos_rv qres_detach_thread(qres_sid_t sid, pid_t pid, tid_t tid) {
 #define QRES_DEV_PATHNAME QOS_DEV_PATH "/" QRES_DEV_NAME
 
 qos_rv qres_init() {
-  qres_fd = open(QRES_DEV_PATHNAME, O_RDONLY);
-  if (qres_fd < 0) {
+  qos_rv rv = QOS_OK;
+  int fd;
+  void *gen;
+
+  pthread_mutex_lock(&qres_open_lock);
+  if (qres_fd != -1)
+    goto out;
+  fd = open(QRES_DEV_PATHNAME, O_RDONLY);
+  if (fd < 0) {
     qos_log_debug("Failed to open device %s", QRES_DEV_PATHNAME);
-    return QOS_E_MISSING_COMPONENT;
+    rv = QOS_E_MISSING_COMPONENT;
+    goto out;
   }
-  return QOS_OK;
+  /* Without the generation counters, parameters are just not cached */
+  if (qres_gen_map == NULL) {
+    gen = mmap(NULL, sizeof(qres_gen_page_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (gen == MAP_FAILED)
+      qos_log_debug("Could not map generation counters, disabling cache");
+    else
+      qres_gen_map = gen;
+  }
+  qres_gen = qres_gen_map;
+  __sync_synchronize();
+  qres_fd = fd;
+
+ out:
+  pthread_mutex_unlock(&qres_open_lock);
+  return rv;
 }
 
 
 qos_rv qres_cleanup() {
-  int fd = qres_fd;
-
-  if (qres_fd == -1)
-    return QOS_E_INCONSISTENT_STATE;
+  qos_rv rv = QOS_OK;
+  int fd;
+
+  pthread_mutex_lock(&qres_open_lock);
+  fd = qres_fd;
+  if (fd == -1) {
+    rv = QOS_E_INCONSISTENT_STATE;
+    goto out;
+  }
 
   qres_fd = -1;
+  /* Disable the cache, but keep the counters mapped, see qres_gen_map */
+  qres_gen = NULL;
   if (close(fd) < 0)
-    return QOS_E_GENERIC;
+    rv = QOS_E_GENERIC;
 
-  return QOS_OK;
+ out:
+  pthread_mutex_unlock(&qres_open_lock);
+  return rv;
 }
 
 
@@ -265,26 +405,177 @@ qos_rv qres_set_params(qres_sid_t sid, qres_params_t * p_params) {
   err = ioctl(qres_fd, IOCTL_OP_SET_PARAMS, &iparams);
   if (err == -1)
     rv = qos_int_rv(-errno);
-  else
-    server_params = *p_params;
   return rv;
 }
 
 
 qos_rv qres_get_params(qres_sid_t sid, qres_params_t * qres_p) {
-  qres_iparams_t iparams;
-  int err;
+  qos_rv rv = check_open();
+  qos_chk_rv(rv == QOS_OK, rv);
+
+  return get_params_cached(sid, qres_p);
+}
+
+
+void qres_tx_begin(qres_tx_t *p_tx) {
+  p_tx->num = 0;
+}
+
+
+qos_rv qres_tx_set_params(qres_tx_t *p_tx, qres_sid_t sid, qres_params_t *p_params) {
+  unsigned int i;
+
+  for (i = 0; i < p_tx->num; ++i)
+    if (p_tx->items[i].server_id == sid)
+      break;
+  if (i == QRES_MAX_MULTI)
+    return QOS_E_FULL;
+  if (i == p_tx->num)
+    p_tx->num++;
+  p_tx->items[i].server_id = sid;
+  p_tx->items[i].params = *p_params;
+  return QOS_OK;
+}
+
+
+qos_rv qres_tx_commit(qres_tx_t *p_tx) {
+  qres_multi_iparams_t iparams;
 
   qos_rv rv = check_open();
   qos_chk_rv(rv == QOS_OK, rv);
 
-  iparams.server_id = sid;
-  err = ioctl(qres_fd, IOCTL_OP_GET_PARAMS, &iparams);
-  if (err == 0) {
-    memcpy(qres_p, &iparams.params, sizeof(qres_params_t));
+  if (p_tx->num == 0)
     return QOS_OK;
-  } else
+  iparams.num = p_tx->num;
+  iparams.p_iparams = p_tx->items;
+  if (ioctl(qres_fd, IOCTL_OP_SET_PARAMS_MULTI, &iparams) < 0)
+    return qos_int_rv(-errno);
+  p_tx->num = 0;
+  return QOS_OK;
+}
+
+
+qos_rv qres_ring_open(qres_ring_handle_t *p_h) {
+  void *ring;
+  qos_rv rv;
+
+  if (p_h == NULL)
+    return QOS_E_INVALID_PARAM;
+  /* A file of its own, as its mapping is replaced by the queues */
+  p_h->fd = open(QRES_DEV_PATHNAME, O_RDWR);
+  if (p_h->fd < 0)
+    return QOS_E_MISSING_COMPONENT;
+  if (ioctl(p_h->fd, IOCTL_OP_RING_SETUP) < 0) {
+    rv = qos_int_rv(-errno);
+    goto err;
+  }
+  ring = mmap(NULL, sizeof(qres_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, p_h->fd, 0);
+  if (ring == MAP_FAILED) {
+    rv = QOS_E_NO_MEMORY;
+    goto err;
+  }
+  p_h->ring = ring;
+  p_h->sq_tail = p_h->ring->sq_tail;
+  return QOS_OK;
+
+ err:
+  qos_log_err("Could not set up the ring: %s", qos_strerror(rv));
+  close(p_h->fd);
+  p_h->fd = -1;
+  return rv;
+}
+
+
+qos_rv qres_ring_close(qres_ring_handle_t *p_h) {
+  qos_rv rv = QOS_OK;
+
+  if (p_h == NULL || p_h->fd < 0)
+    return QOS_E_INCONSISTENT_STATE;
+  munmap((void *) p_h->ring, sizeof(qres_ring_t));
+  if (close(p_h->fd) < 0)
+    rv = QOS_E_GENERIC;
+  p_h->ring = NULL;
+  p_h->fd = -1;
+  return rv;
+}
+
+
+qres_ring_sqe_t *qres_ring_get_sqe(qres_ring_handle_t *p_h) {
+  volatile qres_ring_sqe_t *sqe;
+
+  if (p_h->sq_tail - p_h->ring->sq_head >= QRES_RING_ENTRIES)
+    return NULL;
+  sqe = &p_h->ring->sq[p_h->sq_tail % QRES_RING_ENTRIES];
+  p_h->sq_tail++;
+  return (qres_ring_sqe_t *) sqe;
+}
+
+
+qos_rv qres_ring_submit(qres_ring_handle_t *p_h, unsigned int *p_num) {
+  int num;
+
+  /* Make the entries visible before their tail, see qres_ring.c */
+  __sync_synchronize();
+  p_h->ring->sq_tail = p_h->sq_tail;
+  num = ioctl(p_h->fd, IOCTL_OP_RING_ENTER);
+  if (num < 0)
+    return qos_int_rv(-errno);
+  if (p_num != NULL)
+    *p_num = num;
+  return QOS_OK;
+}
+
+
+qres_ring_cqe_t *qres_ring_peek_cqe(qres_ring_handle_t *p_h) {
+  unsigned int head = p_h->ring->cq_head;
+
+  if (head == p_h->ring->cq_tail)
+    return NULL;
+  /* Read the completion after its tail */
+  __sync_synchronize();
+  return (qres_ring_cqe_t *) &p_h->ring->cq[head % QRES_RING_ENTRIES];
+}
+
+
+void qres_ring_cqe_seen(qres_ring_handle_t *p_h) {
+  /* Done with the completion before giving its slot back */
+  __sync_synchronize();
+  p_h->ring->cq_head++;
+}
+
+
+qos_rv qres_set_cpu_params(qres_sid_t sid, unsigned int cpu_mask, qres_time_t *Q_cpu) {
+  qres_cpu_iparams_t iparams;
+
+  qos_rv rv = check_open();
+  qos_chk_rv(rv == QOS_OK, rv);
+
+  iparams.server_id = sid;
+  iparams.cpu_mask = cpu_mask;
+  if (Q_cpu != NULL)
+    memcpy(iparams.Q_cpu, Q_cpu, sizeof(iparams.Q_cpu));
+  else
+    memset(iparams.Q_cpu, 0, sizeof(iparams.Q_cpu));
+  if (ioctl(qres_fd, IOCTL_OP_SET_CPU_PARAMS, &iparams) < 0)
+    return qos_int_rv(-errno);
+  return QOS_OK;
+}
+
+
+qos_rv qres_get_cpu_params(qres_sid_t sid, unsigned int *p_cpu_mask, qres_time_t *Q_cpu) {
+  qres_cpu_iparams_t iparams;
+
+  qos_rv rv = check_open();
+  qos_chk_rv(rv == QOS_OK, rv);
+
+  iparams.server_id = sid;
+  if (ioctl(qres_fd, IOCTL_OP_GET_CPU_PARAMS, &iparams) < 0)
     return qos_int_rv(-errno);
+  if (p_cpu_mask != NULL)
+    *p_cpu_mask = iparams.cpu_mask;
+  if (Q_cpu != NULL)
+    memcpy(Q_cpu, iparams.Q_cpu, sizeof(iparams.Q_cpu));
+  return QOS_OK;
 }
 
 
@@ -295,9 +586,9 @@ qos_rv qres_set_bandwidth(qres_sid_t sid, qos_bw_t bw) {
   qos_rv rv = check_open();
   qos_chk_rv(rv == QOS_OK, rv);
 
+  qos_chk_ok_ret(get_params_cached(sid, &iparams.params));
   iparams.server_id = sid;
-  iparams.params = server_params;
-  iparams.params.Q = bw2Q(bw, server_params.P);
+  iparams.params.Q = bw2Q(bw, iparams.params.P);
   err = ioctl(qres_fd, IOCTL_OP_SET_PARAMS, &iparams);
   if (err == -1) {
     qos_log_debug("ioctl() FAILED: %s", qos_strerror(qos_int_rv(-errno)));
@@ -308,17 +599,12 @@ qos_rv qres_set_bandwidth(qres_sid_t sid, qos_bw_t bw) {
 
 
 qos_rv qres_get_bandwidth(qres_sid_t sid, float *bw) {
-  qres_iparams_t iparams;
-  int err;
+  qres_params_t params;
 
   qos_chk_ok_ret(check_open());
 
-  iparams.server_id = sid;
-  err = ioctl(qres_fd, IOCTL_OP_GET_PARAMS, &iparams);
-  if (err == 0)
-    *bw = ((float) iparams.params.Q) / ((float) iparams.params.P);
-  else
-    return qos_int_rv(-errno);
+  qos_chk_ok_ret(get_params_cached(sid, &params));
+  *bw = ((float) params.Q) / ((float) params.P);
   return QOS_OK;
 }
 
@@ -375,6 +661,103 @@ qos_rv qres_get_weight(qres_sid_t sid, unsigned int *p_weight) {
   return QOS_OK;
 }
 
+qos_rv qres_set_elasticity(qres_sid_t sid, unsigned int elasticity) {
+  qres_elasticity_iparams_t iparams;
+  qos_rv rv;
+
+  qos_chk_ok_do(rv = check_open(), return rv);
+
+  iparams.server_id = sid;
+  iparams.elasticity = elasticity;
+  if (ioctl(qres_fd, IOCTL_OP_SET_ELASTICITY, &iparams) < 0) {
+    rv = qos_int_rv(-errno);
+    qos_log_err("Got error: %s", qos_strerror(rv));
+    return rv;
+  }
+  return QOS_OK;
+}
+
+qos_rv qres_get_elasticity(qres_sid_t sid, unsigned int *p_elasticity) {
+  qres_elasticity_iparams_t iparams;
+  qos_rv rv;
+
+  qos_chk_ok_do(rv = check_open(), return rv);
+  if (p_elasticity == NULL)
+    return QOS_E_INVALID_PARAM;
+
+  iparams.server_id = sid;
+  if (ioctl(qres_fd, IOCTL_OP_GET_ELASTICITY, &iparams) < 0) {
+    rv = qos_int_rv(-errno);
+    qos_log_err("Got error: %s", qos_strerror(rv));
+    return rv;
+  }
+  *p_elasticity = iparams.elasticity;
+  return QOS_OK;
+}
+
+qos_rv qres_map_samples(qres_sid_t sid, const qres_sample_ring_t **p_ring) {
+  void *ring;
+  qos_rv rv;
+
+  qos_chk_ok_do(rv = check_open(), return rv);
+  if (p_ring == NULL || sid == QRES_SID_NULL)
+    return QOS_E_INVALID_PARAM;
+
+  ring = mmap(NULL, sizeof(qres_sample_ring_t), PROT_READ, MAP_SHARED, qres_fd,
+              QRES_SAMPLES_PGOFF(sid) * sysconf(_SC_PAGESIZE));
+  if (ring == MAP_FAILED) {
+    if (errno == ENOENT)
+      rv = QOS_E_NOT_FOUND;
+    else if (errno == EPERM)
+      rv = QOS_E_UNAUTHORIZED;
+    else
+      rv = QOS_E_MISSING_COMPONENT;
+    qos_log_err("Could not map samples of server %d: %s", sid, qos_strerror(rv));
+    return rv;
+  }
+  *p_ring = ring;
+  return QOS_OK;
+}
+
+qos_rv qres_unmap_samples(const qres_sample_ring_t *ring) {
+  if (munmap((void *) ring, sizeof(qres_sample_ring_t)) < 0)
+    return QOS_E_INVALID_PARAM;
+  return QOS_OK;
+}
+
+/** Read the head of the ring, that may be torn on 32-bit machines while
+ ** the module increments it.
+ **/
+static __u64 ring_head(const volatile qres_sample_ring_t *r) {
+  __u64 head;
+
+  do
+    head = r->head;
+  while (head != r->head);
+  return head;
+}
+
+int qres_get_samples(const qres_sample_ring_t *ring, qres_sample_t *samples, int max) {
+  const volatile qres_sample_ring_t *r = ring;
+  __u64 head, last;
+  unsigned int k, n;
+
+  head = ring_head(r);
+  __sync_synchronize();
+  n = (head < QRES_SAMPLES_NUM) ? head : QRES_SAMPLES_NUM;
+  if ((int) n > max)
+    n = max;
+  for (k = 0; k < n; k++)
+    samples[k] = *(const qres_sample_t *) &r->samples[(head - 1 - k) % QRES_SAMPLES_NUM];
+  __sync_synchronize();
+  /* The module is writing sample number last, in the slot of sample
+   * number last - QRES_SAMPLES_NUM, and has overwritten the older ones */
+  last = ring_head(r);
+  while (n > 0 && (head - n) + QRES_SAMPLES_NUM <= last)
+    --n;
+  return n;
+}
+
 qos_rv qres_get_servers(qres_sid_t *sids, size_t *n) {
   FILE* proc_scheduler_file;
   char buffer[1024];
@@ -403,3 +786,22 @@ qos_rv qres_get_servers(qres_sid_t *sids, size_t *n) {
 
   return QOS_OK;
 }
+
+qos_rv qres_list_servers(qres_server_stat_t *stats, unsigned int *p_num) {
+  qres_list_iparams_t iparams;
+  qos_rv rv;
+
+  qos_chk_ok_do(rv = check_open(), return rv);
+  if (p_num == NULL || (stats == NULL && *p_num > 0))
+    return QOS_E_INVALID_PARAM;
+
+  iparams.num = *p_num;
+  iparams.p_stats = stats;
+  if (ioctl(qres_fd, IOCTL_OP_LIST_SERVERS, &iparams) < 0) {
+    rv = qos_int_rv(-errno);
+    qos_log_err("Got error: %s", qos_strerror(rv));
+    return rv;
+  }
+  *p_num = iparams.num;
+  return QOS_OK;
+}
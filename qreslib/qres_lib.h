@@ -36,7 +36,8 @@
 /** Initializes the QoS RES library.
  *
  * Checks that the kernel supports QoS Management, then
- * initializes the QRES library.
+ * initializes the QRES library. Any other call initializes the library
+ * on demand, and all calls may be made concurrently by multiple threads.
  *
  * @return	QOS_OK if initialization was succesful
  *		QOS_E_MISSING_COMPONENT if kernel does not support QoS management
@@ -56,10 +57,10 @@ qos_rv qres_cleanup(void);
  * support into the kernel with provided parameters.
  *
  * @param p_params
- *   If the QRES_F_PERSISTENT flag is set in p_params->flags, then
- *   the server is not automatically destroyed after detach of the
- *   last thread. Instead, it keeps existing, where further threads
- *   may be attached to it by using the a qres_sid_t value for
+ *   If the QOS_F_PERSISTENT flag is set in p_params->flags, then
+ *   the server is not automatically destroyed after detach or exit
+ *   of the last thread. Instead, it keeps existing, where further
+ *   threads may be attached to it by using the a qres_sid_t value for
  *   identification.
  *
  * @param p_sid
@@ -71,15 +72,37 @@ qos_rv qres_cleanup(void);
  * @note
  *   If the QRES_WATCHDOG has been enabled in the module configuration,
  *   then, if a persistent server remains empty (with no attached threads)
- *   for too much time, the system destroys it automatically. This is
- *   a precaution for avoiding persistence of "unreachable" servers
+ *   for more than p_params->timeout microseconds, the system destroys it
+ *   automatically (QRES_WATCHDOG_DEF_TIMEOUT is used if timeout is zero).
+ *   This is a precaution for avoiding persistence of "unreachable" servers
  *   in the system, due to programming bugs or application crashes.
- *
- * @todo
- *   Implement the QRES_WATCHDOG feature.
+ *   Non-persistent servers whose last thread exited without detaching
+ *   are destroyed within QRES_WATCHDOG_PERIOD microseconds.
  */
 qos_rv qres_create_server(qres_params_t * p_params, qres_sid_t *p_sid);
 
+/** Create a new server nested within an existing one.
+ *
+ * The new server (sub-reservation) is carved out of the bandwidth of
+ * the parent_sid server: the sum of the bandwidths requested by all
+ * the sub-reservations of a server cannot exceed the one requested
+ * by the server itself (QOS_E_SYSTEM_OVERLOAD is returned otherwise),
+ * and threads attached to the parent server only get what is left.
+ * Only top-level servers are accounted for by the supervisor: if the
+ * parent is granted less than its request, then the bandwidths of its
+ * sub-reservations are scaled down in proportion.
+ *
+ * Sub-reservations may in turn be parents of other ones, and they are
+ * destroyed along with their parent.
+ *
+ * @param parent_sid
+ *   Identifier of the enclosing server, which must be owned by the
+ *   caller (or the caller must be root).
+ *
+ * @see qres_create_server() for the other parameters.
+ */
+qos_rv qres_create_subserver(qres_sid_t parent_sid, qres_params_t * p_params, qres_sid_t *p_sid);
+
 /** Attach a task to an already existing server.
  *
  * @param pid
@@ -126,7 +149,8 @@ qos_rv qres_destroy_server(qres_sid_t sid);
  */
 qos_rv qres_get_sid(pid_t pid, tid_t tid, qres_sid_t *p_sid);
 
-/** Change bandwidth			*/
+/** Change the budget of a server, so as to get bandwidth bw with
+ ** its current period			*/
 qos_rv qres_set_bandwidth(qres_sid_t sid, qos_bw_t bw);
 
 /** Retrieve QoS scheduling parameters.
@@ -139,12 +163,153 @@ qos_rv qres_set_bandwidth(qres_sid_t sid, qos_bw_t bw);
  **   set through qres_init_server() or qres_set_params(), because
  **   any granted (budget, period) pair corresponds to a qos_bw_t
  **   value (fixed-point representation of the ratio budget/period).
+ **
+ ** Parameters are cached per server, and retrieved from the kernel
+ ** only after they have been changed, by any process.
  **/
 qos_rv qres_get_params(qres_sid_t sid, qres_params_t *p_params);
 
 /** Change QoS scheduling parameters  */
 qos_rv qres_set_params(qres_sid_t sid, qres_params_t * p_params);
 
+/** A set of parameter changes, to be applied atomically.
+ **
+ ** @see qres_tx_begin()
+ **/
+typedef struct qres_tx_t {
+  unsigned int num;			/**< Number of queued changes	*/
+  qres_iparams_t items[QRES_MAX_MULTI];	/**< Queued changes		*/
+} qres_tx_t;
+
+/** Start a new transaction in *p_tx, with no changes queued.
+ *
+ * A transaction changes the parameters of multiple servers at once, e.g.,
+ * on a mode change of an application made of many reserved threads:
+ * @code
+ *   qres_tx_t tx;
+ *   qres_tx_begin(&tx);
+ *   qres_tx_set_params(&tx, sid_video, &video_params);
+ *   qres_tx_set_params(&tx, sid_audio, &audio_params);
+ *   rv = qres_tx_commit(&tx);
+ * @endcode
+ * Admission control is performed once, on the parameters of all servers
+ * after the changes, so that no intermediate state needs to be feasible.
+ */
+void qres_tx_begin(qres_tx_t *p_tx);
+
+/** Queue into *p_tx a change of the parameters of server sid, replacing
+ ** any change already queued for the same server.
+ **
+ ** @return QOS_E_FULL if QRES_MAX_MULTI servers have already been queued
+ **/
+qos_rv qres_tx_set_params(qres_tx_t *p_tx, qres_sid_t sid, qres_params_t *p_params);
+
+/** Apply all the changes queued into *p_tx, or none of them on failure.
+ **
+ ** On success, the transaction is emptied and can be reused.
+ **
+ ** @return QOS_E_SYSTEM_OVERLOAD if the resulting parameters would not
+ **         pass admission control, or the error of the first invalid change
+ **/
+qos_rv qres_tx_commit(qres_tx_t *p_tx);
+
+/** Submission and completion queues shared with the module.
+ **
+ ** @see qres_ring_open()
+ **/
+typedef struct qres_ring_handle_t {
+  int fd;			/**< Device file owning the queues	*/
+  volatile qres_ring_t *ring;	/**< Queues mapped from fd		*/
+  unsigned int sq_tail;		/**< Entries handed out so far		*/
+} qres_ring_handle_t;
+
+/** Set up in *p_h a new pair of submission and completion queues.
+ *
+ * Queued operations are executed in order, with a single system call
+ * per batch, and with the scheduler reprogrammed once per batch, e.g.:
+ * @code
+ *   qres_ring_handle_t h;
+ *   qres_ring_sqe_t *sqe;
+ *   qres_ring_cqe_t *cqe;
+ *   qres_ring_open(&h);
+ *   for (i = 0; i < n && (sqe = qres_ring_get_sqe(&h)) != NULL; ++i) {
+ *     sqe->op = QRES_OP_SET_PARAMS;
+ *     sqe->user_data = i;
+ *     sqe->u.iparams.server_id = sids[i];
+ *     sqe->u.iparams.params = params[i];
+ *   }
+ *   qres_ring_submit(&h, NULL);
+ *   while ((cqe = qres_ring_peek_cqe(&h)) != NULL) {
+ *     handle(cqe->user_data, qos_int_rv(cqe->rv));
+ *     qres_ring_cqe_seen(&h);
+ *   }
+ * @endcode
+ * Entries carry the same payloads as the ioctl() of their operation.
+ * Creations, sub-reservations, per-CPU and multi-server changes are
+ * only available through the ioctl(), and complete with
+ * QOS_E_UNIMPLEMENTED. A handle may be used by one thread at a time.
+ */
+qos_rv qres_ring_open(qres_ring_handle_t *p_h);
+
+/** Release the queues in *p_h, discarding pending completions */
+qos_rv qres_ring_close(qres_ring_handle_t *p_h);
+
+/** Return the next free submission queue entry, or NULL if the queue
+ ** is full. The entry is executed by the next qres_ring_submit().
+ **/
+qres_ring_sqe_t *qres_ring_get_sqe(qres_ring_handle_t *p_h);
+
+/** Execute the entries returned by qres_ring_get_sqe() so far, as long
+ ** as there is room in the completion queue.
+ **
+ ** @param p_num If not NULL, the number of executed entries
+ **/
+qos_rv qres_ring_submit(qres_ring_handle_t *p_h, unsigned int *p_num);
+
+/** Return the oldest completion not seen yet, or NULL if none */
+qres_ring_cqe_t *qres_ring_peek_cqe(qres_ring_handle_t *p_h);
+
+/** Mark the completion returned by qres_ring_peek_cqe() as seen */
+void qres_ring_cqe_seen(qres_ring_handle_t *p_h);
+
+/** Spread the budget of a server over multiple CPUs.
+ *
+ * By default, the whole budget of a server is available on each CPU,
+ * and it is accounted as such. This call restricts the server to the
+ * CPUs in cpu_mask (bit i standing for CPU i), with one budget each:
+ * a single-threaded application may thus reserve a budget on one CPU
+ * only, while a multi-threaded one may get a total budget larger than
+ * the period, across multiple CPUs.
+ *
+ * Threads attached to the server should be bound to the CPUs in
+ * cpu_mask, e.g., through sched_setaffinity(), as no runtime is
+ * available to them on other CPUs.
+ *
+ * @param cpu_mask
+ *   CPUs the budget is spread over, or 0 for restoring the default
+ *   behaviour.
+ *
+ * @param Q_cpu
+ *   Array of QRES_MAX_CPUS budgets, one per CPU in cpu_mask, and 0
+ *   for other CPUs. Their sum becomes the server budget. If NULL, or
+ *   all 0, then the current server budget is evenly spread over the
+ *   CPUs in cpu_mask.
+ *
+ * @return
+ *   QOS_E_SYSTEM_OVERLOAD if the budget on any CPU does not fit in
+ *   what is left on that CPU by the other servers.
+ *
+ * @note
+ *   The approved budget is then the one on the CPU with the largest
+ *   share of the budget.
+ */
+qos_rv qres_set_cpu_params(qres_sid_t sid, unsigned int cpu_mask, qres_time_t *Q_cpu);
+
+/** Retrieve the CPUs the budget of a server is spread over, and the
+ ** budget on each of them (Q_cpu must hold QRES_MAX_CPUS items).
+ **/
+qos_rv qres_get_cpu_params(qres_sid_t sid, unsigned int *p_cpu_mask, qres_time_t *Q_cpu);
+
 /** Get the bandwidth of the server with the supplied ID.	*/
 qos_rv qres_get_bandwidth(qres_sid_t sid, float *bw);
 
@@ -198,7 +363,11 @@ qos_rv qres_get_next_budget(qres_sid_t sid, qres_time_t *next_budget);
  **/
 qos_rv qres_get_appr_budget(qres_sid_t sid, qres_time_t *appr_budget);
 
-/** Retrieve current scheduling deadline	*/
+/** Retrieve the end of the current period of the server, on
+ ** CLOCK_MONOTONIC. Periods are counted from the creation of the server,
+ ** or from the last change of its period, and are not synchronized with
+ ** the replenishments of the scheduler.
+ **/
 qos_rv qres_get_deadline(qres_sid_t sid, struct timespec *p_deadline);
 
 /** Set scheduling weight (i.e., used by shrub) */
@@ -207,6 +376,45 @@ qos_rv qres_set_weight(qres_sid_t sid, unsigned int weight);
 /** Retrieve scheduling weight (i.e., used by shrub) */
 qos_rv qres_get_weight(qres_sid_t sid, unsigned int *p_weight);
 
+/** Set the elasticity of a server, i.e., its share of the compression of
+ ** its level on overload, if the supervisor is configured to compress the
+ ** level elastically. It cannot be lower than the weight of the rule in
+ ** force for the server owner.
+ **/
+qos_rv qres_set_elasticity(qres_sid_t sid, unsigned int elasticity);
+
+/** Retrieve the elasticity of a server */
+qos_rv qres_get_elasticity(qres_sid_t sid, unsigned int *p_elasticity);
+
+/** Map read-only the ring of per-period execution samples of a server,
+ ** that the module keeps updating until the server is destroyed.
+ **
+ ** @return QOS_E_NOT_FOUND if the server does not exist,
+ **         QOS_E_UNAUTHORIZED if the caller does not own the server, or
+ **         QOS_E_MISSING_COMPONENT if the module keeps no samples
+ **/
+qos_rv qres_map_samples(qres_sid_t sid, const qres_sample_ring_t **p_ring);
+
+/** Unmap a ring of samples returned by qres_map_samples() */
+qos_rv qres_unmap_samples(const qres_sample_ring_t *ring);
+
+/** Copy into samples[] up to max samples from the ring, most recent
+ ** first, without any system call. Samples overwritten by the module
+ ** while being copied are dropped.
+ **
+ ** @return the number of samples copied
+ **/
+int qres_get_samples(const qres_sample_ring_t *ring, qres_sample_t *samples, int max);
+
+/** Copy into stats[] the states of up to *p_num servers, with a single
+ ** system call, and set *p_num to the number of existing servers.
+ **
+ ** If *p_num grew beyond the room in stats[], only part of the servers
+ ** were listed, and the call may be repeated with a larger array.
+ ** Unlike qres_get_servers(), it needs no parsing of text from /proc.
+ **/
+qos_rv qres_list_servers(qres_server_stat_t *stats, unsigned int *p_num);
+
 /** Retrieve the existing servers
  ** @param sids
  **   A pre-allocated array supplied by the caller for storing the server ids
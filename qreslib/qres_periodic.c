@@ -0,0 +1,101 @@
+#include "qres_config.h"
+
+#include "qres_periodic.h"
+#include "qres_lib.h"
+
+#include <errno.h>
+#include <string.h>
+
+static inline void timespec_add_us(struct timespec *p_ts, qres_time_t us) {
+  p_ts->tv_sec += us / 1000000;
+  p_ts->tv_nsec += (us % 1000000) * 1000;
+  if (p_ts->tv_nsec >= 1000000000) {
+    p_ts->tv_nsec -= 1000000000;
+    p_ts->tv_sec++;
+  }
+}
+
+static inline long long timespec_sub_us(const struct timespec *p_t1, const struct timespec *p_t2) {
+  return (p_t1->tv_sec - p_t2->tv_sec) * 1000000LL
+    + (p_t1->tv_nsec - p_t2->tv_nsec) / 1000;
+}
+
+qos_rv qres_periodic_init(qres_periodic_t *p_per, qres_time_t period_us,
+			  qres_time_t deadline_us, qres_periodic_func_t func, void *arg) {
+  if (period_us <= 0 || deadline_us < 0 || func == NULL)
+    return QOS_E_INVALID_PARAM;
+
+  p_per->period = period_us;
+  p_per->deadline = (deadline_us != 0) ? deadline_us : period_us;
+  p_per->func = func;
+  p_per->arg = arg;
+  memset(&p_per->stat, 0, sizeof(p_per->stat));
+  if (clock_gettime(CLOCK_MONOTONIC, &p_per->next) < 0)
+    return QOS_E_GENERIC;
+  timespec_add_us(&p_per->next, p_per->period);
+  return QOS_OK;
+}
+
+qos_rv qres_periodic_align(qres_periodic_t *p_per, qres_sid_t sid) {
+  struct timespec now, dl;
+  long long delta;
+
+  qos_chk_ok_ret(qres_get_deadline(sid, &dl));
+  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+    return QOS_E_GENERIC;
+
+  /* Periods of the server are spaced by its period from dl on */
+  delta = timespec_sub_us(&now, &dl);
+  if (delta > 0)
+    timespec_add_us(&dl, (delta / p_per->period + 1) * p_per->period);
+  p_per->next = dl;
+  return QOS_OK;
+}
+
+qos_rv qres_periodic_next(qres_periodic_t *p_per) {
+  struct timespec now;
+  long long resp;
+  int err;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+    return QOS_E_GENERIC;
+  /* Skip the activations whose period is already over */
+  if (timespec_sub_us(&now, &p_per->next) >= p_per->period) {
+    long long late = timespec_sub_us(&now, &p_per->next) / p_per->period;
+    timespec_add_us(&p_per->next, late * p_per->period);
+    p_per->stat.skipped += late;
+  }
+
+  while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p_per->next, NULL)) == EINTR)
+    ;
+  if (err != 0)
+    return QOS_E_GENERIC;
+
+  p_per->func(p_per->arg);
+
+  if (clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+    return QOS_E_GENERIC;
+  resp = timespec_sub_us(&now, &p_per->next);
+  p_per->stat.jobs++;
+  p_per->stat.last_resp = resp;
+  p_per->stat.tot_resp += resp;
+  if (resp > p_per->stat.max_resp)
+    p_per->stat.max_resp = resp;
+  if (resp > p_per->deadline)
+    p_per->stat.misses++;
+
+  timespec_add_us(&p_per->next, p_per->period);
+  return QOS_OK;
+}
+
+qos_rv qres_periodic_run(qres_periodic_t *p_per, unsigned long num_jobs) {
+  unsigned long n;
+
+  for (n = 0; num_jobs == 0 || n < num_jobs; ++n)
+    qos_chk_ok_ret(qres_periodic_next(p_per));
+  return QOS_OK;
+}
+
+void qres_periodic_get_stat(qres_periodic_t *p_per, qres_periodic_stat_t *p_stat) {
+  *p_stat = p_per->stat;
+}
@@ -0,0 +1,90 @@
+#ifndef __QRES_PERIODIC_H__
+#define __QRES_PERIODIC_H__
+
+#include "qos_types.h"
+#include "qos_debug.h"
+
+#include <time.h>
+
+/** @addtogroup QRES_LIB
+ * @{
+ */
+
+/** @file
+ * @brief Periodic execution of a job function within a reservation
+ *
+ * Activations are timed by absolute sleeps on CLOCK_MONOTONIC, so that
+ * waiting for the next activation consumes no budget, and timing errors
+ * do not accumulate over time:
+ * @code
+ *   qres_periodic_t per;
+ *   qres_periodic_init(&per, 40000, 0, decode_frame, &ctx);
+ *   qres_periodic_align(&per, sid);
+ *   qres_periodic_run(&per, 0);
+ * @endcode
+ * No global state is kept, so multiple threads of a process may run
+ * their own periodic activities concurrently, each one with its own
+ * qres_periodic_t.
+ */
+
+/** Job function, called once per activation */
+typedef void (*qres_periodic_func_t)(void *arg);
+
+/** Statistics of a periodic activity */
+typedef struct qres_periodic_stat_t {
+  unsigned long jobs;		/**< Number of executed jobs			*/
+  unsigned long misses;		/**< Jobs completed after their deadline	*/
+  unsigned long skipped;	/**< Activations skipped due to late jobs	*/
+  qres_time_t last_resp;	/**< Response time of the last job (us)		*/
+  qres_time_t max_resp;		/**< Maximum response time (us)			*/
+  qres_atime_t tot_resp;	/**< Sum of all response times (us)		*/
+} qres_periodic_stat_t;
+
+/** A periodic activity */
+typedef struct qres_periodic_t {
+  qres_time_t period;		/**< Activation period (us)			*/
+  qres_time_t deadline;		/**< Relative deadline (us)			*/
+  struct timespec next;		/**< Next activation time (CLOCK_MONOTONIC)	*/
+  qres_periodic_func_t func;	/**< Job function				*/
+  void *arg;			/**< Argument of func				*/
+  qres_periodic_stat_t stat;	/**< Statistics					*/
+} qres_periodic_t;
+
+/** Initialize a periodic activity calling func(arg) every period_us
+ * microseconds, starting one period from now.
+ *
+ * @param deadline_us
+ *   Relative deadline of each job, used to count misses, or 0 for a
+ *   deadline equal to the period.
+ */
+qos_rv qres_periodic_init(qres_periodic_t *p_per, qres_time_t period_us,
+			  qres_time_t deadline_us, qres_periodic_func_t func, void *arg);
+
+/** Align the activations with the periods of server sid, i.e., move the
+ * next activation to the end of the current period of the server, as
+ * reported by qres_get_deadline(). Activities aligned with the same
+ * server are then activated together.
+ *
+ * The replenishments of the scheduler are not exposed, so jobs are not
+ * guaranteed to find a full budget. The period of the activity should
+ * be a multiple of the server one.
+ */
+qos_rv qres_periodic_align(qres_periodic_t *p_per, qres_sid_t sid);
+
+/** Wait for the next activation, then execute one job.
+ *
+ * If the previous job completed later than one period after its own
+ * activation, then the elapsed activations are skipped, but the latest
+ * one, whose job is executed right away.
+ */
+qos_rv qres_periodic_next(qres_periodic_t *p_per);
+
+/** Execute num_jobs jobs (forever if num_jobs is 0) */
+qos_rv qres_periodic_run(qres_periodic_t *p_per, unsigned long num_jobs);
+
+/** Retrieve statistics of the activity */
+void qres_periodic_get_stat(qres_periodic_t *p_per, qres_periodic_stat_t *p_stat);
+
+/** @} */
+
+#endif // __QRES_PERIODIC_H__
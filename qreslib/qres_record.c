@@ -0,0 +1,207 @@
+/** @file
+ ** @brief Recorder of the reservation operations made by applications.
+ **
+ ** Built as libqres_record.so, to be preloaded into applications linked
+ ** to the shared qreslib:
+ **
+ **   QRES_RECORD_FILE=/tmp/app.trace LD_PRELOAD=libqres_record.so app
+ **
+ ** Each operation is forwarded to qreslib, and appended to the trace
+ ** along with its outcome, one line per operation, with the time in usec
+ ** taken from CLOCK_MONOTONIC:
+ **
+ **   <usec> create <sid> <uid> <gid> <Q_min> <Q> <P> <flags> <rv>
+ **   <usec> sub <sid> <parent> <Q_min> <Q> <P> <flags> <rv>
+ **   <usec> set <sid> <Q_min> <Q> <P> <flags> <rv>
+ **   <usec> attach <sid> <pid> <tid> <rv>
+ **   <usec> detach <sid> <pid> <tid> <rv>
+ **   <usec> destroy <sid> <rv>
+ **   <usec> cpu <sid> <cpu_mask> <Q_cpu>... <rv>
+ **
+ ** where rv is the qos_rv integer returned, and sid is -1 for failed
+ ** creations. Changes of CPUs list the budget requested on each CPU in
+ ** cpu_mask, in increasing order, 0 meaning an even spread. Successful
+ ** changes made through qres_set_bandwidth() are recorded as set, with
+ ** the parameters in force after them. Operations submitted through a
+ ** ring are not recorded.
+ **
+ ** Without QRES_RECORD_FILE, the trace is a new file of the process,
+ ** that is not recorded if the file exists already. Otherwise, it is
+ ** appended to the named file, that may be shared by many processes.
+ ** Either file is created readable by its owner only.
+ **
+ ** Traces are replayed against the user-space supervisor by
+ ** src/test-qsup-replay.c.
+ **/
+
+#define _GNU_SOURCE
+#include "qres_lib.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+/** Trace written when QRES_RECORD_FILE is not set, %d being the pid */
+#define QRES_RECORD_DEFAULT "/tmp/qres-record.%d.trace"
+
+static FILE *rec_file = NULL;
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static qos_rv (*real_create_server)(qres_params_t *, qres_sid_t *);
+static qos_rv (*real_create_subserver)(qres_sid_t, qres_params_t *, qres_sid_t *);
+static qos_rv (*real_destroy_server)(qres_sid_t);
+static qos_rv (*real_attach_thread)(qres_sid_t, pid_t, tid_t);
+static qos_rv (*real_detach_thread)(qres_sid_t, pid_t, tid_t);
+static qos_rv (*real_set_params)(qres_sid_t, qres_params_t *);
+static qos_rv (*real_get_params)(qres_sid_t, qres_params_t *);
+static qos_rv (*real_set_bandwidth)(qres_sid_t, qos_bw_t);
+static qos_rv (*real_tx_commit)(qres_tx_t *);
+static qos_rv (*real_set_cpu_params)(qres_sid_t, unsigned int, qres_time_t *);
+
+__attribute__((constructor))
+static void rec_init(void) {
+  const char *name = getenv("QRES_RECORD_FILE");
+  int flags = O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW;
+  char buf[64];
+  int fd;
+
+  real_create_server = dlsym(RTLD_NEXT, "qres_create_server");
+  real_create_subserver = dlsym(RTLD_NEXT, "qres_create_subserver");
+  real_destroy_server = dlsym(RTLD_NEXT, "qres_destroy_server");
+  real_attach_thread = dlsym(RTLD_NEXT, "qres_attach_thread");
+  real_detach_thread = dlsym(RTLD_NEXT, "qres_detach_thread");
+  real_set_params = dlsym(RTLD_NEXT, "qres_set_params");
+  real_get_params = dlsym(RTLD_NEXT, "qres_get_params");
+  real_set_bandwidth = dlsym(RTLD_NEXT, "qres_set_bandwidth");
+  real_tx_commit = dlsym(RTLD_NEXT, "qres_tx_commit");
+  real_set_cpu_params = dlsym(RTLD_NEXT, "qres_set_cpu_params");
+
+  if (name == NULL) {
+    /* Never follow a file planted by someone else in /tmp */
+    snprintf(buf, sizeof(buf), QRES_RECORD_DEFAULT, (int) getpid());
+    name = buf;
+    flags |= O_EXCL;
+  }
+  fd = open(name, flags, 0600);
+  if (fd >= 0 && (rec_file = fdopen(fd, "a")) == NULL)
+    close(fd);
+  /* Not qos_log_err(), so as not to depend on how qreslib was linked */
+  if (rec_file == NULL)
+    fprintf(stderr, "qres_record: could not open trace %s, not recording\n", name);
+}
+
+__attribute__((destructor))
+static void rec_cleanup(void) {
+  /* Other threads may still be recording */
+  pthread_mutex_lock(&rec_lock);
+  if (rec_file != NULL)
+    fclose(rec_file);
+  rec_file = NULL;
+  pthread_mutex_unlock(&rec_lock);
+}
+
+/** Append a line to the trace, prefixed with the current time */
+static void rec_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void rec_printf(const char *fmt, ...) {
+  struct timespec ts;
+  va_list args;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  pthread_mutex_lock(&rec_lock);
+  if (rec_file == NULL) {
+    pthread_mutex_unlock(&rec_lock);
+    return;
+  }
+  fprintf(rec_file, "%llu ", (unsigned long long) ts.tv_sec * 1000000ull + ts.tv_nsec / 1000);
+  va_start(args, fmt);
+  vfprintf(rec_file, fmt, args);
+  va_end(args);
+  fflush(rec_file);
+  pthread_mutex_unlock(&rec_lock);
+}
+
+#define PARAMS_FMT QRES_TIME_FMT " " QRES_TIME_FMT " " QRES_TIME_FMT " %u"
+#define PARAMS_ARGS(p) (p)->Q_min, (p)->Q, (p)->P, (p)->flags
+
+/** Record the parameters in force for sid, after a successful change */
+static void rec_set(qres_sid_t sid, qos_rv rv) {
+  qres_params_t params;
+
+  if (rv == QOS_OK && real_get_params(sid, &params) == QOS_OK)
+    rec_printf("set %d " PARAMS_FMT " %d\n", sid, PARAMS_ARGS(&params), qos_rv_int(rv));
+}
+
+qos_rv qres_create_server(qres_params_t *p_params, qres_sid_t *p_sid) {
+  qos_rv rv = real_create_server(p_params, p_sid);
+  rec_printf("create %d %d %d " PARAMS_FMT " %d\n", rv == QOS_OK ? *p_sid : -1,
+	     (int) geteuid(), (int) getegid(), PARAMS_ARGS(p_params), qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_create_subserver(qres_sid_t parent_sid, qres_params_t *p_params, qres_sid_t *p_sid) {
+  qos_rv rv = real_create_subserver(parent_sid, p_params, p_sid);
+  rec_printf("sub %d %d " PARAMS_FMT " %d\n", rv == QOS_OK ? *p_sid : -1,
+	     parent_sid, PARAMS_ARGS(p_params), qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_destroy_server(qres_sid_t sid) {
+  qos_rv rv = real_destroy_server(sid);
+  rec_printf("destroy %d %d\n", sid, qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_attach_thread(qres_sid_t sid, pid_t pid, tid_t tid) {
+  qos_rv rv = real_attach_thread(sid, pid, tid);
+  rec_printf("attach %d %d %d %d\n", sid, (int) pid, (int) tid, qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_detach_thread(qres_sid_t sid, pid_t pid, tid_t tid) {
+  qos_rv rv = real_detach_thread(sid, pid, tid);
+  rec_printf("detach %d %d %d %d\n", sid, (int) pid, (int) tid, qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_set_params(qres_sid_t sid, qres_params_t *p_params) {
+  qos_rv rv = real_set_params(sid, p_params);
+  rec_printf("set %d " PARAMS_FMT " %d\n", sid, PARAMS_ARGS(p_params), qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_set_bandwidth(qres_sid_t sid, qos_bw_t bw) {
+  qos_rv rv = real_set_bandwidth(sid, bw);
+  rec_set(sid, rv);
+  return rv;
+}
+
+/** Each of the changes committed at once is recorded as a set */
+qos_rv qres_tx_commit(qres_tx_t *p_tx) {
+  qres_tx_t tx = *p_tx;
+  qos_rv rv = real_tx_commit(p_tx);
+  unsigned int i;
+
+  for (i = 0; i < tx.num; i++)
+    rec_printf("set %d " PARAMS_FMT " %d\n", tx.items[i].server_id,
+	       PARAMS_ARGS(&tx.items[i].params), qos_rv_int(rv));
+  return rv;
+}
+
+qos_rv qres_set_cpu_params(qres_sid_t sid, unsigned int cpu_mask, qres_time_t *Q_cpu) {
+  qos_rv rv = real_set_cpu_params(sid, cpu_mask, Q_cpu);
+  char buf[QRES_MAX_CPUS * 22 + 1], *pos = buf;	/* Up to 21 chars per CPU */
+  int cpu;
+
+  buf[0] = '\0';
+  for (cpu = 0; cpu < QRES_MAX_CPUS; cpu++)
+    if (cpu_mask & (1u << cpu))
+      pos += sprintf(pos, " " QRES_TIME_FMT, Q_cpu != NULL ? Q_cpu[cpu] : 0);
+  rec_printf("cpu %d %u%s %d\n", sid, cpu_mask, buf, qos_rv_int(rv));
+  return rv;
+}
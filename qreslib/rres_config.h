@@ -65,6 +65,12 @@
 /** Enable SHRUB reclaiming */
 #undef SHRUB
 
+/** Represent bandwidths with 32 fractional bits on 64 bits, instead of
+ ** 24 bits on an unsigned long (see qos_bw_t). Kernel interfaces keep
+ ** accepting the legacy 24-bit format from callers unaware of it.
+ **/
+#undef QOS_BW_WIDE
+
 /** Utilization limit for all AQuoSA tasks, as integer < 100 **/
 #define RRES_U_LUB 95
 
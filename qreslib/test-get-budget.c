@@ -1,11 +1,12 @@
 #include "qos_debug.h"
 #include "qres_lib.h"
 
-#include "util_periodic.h"
+#include "qres_periodic.h"
+#include "util_timeval.h"
 #include <stdio.h>
 
 #define N 1000
-#define TICK_US 100ull
+#define TICK_US 100
 
 struct timeval t0;
 
@@ -66,9 +67,8 @@ void data_write_timestamps(struct data *p_data, const char *fname) {
 int main(int argc, char *argv[])
 {
   qres_params_t params;
-  struct timeval t1;
-  struct timeval duration = { .tv_sec = (TICK_US * N) / 1000000, .tv_usec = (TICK_US * N) % 1000000 };
-  struct timeval tick = { .tv_sec = TICK_US / 1000000, .tv_usec = TICK_US % 1000000 };
+  qres_periodic_t per;
+  qres_periodic_stat_t stat;
 
   qos_chk_ok_exit(qres_init());
 
@@ -80,10 +80,13 @@ int main(int argc, char *argv[])
   qos_chk_ok_exit(qres_attach_thread(data.sid, 0, 0));
 
   gettimeofday(&t0, NULL);
-  timeval_add(&t1, &t0, &duration);
 
   data.num = 0;
-  spin_periodic_call(&t0, &t1, &tick, f, &data);
+  qos_chk_ok_exit(qres_periodic_init(&per, TICK_US, 0, f, &data));
+  qos_chk_ok_exit(qres_periodic_run(&per, N));
+  qres_periodic_get_stat(&per, &stat);
+  printf("jobs=%lu misses=%lu skipped=%lu max_resp=" QRES_TIME_FMT "us\n",
+	 stat.jobs, stat.misses, stat.skipped, stat.max_resp);
 
   qos_chk_ok_exit(qres_destroy_server(data.sid));
 
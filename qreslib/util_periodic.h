@@ -3,6 +3,7 @@
 
 #include "util_timeval.h"
 
+/** Busy-wait based periodic call, see qres_periodic.h for a sleeping one */
 void spin_periodic_call(const struct timeval *p_t0, const struct timeval *p_t1,
 			const struct timeval *p_tick, void (*cb_func)(void *), void * cb_param);
 
@@ -0,0 +1,261 @@
+#ifndef KAL_EHEAP_H_
+#define KAL_EHEAP_H_
+
+/** @file
+ ** @brief Generic indexed min-heap with stable handles (extractable heap).
+ **
+ ** The heap is a d-ary tree (KAL_EHEAP_ARITY children per node) laid out
+ ** in a contiguous array of (key, value, handle) nodes, so that the
+ ** children of a node share one or two cache lines. The array doubles its
+ ** capacity whenever it fills up.
+ **
+ ** Every inserted item is associated with a handle (a kal_eheap_iterator_t
+ ** owned by the caller, e.g. embedded in the enqueued object) which the
+ ** heap keeps pointing to the current position of the item, so that the
+ ** item may be removed in O(log n) through kal_eheap_del().
+ **
+ ** Usage:
+ ** @code
+ **   #define kal_eheap_key_lt kal_time_lt     // optional, defaults to <
+ **   #include "kal_eheap.h"
+ **
+ **   kal_define_eheap(kal_time_t, server_p);
+ **   kal_eheap_t(kal_time_t, server_p) heap;
+ **   kal_eheap_iterator_t(kal_time_t, server_p) handle;
+ **
+ **   kal_eheap_init(&heap, 4);                 // initial capacity: 1 << 4
+ **   kal_eheap_add(&heap, deadline, srv, &handle);
+ **   kal_eheap_get_min(&heap, &deadline, &srv);
+ **   kal_eheap_del(&heap, &handle);
+ **   kal_eheap_cleanup(&heap);
+ ** @endcode
+ **
+ ** @note
+ ** Key and value types must be single identifiers (use a typedef for
+ ** pointers or multi-word types), as they are pasted into type names.
+ ** The key comparison is the one kal_eheap_key_lt is defined to at the
+ ** point where the operations are used.
+ **/
+
+#include "qos_types.h"
+#include "qos_memory.h"
+
+#ifdef QOS_KS
+#  include <linux/string.h>
+#else
+#  include <string.h>
+#endif
+
+/** Number of children of each heap node (4 or 8 fit best in cache lines) */
+#ifndef KAL_EHEAP_ARITY
+#  define KAL_EHEAP_ARITY 4
+#endif
+
+/** Strict weak ordering among keys */
+#ifndef kal_eheap_key_lt
+#  define kal_eheap_key_lt(a, b) ((a) < (b))
+#endif
+
+#define kal_eheap_iterator_t(K, V) struct kal_eheap_it_##K##_##V
+#define kal_eheap_node_t(K, V) struct kal_eheap_node_##K##_##V
+#define kal_eheap_t(K, V) struct kal_eheap_##K##_##V
+
+/** Define the heap, node and iterator types for keys K and values V */
+#define kal_define_eheap(K, V)						\
+  kal_eheap_iterator_t(K, V) {						\
+    long pos;		/**< Position in the heap, or -1 */		\
+  };									\
+  kal_eheap_node_t(K, V) {						\
+    K key;								\
+    V val;								\
+    kal_eheap_iterator_t(K, V) *p_it;					\
+  };									\
+  kal_eheap_t(K, V) {							\
+    kal_eheap_node_t(K, V) *nodes;					\
+    long size;								\
+    long capacity;							\
+  }
+
+/** Initialize an iterator as invalid (item not enqueued) */
+#define kal_eheap_iterator_init(p_it) do { (p_it)->pos = -1; } while (0)
+
+/** Return non-zero if the iterator refers to an item in the heap */
+#define kal_eheap_iterator_valid(p_it) ((p_it)->pos >= 0)
+
+/** Number of items in the heap */
+#define kal_eheap_size(p_heap) ((p_heap)->size)
+
+/** Initialize an empty heap with an initial capacity of (1 << bits) items.
+ **
+ ** @return QOS_OK, or QOS_E_NO_MEMORY
+ **/
+#define kal_eheap_init(p_heap, bits) ({					\
+  typeof(p_heap) __kei_h = (p_heap);					\
+  __kei_h->size = 0;							\
+  __kei_h->capacity = 1L << (bits);					\
+  __kei_h->nodes = qos_malloc(__kei_h->capacity * sizeof(*__kei_h->nodes)); \
+  __kei_h->nodes != NULL ? QOS_OK : QOS_E_NO_MEMORY;			\
+})
+
+/** Release the memory used by the heap (does not touch the handles) */
+#define kal_eheap_cleanup(p_heap) do {					\
+  typeof(p_heap) __kec_h = (p_heap);					\
+  if (__kec_h->nodes != NULL)						\
+    qos_free(__kec_h->nodes);						\
+  __kec_h->nodes = NULL;						\
+  __kec_h->size = __kec_h->capacity = 0;				\
+} while (0)
+
+/** Double the heap capacity.
+ **
+ ** @return QOS_OK, or QOS_E_NO_MEMORY leaving the heap untouched
+ **/
+#define __kal_eheap_grow(h) ({						\
+  typeof((h)->nodes) __keg_n = qos_malloc(2 * (h)->capacity * sizeof(*(h)->nodes)); \
+  qos_rv __keg_rv = QOS_E_NO_MEMORY;					\
+  if (__keg_n != NULL) {						\
+    memcpy(__keg_n, (h)->nodes, (h)->size * sizeof(*(h)->nodes));	\
+    qos_free((h)->nodes);						\
+    (h)->nodes = __keg_n;						\
+    (h)->capacity *= 2;							\
+    __keg_rv = QOS_OK;							\
+  }									\
+  __keg_rv;								\
+})
+
+/** Move up the node at position i, until the heap property holds */
+#define __kal_eheap_sift_up(h, i) do {					\
+  typeof(*(h)->nodes) __keu_n = (h)->nodes[(i)];			\
+  long __keu_i = (i);							\
+  while (__keu_i > 0) {							\
+    long __keu_p = (__keu_i - 1) / KAL_EHEAP_ARITY;			\
+    if (! kal_eheap_key_lt(__keu_n.key, (h)->nodes[__keu_p].key))	\
+      break;								\
+    (h)->nodes[__keu_i] = (h)->nodes[__keu_p];				\
+    (h)->nodes[__keu_i].p_it->pos = __keu_i;				\
+    __keu_i = __keu_p;							\
+  }									\
+  (h)->nodes[__keu_i] = __keu_n;					\
+  __keu_n.p_it->pos = __keu_i;						\
+} while (0)
+
+/** Move down the node at position i, until the heap property holds */
+#define __kal_eheap_sift_down(h, i) do {				\
+  typeof(*(h)->nodes) __ked_n = (h)->nodes[(i)];			\
+  long __ked_i = (i);							\
+  for (;;) {								\
+    long __ked_c = __ked_i * KAL_EHEAP_ARITY + 1;			\
+    long __ked_end = __ked_c + KAL_EHEAP_ARITY;				\
+    long __ked_min = __ked_c;						\
+    if (__ked_c >= (h)->size)						\
+      break;								\
+    if (__ked_end > (h)->size)						\
+      __ked_end = (h)->size;						\
+    for (++__ked_c; __ked_c < __ked_end; ++__ked_c)			\
+      if (kal_eheap_key_lt((h)->nodes[__ked_c].key, (h)->nodes[__ked_min].key)) \
+        __ked_min = __ked_c;						\
+    if (! kal_eheap_key_lt((h)->nodes[__ked_min].key, __ked_n.key))	\
+      break;								\
+    (h)->nodes[__ked_i] = (h)->nodes[__ked_min];			\
+    (h)->nodes[__ked_i].p_it->pos = __ked_i;				\
+    __ked_i = __ked_min;						\
+  }									\
+  (h)->nodes[__ked_i] = __ked_n;					\
+  __ked_n.p_it->pos = __ked_i;						\
+} while (0)
+
+/** Insert (key, val) into the heap, and make *p_it refer to it.
+ **
+ ** @return QOS_OK, or QOS_E_NO_MEMORY if the heap could not grow
+ **/
+#define kal_eheap_add(p_heap, k, v, p_item_it) ({			\
+  typeof(p_heap) __kea_h = (p_heap);					\
+  qos_rv __kea_rv = QOS_OK;						\
+  if (__kea_h->size == __kea_h->capacity)				\
+    __kea_rv = __kal_eheap_grow(__kea_h);				\
+  if (__kea_rv == QOS_OK) {						\
+    long __kea_i = __kea_h->size++;					\
+    __kea_h->nodes[__kea_i].key = (k);					\
+    __kea_h->nodes[__kea_i].val = (v);					\
+    __kea_h->nodes[__kea_i].p_it = (p_item_it);				\
+    __kal_eheap_sift_up(__kea_h, __kea_i);				\
+  }									\
+  __kea_rv;								\
+})
+
+/** Remove from the heap the item referred to by *p_it, then invalidate it.
+ **
+ ** @return QOS_OK, or QOS_E_NOT_FOUND if the iterator is not valid
+ **/
+#define kal_eheap_del(p_heap, p_item_it) ({				\
+  typeof(p_heap) __kex_h = (p_heap);					\
+  typeof(p_item_it) __kex_it = (p_item_it);				\
+  long __kex_i = __kex_it->pos;						\
+  qos_rv __kex_rv = QOS_E_NOT_FOUND;					\
+  if (__kex_i >= 0 && __kex_i < __kex_h->size				\
+      && __kex_h->nodes[__kex_i].p_it == __kex_it) {			\
+    long __kex_last = --__kex_h->size;					\
+    if (__kex_i != __kex_last) {					\
+      __kex_h->nodes[__kex_i] = __kex_h->nodes[__kex_last];		\
+      if (__kex_i > 0 && kal_eheap_key_lt(__kex_h->nodes[__kex_i].key,	\
+            __kex_h->nodes[(__kex_i - 1) / KAL_EHEAP_ARITY].key))	\
+        __kal_eheap_sift_up(__kex_h, __kex_i);				\
+      else								\
+        __kal_eheap_sift_down(__kex_h, __kex_i);			\
+    }									\
+    kal_eheap_iterator_init(__kex_it);					\
+    __kex_rv = QOS_OK;							\
+  }									\
+  __kex_rv;								\
+})
+
+/** Retrieve the minimum key item, without removing it. Either p_key
+ ** or p_val may be NULL.
+ **
+ ** @return QOS_OK, or QOS_E_EMPTY if the heap is empty
+ **/
+#define kal_eheap_get_min(p_heap, p_key, p_val) ({			\
+  typeof(p_heap) __kem_h = (p_heap);					\
+  void *__kem_k = (p_key);						\
+  void *__kem_v = (p_val);					\
+  qos_rv __kem_rv = QOS_E_EMPTY;					\
+  if (__kem_h->size > 0) {						\
+    if (__kem_k != NULL)						\
+      memcpy(__kem_k, &__kem_h->nodes[0].key, sizeof(__kem_h->nodes[0].key)); \
+    if (__kem_v != NULL)						\
+      memcpy(__kem_v, &__kem_h->nodes[0].val, sizeof(__kem_h->nodes[0].val)); \
+    __kem_rv = QOS_OK;							\
+  }									\
+  __kem_rv;								\
+})
+
+/** Start an (unordered) iteration over all items of the heap */
+#define kal_eheap_begin(p_heap, p_it) ((void) ((p_it)->pos = 0))
+
+/** Retrieve the item referred to by the iteration iterator *p_it, and
+ ** advance it. Either p_key or p_val may be NULL.
+ **
+ ** @note
+ ** The iteration iterator is not a handle: the heap must not be
+ ** modified during an iteration.
+ **
+ ** @return QOS_OK, or QOS_E_EMPTY once all items have been visited
+ **/
+#define kal_eheap_next(p_heap, p_it, p_key, p_val) ({			\
+  typeof(p_heap) __ken_h = (p_heap);					\
+  void *__ken_k = (p_key);						\
+  void *__ken_v = (p_val);					\
+  long __ken_i = (p_it)->pos;						\
+  qos_rv __ken_rv = QOS_E_EMPTY;					\
+  if (__ken_i >= 0 && __ken_i < __ken_h->size) {			\
+    if (__ken_k != NULL)						\
+      memcpy(__ken_k, &__ken_h->nodes[__ken_i].key, sizeof(__ken_h->nodes[__ken_i].key)); \
+    if (__ken_v != NULL)						\
+      memcpy(__ken_v, &__ken_h->nodes[__ken_i].val, sizeof(__ken_h->nodes[__ken_i].val)); \
+    (p_it)->pos = __ken_i + 1;						\
+    __ken_rv = QOS_OK;							\
+  }									\
+  __ken_rv;								\
+})
+
+#endif /*KAL_EHEAP_H_*/
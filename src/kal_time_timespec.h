@@ -0,0 +1,120 @@
+#ifndef KAL_TIME_TIMESPEC_H_
+#define KAL_TIME_TIMESPEC_H_
+
+#ifdef QOS_KS
+#  include <linux/time.h>
+#  include <linux/ktime.h>
+#  include <linux/jiffies.h>
+#  include <linux/hrtimer.h>
+#else
+#  include <time.h>
+#endif
+
+/********************** TIME RELATED **********************/
+
+/** Kernel-dependent long time information, with nanosecond resolution
+ ** on the CLOCK_MONOTONIC time base.
+ **/
+typedef struct timespec kal_time_t;
+
+#define KAL_TIME_NS(sec, nsec) ((struct timespec) { .tv_sec = (sec), .tv_nsec = ((long unsigned) nsec) })
+#define KAL_TIME_US(sec, usec) ((struct timespec) { .tv_sec = (sec), .tv_nsec = ((long unsigned) usec) * 1000 })
+
+#define KAL_TIME_FMT "<%6lu.%6lu>"
+
+#define KAL_TIME_FMT_ARG(t) kal_time_get_sec(t), kal_time_get_usec(t)
+
+/** Bring tv_nsec back within [0, NSEC_PER_SEC) **/
+static inline kal_time_t kal_time_normalize(long sec, long nsec) {
+  kal_time_t t;
+  while (nsec >= 1000000000L) {
+    nsec -= 1000000000L;
+    ++sec;
+  }
+  while (nsec < 0) {
+    nsec += 1000000000L;
+    --sec;
+  }
+  t.tv_sec = sec;
+  t.tv_nsec = nsec;
+  return t;
+}
+
+static inline kal_time_t kal_time_ns(unsigned long sec, unsigned long nsec) {
+  return kal_time_normalize(sec, nsec);
+}
+
+static inline unsigned long kal_time_get_sec(kal_time_t t) {
+  return t.tv_sec;
+}
+
+static inline unsigned long kal_time_get_usec(kal_time_t t) {
+  return t.tv_nsec / 1000;
+}
+
+static inline unsigned long kal_time_get_nsec(kal_time_t t) {
+  return t.tv_nsec;
+}
+
+static inline unsigned long long kal_time2usec(kal_time_t t) {
+  return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+
+static inline kal_time_t kal_usec2time(unsigned long long usec) {
+#ifdef QOS_KS
+  /* ns_to_timespec() takes care of 64-bit divisions on 32-bit archs */
+  return ns_to_timespec(usec * NSEC_PER_USEC);
+#else
+  return KAL_TIME_US((unsigned long) (usec / 1000000ull), (unsigned long) (usec % 1000000ull));
+#endif
+}
+
+static inline kal_time_t kal_time_add(kal_time_t ta, kal_time_t tb) {
+  return kal_time_normalize(ta.tv_sec + tb.tv_sec, ta.tv_nsec + tb.tv_nsec);
+}
+
+static inline kal_time_t kal_time_sub(kal_time_t ta, kal_time_t tb) {
+  return kal_time_normalize(ta.tv_sec - tb.tv_sec, ta.tv_nsec - tb.tv_nsec);
+}
+
+static inline int kal_time_lt(kal_time_t t1, kal_time_t t2) {
+  return (t1.tv_sec < t2.tv_sec) || (t1.tv_sec == t2.tv_sec && t1.tv_nsec < t2.tv_nsec);
+}
+
+static inline int kal_time_le(kal_time_t t1, kal_time_t t2) {
+  return ! kal_time_lt(t2, t1);
+}
+
+static inline struct timespec kal_time2timespec(kal_time_t t) {
+  return t;
+}
+
+#ifdef QOS_KS
+
+static inline kal_time_t kal_time_now(void) {
+  struct timespec ts;
+  ktime_get_ts(&ts);
+  return ts;
+}
+
+static inline unsigned long kal_time2jiffies(kal_time_t t) {
+  return timespec_to_jiffies(&t);
+}
+
+static inline kal_time_t kal_jiffies2time(unsigned long jiffies) {
+  struct timespec ts;
+  jiffies_to_timespec(jiffies, &ts);
+  return ts;
+}
+
+#else /* !QOS_KS */
+
+static inline kal_time_t kal_time_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts;
+}
+
+#endif /* QOS_KS */
+
+#endif /*KAL_TIME_TIMESPEC_H_*/
@@ -0,0 +1,131 @@
+/** @file
+ ** @brief Benchmark of the kal_timer backend.
+ **
+ ** Arms a periodic kal_timer through kal_timer_forward(), and measures:
+ ** <ul>
+ **   <li>the jitter of inter-expiration intervals w.r.t. the period;
+ **   <li>the lateness of each expiration w.r.t. the ideal activation;
+ **   <li>the overhead of re-arming the timer (kal_timer_forward()).
+ ** </ul>
+ ** Results are printed once all samples have been collected, or at module
+ ** removal. The same source is built once per backend, see
+ ** kal_timer_bench_wheel.c and kal_timer_bench_hrtimer.c, so that e.g.:
+ **
+ **   insmod kal_timer_bench_hrtimer.ko period_us=500 samples=10000
+ **
+ ** can be compared to the same run of kal_timer_bench_wheel.ko.
+ **/
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <asm/timex.h>
+
+#include "kal_timer.h"
+
+static int period_us = 1000;
+module_param(period_us, int, 0444);
+MODULE_PARM_DESC(period_us, "Timer period (us)");
+
+static int samples = 1000;
+module_param(samples, int, 0444);
+MODULE_PARM_DESC(samples, "Number of expirations to measure");
+
+static kal_timer_t bench_timer;
+static ktime_t bench_start, bench_prev;
+static int bench_count;
+static int bench_done;
+static volatile int bench_stopped;
+
+static struct {
+  s64 jitter_min, jitter_max, jitter_sum;
+  u64 jitter_abs_sum;
+  s64 late_min, late_max, late_sum;
+  cycles_t fwd_min, fwd_max, fwd_sum;
+} bench;
+
+static void bench_report(void) {
+  int n = bench_count > 1 ? bench_count - 1 : 1;
+  printk(KERN_INFO "kal_timer_bench (%s): period=%d us, samples=%d\n",
+#ifdef KAL_USE_HRTIMER
+         "hrtimer",
+#else
+         "wheel",
+#endif
+         period_us, bench_count);
+  printk(KERN_INFO "  jitter (ns): min=%lld avg=%lld max=%lld avg|.|=%llu\n",
+         bench.jitter_min, div_s64(bench.jitter_sum, n), bench.jitter_max,
+         div64_u64(bench.jitter_abs_sum, n));
+  printk(KERN_INFO "  lateness (ns): min=%lld avg=%lld max=%lld\n",
+         bench.late_min, div_s64(bench.late_sum, bench_count ? bench_count : 1), bench.late_max);
+  printk(KERN_INFO "  forward (cycles): min=%llu avg=%llu max=%llu\n",
+         (u64) bench.fwd_min, div64_u64(bench.fwd_sum, bench_count ? bench_count : 1), (u64) bench.fwd_max);
+}
+
+static void bench_handler(kal_arg_t arg) {
+  ktime_t now = ktime_get();
+  s64 late, jitter;
+  cycles_t c0, c1;
+
+  if (bench_stopped)
+    return;
+  ++bench_count;
+  late = ktime_to_ns(ktime_sub(now, bench_start)) - (s64) bench_count * period_us * NSEC_PER_USEC;
+  if (bench_count == 1 || late < bench.late_min)
+    bench.late_min = late;
+  if (bench_count == 1 || late > bench.late_max)
+    bench.late_max = late;
+  bench.late_sum += late;
+
+  if (bench_count > 1) {
+    jitter = ktime_to_ns(ktime_sub(now, bench_prev)) - (s64) period_us * NSEC_PER_USEC;
+    if (bench_count == 2 || jitter < bench.jitter_min)
+      bench.jitter_min = jitter;
+    if (bench_count == 2 || jitter > bench.jitter_max)
+      bench.jitter_max = jitter;
+    bench.jitter_sum += jitter;
+    bench.jitter_abs_sum += jitter < 0 ? -jitter : jitter;
+  }
+  bench_prev = now;
+
+  if (bench_count >= samples) {
+    bench_done = 1;
+    bench_report();
+    return;
+  }
+
+  c0 = get_cycles();
+  kal_timer_forward(&bench_timer, kal_usec2time(period_us));
+  c1 = get_cycles();
+  if (bench_count == 1 || c1 - c0 < bench.fwd_min)
+    bench.fwd_min = c1 - c0;
+  if (c1 - c0 > bench.fwd_max)
+    bench.fwd_max = c1 - c0;
+  bench.fwd_sum += c1 - c0;
+}
+
+static int __init kal_timer_bench_init(void) {
+  if (period_us <= 0 || samples <= 0)
+    return -EINVAL;
+  memset(&bench, 0, sizeof(bench));
+  bench_count = 0;
+  bench_done = 0;
+  bench_stopped = 0;
+  kal_timer_init(&bench_timer, bench_handler, kal_voidptr_arg(NULL));
+  bench_start = ktime_get();
+  kal_timer_set(&bench_timer, kal_time_add(kal_time_now(), kal_usec2time(period_us)));
+  return 0;
+}
+
+static void __exit kal_timer_bench_exit(void) {
+  bench_stopped = 1;
+  kal_timer_del_sync(&bench_timer);
+  if (! bench_done)
+    bench_report();
+}
+
+module_init(kal_timer_bench_init);
+module_exit(kal_timer_bench_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,8 @@
+/** @file
+ ** @brief kal_timer benchmark on the high-resolution timer backend.
+ **/
+
+#include "rres_config.h"
+#define KAL_USE_HRTIMER
+
+#include "kal_timer_bench.c"
@@ -0,0 +1,8 @@
+/** @file
+ ** @brief kal_timer benchmark on the jiffies-based timer wheel backend.
+ **/
+
+#include "rres_config.h"
+#undef KAL_USE_HRTIMER
+
+#include "kal_timer_bench.c"
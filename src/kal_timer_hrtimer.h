@@ -0,0 +1,92 @@
+#ifndef KAL_TIMER_HRTIMER_H_
+#define KAL_TIMER_HRTIMER_H_
+
+/** @file
+ ** @brief kal_timer_t implementation on top of high-resolution timers.
+ **
+ ** Same API as kal_timer_wheel.h, but expiration times are kept with
+ ** nanosecond resolution on the CLOCK_MONOTONIC base (see
+ ** kal_time_timespec.h), instead of being rounded to jiffies.
+ **/
+
+#include "kal_time.h"
+
+#include "qos_debug.h"
+#include "qos_types.h"
+#include "qos_memory.h"
+
+#include <linux/time.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+
+/********************** TIMER RELATED **********************/
+
+#include "kal_arg.h"
+typedef void (*kal_timer_cb)(kal_arg_t cb_data);
+
+typedef struct {
+  struct hrtimer timer;         //< The kernel hrtimer instance
+  kal_timer_cb timer_cb;        //< The KAL timer callback
+  kal_arg_t timer_cb_data;      //< The opaque data to be supplied to the KAL timer callback
+  char handler_running;         //< Whether we are within this timer handler
+} kal_timer_t;
+
+/** The KAL callback may re-arm the timer through kal_timer_set() or
+ ** kal_timer_forward(), so HRTIMER_NORESTART is always returned.
+ **/
+static enum hrtimer_restart hrtimer_callback(struct hrtimer *p_hrtimer) {
+  kal_timer_t *p_timer = container_of(p_hrtimer, kal_timer_t, timer);
+  qos_chk_do_msg(qos_mem_valid(p_timer), return HRTIMER_NORESTART, "Ignoring timer with deallocated kal_timer_t data");
+  p_timer->handler_running = 1;
+  p_timer->timer_cb(p_timer->timer_cb_data);
+  p_timer->handler_running = 0;
+  return HRTIMER_NORESTART;
+}
+
+static inline void kal_timer_init(kal_timer_t * p_timer, kal_timer_cb cb, kal_arg_t cb_data) {
+  p_timer->timer_cb = cb;
+  p_timer->timer_cb_data = cb_data;
+  p_timer->handler_running = 0;
+  hrtimer_init(&p_timer->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+  p_timer->timer.function = hrtimer_callback;
+}
+
+static inline void kal_timer_init_now(kal_timer_t * p_timer, kal_timer_cb cb, kal_arg_t cb_data) {
+  kal_timer_init(p_timer, cb, cb_data);
+  hrtimer_set_expires(&p_timer->timer, kal_time2ktime(kal_time_now()));
+}
+
+static inline void kal_timer_set(kal_timer_t * p_timer, kal_time_t t) {
+  hrtimer_start(&p_timer->timer, kal_time2ktime(t), HRTIMER_MODE_ABS);
+}
+
+/** Stop the timer, without waiting for its handler if it is running on
+ ** another CPU. May be called from the handler itself.
+ **/
+static inline void kal_timer_del(kal_timer_t * p_timer) {
+  if (! p_timer->handler_running)
+    hrtimer_cancel(&p_timer->timer);
+  else
+    hrtimer_try_to_cancel(&p_timer->timer);
+}
+
+/** Stop the timer, waiting for its handler to return if it is running,
+ ** so that the memory it uses may be freed right after.
+ **
+ ** Not to be called from the handler, nor holding locks it takes. The
+ ** handler must not re-arm the timer once told to stop by its owner.
+ **/
+static inline void kal_timer_del_sync(kal_timer_t * p_timer) {
+  hrtimer_cancel(&p_timer->timer);
+}
+
+static inline void kal_timer_forward(kal_timer_t * p_timer, kal_time_t t) {
+  ktime_t expires = ktime_add(hrtimer_get_expires(&p_timer->timer), kal_time2ktime(t));
+  hrtimer_start(&p_timer->timer, expires, HRTIMER_MODE_ABS);
+}
+
+static inline int kal_timer_pending(kal_timer_t *p_timer) {
+  return hrtimer_is_queued(&p_timer->timer);
+}
+
+#endif /*KAL_TIMER_HRTIMER_H_*/
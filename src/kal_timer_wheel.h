@@ -35,6 +35,7 @@ static void timer_callback(unsigned long cb_data) {
 static inline void kal_timer_init(kal_timer_t * p_timer, kal_timer_cb cb, kal_arg_t cb_data) {
   p_timer->timer_cb = cb;
   p_timer->timer_cb_data = cb_data;
+  p_timer->handler_running = 0;
   setup_timer(&p_timer->timer, timer_callback, (unsigned long) p_timer);
 }
 
@@ -53,11 +54,24 @@ static inline void kal_timer_set(kal_timer_t * p_timer, kal_time_t t) {
   add_timer(&p_timer->timer);
 }
 
+/** Stop the timer, without waiting for its handler if it is running on
+ ** another CPU. May be called from the handler itself.
+ **/
 static inline void kal_timer_del(kal_timer_t * p_timer) {
   if (timer_pending(&p_timer->timer) && (! p_timer->handler_running))
     del_timer_sync(&p_timer->timer);
 }
 
+/** Stop the timer, waiting for its handler to return if it is running,
+ ** so that the memory it uses may be freed right after.
+ **
+ ** Not to be called from the handler, nor holding locks it takes. The
+ ** handler must not re-arm the timer once told to stop by its owner.
+ **/
+static inline void kal_timer_del_sync(kal_timer_t * p_timer) {
+  del_timer_sync(&p_timer->timer);
+}
+
 static inline void kal_timer_forward(kal_timer_t * p_timer, kal_time_t t) {
   unsigned long expires = p_timer->timer.expires + kal_time2jiffies(t);
   //printk("Forwarding expires from %lu to %lu (delta=%lu)\n",
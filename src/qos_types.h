@@ -65,23 +65,57 @@ typedef pid_t tid_t;
  * A CPU bandwidth is a fraction of usage of the processor, in the
  * Resource Reservation meaning, whose maximum value is 1.0. It is
  * represented as a fixed precision number.
+ *
+ * With QOS_BW_WIDE, bandwidths have 32 fractional bits on 64 bits,
+ * so that the rounding of many tiny reservations wastes less of the
+ * capacity. Otherwise, they have 24 fractional bits.
  */
+#ifdef QOS_BW_WIDE
+typedef unsigned long long int qos_bw_t;
+#else
 typedef unsigned long int qos_bw_t;
+#endif
 
 /** Format string to be used for qos_bw_t types in printf-like functions */
-#define QOS_BW_FMT "%lu"
+#ifdef QOS_BW_WIDE
+#  define QOS_BW_FMT "%llu"
+#else
+#  define QOS_BW_FMT "%lu"
+#endif
 
 /** Precision of representation of a bandwidth value.
  *
  * This is the number of bits used to represent a bandwidth value in
  * the range [0.0, 1.0].
  */
-#define QOS_BW_BITS 24
+#ifdef QOS_BW_WIDE
+#  define QOS_BW_BITS 32
+#else
+#  define QOS_BW_BITS 24
+#endif
 
 /** Corresponds to maximum CPU usage (1.0).
  *
  * This is a theoretical value, never assigned to any task in practice.	*/
-#define MAX_BW (1ul << QOS_BW_BITS)
+#define MAX_BW (((qos_bw_t) 1) << QOS_BW_BITS)
+
+/** A bandwidth in the legacy 24-bit format, as exchanged with callers
+ * of the kernel interfaces unaware of QOS_BW_WIDE.
+ */
+typedef unsigned long int qos_bw24_t;
+
+/** Precision of representation of a qos_bw24_t value */
+#define QOS_BW24_BITS 24
+
+/** Convert a bandwidth from the legacy 24-bit format */
+static inline qos_bw_t bw24_to_bw(qos_bw24_t bw) {
+  return ((qos_bw_t) bw) << (QOS_BW_BITS - QOS_BW24_BITS);
+}
+
+/** Convert a bandwidth to the legacy 24-bit format, lower-rounding it */
+static inline qos_bw24_t bw_to_bw24(qos_bw_t bw) {
+  return (qos_bw24_t) (bw >> (QOS_BW_BITS - QOS_BW24_BITS));
+}
 
 /** Maximum utilizable bandwidth. This may be less than
  ** one in order to account for scheduling overhead
@@ -113,22 +147,97 @@ static inline double bw2d(qos_bw_t b) {
  * a qos_bw_t value.
  */
 static inline qos_bw_t r2bw(qres_time_t Q, qres_time_t P) {
+#ifdef QOS_BW_WIDE
+  return ull_div(((__u64) (__u32) Q) << QOS_BW_BITS, (__u32) P);
+#else
   return ul_shl_div((unsigned long) Q, QOS_BW_BITS, (unsigned long) P);
+#endif
 }
 
 /** Convert a reservation (Q,P) into the ratio Q/P represented as
  ** a qos_bw_t value, upper-rounding the result.
  **/
 static inline qos_bw_t r2bw_ceil(qres_time_t Q, qres_time_t P) {
+#ifdef QOS_BW_WIDE
+  return ull_div((((__u64) (__u32) Q) << QOS_BW_BITS) + (__u32) P - 1, (__u32) P);
+#else
   return ul_shl_ceil((unsigned long) Q, QOS_BW_BITS, (unsigned long) P);
+#endif
+}
+
+/** Reciprocal of a period P, precomputed once for many r2bw_recip()
+ ** and r2bw_ceil_recip() conversions with the same period, that are
+ ** then carried out with multiplications only.
+ **/
+typedef struct qos_recip_t {
+  unsigned long P;		/**< The period				*/
+  __u64 inv;			/**< floor((2^(32 + QOS_BW_BITS) - 1) / P) */
+} qos_recip_t;
+
+/** Precompute the reciprocal of the period P into *p_r */
+static inline void qos_recip_init(qos_recip_t *p_r, qres_time_t P) {
+  p_r->P = (unsigned long) P;
+  p_r->inv = (P > 0) ? ull_div(~0ull >> (32 - QOS_BW_BITS), (unsigned long) P) : 0;
+}
+
+/** Computes '(Q << QOS_BW_BITS) / P', storing the remainder into *p_rem */
+static inline __u64 qos_recip_divrem(qres_time_t Q, const qos_recip_t *p_r, __u64 *p_rem) {
+  __u64 num = ((__u64) (__u32) Q) << QOS_BW_BITS;
+  __u64 quot = ull_mul_shr32(p_r->inv, (__u32) Q);
+  __u64 rem = num - quot * p_r->P;
+
+  /* Since inv is rounded down, quot may be one less than needed */
+  if (rem >= p_r->P) {
+    quot++;
+    rem -= p_r->P;
+  }
+  *p_rem = rem;
+  return quot;
+}
+
+/** Same as r2bw(Q, P), with the reciprocal of P precomputed in *p_r */
+static inline qos_bw_t r2bw_recip(qres_time_t Q, const qos_recip_t *p_r) {
+  __u64 rem;
+  return (qos_bw_t) qos_recip_divrem(Q, p_r, &rem);
+}
+
+/** Same as r2bw_ceil(Q, P), with the reciprocal of P precomputed in *p_r */
+static inline qos_bw_t r2bw_ceil_recip(qres_time_t Q, const qos_recip_t *p_r) {
+  __u64 rem;
+  __u64 quot = qos_recip_divrem(Q, p_r, &rem);
+  return (qos_bw_t) (quot + (rem != 0));
 }
 
 static inline unsigned long div_by_bw(unsigned long num, qos_bw_t bw) {
+#ifdef QOS_BW_WIDE
+  return (unsigned long) ull_div64(((__u64) (__u32) num) << QOS_BW_BITS, bw);
+#else
   return ul_shl_div(num, QOS_BW_BITS, bw);
+#endif
 }
 
 static inline unsigned long mul_by_bw(unsigned long value, qos_bw_t bw) {
+#ifdef QOS_BW_WIDE
+  return (unsigned long) ull_mul_shr32(bw, value);
+#else
   return ul_mul_shr(value, bw, QOS_BW_BITS);
+#endif
+}
+
+/** Computes 'x * num / den', where num/den is a ratio of two bandwidths
+ * not greater than 1.0, and x is either a bandwidth or a time.
+ */
+static inline __u64 bw_scale(__u64 x, qos_bw_t num, qos_bw_t den) {
+#ifdef QOS_BW_WIDE
+  /* x * num may not fit 64 bits: split x into a multiple of den and a
+   * remainder, whose product by num (both up to MAX_BW) always does.
+   */
+  __u64 quot = ull_div64(x, den);
+  __u64 rem = x - quot * den;
+  return quot * num + ull_div64(rem * num, den);
+#else
+  return ul_mul_div((unsigned long) x, num, den);
+#endif
 }
 
 /** Converts a reservation (Q,P) into the ratio Q/P represented as
@@ -148,7 +257,11 @@ static inline qres_time_t bw2Q(qos_bw_t bw, qres_time_t P) {
 /*    unsigned long Q = ul_mul_shr(bw, P, QOS_BW_BITS); */
 
 /*   return Q; */
+#ifdef QOS_BW_WIDE
+  return (qres_time_t) ull_mul_shr32(bw, P);
+#else
   return ul_mul_shr(bw, P, QOS_BW_BITS);
+#endif
 }
 
 /** The default P value used when not specified */
@@ -16,8 +16,45 @@
 
 #ifdef __i386__
 #  include "qos_ul_i386.h"
+#elif defined(__x86_64__)
+#  include "qos_ul_x86_64.h"
 #else
 #  include "qos_ul_other.h"
 #endif
 
+#ifdef __KERNEL__
+#  include <linux/math64.h>
+#endif
+
+/** Computes '(x * y) >> 32', with x on 64 bits and y on 32 bits.
+ *
+ * The computation is carried on with intermediate result (x*y)
+ * on 96 bits, as the sum of two 64-bit partial products.
+ */
+#ifndef ull_mul_shr32
+#define ull_mul_shr32(x, y) ({						\
+      __u64 _x = (__u64) (x);						\
+      __u32 _y = (__u32) (y);						\
+      ((_x >> 32) * _y) + (((_x & 0xffffffffull) * _y) >> 32);		\
+    })
+#endif
+
+/** Computes 'num / den', with num on 64 bits and den on 32 bits. */
+#ifndef ull_div
+#  ifdef __KERNEL__
+#    define ull_div(num, den) div_u64((num), (den))
+#  else
+#    define ull_div(num, den) (((__u64) (num)) / (__u32) (den))
+#  endif
+#endif
+
+/** Computes 'num / den', with both num and den on 64 bits. */
+#ifndef ull_div64
+#  ifdef __KERNEL__
+#    define ull_div64(num, den) div64_u64((num), (den))
+#  else
+#    define ull_div64(num, den) (((__u64) (num)) / (__u64) (den))
+#  endif
+#endif
+
 #endif
@@ -5,7 +5,7 @@
  **
  ** @note
  ** All operations are supposed to be called with a global lock held. This lock
- ** may be obtained through the qres_get_lock() function.
+ ** may be obtained through the qres_lock() function.
  **
  ** @todo
  ** Add creation flag that, if set, allows to set required bandwidth to zero when
@@ -18,9 +18,12 @@
 #include "qos_debug.h"
 #include <linux/posix-timers.h>
 #include <linux/time.h>
+#include <linux/math64.h>
 #include <linux/cgroup.h>
 #include <linux/err.h>
 #include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/mutex.h>
 
 #ifdef QRES_MOD_PROFILE
 #  define QOS_PROFILE
@@ -36,11 +39,34 @@
 #include "qos_func.h"
 #include "rres.h"
 #include "kal_sched.h"
+#include "qres_watchdog.h"
+#include "qres_tg_pool.h"
+#include "qres_gen.h"
+#include "qres_samples.h"
+#include "qres_trace.h"
 
 qres_sid_t server_id = 1;
 struct list_head server_list;
 qos_bw_t U_tot = 0;
 
+/** Serializes all operations on servers, see qres_lock() */
+static DEFINE_MUTEX(qres_mutex);
+
+/** Nesting depth of qres_batch_begin() calls, deferring scheduler updates.
+ ** As the flag below, protected by qres_lock().
+ **/
+static int qres_batch_depth = 0;
+/** Whether qres_update_bandwidths() was deferred within the batch */
+static qos_bool_t qres_batch_dirty = 0;
+
+void qres_lock(void) {
+  mutex_lock(&qres_mutex);
+}
+
+void qres_unlock(void) {
+  mutex_unlock(&qres_mutex);
+}
+
 /** Static QRES constructor  */
 qos_rv qres_init(void) {
   // compile-time check, run-time error at module insertion
@@ -60,6 +86,16 @@ qos_rv qres_init(void) {
   qos_log_debug("Task period for root is: %ld", sched_group_rt_period(&init_task_group, 1));
   qos_log_debug("Task tuntime for root is: %ld", sched_group_rt_runtime(&init_task_group, 1));
 
+  qos_chk_ok_ret(qres_gen_init());
+
+#ifdef QRES_TG_POOL
+  qos_chk_ok_ret(qres_tg_pool_init());
+#endif
+
+#ifdef QRES_WATCHDOG
+  qos_chk_ok_ret(qres_watchdog_init());
+#endif
+
   return QOS_OK;
 }
 
@@ -71,6 +107,10 @@ qos_rv qres_cleanup(void) {
   // ** IMPORTANT DO FOLLOWING LINE
   //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
 
+#ifdef QRES_WATCHDOG
+  qres_watchdog_cleanup();
+#endif
+
   /* Destroy all servers, including the default one, if configured. */
   for_each_server_safe(srv, tmp, tmpdel) {
     qos_log_debug("Destroying sever %d ", srv->id);
@@ -78,6 +118,11 @@ qos_rv qres_cleanup(void) {
     qos_chk_ok_ret(qres_destroy_server(qres_find_by_rres(srv)));
     srv = NULL;
   }
+
+#ifdef QRES_TG_POOL
+  qres_tg_pool_cleanup();
+#endif
+  qres_gen_cleanup();
   return QOS_OK;
 }
 
@@ -102,13 +147,15 @@ static qos_bool_t authorize_for_task(struct task_struct *tsk) {
  *
  * @todo It is completely unimplemented, thus it represents a SECURITY FLAW
  */
-static qos_bool_t authorize_for_server(qres_server_t *qres) {
+qos_bool_t authorize_for_server(qres_server_t *qres) {
   return (kal_task_get_uid(kal_task_current()) == 0) ||
          (kal_task_get_uid(kal_task_current()) == qres_get_owner_uid(qres));
 }
 
-/** QRES Factory Method */
-qos_func_define(qos_rv, qres_create_server, qres_params_t *param, qres_sid_t *p_sid) {
+static qos_rv qres_init_server_in(qres_server_t *qres, qres_server_t *parent, qres_params_t *param);
+
+/** Allocate and initialize a new server, nested within parent if not NULL */
+static qos_rv qres_create_server_in(qres_server_t *parent, qres_params_t *param, qres_sid_t *p_sid) {
   qres_server_t *qres;
   qos_rv rv;
 
@@ -117,13 +164,156 @@ qos_func_define(qos_rv, qres_create_server, qres_params_t *param, qres_sid_t *p_
       param->Q, param->Q_min, param->P, param->flags);
   qres = qos_create(qres_server_t);
   qos_chk_rv(qres != NULL, QOS_E_NO_MEMORY);
-  rv = qres_init_server(qres, param);
+  rv = qres_init_server_in(qres, parent, param);
   if (rv != QOS_OK) {
     qos_free(qres);
     qos_log_info("qres_init_server failed: %s", qos_strerror(rv));
     return rv;
   }
   *p_sid = qres->rres.id;
+  trace_qres_server_create(qres->rres.id, parent != NULL ? parent->rres.id : QRES_SID_NULL,
+                           param->Q, param->Q_min, param->P, param->flags);
+  return QOS_OK;
+}
+
+/** QRES Factory Method */
+qos_func_define(qos_rv, qres_create_server, qres_params_t *param, qres_sid_t *p_sid) {
+  return qres_create_server_in(NULL, param, p_sid);
+}
+
+qos_func_define(qos_rv, qres_create_subserver, qres_server_t *parent, qres_params_t *param, qres_sid_t *p_sid) {
+  if (! authorize_for_server(parent))
+    return QOS_E_UNAUTHORIZED;
+  if (parent->cpu_mask != 0)
+    return QOS_E_UNIMPLEMENTED;
+  return qres_create_server_in(parent, param, p_sid);
+}
+
+/** Set the server period, along with its reciprocal */
+static inline void qres_set_period(qres_server_t *qres, qres_time_t P) {
+  /* Periods are counted again from now on, see qres_get_deadline() */
+  if (P != qres->rres.period_us)
+    ktime_get_ts(&qres->period_origin);
+  qres->rres.period_us = P;
+  qres->rres.period = kal_usec2time(P);
+  qos_recip_init(&qres->period_recip, P);
+}
+
+/** Bandwidth requested through the server parameters */
+static inline qos_bw_t qres_req_bw(qres_server_t *qres) {
+  return r2bw_recip(qres->params.Q, &qres->period_recip);
+}
+
+/** Sum of the bandwidths requested by the children of qres, except skip */
+static qos_bw_t qres_children_req_bw(qres_server_t *qres, qres_server_t *skip) {
+  struct list_head *pos;
+  qos_bw_t bw = 0;
+
+  list_for_each(pos, &qres->children) {
+    qres_server_t *child = list_entry(pos, qres_server_t, siblings);
+    if (child != skip)
+      bw += qres_req_bw(child);
+  }
+  return bw;
+}
+
+/** Sum of the bandwidths granted to the children of qres */
+static qos_bw_t qres_children_bw(qres_server_t *qres) {
+  struct list_head *pos;
+  qos_bw_t bw = 0;
+
+  list_for_each(pos, &qres->children)
+    bw += rres_get_bandwidth(&list_entry(pos, qres_server_t, siblings)->rres);
+  return bw;
+}
+
+/** Per-subtree admission control.
+ **
+ ** Check that the bandwidth requested through param by qres still
+ ** accommodates the ones requested by its children and, if qres is a
+ ** sub-reservation, that it fits within the one requested by its
+ ** parent, together with the ones requested by its siblings.
+ **/
+static qos_rv qres_check_subtree(qres_server_t *qres, qres_params_t *param) {
+  qos_bw_t bw_req = r2bw(param->Q, param->P);
+
+  if (bw_req < qres_children_req_bw(qres, NULL)) {
+    trace_qres_admission_reject(qres->rres.id, qos_rv_int(QOS_E_SYSTEM_OVERLOAD), "children");
+    return QOS_E_SYSTEM_OVERLOAD;
+  }
+  if (qres->parent != NULL
+      && qres_children_req_bw(qres->parent, qres) + bw_req > qres_req_bw(qres->parent)) {
+    trace_qres_admission_reject(qres->rres.id, qos_rv_int(QOS_E_SYSTEM_OVERLOAD), "parent");
+    return QOS_E_SYSTEM_OVERLOAD;
+  }
+  return QOS_OK;
+}
+
+/** Largest fraction of the budget the server may use on a single CPU */
+static qos_bw_t qres_cpu_max_share(qres_server_t *qres) {
+  qos_bw_t max = 0;
+  int cpu;
+
+  if (qres->cpu_mask == 0)
+    return MAX_BW;
+  for (cpu = 0; cpu < QRES_MAX_CPUS; ++cpu)
+    if (qres->cpu_share[cpu] > max)
+      max = qres->cpu_share[cpu];
+  return max;
+}
+
+/** Part of the budget Q the server may use on a CPU with the given share */
+static inline qres_time_t qres_cpu_budget(qres_server_t *qres, qres_time_t Q, qos_bw_t share) {
+  return qres->cpu_mask == 0 ? Q : (qres_time_t) mul_by_bw(Q, share);
+}
+
+/** Parameters the supervisor is charged with, i.e., the ones on the CPU
+ ** where the server has the largest share of its budget.
+ **/
+static void qres_charged_params(qres_server_t *qres, qres_params_t *param, qres_params_t *charged) {
+  qos_bw_t share = qres_cpu_max_share(qres);
+
+  *charged = *param;
+  charged->Q = qres_cpu_budget(qres, param->Q, share);
+  charged->Q_min = qres_cpu_budget(qres, param->Q_min, share);
+}
+
+#ifndef QRES_ENABLE_QSUP
+/** Bandwidth approved on cpu to all top-level servers, but skip */
+static qos_bw_t qres_cpu_load(int cpu, qres_server_t *skip) {
+  struct list_head *pos;
+  server_t *srv;
+  qos_bw_t bw = 0;
+
+  for_each_server(srv, pos) {
+    qres_server_t *qres = qres_find_by_rres(srv);
+    if (qres == skip || qres->parent != NULL)
+      continue;
+    if (qres->cpu_mask == 0)
+      bw += rres_get_bandwidth(srv);
+    else if (qres->cpu_mask & (1u << cpu))
+      bw += bw_scale(rres_get_bandwidth(srv), qres->cpu_share[cpu], qres_cpu_max_share(qres));
+  }
+  return bw;
+}
+#endif
+
+/** Restrict the group runtime on each CPU in the server mask to its share
+ ** of budget (the largest share getting all of it), and to zero elsewhere.
+ **/
+static qos_rv qres_set_cpu_budgets(qres_server_t *qres, qres_time_t budget) {
+  qos_bw_t max_share = qres_cpu_max_share(qres);
+  int cpu;
+
+  for_each_possible_cpu(cpu) {
+    qres_time_t q = 0;
+    if (cpu < QRES_MAX_CPUS && (qres->cpu_mask & (1u << cpu)))
+      q = bw_scale(budget, qres->cpu_share[cpu], max_share);
+    if (sched_group_set_rt_runtime_cpu(qres->qsup.tg, cpu, q) < 0) {
+      qos_log_debug("Error setting rt runtime %ld on cpu %d", (long) q, cpu);
+      return QOS_E_UNAUTHORIZED;
+    }
+  }
   return QOS_OK;
 }
 
@@ -138,7 +328,9 @@ int rres_has_ready_tasks(server_t *srv) {
  ** @note: Current budget is updated at the next recharge.
  **/
 qos_func_define(qos_rv, rres_set_budget, server_t *srv, qres_time_t new_budget) {
-  qos_bw_t new_bw;
+  struct qres_server *qres = container_of(srv, struct qres_server, rres);
+  qos_bw_t new_bw, sub_bw;
+  qres_time_t tasks_budget;
   int rv_sched;
   //if (RRES_PARANOID)
   //  qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
@@ -148,17 +340,23 @@ qos_func_define(qos_rv, rres_set_budget, server_t *srv, qres_time_t new_budget)
     qos_log_debug("Divide for period_us = 0, aborting...");
     return QOS_E_INTERNAL_ERROR;
   }
-  new_bw = r2bw(new_budget, srv->period_us);
-  if (U_LUB2 - (U_tot - srv->get_bandwidth(srv)) < new_bw)
+  new_bw = r2bw_recip(new_budget, &qres->period_recip);
+  if (U_LUB2 - (U_tot - srv->get_bandwidth(srv)) < new_bw) {
+    trace_qres_admission_reject(srv->id, qos_rv_int(QOS_E_SYSTEM_OVERLOAD), "budget");
     return QOS_E_SYSTEM_OVERLOAD;
+  }
   srv->max_budget_us = new_budget;
   srv->max_budget = kal_usec2time(new_budget);
 
   //rres_update_current_bandwidth(srv);
-  qos_log_debug("Sched period (%ld) and budget (%ld)", srv->period_us, new_budget);
+  struct task_group *tg = qres->qsup.tg;
 
-  struct task_group *tg;
-  tg = (container_of(srv, struct qres_server, rres))->qsup.tg;
+  /* Tasks attached to the server itself get what is left by its children */
+  tasks_budget = new_budget;
+  sub_bw = qres_children_bw(qres);
+  if (sub_bw > 0)
+    tasks_budget = bw2Q(new_bw > sub_bw ? new_bw - sub_bw : 0, srv->period_us);
+  trace_qres_sched_budget(srv->id, srv->period_us, new_budget, tasks_budget);
 
   rv_sched = sched_group_set_rt_period(tg, 0, srv->period_us);
   if (rv_sched<0) {
@@ -166,7 +364,6 @@ qos_func_define(qos_rv, rres_set_budget, server_t *srv, qres_time_t new_budget)
      qos_log_debug("Period setted: %ld", sched_group_rt_period(tg, 0));
      return QOS_E_UNAUTHORIZED;
   }
-  qos_log_debug("Period added is: %ld", sched_group_rt_period(tg, 0));
 
   rv_sched = sched_group_set_rt_runtime(tg, 0, new_budget);
   if (rv_sched<0) {
@@ -174,7 +371,6 @@ qos_func_define(qos_rv, rres_set_budget, server_t *srv, qres_time_t new_budget)
      qos_log_debug("Runtime setted: %ld", sched_group_rt_runtime(tg, 0));
      return QOS_E_UNAUTHORIZED;
   }
-  qos_log_debug("Runtime added is: %ld", sched_group_rt_runtime(tg, 0));
 
   rv_sched = sched_group_set_rt_period(tg, 1, srv->period_us);
   if (rv_sched<0) {
@@ -182,16 +378,17 @@ qos_func_define(qos_rv, rres_set_budget, server_t *srv, qres_time_t new_budget)
      qos_log_debug("Task period setted: %ld", sched_group_rt_period(tg, 1));
      return QOS_E_UNAUTHORIZED;
   }
-  qos_log_debug("Period for task added is: %ld", sched_group_rt_period(tg, 1));
 
-  rv_sched = sched_group_set_rt_runtime(tg, 1, new_budget);
+  rv_sched = sched_group_set_rt_runtime(tg, 1, tasks_budget);
   if (rv_sched<0) {
-     qos_log_debug("Error setting rt task runtime: %ld", new_budget);
+     qos_log_debug("Error setting rt task runtime: %ld", tasks_budget);
      qos_log_debug("Task runtime setted: %ld", sched_group_rt_runtime(tg, 1));
      return QOS_E_UNAUTHORIZED;
   }
-  qos_log_debug("Runtime for task added is: %ld", sched_group_rt_runtime(tg, 1));
 
+  /* The runtimes above are the ones on the CPU with the largest share */
+  if (qres->cpu_mask != 0)
+    qos_chk_ok_ret(qres_set_cpu_budgets(qres, new_budget));
 
   // @todo Any consequences on the potentiality of malicious violation of assigned max budget ?
   //if ((! rres_has_ready_tasks(srv)) || (! kal_time_le(srv->c, srv->max_budget)))
@@ -206,43 +403,136 @@ qos_func_define(qres_time_t, rres_get_period, server_t *srv) {
   return srv->period_us;
 }
 
-/* TODO: Avoid admission control by RRES without going through all existing servers */
-void qres_update_bandwidths(void) {
-  struct list_head *tmp;
-  server_t *srv;
-  qos_log_debug("Update bandwidth");
+/** Roots of the reservation trees to be reprogrammed, linked through
+ ** reprogram_next, see qres_update_bandwidths()
+ **/
+static qres_server_t *qres_reprogram_roots = NULL;
+
+/** Have the tree holding qres reprogrammed by the next qres_update_bandwidths() */
+static void qres_mark_tree(qres_server_t *qres) {
+  while (qres->parent != NULL)
+    qres = qres->parent;
+  if (qres->reprogram)
+    return;
+  qres->reprogram = 1;
+  qres->reprogram_next = qres_reprogram_roots;
+  qres_reprogram_roots = qres;
+}
+
+/** Forget about reprogramming the top-level server qres, being destroyed */
+static void qres_unmark_tree(qres_server_t *qres) {
+  qres_server_t **pp = &qres_reprogram_roots;
+
+  if (! qres->reprogram)
+    return;
+  while (*pp != qres)
+    pp = &(*pp)->reprogram_next;
+  *pp = qres->reprogram_next;
+  qres->reprogram = 0;
+}
+
+/** Zero the runtimes of the groups of qres and of its children, leaves first */
+static void qres_zero_tree(qres_server_t *qres) {
+  struct list_head *pos;
   int rv_sched;
 
-  for_each_server(srv, tmp) {
-    struct task_group *tg;
-    tg = (container_of(srv, struct qres_server, rres))->qsup.tg;
-    qos_log_debug("xxxxxxxx %ld %ld", (long) tg, (long) &init_task_group);
+  list_for_each(pos, &qres->children)
+    qres_zero_tree(list_entry(pos, qres_server_t, siblings));
+
+  rv_sched = sched_group_set_rt_runtime(qres->qsup.tg, 1, 0);
+  if (rv_sched<0) {
+     qos_log_debug("Error setting rt task runtime!!!!!: %ld", 0);
+     //return QOS_E_UNAUTHORIZED;
+  }
+
+  rv_sched = sched_group_set_rt_runtime(qres->qsup.tg, 0, 0);
+  if (rv_sched<0) {
+     qos_log_debug("Error setting rt runtime!!!!!: %ld", (long) 0);
+     //return QOS_E_UNAUTHORIZED;
+  }
+}
 
+/** Set the approved budgets of qres and of its children, root first */
+static void qres_program_tree(qres_server_t *qres) {
+  struct list_head *pos;
+  qres_time_t q = bw2Q(rres_get_bandwidth(&qres->rres), rres_get_period(&qres->rres));
 
-    rv_sched = sched_group_set_rt_runtime(tg, 1, 0);
-    if (rv_sched<0) {
-       qos_log_debug("Error setting rt task runtime!!!!!: %ld", 0);
-       //return QOS_E_UNAUTHORIZED;
-    }
+  rres_set_budget(&qres->rres, q);
+  list_for_each(pos, &qres->children)
+    qres_program_tree(list_entry(pos, qres_server_t, siblings));
+}
 
-    rv_sched = sched_group_set_rt_runtime(tg, 0, 0);
-    if (rv_sched<0) {
-       qos_log_debug("Error setting rt runtime!!!!!: %ld", (long) 0);
-       //return QOS_E_UNAUTHORIZED;
-    }
+/* TODO: Avoid admission control by RRES without going through all existing servers */
+/* Runtimes are zeroed from the leaves up, then assigned from the roots
+ * down, so that no group ever exceeds the bandwidth of its parent.
+ * Only the trees holding a server whose approved budget changed are
+ * reprogrammed, as the runtime left to the tasks of a parent depends on
+ * the budgets of its children. Top-level servers are found on the dirty
+ * list of the supervisor, sub-reservations are marked by the callers
+ * changing them, through qres_mark_tree(). */
+void qres_update_bandwidths(void) {
+  qres_server_t *qres;
 
+  if (qres_batch_depth > 0) {
+    qres_batch_dirty = 1;
+    return;
+  }
+
+#ifdef QRES_ENABLE_QSUP
+  {
+    qsup_server_t *qsup;
+    while ((qsup = qsup_pop_dirty()) != NULL) {
+      qres = container_of(qsup, qres_server_t, qsup);
+      /* Being created, programmed once complete */
+      if (qres->qsup.tg == NULL)
+	continue;
+      if (bw2Q(rres_get_bandwidth(&qres->rres), rres_get_period(&qres->rres))
+	  != qres->rres.max_budget_us)
+	qres_mark_tree(qres);
+    }
+  }
+#else
+  {
+    struct list_head *tmp;
+    server_t *srv;
+    for_each_server(srv, tmp)
+      qres_mark_tree(qres_find_by_rres(srv));
+  }
+#endif
 
+  for (qres = qres_reprogram_roots; qres != NULL; qres = qres->reprogram_next)
+    qres_zero_tree(qres);
+  for (qres = qres_reprogram_roots; qres != NULL; qres = qres->reprogram_next) {
+    qres_program_tree(qres);
+    qres->reprogram = 0;
   }
+  qres_reprogram_roots = NULL;
+}
 
-  for_each_server(srv, tmp) {
-    qres_time_t q = bw2Q(rres_get_bandwidth(srv), rres_get_period(srv));
-    qos_log_debug("Set bw sched: %ld", q);
-    rres_set_budget(srv, q);
+void qres_batch_begin(void) {
+  qres_batch_depth++;
+#ifdef QRES_ENABLE_QSUP
+  qsup_batch_begin();
+#endif
+}
+
+void qres_batch_end(void) {
+#ifdef QRES_ENABLE_QSUP
+  qsup_batch_end();
+#endif
+  if (--qres_batch_depth == 0 && qres_batch_dirty) {
+    qres_batch_dirty = 0;
+    qres_update_bandwidths();
   }
 }
 
 /** QRES Server constructor.    */
 qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *param) {
+  return qres_init_server_in(qres, NULL, param);
+}
+
+/** QRES Server constructor, for a server nested within parent if not NULL */
+static qos_rv qres_init_server_in(qres_server_t *qres, qres_server_t *parent, qres_params_t *param) {
   qos_rv rv;
   qres_time_t approved_Q;
   qos_bw_t bw_min;
@@ -253,17 +543,21 @@ qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *pa
 
   server_t *srv = &qres->rres;
 
+  srv->id = QRES_SID_NULL;
   srv->c = KAL_TIME_US(0, 0);
   srv->deadline = kal_time_now();
   srv->U_current = 0;
   srv->max_budget_us = 0;
   srv->max_budget = KAL_TIME_US(0, 0);
-  srv->period_us = param->P;
-  srv->period = kal_usec2time(param->P);
+  srv->period_us = 0;
+  qres_set_period(qres, param->P);
   srv->stat.n_rcg = 0;
   srv->stat.exec_time = KAL_TIME_US(0, 0);
   srv->flags = param->flags;
   srv->forbid_reorder = 0;
+  qres->parent = parent;
+  INIT_LIST_HEAD(&qres->children);
+  qres->cpu_mask = 0;
 
   //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
   qos_log_debug("(Q, P): (" QRES_TIME_FMT ", " QRES_TIME_FMT ")", param->Q, param->P);
@@ -288,37 +582,46 @@ qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *pa
   uid = kal_task_get_uid(kal_task_current());
   gid = kal_task_get_gid(kal_task_current());
 
+  if (parent != NULL) {
+    /* Sub-reservations are accounted within their parent only */
+    if (param->flags & QOS_F_DEFAULT)
+      return QOS_E_INVALID_PARAM;
+    qos_chk_ok_ret(qres_check_subtree(qres, param));
+    /* Possibly scaled down later on, see qres_sub_get_bandwidth() */
+    approved_Q = param->Q;
+  } else {
 #ifdef QRES_ENABLE_QSUP
-  /* First, check if request of guaranteed bw min respects constraints
-   * for the requesting user (according to its effective uid/guid), and
-   * create RRES server (i.e. perform admission control) based on this
-   * value.
-   */
-  if (param->flags & QOS_F_DEFAULT) {
-    if (uid != 0 && uid != QSUP_DEFAULT_SRV_UID && gid != QSUP_DEFAULT_SRV_GID)
-      return QOS_E_UNAUTHORIZED;
-  }
-  qos_chk_ok_ret(qsup_init_server(&qres->qsup, kal_task_get_uid(kal_task_current()),
-                                  kal_task_get_gid(kal_task_current()), param));
-
-  /* Then, set the actual request (may be < = > than min guaranteed)    */
-  bw_req = r2bw(param->Q, param->P);
-  qos_log_debug("Setting required bw to " QOS_BW_FMT, bw_req);
-  rv = qsup_set_required_bw(&qres->qsup, bw_req);
-  if (rv != QOS_OK) {
-    qos_log_info("qsup_set_required_bw() failed: %s", qos_strerror(rv));
-    qsup_cleanup_server(&qres->qsup);
-    return rv;
-  }
+    /* First, check if request of guaranteed bw min respects constraints
+     * for the requesting user (according to its effective uid/guid), and
+     * create RRES server (i.e. perform admission control) based on this
+     * value.
+     */
+    if (param->flags & QOS_F_DEFAULT) {
+      if (uid != 0 && uid != QSUP_DEFAULT_SRV_UID && gid != QSUP_DEFAULT_SRV_GID)
+        return QOS_E_UNAUTHORIZED;
+    }
+    qos_chk_ok_ret(qsup_init_server(&qres->qsup, kal_task_get_uid(kal_task_current()),
+                                    kal_task_get_gid(kal_task_current()), param));
+
+    /* Then, set the actual request (may be < = > than min guaranteed)    */
+    bw_req = r2bw(param->Q, param->P);
+    qos_log_debug("Setting required bw to " QOS_BW_FMT, bw_req);
+    rv = qsup_set_required_bw(&qres->qsup, bw_req);
+    if (rv != QOS_OK) {
+      qos_log_info("qsup_set_required_bw() failed: %s", qos_strerror(rv));
+      qsup_cleanup_server(&qres->qsup);
+      return rv;
+    }
 
-  /** Compute Q value as approved by supervisor */
-  approved_Q = bw2Q(qsup_get_approved_bw(&qres->qsup), param->P);
+    /** Compute Q value as approved by supervisor */
+    approved_Q = bw2Q(qsup_get_approved_bw(&qres->qsup), param->P);
 
 #else
-  if ((param->flags & QOS_F_DEFAULT) && (uid != 0))
-    return QOS_E_UNAUTHORIZED;
-  approved_Q = param->Q;
+    if ((param->flags & QOS_F_DEFAULT) && (uid != 0))
+      return QOS_E_UNAUTHORIZED;
+    approved_Q = param->Q;
 #endif
+  }
 
   qos_log_debug("Required=" QRES_TIME_FMT ", Approved=" QRES_TIME_FMT, param->Q, approved_Q);
 
@@ -329,12 +632,18 @@ qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *pa
   /* Then, we create the cgroup for this reservation */
   qos_log_debug("Creating a new cgroup reservation");
 
-  struct task_group *tg = sched_create_group(&init_task_group);
+#ifdef QRES_TG_POOL
+  struct task_group *tg = qres_tg_pool_get(parent != NULL ? parent->qsup.tg : &init_task_group);
+#else
+  struct task_group *tg = sched_create_group(parent != NULL ? parent->qsup.tg : &init_task_group);
+#endif
   if (IS_ERR(tg)) {
 
+    rv = QOS_E_NO_MEMORY;
     qos_log_info("sched_create_group() failed: %s", qos_strerror(rv));
 #ifdef QRES_ENABLE_QSUP
-    qsup_cleanup_server(&qres->qsup);
+    if (parent == NULL)
+      qsup_cleanup_server(&qres->qsup);
 #endif
     // New incomplete server was not enqueued, so it is safe to loop all servers.
     // All servers have their bandwidths back like before creation of this server.
@@ -343,6 +652,9 @@ qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *pa
 
   }
   qres->qsup.tg = tg;
+#ifdef QRES_WATCHDOG
+  sched_group_set_empty_notify(tg, &qres_watchdog_empty_notify);
+#endif
 
 /*
   rv_sched = sched_group_set_rt_period(qres->qsup.tg, 0, param->P);
@@ -405,15 +717,33 @@ qos_func_define(qos_rv, qres_init_server, qres_server_t *qres, qres_params_t *pa
   qres->owner_gid = gid;
 
   qres->params = *param;
+  qres->used = 0;
+  qres->empty = 1;
+  qres->empty_since = kal_time_now();
 
   ///* Override parent class vtable */
   qres->rres.cleanup = &_qres_cleanup_server;
   qres->rres.get_bandwidth = &_qres_get_bandwidth;
   qres->rres.id = new_server_id();
+#ifdef QRES_SAMPLES
+  /* Samples are for monitoring only, the server works without them */
+  if (qres_samples_init(qres) != QOS_OK)
+    qos_log_err("Could not allocate the samples of server %d", qres->rres.id);
+#endif
   rres_add_to_srv_set(&qres->rres);
+  qres_gen_bump(qres->rres.id);
+  if (parent != NULL)
+    list_add_tail(&qres->siblings, &parent->children);
+  qres->reprogram = 0;
+  qres_mark_tree(qres);
 
   qres_update_bandwidths();
 
+#ifdef QRES_WATCHDOG
+  /* Let the watchdog account for the new, still empty, server */
+  qres_watchdog_kick();
+#endif
+
   return QOS_OK;
 }
 
@@ -438,17 +768,39 @@ server_t* rres_find_by_id(qres_sid_t sid) {
   if (sid == QRES_SID_NULL)
     return rres_find_by_task(kal_task_current());
   for_each_server(srv, tmp_list) {
-    qos_log_debug("For each server: %d\n", srv->id);
     if (srv->id == sid)
       return srv;
   }
   return NULL;
 }
 
-qos_func_define(qos_rv, qres_destroy_server, qres_server_t *qres) {
+/** Return non-zero if no tasks are attached to the server.
+ **
+ ** The task list is read under the group lock, that is taken by fork and
+ ** by attach when they add tasks, rather than through the lockless
+ ** sched_group_nr_tasks(). Tasks joining after this check are moved back
+ ** to the root group if the server is reaped, see qres_reap_server().
+ **/
+qos_bool_t qres_is_empty(qres_server_t *qres) {
+  struct task_group *tg = qres->qsup.tg;
+  unsigned long flags;
+  qos_bool_t empty;
+
+  if (! list_empty(&qres->children))
+    return 0;
+  if (tg == NULL)
+    return 1;
+  spin_lock_irqsave(&tg->tasks_lock, flags);
+  empty = list_empty(&tg->tasks);
+  spin_unlock_irqrestore(&tg->tasks_lock, flags);
+  return empty;
+}
 
-  struct task_struct *tsk;
-  struct list_head *pos, *n;
+qos_func_define(qos_rv, qres_reap_server, qres_server_t *qres) {
+
+  /* Sub-reservations first, as their groups are nested within this one */
+  while (! list_empty(&qres->children))
+    qos_chk_ok_ret(qres_reap_server(list_entry(qres->children.next, qres_server_t, siblings)));
 
   //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
   //while ((task = rres_any_ready_task(&qres->rres)) != NULL) {
@@ -458,32 +810,89 @@ qos_func_define(qos_rv, qres_destroy_server, qres_server_t *qres) {
     //qos_chk_ok_ret(rres_detach_task(&qres->rres, task));
   //}
 
+#ifdef QRES_SAMPLES
+  /* Stop sampling before the scheduling group goes away, as the handler
+   * reads the runtime of its tasks */
+  qres_samples_cleanup(qres);
+#endif
+
   if(qres->qsup.tg != NULL) {
-    list_for_each_safe(pos, n, &qres->qsup.tg->tasks) {
-          int rev;
-          tsk = list_entry(pos, struct task_struct, gtasks);
-          qos_log_debug("hmm task %d", (int) tsk);
-    	rev = sched_attach_task(&init_task_group, tsk);
-    	qos_log_debug("sched move task rev: %d", rev);
-
-    	if(rev<0) {
-    	   qos_log_debug("Error detaching task of group");
-    	}
-    }
-    qos_log_debug("Out of list for each");
+    sched_group_set_empty_notify(qres->qsup.tg, NULL);
+    sched_detach_group_tasks(qres->qsup.tg);
+
+    /* Drop our reference: the group is freed after an RCU grace period,
+     * once tasks racing with us (e.g., exiting ones) left it too */
+    qos_log_debug("Put group pointer %d", (int) qres->qsup.tg);
+#ifdef QRES_TG_POOL
+    qres_tg_pool_put(qres->qsup.tg);
+#else
+    sched_group_put(qres->qsup.tg);
+#endif
 
-    /* Would we need to hold some lock? */
-    qos_log_debug("Destroy group pointer %d", (int) qres->qsup.tg);
-    sched_destroy_group(qres->qsup.tg);
+    qres->qsup.tg = NULL;
+  }
 
-    //qres->qsup.tg = NULL;
+  /* Virtual call to _qres_cleanup_server(), giving back to the
+   * supervisor the bandwidth assigned to this server */
+  qos_chk_ok_ret(rres_cleanup_server(&qres->rres));
+  trace_qres_server_destroy(qres->rres.id);
+
+  rres_del_from_srv_set(&qres->rres);
+  if (qres->parent == NULL)
+    qres_unmark_tree(qres);
+  else {
+    list_del(&qres->siblings);
+    qres_mark_tree(qres->parent);
+#ifdef QRES_WATCHDOG
+    /* The parent might have been left empty */
+    qres_watchdog_kick();
+#endif
   }
+  qos_free(qres);
+  qres = NULL; // Don't use qres pointer from here on
+
+  return QOS_OK;
+}
+
+qos_func_define(qos_rv, qres_destroy_server, qres_server_t *qres) {
+  if (! authorize_for_server(qres))
+    return QOS_E_UNAUTHORIZED;
 
-  //qos_chk_ok_ret(rres_destroy_server(&qres->rres));
-  //qres = NULL; // Don't use qres pointer from here on
+  qos_chk_ok_ret(qres_reap_server(qres));
+  qres = NULL; // Don't use qres pointer from here on
+
+  /* Remaining servers possibly get back the bandwidth freed by this one */
+  qres_update_bandwidths();
 
   return QOS_OK;
+}
 
+/** Check if the server is empty and, unless it has been created with the
+ ** QOS_F_PERSISTENT flag, destroy it.
+ **
+ ** Persistent servers are only marked as empty, so that the watchdog may
+ ** reap them once their timeout has elapsed.
+ **
+ ** @note
+ ** When this function returns, the memory pointed to by the qres parameter
+ ** could have been deallocated.
+ **/
+static qos_rv qres_check_destroy(qres_server_t *qres) {
+  if (! qres_is_empty(qres)) {
+    qres->empty = 0;
+    return QOS_OK;
+  }
+  if (! (qres->params.flags & QOS_F_PERSISTENT)) {
+    qos_log_debug("Destroying empty server %d", qres->rres.id);
+    qos_chk_ok_ret(qres_reap_server(qres));
+    qres_update_bandwidths();
+    return QOS_OK;
+  }
+  if (! qres->empty) {
+    qres->empty = 1;
+    qres->empty_since = kal_time_now();
+  }
+  return QOS_OK;
 }
 
 /** Non-virtual QRES server destructor  */
@@ -491,14 +900,15 @@ qos_func_define(qos_rv, _qres_cleanup_server, server_t *rres) {
   qres_server_t *qres = qres_find_by_rres(rres);
 
   //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
-  if (! authorize_for_server(qres))
-    return QOS_E_UNAUTHORIZED;
 
   /* First, destroy child extensions keeping overridden vtable */
 
 #ifdef QRES_ENABLE_QSUP
-  qos_chk_ok_ret(qsup_cleanup_server(&qres->qsup));
+  /* Sub-reservations are not known to the supervisor */
+  if (qres->parent == NULL)
+    qos_chk_ok_ret(qsup_cleanup_server(&qres->qsup));
 #endif
+  qres_gen_bump(rres->id);
 
   /* Then, reset original parent class vtable	*/
 
@@ -510,9 +920,24 @@ qos_func_define(qos_rv, _qres_cleanup_server, server_t *rres) {
   return QOS_OK;
 }
 
+/** Bandwidth granted to a sub-reservation: the requested one, scaled down
+ ** in proportion if its parent has not been granted all of its request.
+ **/
+static qos_bw_t qres_sub_get_bandwidth(qres_server_t *qres) {
+  qos_bw_t bw_req = qres_req_bw(qres);
+  qos_bw_t bw_parent_req = qres_req_bw(qres->parent);
+  qos_bw_t bw_parent = rres_get_bandwidth(&qres->parent->rres);
+
+  if (bw_parent >= bw_parent_req)
+    return bw_req;
+  return bw_scale(bw_req, bw_parent, bw_parent_req);
+}
+
 /** Non-virtual bandwidth getter        */
 qos_bw_t _qres_get_bandwidth(server_t *srv) {
   qres_server_t *qres = qres_find_by_rres(srv);
+  if (qres->parent != NULL)
+    return qres_sub_get_bandwidth(qres);
   /* r2bw works with clocks too, as long as all in/out params fit into an unsigned long */
 #ifdef QRES_ENABLE_QSUP
   return qsup_get_approved_bw(&qres->qsup);
@@ -534,12 +959,21 @@ qos_func_define(qos_rv, qres_attach_task, qres_server_t *qres, struct task_struc
   //tsk->tg = qres->qsup.tg;
   //qos_log_debug("going to move task");
   //sched_move_task(tsk);
+#ifdef QRES_SAMPLES
+  qres_samples_tasks_begin(qres);
+#endif
   rv = sched_attach_task(qres->qsup.tg, tsk);
-  qos_log_debug("sched move task rv: %d", rv);
+#ifdef QRES_SAMPLES
+  qres_samples_tasks_end(qres);
+#endif
+  trace_qres_task_attach(qres->rres.id, tsk->pid, rv);
 
   if(rv<0) {
      qos_log_debug("Error attaching task to group");
+     return QOS_E_INTERNAL_ERROR;
   }
+  qres->used = 1;
+  qres->empty = 0;
 
   /* Dynamic reclamation is automatic here, no need to explicitly       *
    * require the QSUP_DYNAMIC_RECLAIM switch !                          */
@@ -563,16 +997,29 @@ qos_func_define(qos_rv, qres_attach_task, qres_server_t *qres, struct task_struc
 qos_func_define(qos_rv, qres_detach_task, qres_server_t *qres, struct task_struct *tsk) {
 
   int rev;
+  qos_bool_t attached;
 
   //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
   if (qres == NULL)
     return QOS_E_NOT_FOUND;
   if ((! authorize_for_task(tsk)) || (! authorize_for_server(qres)))
     return QOS_E_UNAUTHORIZED;
+  /* Neither move nor destroy anything on behalf of another server */
+  task_lock(tsk);
+  attached = (tsk->tg == qres->qsup.tg);
+  task_unlock(tsk);
+  if (! attached)
+    return QOS_E_NOT_FOUND;
   //qos_chk_ok_ret(rres_detach_task(&qres->rres, tsk));
 
+#ifdef QRES_SAMPLES
+  qres_samples_tasks_begin(qres);
+#endif
   rev = sched_attach_task(&init_task_group, tsk);
-  qos_log_debug("sched move task rev: %d", rev);
+#ifdef QRES_SAMPLES
+  qres_samples_tasks_end(qres);
+#endif
+  trace_qres_task_detach(qres->rres.id, tsk->pid, rev);
 
   if(rev<0) {
      qos_log_debug("Error detaching task of group");
@@ -584,23 +1031,39 @@ qos_func_define(qos_rv, qres_detach_task, qres_server_t *qres, struct task_struc
   //  qsup_set_required_bw(&qres->qsup, 0);
   //}
 
-  //qos_chk_ok_ret(rres_check_destroy(&qres->rres));
+  qos_chk_ok_ret(qres_check_destroy(qres));
   qres = NULL; // DO NOT USE qres POINTER, FROM HERE ON
   return QOS_OK;
 }
 
 /** Set QRES server parameters Q, Q_min and P. **/
-qos_func_define(qos_rv, qres_set_params, qres_server_t *qres, qres_params_t *param) {
-  qres_time_t approved_Q;
+#ifdef QRES_ENABLE_QSUP
+/** Update the supervisor request of a top-level server, from the charged
+ ** parameters old_param to the ones in param.
+ **/
+static qos_rv qres_qsup_update(qres_server_t *qres, qres_params_t *old_param, qres_params_t *param) {
+  if (param->Q_min != old_param->Q_min
+      || param->P != old_param->P) {
+    qos_chk_ok_ret(qsup_cleanup_server(&qres->qsup));
+    if (qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, param) != QOS_OK)
+      qos_chk_ok_ret(qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, old_param));
+  }
+  return qsup_set_required_bw(&qres->qsup, r2bw(param->Q, param->P));
+}
+#endif
 
-  //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
-  qos_log_debug("Q=" QRES_TIME_FMT "  Q_min=" QRES_TIME_FMT "  P=" QRES_TIME_FMT,
-		param->Q, param->Q_min, param->P);
+/** Check that param is acceptable for qres, rounding its values
+ ** according to the qos_bw_t granularity.
+ **/
+static qos_rv qres_check_params(qres_server_t *qres, qres_params_t *param) {
+  qres_params_t charged;
 
   if (! authorize_for_server(qres))
     return(QOS_E_UNAUTHORIZED);
 
-  if (param->P < MIN_SRV_PERIOD || param->Q > param->P)
+  /* A budget spread over multiple CPUs may exceed the period */
+  qres_charged_params(qres, param, &charged);
+  if (param->P < MIN_SRV_PERIOD || charged.Q > param->P)
     return QOS_E_INVALID_PARAM;
 
   if (param->Q < MIN_SRV_MAX_BUDGET)
@@ -613,24 +1076,282 @@ qos_func_define(qos_rv, qres_set_params, qres_server_t *qres, qres_params_t *par
   param->Q_min = bw2Q(r2bw_ceil(param->Q_min, param->P), param->P);
   param->Q = bw2Q(r2bw_ceil(param->Q, param->P), param->P);
   qos_log_debug("Rounded (Q, Q_min, P): (" QRES_TIME_FMT ", " QRES_TIME_FMT ", " QRES_TIME_FMT ")", param->Q, param->Q_min, param->P);
+  return QOS_OK;
+}
+
+qos_func_define(qos_rv, qres_set_params, qres_server_t *qres, qres_params_t *param) {
+  qres_time_t approved_Q;
 
+  //qos_chk_do(kal_atomic(), return QOS_E_INTERNAL_ERROR);
+  qos_log_debug("Q=" QRES_TIME_FMT "  Q_min=" QRES_TIME_FMT "  P=" QRES_TIME_FMT,
+		param->Q, param->Q_min, param->P);
+
+  qos_chk_ok_ret(qres_check_params(qres, param));
+  qos_chk_ok_ret(qres_check_subtree(qres, param));
+
+  /* Possibly scaled down later on, see qres_sub_get_bandwidth() */
+  approved_Q = param->Q;
 #ifdef QRES_ENABLE_QSUP
-  if (param->Q_min != qres->params.Q_min
-      || param->P != qres->params.P) {
-    qos_chk_ok_ret(qsup_cleanup_server(&qres->qsup));
-    if (qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, param) != QOS_OK)
-      qos_chk_ok_ret(qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, &qres->params));
+  if (qres->parent == NULL) {
+    qres_params_t charged, old_charged;
+    qres_charged_params(qres, param, &charged);
+    qres_charged_params(qres, &qres->params, &old_charged);
+    qos_chk_ok_ret(qres_qsup_update(qres, &old_charged, &charged));
+    approved_Q = bw2Q(qsup_get_approved_bw(&qres->qsup), param->P);
   }
-  qos_chk_ok_ret(qsup_set_required_bw(&qres->qsup, r2bw(param->Q, param->P)));
-  approved_Q = bw2Q(qsup_get_approved_bw(&qres->qsup), param->P);
-#else
-  approved_Q = param->Q;
 #endif
   qos_log_debug("Required=" QRES_TIME_FMT ", Approved=" QRES_TIME_FMT, param->Q, approved_Q);
   //qos_chk_ok_ret(rres_set_params(&qres->rres, approved_Q, param->P));
   qres->params = *param;
+  qres_set_period(qres, param->P);
+  qres_gen_bump(qres->rres.id);
+  trace_qres_set_params(qres->rres.id, param->Q, param->Q_min, param->P);
+  qres_mark_tree(qres);
+
+  /* Children of this server, if any, get scaled along with it */
+  qres_update_bandwidths();
+
+  return QOS_OK;
+}
+
+/** Supervisor state of a server changed by qres_set_params_multi() */
+typedef enum {
+  QRES_TX_UNTOUCHED,	/**< Guarantee unchanged			*/
+  QRES_TX_RELEASED,	/**< Old guarantee given back to the supervisor	*/
+  QRES_TX_REINIT	/**< New guarantee obtained from the supervisor	*/
+} qres_tx_state_t;
+
+/** Saved state of a server changed by qres_set_params_multi() */
+typedef struct qres_tx_entry_t {
+  qres_params_t old_params;	/**< Parameters before the transaction	*/
+#ifdef QRES_ENABLE_QSUP
+  qos_bw_t old_req;		/**< Supervisor request before the transaction */
+#endif
+  qres_tx_state_t state;
+} qres_tx_entry_t;
+
+qos_func_define(qos_rv, qres_set_params_multi, int num, qres_server_t **servers, qres_params_t *params) {
+  qres_tx_entry_t *tx;
+  int i, j;
+  qos_rv rv = QOS_OK;
+
+  if (num <= 0)
+    return QOS_E_INVALID_PARAM;
+  for (i = 0; i < num; ++i) {
+    for (j = 0; j < i; ++j)
+      if (servers[j] == servers[i])
+        return QOS_E_INVALID_PARAM;
+    qos_chk_ok_ret(qres_check_params(servers[i], &params[i]));
+  }
+
+  tx = qos_malloc(num * sizeof(*tx));
+  if (tx == NULL)
+    return QOS_E_NO_MEMORY;
 
+  /* Admission control within sub-reservation trees, on the final state */
+  for (i = 0; i < num; ++i) {
+    tx[i].old_params = servers[i]->params;
+    tx[i].state = QRES_TX_UNTOUCHED;
+#ifdef QRES_ENABLE_QSUP
+    tx[i].old_req = qsup_get_required_bw(&servers[i]->qsup);
+#endif
+    servers[i]->params = params[i];
+    qres_set_period(servers[i], params[i].P);
+  }
+  for (i = 0; i < num; ++i) {
+    rv = qres_check_subtree(servers[i], &params[i]);
+    if (rv != QOS_OK)
+      goto restore_params;
+  }
+
+#ifdef QRES_ENABLE_QSUP
+  qsup_batch_begin();
+  /* Give back all the changing guarantees before asking for the new ones,
+   * so that the outcome does not depend on the order of the changes */
+  for (i = 0; i < num; ++i) {
+    qres_server_t *qres = servers[i];
+    if (qres->parent != NULL)
+      continue;
+    if (params[i].Q_min != tx[i].old_params.Q_min || params[i].P != tx[i].old_params.P) {
+      rv = qsup_cleanup_server(&qres->qsup);
+      if (rv != QOS_OK)
+        goto restore_qsup;
+      tx[i].state = QRES_TX_RELEASED;
+    }
+  }
+  for (i = 0; i < num; ++i) {
+    qres_server_t *qres = servers[i];
+    qres_params_t charged;
+    if (qres->parent != NULL)
+      continue;
+    qres_charged_params(qres, &params[i], &charged);
+    if (tx[i].state == QRES_TX_RELEASED) {
+      rv = qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, &charged);
+      if (rv != QOS_OK)
+        goto restore_qsup;
+      tx[i].state = QRES_TX_REINIT;
+    }
+    rv = qsup_set_required_bw(&qres->qsup, r2bw(charged.Q, charged.P));
+    if (rv != QOS_OK)
+      goto restore_qsup;
+  }
+  qsup_batch_end();
+#endif
+
+  for (i = 0; i < num; ++i) {
+    qres_gen_bump(servers[i]->rres.id);
+    trace_qres_set_params(servers[i]->rres.id, params[i].Q, params[i].Q_min, params[i].P);
+    qres_mark_tree(servers[i]);
+  }
+  qres_update_bandwidths();
+  qos_free(tx);
   return QOS_OK;
+
+#ifdef QRES_ENABLE_QSUP
+ restore_qsup:
+  /* The old guarantees fitted together, so they can all be obtained back */
+  for (i = 0; i < num; ++i)
+    if (tx[i].state == QRES_TX_REINIT)
+      qsup_cleanup_server(&servers[i]->qsup);
+  for (i = 0; i < num; ++i) {
+    qres_server_t *qres = servers[i];
+    qres_params_t old_charged;
+    if (tx[i].state == QRES_TX_UNTOUCHED)
+      continue;
+    qres_charged_params(qres, &tx[i].old_params, &old_charged);
+    if (qsup_init_server(&qres->qsup, qres->owner_uid, qres->owner_gid, &old_charged) != QOS_OK)
+      qos_log_crit("Could not restore the guarantee of a server");
+  }
+  for (i = 0; i < num; ++i)
+    if (servers[i]->parent == NULL)
+      qsup_set_required_bw(&servers[i]->qsup, tx[i].old_req);
+  qsup_batch_end();
+#endif
+ restore_params:
+  for (i = 0; i < num; ++i) {
+    servers[i]->params = tx[i].old_params;
+    qres_set_period(servers[i], tx[i].old_params.P);
+  }
+  qos_free(tx);
+  return rv;
+}
+
+qos_func_define(qos_rv, qres_set_cpu_params, qres_server_t *qres, unsigned int cpu_mask, qres_time_t *Q_cpu) {
+  qos_bw_t cpu_share[QRES_MAX_CPUS];
+  qos_bw_t old_share[QRES_MAX_CPUS];
+  unsigned int old_mask = qres->cpu_mask;
+  qres_params_t param = qres->params;
+  qres_params_t charged, old_charged;
+  qres_time_t Q_tot = 0;
+  int cpu, n = 0;
+  qos_rv rv = QOS_OK;
+
+  if (! authorize_for_server(qres))
+    return QOS_E_UNAUTHORIZED;
+  if (qres->parent != NULL || ! list_empty(&qres->children))
+    return QOS_E_UNIMPLEMENTED;
+
+  for (cpu = 0; cpu < QRES_MAX_CPUS; ++cpu) {
+    cpu_share[cpu] = 0;
+    if (! (cpu_mask & (1u << cpu))) {
+      if (Q_cpu[cpu] != 0)
+        return QOS_E_INVALID_PARAM;
+      continue;
+    }
+    if (cpu >= nr_cpu_ids || ! cpu_online(cpu) || Q_cpu[cpu] > param.P)
+      return QOS_E_INVALID_PARAM;
+    Q_tot += Q_cpu[cpu];
+    ++n;
+  }
+
+  /* Either use the supplied split, or spread the current budget evenly */
+  for (cpu = 0; cpu < QRES_MAX_CPUS; ++cpu)
+    if (cpu_mask & (1u << cpu))
+      cpu_share[cpu] = (Q_tot != 0) ? r2bw(Q_cpu[cpu], Q_tot) : MAX_BW / n;
+  if (Q_tot != 0)
+    param.Q = Q_tot;
+  if (param.Q_min > param.Q)
+    return QOS_E_INVALID_PARAM;
+
+  qres_charged_params(qres, &qres->params, &old_charged);
+  memcpy(old_share, qres->cpu_share, sizeof(old_share));
+  qres->cpu_mask = cpu_mask;
+  memcpy(qres->cpu_share, cpu_share, sizeof(cpu_share));
+  qres_charged_params(qres, &param, &charged);
+  if (charged.Q > param.P) {
+    rv = QOS_E_INVALID_PARAM;
+    goto restore;
+  }
+
+#ifdef QRES_ENABLE_QSUP
+  /* No separate per-CPU admission: the load of each CPU cannot exceed the
+   * sum of the charged bandwidths, that the supervisor keeps within U_LUB */
+  rv = qres_qsup_update(qres, &old_charged, &charged);
+  if (rv != QOS_OK)
+    goto restore;
+#else
+  /* Per-CPU admission, against the bandwidth approved to other servers */
+  for (cpu = 0; cpu < QRES_MAX_CPUS; ++cpu) {
+    qos_bw_t bw = r2bw(qres_cpu_budget(qres, param.Q, cpu_share[cpu]), param.P);
+    if (((cpu_mask == 0 && cpu < nr_cpu_ids && cpu_online(cpu)) || (cpu_mask & (1u << cpu)))
+        && qres_cpu_load(cpu, qres) + bw > U_LUB) {
+      qos_log_debug("Overload on cpu %d", cpu);
+      rv = QOS_E_SYSTEM_OVERLOAD;
+      trace_qres_admission_reject(qres->rres.id, qos_rv_int(rv), "cpu");
+      goto restore;
+    }
+  }
+#endif
+  qres->params = param;
+  qres_gen_bump(qres->rres.id);
+  trace_qres_set_params(qres->rres.id, param.Q, param.Q_min, param.P);
+  qres_mark_tree(qres);
+  qres_update_bandwidths();
+  return QOS_OK;
+
+ restore:
+  qres->cpu_mask = old_mask;
+  memcpy(qres->cpu_share, old_share, sizeof(old_share));
+  return rv;
+}
+
+qos_func_define(qos_rv, qres_get_cpu_params, qres_server_t *qres, unsigned int *p_cpu_mask, qres_time_t *Q_cpu) {
+  int cpu;
+
+  *p_cpu_mask = qres->cpu_mask;
+  for (cpu = 0; cpu < QRES_MAX_CPUS; ++cpu)
+    Q_cpu[cpu] = (qres->cpu_mask & (1u << cpu))
+      ? qres_cpu_budget(qres, qres->params.Q, qres->cpu_share[cpu]) : 0;
+  return QOS_OK;
+}
+
+qos_func_define(qos_rv, qres_set_elasticity, qres_server_t *qres, unsigned int elasticity) {
+#ifdef QRES_ENABLE_QSUP
+  qos_rv rv;
+
+  if (! authorize_for_server(qres))
+    return QOS_E_UNAUTHORIZED;
+  if (qres->parent != NULL)
+    return QOS_E_UNIMPLEMENTED;
+  rv = qsup_set_elasticity(&qres->qsup, elasticity);
+  if (rv != QOS_OK)
+    return rv;
+  qres_update_bandwidths();
+  return QOS_OK;
+#else
+  return QOS_E_UNIMPLEMENTED;
+#endif
+}
+
+qos_func_define(qos_rv, qres_get_elasticity, qres_server_t *qres, unsigned int *p_elasticity) {
+#ifdef QRES_ENABLE_QSUP
+  if (qres->parent != NULL)
+    return QOS_E_UNIMPLEMENTED;
+  *p_elasticity = qsup_get_elasticity(&qres->qsup);
+  return QOS_OK;
+#else
+  return QOS_E_UNIMPLEMENTED;
+#endif
 }
 
 qos_func_define(qos_rv, qres_get_params, qres_server_t *qres, qres_params_t *params) {
@@ -652,7 +1373,13 @@ qos_func_define(qres_time_t, qres_get_appr_budget, qres_server_t *qres) {
 }
 
 qos_func_define(qos_rv, qres_get_deadline, qres_server_t *qres, struct timespec *p_deadline) {
-  return rres_get_deadline(&qres->rres, p_deadline);
+  struct timespec now;
+  s64 origin = timespec_to_ns(&qres->period_origin);
+  u64 P = (u64) qres->rres.period_us * NSEC_PER_USEC;
+
+  ktime_get_ts(&now);
+  *p_deadline = ns_to_timespec(origin + (div64_u64(timespec_to_ns(&now) - origin, P) + 1) * P);
+  return QOS_OK;
 }
 
 qos_func_define(qos_rv, qres_get_exec_abs_time, qres_server_t *qres,
@@ -662,6 +1389,25 @@ qos_func_define(qos_rv, qres_get_exec_abs_time, qres_server_t *qres,
   return QOS_OK;
 }
 
+void qres_get_stat(qres_server_t *qres, qres_server_stat_t *stat) {
+  stat->server_id = qres->rres.id;
+  stat->parent_id = (qres->parent != NULL) ? qres->parent->rres.id : QRES_SID_NULL;
+  stat->uid = qres->owner_uid;
+  stat->gid = qres->owner_gid;
+  stat->params = qres->params;
+  stat->appr_budget = qres_get_appr_budget(qres);
+  stat->curr_budget = qres_get_curr_budget(qres);
+  stat->nr_tasks = (qres->qsup.tg != NULL) ? sched_group_nr_tasks(qres->qsup.tg) : 0;
+  stat->reserved = 0;
+#ifdef QRES_SAMPLES
+  qres_samples_stat(qres, stat);
+#else
+  stat->throttled = 0;
+  stat->consumed = 0;
+  stat->total = 0;
+#endif
+}
+
 /** Return the user id of the owner of the server. */
 kal_uid_t qres_get_owner_uid(qres_server_t* qres) {
   return qres->owner_uid;
@@ -675,13 +1421,19 @@ kal_gid_t qres_get_owner_gid(qres_server_t* qres) {
 EXPORT_SYMBOL_GPL(qres_get_owner_gid);
 
 EXPORT_SYMBOL_GPL(qres_create_server);
+EXPORT_SYMBOL_GPL(qres_create_subserver);
 EXPORT_SYMBOL_GPL(qres_destroy_server);
+EXPORT_SYMBOL_GPL(qres_reap_server);
 EXPORT_SYMBOL_GPL(qres_attach_task);
 EXPORT_SYMBOL_GPL(qres_detach_task);
 EXPORT_SYMBOL_GPL(qres_set_params);
+EXPORT_SYMBOL_GPL(qres_set_params_multi);
 EXPORT_SYMBOL_GPL(qres_get_params);
+EXPORT_SYMBOL_GPL(qres_set_cpu_params);
+EXPORT_SYMBOL_GPL(qres_get_cpu_params);
 //EXPORT_SYMBOL_GPL(qres_get_exec_time);
 EXPORT_SYMBOL_GPL(qres_get_exec_abs_time);
+EXPORT_SYMBOL_GPL(qres_get_stat);
 EXPORT_SYMBOL_GPL(qres_get_deadline);
 
 /* Export protected symbols */
@@ -52,4 +52,54 @@
  **/
 #undef QSUP_DYNAMIC_RECLAIM
 
+/** Enable the watchdog reaping servers left without tasks: non-persistent
+ ** ones are destroyed as soon as the watchdog notices they became empty,
+ ** QOS_F_PERSISTENT ones only after being empty for their timeout.
+ **/
+#define QRES_WATCHDOG
+
+/** Watchdog tick (usec). All expirations falling within the same tick are
+ ** reaped in a single pass, followed by a single bandwidth recomputation.
+ **/
+#define QRES_WATCHDOG_PERIOD 100000L
+
+/** Empty-server timeout (usec) applied to persistent servers created with
+ ** a null timeout, and to servers never hosting any task.
+ **/
+#define QRES_WATCHDOG_DEF_TIMEOUT 10000000L
+
+/** Keep a pool of pre-created, idle scheduling groups, so that creating
+ ** a top-level server does not need to allocate the per-CPU scheduler
+ ** structures of a new group. The pool is refilled asynchronously.
+ **/
+#define QRES_TG_POOL
+
+/** Default number of idle groups kept in the pool (may be overridden
+ ** through the tg_pool_size module parameter, 0 disabling the pool).
+ **/
+#define QRES_TG_POOL_SIZE 8
+
+/** Default number of supervisor levels (may be overridden through the
+ ** levels module parameter, up to QSUP_MAX_LEVELS).
+ **/
+#define QSUP_NUM_LEVELS 2
+
+/** Keep a flight recorder of the last admission decisions of the
+ ** supervisor, retrievable through QSUP_OP_GET_DECISIONS.
+ **/
+#define QSUP_REC
+
+/** Number of decisions kept by the flight recorder for each CPU */
+#define QSUP_REC_SIZE 256
+
+/** Keep, for each server, a ring of per-period execution samples, that
+ ** user-space may map read-only from the QRES device.
+ **/
+#define QRES_SAMPLES
+
+/** Let processes submit operations in batches through shared-memory
+ ** submission and completion queues, see qres_ring_t.
+ **/
+#define QRES_RING
+
 #endif /* __QRES_CONFIG_H__ */
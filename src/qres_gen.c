@@ -0,0 +1,56 @@
+/** @file
+ ** @brief Per-server generation counters, shared read-only with user-space.
+ **
+ ** A single page holds QRES_GEN_SLOTS counters, and each server bumps the
+ ** one at QRES_GEN_SLOT() of its sid whenever its parameters change, as
+ ** well as on its creation and destruction (sids are reused). Processes
+ ** map the page through the QRES device, and may keep using a cached copy
+ ** of the parameters of a server while its counter is unchanged. Servers
+ ** sharing a slot only cause spurious cache misses.
+ **/
+
+#include "rres_config.h"
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qres_gen.h"
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <asm/io.h>
+
+static qres_gen_page_t *qres_gen_page = NULL;
+
+qos_rv qres_gen_init(void) {
+  BUILD_BUG_ON(sizeof(qres_gen_page_t) > PAGE_SIZE);
+  qres_gen_page = (qres_gen_page_t *) get_zeroed_page(GFP_KERNEL);
+  qos_chk_rv(qres_gen_page != NULL, QOS_E_NO_MEMORY);
+  return QOS_OK;
+}
+
+void qres_gen_cleanup(void) {
+  if (qres_gen_page != NULL)
+    free_page((unsigned long) qres_gen_page);
+  qres_gen_page = NULL;
+}
+
+void qres_gen_bump(qres_sid_t sid) {
+  if (qres_gen_page == NULL)
+    return;
+  /* Make the change visible before the counter, see qres_lib.c */
+  smp_wmb();
+  qres_gen_page->gen[QRES_GEN_SLOT(sid)]++;
+}
+
+int qres_gen_mmap(struct file *file, struct vm_area_struct *vma) {
+  if (qres_gen_page == NULL)
+    return -ENODEV;
+  if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+    return -EINVAL;
+  if (vma->vm_flags & VM_WRITE)
+    return -EPERM;
+  vma->vm_flags &= ~VM_MAYWRITE;
+  return remap_pfn_range(vma, vma->vm_start, virt_to_phys(qres_gen_page) >> PAGE_SHIFT,
+                         PAGE_SIZE, vma->vm_page_prot);
+}
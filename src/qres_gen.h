@@ -0,0 +1,36 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Per-server generation counters, shared read-only with user-space.
+ *
+ */
+
+#ifndef _QRES_GEN_H_
+#define _QRES_GEN_H_
+
+#include "qres_config.h"
+#include "qos_types.h"
+#include "qres_gw.h"
+
+struct file;
+struct vm_area_struct;
+
+/** Allocate the page of generation counters */
+qos_rv qres_gen_init(void);
+
+/** Release the page of generation counters */
+void qres_gen_cleanup(void);
+
+/** Signal a change in the parameters of server sid, or its creation or
+ ** destruction, to the processes caching its parameters.
+ **/
+void qres_gen_bump(qres_sid_t sid);
+
+/** Map the page of generation counters read-only into the caller */
+int qres_gen_mmap(struct file *file, struct vm_area_struct *vma);
+
+#endif  //  _QRES_GEN_H_
+
+/** @} */
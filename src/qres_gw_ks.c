@@ -27,6 +27,9 @@
 #include "qos_func.h"
 #include "kal_sched.h"
 
+#include <linux/vmalloc.h>
+
+#include "rres.h"
 #include "rres_ready_queue.h"
 #include "rres_server.h"
 
@@ -73,14 +76,24 @@ static qos_rv find_task(pid_t pid, tid_t tid, struct task_struct **p_ptsk) {
 } while (0)
 
 #define call_sync(func) ({					\
-  kal_irq_state flags;						\
   qos_rv __rv;							\
-/*  kal_spin_lock_irqsave(rres_get_spinlock(), &flags); */  \
+  qres_lock();							\
   __rv = (func);						\
-/*  kal_spin_unlock_irqrestore(rres_get_spinlock(), &flags); */  \
+  qres_unlock();						\
   __rv;								\
 })
 
+qos_func_define(qos_rv, qres_gw_create_subserver, qres_sub_iparams_t *iparams) {
+  qres_server_t *parent;
+
+  if (iparams->parent_id == QRES_SID_NULL)
+    return QOS_E_INVALID_PARAM;
+  parent = qres_find_by_id(iparams->parent_id);
+  if (parent == NULL)
+    return QOS_E_NOT_FOUND;
+  return qres_create_subserver(parent, &iparams->params, &iparams->server_id);
+}
+
 qos_func_define(qos_rv, qres_gw_destroy_server, qres_sid_t sid) {
   qres_server_t *qres = qres_find_by_id(sid);
   if (qres == NULL)
@@ -124,6 +137,46 @@ qos_func_define(qos_rv, qres_gw_set_params, qres_iparams_t *iparams) {
   return qres_set_params(qres, &iparams->params);
 }
 
+qos_func_define(qos_rv, qres_gw_set_params_multi, qres_multi_iparams_t *iparams) {
+  qres_iparams_t *items = NULL;
+  qres_server_t **servers = NULL;
+  qres_params_t *params = NULL;
+  unsigned int i, num = iparams->num;
+  qos_rv rv = QOS_OK;
+
+  if (num == 0 || num > QRES_MAX_MULTI)
+    return QOS_E_INVALID_PARAM;
+  items = qos_malloc(num * sizeof(*items));
+  servers = qos_malloc(num * sizeof(*servers));
+  params = qos_malloc(num * sizeof(*params));
+  if (items == NULL || servers == NULL || params == NULL) {
+    rv = QOS_E_NO_MEMORY;
+    goto err;
+  }
+  if (copy_from_user(items, (void __user *) iparams->p_iparams, num * sizeof(*items))) {
+    rv = QOS_E_INVALID_PARAM;
+    goto err;
+  }
+  for (i = 0; i < num; ++i) {
+    servers[i] = qres_find_by_id(items[i].server_id);
+    if (servers[i] == NULL) {
+      rv = QOS_E_NOT_FOUND;
+      goto err;
+    }
+    params[i] = items[i].params;
+  }
+  rv = qres_set_params_multi(num, servers, params);
+
+ err:
+  if (items != NULL)
+    qos_free(items);
+  if (servers != NULL)
+    qos_free(servers);
+  if (params != NULL)
+    qos_free(params);
+  return rv;
+}
+
 qos_func_define(qos_rv, qres_gw_get_params, qres_iparams_t *iparams) {
   qres_server_t *qres;
 
@@ -133,6 +186,24 @@ qos_func_define(qos_rv, qres_gw_get_params, qres_iparams_t *iparams) {
   return qres_get_params(qres, &iparams->params);
 }
 
+qos_func_define(qos_rv, qres_gw_set_cpu_params, qres_cpu_iparams_t *iparams) {
+  qres_server_t *qres;
+
+  qres = qres_find_by_id(iparams->server_id);
+  if (qres == NULL)
+    return QOS_E_NOT_FOUND;
+  return qres_set_cpu_params(qres, iparams->cpu_mask, iparams->Q_cpu);
+}
+
+qos_func_define(qos_rv, qres_gw_get_cpu_params, qres_cpu_iparams_t *iparams) {
+  qres_server_t *qres;
+
+  qres = qres_find_by_id(iparams->server_id);
+  if (qres == NULL)
+    return QOS_E_NOT_FOUND;
+  return qres_get_cpu_params(qres, &iparams->cpu_mask, iparams->Q_cpu);
+}
+
 /** Get the execution time of the server since its creation.
  *
  * This is the total amount of time for which the tasks attached
@@ -235,6 +306,114 @@ qos_func_define(qos_rv, qres_gw_get_weight, qres_weight_iparams_t *iparams) {
   return QOS_OK;
 }
 
+qos_func_define(qos_rv, qres_gw_set_elasticity, qres_elasticity_iparams_t *iparams) {
+  qres_server_t *qres;
+
+  qres = qres_find_by_id(iparams->server_id);
+  if (qres == NULL)
+    return QOS_E_NOT_FOUND;
+  return qres_set_elasticity(qres, iparams->elasticity);
+}
+
+qos_func_define(qos_rv, qres_gw_get_elasticity, qres_elasticity_iparams_t *iparams) {
+  qres_server_t *qres;
+
+  qres = qres_find_by_id(iparams->server_id);
+  if (qres == NULL)
+    return QOS_E_NOT_FOUND;
+  return qres_get_elasticity(qres, &iparams->elasticity);
+}
+
+/** Fill stats with the states of the first room servers, returning the
+ ** number of existing servers, that may be larger. To be called with
+ ** qres_lock() held.
+ **/
+qos_func_define(unsigned int, qres_gw_snapshot_servers, qres_server_stat_t *stats, unsigned int room) {
+  struct list_head *pos;
+  server_t *srv;
+  unsigned int num = 0;
+
+  for_each_server(srv, pos) {
+    if (num < room)
+      qres_get_stat(qres_find_by_rres(srv), &stats[num]);
+    num++;
+  }
+  return num;
+}
+
+/** Copy the states of the first iparams->num servers to user space,
+ ** setting iparams->num to the number of existing servers, that may be
+ ** larger.
+ **
+ ** The states are a snapshot taken under qres_lock(), that is copied out
+ ** once the lock is released.
+ **/
+static qos_rv qres_gw_list_servers(qres_list_iparams_t *iparams) {
+  qres_server_stat_t *stats = NULL;
+  unsigned int room = 0, num;
+  qos_rv rv = QOS_OK;
+
+  for (;;) {
+    qres_lock();
+    num = qres_gw_snapshot_servers(stats, room);
+    qres_unlock();
+    /* Retry with a larger snapshot if servers were created meanwhile */
+    if (num <= room || room == iparams->num)
+      break;
+    if (stats != NULL)
+      vfree(stats);
+    room = min(num, iparams->num);
+    stats = vmalloc(room * sizeof(qres_server_stat_t));
+    qos_chk_rv(stats != NULL, QOS_E_NO_MEMORY);
+  }
+  if (min(num, room) > 0
+      && copy_to_user((void __user *) iparams->p_stats, stats, min(num, room) * sizeof(qres_server_stat_t)))
+    rv = QOS_E_INVALID_PARAM;
+  if (stats != NULL)
+    vfree(stats);
+  iparams->num = num;
+  return rv;
+}
+
+/** Execute an operation submitted through a ring, whose parameters have
+ ** already been copied into kernel space. Output parameters are left in
+ ** *u, as they would be copied back by qres_gw_ks(). The caller holds
+ ** qres_lock() for the whole batch of operations, see qres_ring_enter().
+ **/
+qos_rv qres_gw_ks_exec(qres_op_t op, qres_ring_args_t *u) {
+  switch (op) {
+  case QRES_OP_DESTROY_SERVER:
+    return qres_gw_destroy_server(u->server_id);
+  case QRES_OP_ATTACH_TO_SERVER:
+    return qres_gw_attach_task(&u->attach_iparams);
+  case QRES_OP_DETACH_FROM_SERVER:
+    return qres_gw_detach_task(&u->attach_iparams);
+  case QRES_OP_SET_PARAMS:
+    return qres_gw_set_params(&u->iparams);
+  case QRES_OP_GET_PARAMS:
+    return qres_gw_get_params(&u->iparams);
+  case QRES_OP_GET_EXEC_TIME:
+    return qres_gw_get_exec_time(&u->time_iparams);
+  case QRES_OP_GET_CURR_BUDGET:
+    return qres_gw_get_curr_budget(&u->time_iparams);
+  case QRES_OP_GET_NEXT_BUDGET:
+    return qres_gw_get_next_budget(&u->time_iparams);
+  case QRES_OP_GET_APPR_BUDGET:
+    return qres_gw_get_appr_budget(&u->time_iparams);
+  case QRES_OP_SET_WEIGHT:
+    return qres_gw_set_weight(&u->weight_iparams);
+  case QRES_OP_GET_WEIGHT:
+    return qres_gw_get_weight(&u->weight_iparams);
+  case QRES_OP_SET_ELASTICITY:
+    return qres_gw_set_elasticity(&u->elasticity_iparams);
+  case QRES_OP_GET_ELASTICITY:
+    return qres_gw_get_elasticity(&u->elasticity_iparams);
+  default:
+    /* Creations, multi-server and per-CPU changes need the ioctl() */
+    return QOS_E_UNIMPLEMENTED;
+  }
+}
+
 /** Main US-to-KS gateway function.
  *
  * Copies parameters from US to KS, checks if requested operation is
@@ -271,10 +450,15 @@ qos_rv qres_gw_ks(qres_op_t op, void __user *up_iparams, unsigned long size) {
   union {
     qres_sid_t server_id;
     qres_iparams_t iparams;
+    qres_multi_iparams_t multi_iparams;
+    qres_sub_iparams_t sub_iparams;
+    qres_cpu_iparams_t cpu_iparams;
     qres_attach_iparams_t attach_iparams;
     qres_time_iparams_t time_iparams;
     qres_timespec_iparams_t timespec_iparams;
     qres_weight_iparams_t weight_iparams;
+    qres_elasticity_iparams_t elasticity_iparams;
+    qres_list_iparams_t list_iparams;
   } u;
   qos_rv err = QOS_OK;
 
@@ -285,6 +469,12 @@ qos_rv qres_gw_ks(qres_op_t op, void __user *up_iparams, unsigned long size) {
     if (err == QOS_OK && copy_to_user(up_iparams, &u.iparams, sizeof(qres_iparams_t)))
       err = QOS_E_INTERNAL_ERROR;
     break;
+  case QRES_OP_CREATE_SUBSERVER:
+    COPY_FROM_USER_TO(up_iparams, size, &u.sub_iparams);
+    err = call_sync(qres_gw_create_subserver(&u.sub_iparams));
+    if (err == QOS_OK && copy_to_user(up_iparams, &u.sub_iparams, sizeof(qres_sub_iparams_t)))
+      err = QOS_E_INTERNAL_ERROR;
+    break;
   case QRES_OP_GET_SERVER_ID:
     COPY_FROM_USER_TO(up_iparams, size, &u.attach_iparams);
     err = call_sync(qres_gw_get_server_id(&u.attach_iparams));
@@ -307,12 +497,26 @@ qos_rv qres_gw_ks(qres_op_t op, void __user *up_iparams, unsigned long size) {
     COPY_FROM_USER_TO(up_iparams, size, &u.iparams);
     err = call_sync(qres_gw_set_params(&u.iparams));
     break;
+  case QRES_OP_SET_PARAMS_MULTI:
+    COPY_FROM_USER_TO(up_iparams, size, &u.multi_iparams);
+    err = call_sync(qres_gw_set_params_multi(&u.multi_iparams));
+    break;
   case QRES_OP_GET_PARAMS:
     COPY_FROM_USER_TO(up_iparams, size, &u.iparams);
     err = call_sync(qres_gw_get_params(&u.iparams));
     if (err == QOS_OK && copy_to_user(up_iparams, &u.iparams, sizeof(qres_iparams_t)))
       err = QOS_E_INTERNAL_ERROR;
     break;
+  case QRES_OP_SET_CPU_PARAMS:
+    COPY_FROM_USER_TO(up_iparams, size, &u.cpu_iparams);
+    err = call_sync(qres_gw_set_cpu_params(&u.cpu_iparams));
+    break;
+  case QRES_OP_GET_CPU_PARAMS:
+    COPY_FROM_USER_TO(up_iparams, size, &u.cpu_iparams);
+    err = call_sync(qres_gw_get_cpu_params(&u.cpu_iparams));
+    if (err == QOS_OK && copy_to_user(up_iparams, &u.cpu_iparams, sizeof(qres_cpu_iparams_t)))
+      err = QOS_E_INTERNAL_ERROR;
+    break;
   case QRES_OP_GET_EXEC_TIME:
     COPY_FROM_USER_TO(up_iparams, size, &u.time_iparams);
     err = call_sync(qres_gw_get_exec_time(&u.time_iparams));
@@ -353,6 +557,23 @@ qos_rv qres_gw_ks(qres_op_t op, void __user *up_iparams, unsigned long size) {
     if (err == QOS_OK && copy_to_user(up_iparams, &u.weight_iparams, sizeof(qres_weight_iparams_t)))
       err = QOS_E_INTERNAL_ERROR;
     break;
+  case QRES_OP_SET_ELASTICITY:
+    COPY_FROM_USER_TO(up_iparams, size, &u.elasticity_iparams);
+    err = call_sync(qres_gw_set_elasticity(&u.elasticity_iparams));
+    break;
+  case QRES_OP_GET_ELASTICITY:
+    COPY_FROM_USER_TO(up_iparams, size, &u.elasticity_iparams);
+    err = call_sync(qres_gw_get_elasticity(&u.elasticity_iparams));
+    if (err == QOS_OK && copy_to_user(up_iparams, &u.elasticity_iparams, sizeof(qres_elasticity_iparams_t)))
+      err = QOS_E_INTERNAL_ERROR;
+    break;
+  case QRES_OP_LIST_SERVERS:
+    COPY_FROM_USER_TO(up_iparams, size, &u.list_iparams);
+    /* Copies to US, so it locks by itself */
+    err = qres_gw_list_servers(&u.list_iparams);
+    if (err == QOS_OK && copy_to_user(up_iparams, &u.list_iparams, sizeof(qres_list_iparams_t)))
+      err = QOS_E_INTERNAL_ERROR;
+    break;
   default:
     qos_log_err("Unhandled operation code");
     err = QOS_E_INTERNAL_ERROR;	/* For debugging purposes */
@@ -33,6 +33,13 @@ qos_rv qres_get_exec_abs_time(qres_server_t *qres, qres_time_t *exec_time, qres_
  */
 qos_rv qres_gw_ks(qres_op_t op, void __user *up_iparams, unsigned long size);
 
+/** Execute an operation submitted through a ring, see qres_ring.c.
+ * To be called with qres_lock() held.
+ *
+ * @return QOS_E_UNIMPLEMENTED for operations only available as ioctl()
+ */
+qos_rv qres_gw_ks_exec(qres_op_t op, qres_ring_args_t *u);
+
 /** @} */
 
 #endif
@@ -25,6 +25,7 @@
 #include "qos_debug.h"
 #include "rres_interface.h"
 #include "rres_kpi_protected.h"
+#include "qres_samples.h"
 
 /** Main QRES Server struct, conceptually extends the RRES Server struct (in a OO fashion).
  **
@@ -44,8 +45,23 @@ typedef struct qres_server {
   qsup_server_t qsup;   /**< Supervisor related info    **/
 #endif
   qres_params_t params; /**< Parameters                 **/
+  qos_recip_t period_recip; /**< Reciprocal of params.P  **/
+  struct timespec period_origin; /**< Start of the periods on CLOCK_MONOTONIC, see qres_get_deadline() **/
   kal_uid_t owner_uid;  /**< UID of this server owner   **/
   kal_gid_t owner_gid;  /**< GID of this server owner   **/
+  qos_bool_t used;      /**< Whether it ever hosted a task **/
+  qos_bool_t empty;     /**< Whether found empty by the watchdog **/
+  kal_time_t empty_since; /**< When it was first found empty **/
+  struct qres_server *parent; /**< Enclosing server, or NULL if top-level **/
+  struct list_head children;  /**< Sub-reservations nested in this server **/
+  struct list_head siblings;  /**< Link within the parent children list **/
+  unsigned int cpu_mask;      /**< CPUs the budget is spread over, 0 for all **/
+  qos_bw_t cpu_share[QRES_MAX_CPUS]; /**< Fraction of the budget for each CPU in cpu_mask **/
+  qos_bool_t reprogram;       /**< Tree to be set by qres_update_bandwidths() **/
+  struct qres_server *reprogram_next; /**< Next tree to be reprogrammed **/
+#ifdef QRES_SAMPLES
+  qres_sampler_t samples;     /**< Per-period execution samples **/
+#endif
 } qres_server_t;
 
 static inline qres_server_t *qres_find_by_rres(server_t *srv) {
@@ -72,6 +88,18 @@ static inline kal_lock_t *qres_get_lock(void) {
   return rres_get_spinlock();
 }
 
+/** Take the mutex serializing all operations on servers and on the
+ ** supervisor, as made through the QRES and QSUP devices, or by the
+ ** watchdog. Operations may sleep, e.g., when the runtime of a group
+ ** changes, so a mutex is used instead of the spinlock above.
+ **
+ ** It is not held while copying from or to user-space.
+ **/
+void qres_lock(void);
+
+/** Release the mutex taken by qres_lock() */
+void qres_unlock(void);
+
 /*
  * The QRES kernel API functions.
  */
@@ -90,19 +118,69 @@ qos_rv qres_create_server(qres_params_t *param, qres_sid_t *p_sid);
 
 qos_rv qres_init_server(qres_server_t *srv, qres_params_t *param);
 
+/** Create a sub-reservation nested within the parent server, with
+ ** the provided parameters.
+ **
+ ** The new server scheduling group is a child of the parent one. The
+ ** sum of the bandwidths requested by all children of a server must
+ ** not exceed the bandwidth requested by the server itself, otherwise
+ ** QOS_E_SYSTEM_OVERLOAD is returned. Sub-reservations are not known
+ ** to the supervisor: if the parent gets less than its requested
+ ** bandwidth, the ones of its children are scaled down in proportion.
+ **
+ ** Return the new server identifier in *p_sid
+ **/
+qos_rv qres_create_subserver(qres_server_t *parent, qres_params_t *param, qres_sid_t *p_sid);
+
 /** Detach all tasks from from the specified server, and destroy
- ** the server
+ ** the server, along with all of its sub-reservations
  **/
 qos_rv qres_destroy_server(qres_server_t *srv);
 
+/** Detach all tasks from the specified server and destroy it, without
+ ** any authorization check nor bandwidth recomputation.
+ **
+ ** Used for garbage-collecting servers nobody is going to destroy
+ ** explicitly, e.g., the ones found empty by the watchdog. Callers
+ ** must call qres_update_bandwidths() afterwards.
+ **/
+qos_rv qres_reap_server(qres_server_t *qres);
+
+/** Return non-zero if no tasks are attached to the server, and no
+ ** sub-reservations are nested therein
+ **/
+qos_bool_t qres_is_empty(qres_server_t *qres);
+
+/** Reprogram the scheduler with the bandwidths approved by the supervisor
+ ** for all servers.
+ **/
+void qres_update_bandwidths(void);
+
+/** Defer the reprogramming of the scheduler, done by each change of
+ ** parameters, until the matching qres_batch_end(). Calls may nest, and
+ ** also batch the supervisor updates, see qsup_batch_begin().
+ **
+ ** The batch is global: it must begin and end within the same
+ ** qres_lock() section, that also protects its nesting depth.
+ **/
+void qres_batch_begin(void);
+
+/** Reprogram the scheduler once, if any server changed since the
+ ** outermost qres_batch_begin().
+ **/
+void qres_batch_end(void);
+
 /** Virtual destructor override **/
 qos_rv _qres_cleanup_server(server_t *srv);
 
 /** Attach to the server identified by srv_id the task identified by tsk */
 qos_rv qres_attach_task(qres_server_t *qres, struct task_struct *tsk);
 
-/** Detach the specified task from its server and, if
- ** no other tasks reside therein, destroy the server.
+/** Detach the specified task from its server and, if no other tasks
+ ** reside therein and the server is not QOS_F_PERSISTENT, destroy it.
+ **
+ ** @return QOS_E_NOT_FOUND, leaving all servers untouched, if tsk is not
+ **         attached to qres
  **/
 qos_rv qres_detach_task(qres_server_t *qres, struct task_struct *tsk);
 
@@ -110,6 +188,50 @@ qos_rv qres_detach_task(qres_server_t *qres, struct task_struct *tsk);
  ** the specified task is attached				*/
 qos_rv qres_set_params(qres_server_t *qres, qres_params_t *param);
 
+/** Change the scheduling parameters of num servers at once, servers[i]
+ ** getting params[i].
+ **
+ ** Admission control is performed once, on the final state resulting
+ ** from all the changes, the supervisor recomputes the approved
+ ** bandwidths once, and the scheduler is reprogrammed once. Either all
+ ** the changes are applied, or none of them is.
+ **/
+qos_rv qres_set_params_multi(int num, qres_server_t **servers, qres_params_t *params);
+
+/** Spread the budget of the server over the CPUs in cpu_mask.
+ **
+ ** If Q_cpu holds any non-null values, then they are the budgets for each
+ ** CPU in cpu_mask, and their sum becomes the server budget. Otherwise, the
+ ** current server budget is evenly spread over the CPUs in cpu_mask. A null
+ ** cpu_mask restores the default behaviour, where the whole budget is
+ ** available on each CPU.
+ **
+ ** Admission is performed on each CPU in cpu_mask, against the budgets
+ ** requested on that CPU by all other top-level servers. The supervisor
+ ** is charged the largest per-CPU budget, thus approved budgets and
+ ** bandwidths returned by this interface are per-CPU ones.
+ **
+ ** @note
+ ** Only top-level servers with no sub-reservations are supported.
+ **/
+qos_rv qres_set_cpu_params(qres_server_t *qres, unsigned int cpu_mask, qres_time_t *Q_cpu);
+
+/** Retrieve the CPUs the server budget is spread over, and the budget
+ ** requested on each of them.
+ **/
+qos_rv qres_get_cpu_params(qres_server_t *qres, unsigned int *p_cpu_mask, qres_time_t *Q_cpu);
+
+/** Set the elasticity of the server, i.e., its share of the compression
+ ** of the level it belongs to, when that is elastic (see qsup_compress_t).
+ **
+ ** Budgets of all servers are reprogrammed with the new approved values.
+ ** Only top-level servers are supported.
+ **/
+qos_rv qres_set_elasticity(qres_server_t *qres, unsigned int elasticity);
+
+/** Retrieve the elasticity of the server */
+qos_rv qres_get_elasticity(qres_server_t *qres, unsigned int *p_elasticity);
+
 /** Get the scheduling parameters of the server attached to
  ** the specified task.
  **
@@ -144,9 +266,18 @@ qres_time_t qres_get_next_budget(qres_server_t *qres);
  **/
 qres_time_t qres_get_appr_budget(qres_server_t *qres);
 
-/** Retrieve the current server deadline */
+/** Retrieve the end of the current period of the server, on
+ ** CLOCK_MONOTONIC. Periods are counted from the creation of the server,
+ ** or from the last change of its period, and are not synchronized with
+ ** the replenishments of the scheduler.
+ **/
 qos_rv qres_get_deadline(qres_server_t *qres, struct timespec *p_deadline);
 
+/** Retrieve at once all the state of the server listed by
+ ** QRES_OP_LIST_SERVERS.
+ **/
+void qres_get_stat(qres_server_t *qres, qres_server_stat_t *stat);
+
 #ifdef QRES_ENABLE_QSUP
 /** Retrieve the qsup_server_t instance attached to a RR server	*/
 static inline qsup_server_t * qres_get_qsup(qres_server_t *qres) {
@@ -14,4 +14,9 @@
 qos_bw_t _qres_get_bandwidth(server_t *srv);
 qos_rv _qres_cleanup_server(server_t *rres);
 
+/** Check whether the current process may operate on the existing server
+ ** qres, as the device operations do.
+ **/
+qos_bool_t authorize_for_server(qres_server_t *qres);
+
 #endif /*QRES_KPI_PROTECTED_H_*/
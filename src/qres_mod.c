@@ -20,10 +20,14 @@
 
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/mm.h>
 #include <asm/uaccess.h>	/* for get_user and put_user */
 #include <asm/processor.h>
 
 #include "qres_gw_ks.h"
+#include "qres_gen.h"
+#include "qres_samples.h"
+#include "qres_ring.h"
 #include "qsup_mod.h"
 
 #include "qos_kernel_dep.h"
@@ -80,6 +84,10 @@ static int device_release(struct inode *inode, struct file *file)
    */
   Device_Open--;
 
+#ifdef QRES_RING
+  qres_ring_release(file);
+#endif
+
   KERN_DECREMENT;
 
   return SUCCESS;
@@ -173,6 +181,16 @@ int device_ioctl(struct inode *inode,	/* see include/linux/fs.h */
 		 unsigned long ioctl_param)
 {
   qos_rv err;
+#ifdef QRES_RING
+  /* Ring operations act on the file, rather than on servers */
+  if (_IOC_NR(ioctl_num) == QRES_OP_RING_SETUP) {
+    err = qres_ring_setup(file);
+    return qos_rv_int(err);
+  } else if (_IOC_NR(ioctl_num) == QRES_OP_RING_ENTER) {
+    /* Number of executed operations, if non-negative */
+    return qres_ring_enter(file);
+  }
+#endif
   /* SUCCESS is zero, error is negative, same as QOS_x error codes	*/
   err = qres_gw_ks(_IOC_NR(ioctl_num), (void *) ioctl_param,
 		   _IOC_SIZE(ioctl_num));
@@ -180,6 +198,24 @@ int device_ioctl(struct inode *inode,	/* see include/linux/fs.h */
   return qos_rv_int(err);
 }
 
+/** Map the page of generation counters at offset 0, or the ring of
+ ** samples of a server at its QRES_SAMPLES_PGOFF(), unless the file
+ ** has been turned into a submission/completion ring
+ **/
+static int device_mmap(struct file *file, struct vm_area_struct *vma) {
+#ifdef QRES_RING
+  if (qres_ring_present(file))
+    return qres_ring_mmap(file, vma);
+#endif
+  if (vma->vm_pgoff == 0)
+    return qres_gen_mmap(file, vma);
+#ifdef QRES_SAMPLES
+  return qres_samples_mmap(file, vma);
+#else
+  return -EINVAL;
+#endif
+}
+
 /* Module Declarations */
 
 /** Handlers for the various operation requests on the device
@@ -194,6 +230,7 @@ struct file_operations Fops = {
 	.read = device_read,
 	.write = device_write,
 	.ioctl = device_ioctl,
+	.mmap = device_mmap,
 	.open = device_open,
 	.release = device_release,	/* a.k.a. close */
 };
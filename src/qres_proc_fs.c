@@ -14,6 +14,7 @@
 #include <stdarg.h>
 
 #include "rres_proc_fs.h"
+#include "qres_tg_pool.h"
 
 extern struct proc_dir_entry proc_root;           /**< pointer to linux proc file-system root */
 
@@ -38,6 +39,25 @@ static int qres_read_modinfo(char *page, char **start, off_t off, int count,
     PROC_PRINT("off\n");
 #endif
 
+  PROC_PRINT("QRES Watchdog\t\t");
+#ifdef QRES_WATCHDOG
+    PROC_PRINT("on (period %ld us)\n", QRES_WATCHDOG_PERIOD);
+#else
+    PROC_PRINT("off\n");
+#endif
+
+  PROC_PRINT("QRES Group Pool\t\t");
+#ifdef QRES_TG_POOL
+  {
+    qres_tg_pool_stat_t stat;
+    qres_tg_pool_get_stat(&stat);
+    PROC_PRINT("on (size %d, available %d, hits %lu, misses %lu, recycled %lu)\n",
+               stat.size, stat.avail, stat.hits, stat.misses, stat.recycled);
+  }
+#else
+    PROC_PRINT("off\n");
+#endif
+
   PROC_PRINT("\n");
   PROC_PRINT_DONE;
 
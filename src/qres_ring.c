@@ -0,0 +1,144 @@
+/** @file
+ ** @brief Shared-memory submission and completion queues of the QRES device.
+ **
+ ** Processes issuing many requests per period, e.g., a feedback controller
+ ** setting the parameters of thousands of servers, may open the device
+ ** once more and turn that file into a ring through QRES_OP_RING_SETUP.
+ ** Its mapping then holds a qres_ring_t, where operations are queued with
+ ** the same payloads as their ioctl(), and executed in a single batch by
+ ** each QRES_OP_RING_ENTER, which posts their completions in order.
+ **
+ ** The scheduler and the supervisor are updated once per batch, see
+ ** qres_batch_begin(), instead of once per operation. Operations reading
+ ** approved budgets first flush the changes queued before them, so that
+ ** results are the same as with one ioctl() per operation.
+ **/
+
+#include "rres_config.h"
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qres_ring.h"
+#include "qres_gw_ks.h"
+#include "qres_interface.h"
+#include "qos_memory.h"
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+
+#ifdef QRES_RING
+
+/** Queues of a device file, pointed to by its private_data */
+typedef struct qres_ring_ctx_t {
+  qres_ring_t *ring;		/**< Shared with the process		*/
+  struct mutex lock;		/**< Serializes QRES_OP_RING_ENTER	*/
+} qres_ring_ctx_t;
+
+#define QRES_RING_MASK (QRES_RING_ENTRIES - 1)
+
+qos_rv qres_ring_setup(struct file *file) {
+  qres_ring_ctx_t *ctx;
+
+  BUILD_BUG_ON(QRES_RING_ENTRIES & QRES_RING_MASK);
+  ctx = qos_create(qres_ring_ctx_t);
+  qos_chk_rv(ctx != NULL, QOS_E_NO_MEMORY);
+  ctx->ring = vmalloc_user(sizeof(qres_ring_t));
+  if (ctx->ring == NULL) {
+    qos_free(ctx);
+    return QOS_E_NO_MEMORY;
+  }
+  mutex_init(&ctx->lock);
+  if (cmpxchg(&file->private_data, NULL, ctx) != NULL) {
+    vfree(ctx->ring);
+    qos_free(ctx);
+    return QOS_E_INCONSISTENT_STATE;
+  }
+  return QOS_OK;
+}
+
+void qres_ring_release(struct file *file) {
+  qres_ring_ctx_t *ctx = file->private_data;
+
+  if (ctx == NULL)
+    return;
+  file->private_data = NULL;
+  vfree(ctx->ring);
+  qos_free(ctx);
+}
+
+qos_bool_t qres_ring_present(struct file *file) {
+  return file->private_data != NULL;
+}
+
+int qres_ring_mmap(struct file *file, struct vm_area_struct *vma) {
+  qres_ring_ctx_t *ctx = file->private_data;
+
+  if (ctx == NULL)
+    return -ENODEV;
+  if (vma->vm_pgoff != 0)
+    return -EINVAL;
+  return remap_vmalloc_range(vma, ctx->ring, 0);
+}
+
+/** Return non-zero if op changes the bandwidths of the servers */
+static inline qos_bool_t qres_ring_op_changes(__u32 op) {
+  return op == QRES_OP_SET_PARAMS || op == QRES_OP_SET_ELASTICITY
+    || op == QRES_OP_DESTROY_SERVER || op == QRES_OP_DETACH_FROM_SERVER;
+}
+
+int qres_ring_enter(struct file *file) {
+  qres_ring_ctx_t *ctx = file->private_data;
+  qres_ring_t *ring;
+  qres_ring_sqe_t sqe;
+  qres_ring_cqe_t *cqe;
+  __u32 sq_head, sq_tail, cq_tail, cq_head;
+  qos_bool_t dirty = 0;
+  int num = 0;
+
+  if (ctx == NULL)
+    return qos_rv_int(QOS_E_INCONSISTENT_STATE);
+  ring = ctx->ring;
+
+  mutex_lock(&ctx->lock);
+  /* Held across the whole batch, that is shared with other processes */
+  qres_lock();
+  sq_head = ring->sq_head;
+  cq_tail = ring->cq_tail;
+  sq_tail = ACCESS_ONCE(ring->sq_tail);
+  cq_head = ACCESS_ONCE(ring->cq_head);
+  /* Read the entries after their tail, see qres_lib.c */
+  smp_rmb();
+
+  qres_batch_begin();
+  while (sq_head != sq_tail && cq_tail - cq_head < QRES_RING_ENTRIES) {
+    /* The process may still scribble over the entry: work on a copy */
+    sqe = ring->sq[sq_head & QRES_RING_MASK];
+    if (dirty && ! qres_ring_op_changes(sqe.op)) {
+      qres_batch_end();
+      qres_batch_begin();
+      dirty = 0;
+    }
+    cqe = &ring->cq[cq_tail & QRES_RING_MASK];
+    cqe->user_data = sqe.user_data;
+    cqe->reserved = 0;
+    cqe->rv = qos_rv_int(qres_gw_ks_exec((qres_op_t) sqe.op, &sqe.u));
+    cqe->u = sqe.u;
+    dirty = dirty || qres_ring_op_changes(sqe.op);
+    ++sq_head;
+    ++cq_tail;
+    ++num;
+  }
+  qres_batch_end();
+
+  /* Make the completions visible before their tail */
+  smp_wmb();
+  ring->sq_head = sq_head;
+  ring->cq_tail = cq_tail;
+  qres_unlock();
+  mutex_unlock(&ctx->lock);
+  return num;
+}
+
+#endif /* QRES_RING */
@@ -0,0 +1,47 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Shared-memory submission and completion queues of the QRES device.
+ *
+ */
+
+#ifndef _QRES_RING_H_
+#define _QRES_RING_H_
+
+#include "qres_config.h"
+#include "qos_types.h"
+#include "qres_gw.h"
+
+struct file;
+struct vm_area_struct;
+
+#ifdef QRES_RING
+
+/** Allocate the queues of the device file, that may then be mapped
+ ** through it instead of the page of generation counters.
+ **/
+qos_rv qres_ring_setup(struct file *file);
+
+/** Release the queues of the device file, if any, on its last close */
+void qres_ring_release(struct file *file);
+
+/** Return non-zero if the device file has its queues */
+qos_bool_t qres_ring_present(struct file *file);
+
+/** Map the queues of the device file read-write into the caller */
+int qres_ring_mmap(struct file *file, struct vm_area_struct *vma);
+
+/** Execute the operations submitted so far to the device file, as long
+ ** as there is room for their completions.
+ **
+ ** @return the number of operations executed, or a negative qos_rv
+ **/
+int qres_ring_enter(struct file *file);
+
+#endif
+
+#endif  //  _QRES_RING_H_
+
+/** @} */
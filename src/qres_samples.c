@@ -0,0 +1,234 @@
+/** @file
+ ** @brief Per-period execution samples of QRES servers, shared read-only
+ ** with user-space.
+ **
+ ** Each server owns a page holding a ring of QRES_SAMPLES_NUM samples,
+ ** and a kal_timer firing at the end of each of its periods, that stores
+ ** into the ring the runtime consumed by the server tasks in the period,
+ ** along with the budget approved for it. Processes map the ring of a
+ ** server through the QRES device, and read the samples without any
+ ** system call, see qres_get_samples() in qres_lib.c.
+ **
+ ** The runtime of a server is the sum of the sum_exec_runtime of the
+ ** tasks attached to its scheduling group, whose real-time runqueues are
+ ** private to the scheduler. For the same reason, the period of the
+ ** samples is not aligned with the replenishments of the scheduler, and a
+ ** period is flagged as throttled when the runtime consumed in it reached
+ ** the approved budget. Runtime consumed by tasks exiting during a period
+ ** is lost, while tasks attached or detached through the QRES interface
+ ** are accounted up to the change, and the sample is flagged.
+ **/
+
+#include "rres_config.h"
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qres_samples.h"
+#include "qres_interface.h"
+#include "qres_kpi_protected.h"
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/sched.h>
+
+#ifdef QRES_SAMPLES
+
+/** Sum of the runtime of the tasks attached to tg (ns) */
+static __u64 qres_samples_runtime(struct task_group *tg) {
+  struct task_struct *tsk;
+  unsigned long flags;
+  __u64 runtime = 0;
+
+  spin_lock_irqsave(&tg->tasks_lock, flags);
+  list_for_each_entry(tsk, &tg->tasks, gtasks)
+    runtime += tsk->se.sum_exec_runtime;
+  spin_unlock_irqrestore(&tg->tasks_lock, flags);
+  return runtime;
+}
+
+/** Runtime consumed since the start of the current period (ns), with
+ ** the tasks currently attached having consumed now in total.
+ **/
+static inline __u64 qres_samples_consumed(qres_sampler_t *s, __u64 now) {
+  /* Tasks exited since base was taken, along with their runtime */
+  if (now < s->base)
+    return s->acc;
+  return s->acc + (now - s->base);
+}
+
+static void qres_samples_handler(kal_arg_t arg) {
+  qres_server_t *qres = (qres_server_t *) kal_arg_voidptr(arg);
+  qres_sampler_t *s = &qres->samples;
+  qres_sample_ring_t *ring = s->ring;
+  qres_sample_t *sample;
+  kal_irq_state flags;
+  kal_time_t now = kal_time_now();
+  __u64 runtime, consumed;
+  qres_time_t budget;
+
+  if (s->stopped)
+    return;
+
+  budget = qres_get_appr_budget(qres);
+  runtime = qres_samples_runtime(qres->qsup.tg);
+
+  kal_spin_lock_irqsave(&s->lock, &flags);
+  /* Once stopped, the ring may be freed as soon as we return */
+  if (s->stopped) {
+    kal_spin_unlock_irqrestore(&s->lock, &flags);
+    return;
+  }
+  consumed = qres_samples_consumed(s, runtime);
+  s->total += consumed;
+
+  sample = &ring->samples[s->slot];
+  sample->start = kal_time2usec(s->start);
+  sample->total = ull_div(s->total, 1000);
+  sample->consumed = (__u32) ull_div(consumed, 1000);
+  sample->budget = (__u32) budget;
+  sample->period = (__u32) kal_time2usec(kal_time_sub(now, s->start));
+  sample->flags = s->flags;
+  if (sample->budget > 0 && sample->consumed >= sample->budget) {
+    sample->flags |= QRES_SAMPLE_F_THROTTLED;
+    s->throttled++;
+  }
+  /* Make the sample visible before the head, see qres_lib.c */
+  smp_wmb();
+  ring->head++;
+  s->slot = (s->slot + 1) % QRES_SAMPLES_NUM;
+
+  s->start = now;
+  s->base = runtime;
+  s->acc = 0;
+  s->flags = 0;
+  /* Re-armed under the lock, so that cleanup cancels the new expiry */
+  kal_timer_forward(&s->timer, kal_usec2time(qres->params.P));
+  kal_spin_unlock_irqrestore(&s->lock, &flags);
+}
+
+qos_rv qres_samples_init(qres_server_t *qres) {
+  qres_sampler_t *s = &qres->samples;
+
+  BUILD_BUG_ON(sizeof(qres_sample_ring_t) > PAGE_SIZE);
+  s->page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+  qos_chk_rv(s->page != NULL, QOS_E_NO_MEMORY);
+  s->ring = (qres_sample_ring_t *) page_address(s->page);
+  s->ring->server_id = qres->rres.id;
+
+  spin_lock_init(&s->lock);
+  s->start = kal_time_now();
+  s->base = qres_samples_runtime(qres->qsup.tg);
+  s->acc = 0;
+  s->total = 0;
+  s->flags = 0;
+  s->throttled = 0;
+  s->slot = 0;
+  s->stopped = 0;
+  kal_timer_init(&s->timer, qres_samples_handler, kal_voidptr_arg(qres));
+  kal_timer_set(&s->timer, kal_time_add(s->start, kal_usec2time(qres->params.P)));
+  return QOS_OK;
+}
+
+void qres_samples_cleanup(qres_server_t *qres) {
+  qres_sampler_t *s = &qres->samples;
+  kal_irq_state flags;
+
+  if (s->page == NULL)
+    return;
+  /* After this, the handler neither touches the ring nor re-arms */
+  kal_spin_lock_irqsave(&s->lock, &flags);
+  s->stopped = 1;
+  kal_spin_unlock_irqrestore(&s->lock, &flags);
+  kal_timer_del_sync(&s->timer);
+  /* Processes still mapping the ring hold their own reference */
+  __free_page(s->page);
+  s->page = NULL;
+  s->ring = NULL;
+}
+
+void qres_samples_tasks_begin(qres_server_t *qres) {
+  qres_sampler_t *s = &qres->samples;
+  kal_irq_state flags;
+  __u64 runtime;
+
+  if (s->page == NULL)
+    return;
+  runtime = qres_samples_runtime(qres->qsup.tg);
+  kal_spin_lock_irqsave(&s->lock, &flags);
+  s->acc = qres_samples_consumed(s, runtime);
+  s->base = runtime;
+  kal_spin_unlock_irqrestore(&s->lock, &flags);
+}
+
+void qres_samples_tasks_end(qres_server_t *qres) {
+  qres_sampler_t *s = &qres->samples;
+  kal_irq_state flags;
+  __u64 runtime;
+
+  if (s->page == NULL)
+    return;
+  runtime = qres_samples_runtime(qres->qsup.tg);
+  kal_spin_lock_irqsave(&s->lock, &flags);
+  s->base = runtime;
+  s->flags |= QRES_SAMPLE_F_TASKS;
+  kal_spin_unlock_irqrestore(&s->lock, &flags);
+}
+
+void qres_samples_stat(qres_server_t *qres, qres_server_stat_t *stat) {
+  qres_sampler_t *s = &qres->samples;
+  qres_sample_t *last;
+  kal_irq_state flags;
+
+  stat->throttled = 0;
+  stat->consumed = 0;
+  stat->total = 0;
+  if (s->page == NULL)
+    return;
+  kal_spin_lock_irqsave(&s->lock, &flags);
+  stat->throttled = s->throttled;
+  stat->total = ull_div(s->total, 1000);
+  if (s->ring->head > 0) {
+    last = &s->ring->samples[(s->slot + QRES_SAMPLES_NUM - 1) % QRES_SAMPLES_NUM];
+    stat->consumed = last->consumed;
+  }
+  kal_spin_unlock_irqrestore(&s->lock, &flags);
+}
+
+int qres_samples_mmap(struct file *file, struct vm_area_struct *vma) {
+  qres_sid_t sid = (qres_sid_t) (vma->vm_pgoff - QRES_SAMPLES_PGOFF(0));
+  server_t *srv;
+  qres_server_t *qres;
+  int rv;
+
+  if (vma->vm_pgoff < QRES_SAMPLES_PGOFF(0) || vma->vm_end - vma->vm_start != PAGE_SIZE)
+    return -EINVAL;
+  if (vma->vm_flags & VM_WRITE)
+    return -EPERM;
+  /* Keeps the server from being reaped meanwhile */
+  qres_lock();
+  /* QRES_SID_NULL would select the server of the caller */
+  srv = rres_find_by_id(sid);
+  if (srv == NULL || srv->id != sid) {
+    rv = -ENOENT;
+    goto out;
+  }
+  qres = qres_find_by_rres(srv);
+  /* The same check as the device operations on the server */
+  if (! authorize_for_server(qres)) {
+    rv = -EPERM;
+    goto out;
+  }
+  if (qres->samples.page == NULL) {
+    rv = -ENODEV;
+    goto out;
+  }
+  vma->vm_flags &= ~VM_MAYWRITE;
+  /* Takes a reference to the page, that outlives the server if needed */
+  rv = vm_insert_page(vma, vma->vm_start, qres->samples.page);
+ out:
+  qres_unlock();
+  return rv;
+}
+
+#endif /* QRES_SAMPLES */
@@ -0,0 +1,83 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Per-period execution samples of QRES servers, shared read-only
+ * with user-space.
+ *
+ */
+
+#ifndef _QRES_SAMPLES_H_
+#define _QRES_SAMPLES_H_
+
+#include "qres_config.h"
+#include "qos_types.h"
+#include "qres_gw.h"
+#include "kal_sched.h"
+#include "kal_timer.h"
+
+struct file;
+struct page;
+struct vm_area_struct;
+struct qres_server;
+
+#ifdef QRES_SAMPLES
+
+/** Sampling state of a server, embedded in qres_server_t */
+typedef struct qres_sampler_t {
+  struct page *page;		/**< Page holding the ring, NULL if none	*/
+  qres_sample_ring_t *ring;	/**< Kernel address of the page		*/
+  kal_lock_t lock;		/**< Serializes the timer and task changes	*/
+  kal_timer_t timer;		/**< Fires at the end of each period		*/
+  volatile qos_bool_t stopped;	/**< Set under lock once the ring is going	*/
+  kal_time_t start;		/**< Start of the current period		*/
+  __u64 base;			/**< Runtime of the tasks at start, or at
+				     the last change of the tasks (ns)	*/
+  __u64 acc;			/**< Runtime accumulated before the last
+				     change of the tasks (ns)		*/
+  __u64 total;			/**< Runtime over all past periods (ns)	*/
+  __u32 flags;			/**< Flags of the current period		*/
+  __u32 throttled;		/**< Periods flagged as throttled so far	*/
+  unsigned int slot;		/**< Slot of the next sample: the 64-bit
+				     head modulo QRES_SAMPLES_NUM, kept
+				     apart to spare 32-bit kernels the
+				     64-bit division			*/
+} qres_sampler_t;
+
+/** Allocate the ring of samples of qres, and start sampling it. To be
+ ** called once its scheduling group and its sid are set.
+ **/
+qos_rv qres_samples_init(struct qres_server *qres);
+
+/** Stop sampling qres, waiting for a running handler, and drop the
+ ** reference to its ring, that is freed once unmapped by all processes.
+ ** To be called before the scheduling group of qres is released.
+ **/
+void qres_samples_cleanup(struct qres_server *qres);
+
+/** Account the runtime consumed so far in the current period, before a
+ ** task joins or leaves qres.
+ **/
+void qres_samples_tasks_begin(struct qres_server *qres);
+
+/** Restart accounting from the runtime of the tasks of qres, after one
+ ** of them joined or left.
+ **/
+void qres_samples_tasks_end(struct qres_server *qres);
+
+/** Fill in the fields of *stat taken from the samples of qres, i.e.,
+ ** throttled, consumed and total, or zero them if qres is not sampled.
+ **/
+void qres_samples_stat(struct qres_server *qres, qres_server_stat_t *stat);
+
+/** Map the ring of samples of the server at the page offset, as given by
+ ** QRES_SAMPLES_PGOFF(), read-only into the caller.
+ **/
+int qres_samples_mmap(struct file *file, struct vm_area_struct *vma);
+
+#endif
+
+#endif  //  _QRES_SAMPLES_H_
+
+/** @} */
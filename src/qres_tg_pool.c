@@ -0,0 +1,181 @@
+/** @file
+ ** @brief Pool of pre-created scheduling groups for QRES servers.
+ **
+ ** sched_create_group() allocates the per-CPU runqueues and scheduling
+ ** entities of the new group for all possible CPUs, and the group
+ ** destruction frees all of them again, so that the creation of short
+ ** lived servers is dominated by this allocation churn on machines with
+ ** many CPUs.
+ **
+ ** The pool keeps up to tg_pool_size idle children of init_task_group,
+ ** with a null runtime. Servers take their group from the pool, falling
+ ** back to sched_create_group() when it is empty, and give it back on
+ ** destruction, after it has been emptied and its runtime reset. The
+ ** pool is refilled from a workqueue, outside of the creation path.
+ ** Servers are destroyed in process context, with qres_lock() held, so
+ ** that the runtime may be reset there.
+ **/
+
+#include "rres_config.h"
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qres_tg_pool.h"
+#include "qos_memory.h"
+#include "kal_sched.h"
+#include <linux/module.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+
+#ifdef QRES_TG_POOL
+
+static int tg_pool_size = QRES_TG_POOL_SIZE;
+module_param(tg_pool_size, int, S_IRUGO);
+MODULE_PARM_DESC(tg_pool_size, "Number of idle scheduling groups kept ready for new servers");
+
+kal_lock_define(qres_tg_pool_lock);
+static struct task_group **qres_tg_pool;        /**< Idle groups      */
+static int qres_tg_pool_avail = 0;              /**< Used pool slots  */
+static qos_bool_t qres_tg_pool_stopped = 1;
+static unsigned long qres_tg_pool_hits = 0;
+static unsigned long qres_tg_pool_misses = 0;
+static unsigned long qres_tg_pool_recycled = 0;
+
+static void qres_tg_pool_refill(struct work_struct *work);
+static DECLARE_WORK(qres_tg_pool_work, qres_tg_pool_refill);
+
+/** Push tg into the pool, unless it is full or stopped.
+ **
+ ** @return non-zero if tg has been taken by the pool
+ **/
+static qos_bool_t qres_tg_pool_push(struct task_group *tg) {
+  kal_irq_state flags;
+  qos_bool_t pushed = 0;
+
+  kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+  if (! qres_tg_pool_stopped && qres_tg_pool_avail < tg_pool_size) {
+    qres_tg_pool[qres_tg_pool_avail++] = tg;
+    pushed = 1;
+  }
+  kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+  return pushed;
+}
+
+/** Workqueue handler, creating groups until the pool is full */
+static void qres_tg_pool_refill(struct work_struct *work) {
+  struct task_group *tg;
+  kal_irq_state flags;
+  qos_bool_t full;
+
+  for (;;) {
+    kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+    full = qres_tg_pool_stopped || qres_tg_pool_avail >= tg_pool_size;
+    kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+    if (full)
+      break;
+
+    tg = sched_create_group(&init_task_group);
+    if (IS_ERR(tg)) {
+      qos_log_err("Could not refill the scheduling group pool");
+      break;
+    }
+    if (! qres_tg_pool_push(tg)) {
+      sched_group_put(tg);
+      break;
+    }
+  }
+}
+
+struct task_group *qres_tg_pool_get(struct task_group *parent) {
+  struct task_group *tg = NULL;
+  kal_irq_state flags;
+  qos_bool_t stopped;
+
+  if (parent != &init_task_group)
+    return sched_create_group(parent);
+
+  /* A stopped pool is being drained by qres_tg_pool_cleanup() */
+  kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+  stopped = qres_tg_pool_stopped;
+  if (! stopped && qres_tg_pool_avail > 0) {
+    tg = qres_tg_pool[--qres_tg_pool_avail];
+    ++qres_tg_pool_hits;
+  } else
+    ++qres_tg_pool_misses;
+  kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+
+  if (! stopped)
+    schedule_work(&qres_tg_pool_work);
+
+  if (tg == NULL)
+    tg = sched_create_group(parent);
+  return tg;
+}
+
+void qres_tg_pool_put(struct task_group *tg) {
+  kal_irq_state flags;
+
+  /* Groups still referenced (e.g., by exiting tasks) cannot be reused.
+   * Resetting the runtime takes rt_constraints_mutex, so groups released
+   * in atomic context are not recycled either. */
+  if (! kal_atomic()
+      && tg->parent == &init_task_group && sched_group_nr_tasks(tg) == 0
+      && atomic_read(&tg->refcount) == 1) {
+    sched_group_set_empty_notify(tg, NULL);
+    if (sched_group_set_rt_runtime(tg, 1, 0) == 0
+        && sched_group_set_rt_runtime(tg, 0, 0) == 0
+        && qres_tg_pool_push(tg)) {
+      kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+      ++qres_tg_pool_recycled;
+      kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+      return;
+    }
+  }
+  sched_group_put(tg);
+}
+
+void qres_tg_pool_get_stat(qres_tg_pool_stat_t *p_stat) {
+  kal_irq_state flags;
+
+  kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+  p_stat->size = tg_pool_size;
+  p_stat->avail = qres_tg_pool_avail;
+  p_stat->hits = qres_tg_pool_hits;
+  p_stat->misses = qres_tg_pool_misses;
+  p_stat->recycled = qres_tg_pool_recycled;
+  kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+}
+
+qos_rv qres_tg_pool_init(void) {
+  if (tg_pool_size < 0)
+    tg_pool_size = 0;
+  qos_log_debug("Starting scheduling group pool with %d groups", tg_pool_size);
+  if (tg_pool_size > 0) {
+    qres_tg_pool = qos_malloc(tg_pool_size * sizeof(*qres_tg_pool));
+    qos_chk_rv(qres_tg_pool != NULL, QOS_E_NO_MEMORY);
+  }
+  qres_tg_pool_avail = 0;
+  qres_tg_pool_stopped = 0;
+  if (tg_pool_size > 0)
+    schedule_work(&qres_tg_pool_work);
+  return QOS_OK;
+}
+
+void qres_tg_pool_cleanup(void) {
+  kal_irq_state flags;
+
+  kal_spin_lock_irqsave(&qres_tg_pool_lock, &flags);
+  qres_tg_pool_stopped = 1;
+  kal_spin_unlock_irqrestore(&qres_tg_pool_lock, &flags);
+  cancel_work_sync(&qres_tg_pool_work);
+
+  /* No more concurrent users of the pool from here on */
+  while (qres_tg_pool_avail > 0)
+    sched_group_put(qres_tg_pool[--qres_tg_pool_avail]);
+  if (qres_tg_pool != NULL)
+    qos_free(qres_tg_pool);
+  qres_tg_pool = NULL;
+}
+
+#endif /* QRES_TG_POOL */
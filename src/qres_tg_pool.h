@@ -0,0 +1,61 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Pool of pre-created scheduling groups for QRES servers.
+ *
+ */
+
+#ifndef _QRES_TG_POOL_H_
+#define _QRES_TG_POOL_H_
+
+#include "qres_config.h"
+#include "qos_types.h"
+
+struct task_group;
+
+#ifdef QRES_TG_POOL
+
+/** Pool usage statistics, as shown in /proc */
+typedef struct qres_tg_pool_stat_t {
+  int size;                     /**< Configured number of idle groups */
+  int avail;                    /**< Idle groups currently in the pool */
+  unsigned long hits;           /**< Groups served from the pool */
+  unsigned long misses;         /**< Groups created on the spot */
+  unsigned long recycled;       /**< Groups given back to the pool */
+} qres_tg_pool_stat_t;
+
+/** Fill the pool up to its configured size */
+qos_rv qres_tg_pool_init(void);
+
+/** Stop refilling the pool, and destroy all idle groups */
+void qres_tg_pool_cleanup(void);
+
+/** Return an idle scheduling group child of parent, taken from the pool
+ ** if possible, or freshly created otherwise.
+ **
+ ** Only children of init_task_group are pooled.
+ **
+ ** @return the group, or an ERR_PTR() as sched_create_group() does
+ **/
+struct task_group *qres_tg_pool_get(struct task_group *parent);
+
+/** Release the caller reference to a group no more used by a server.
+ **
+ ** If no tasks are left in the group, nor references to it other than the
+ ** caller's one, then its runtime is reset and it is given back to the
+ ** pool, provided the pool is not full. Otherwise, it is just released.
+ ** Resetting the runtime may sleep, so groups released in atomic context
+ ** are never given back to the pool.
+ **/
+void qres_tg_pool_put(struct task_group *tg);
+
+/** Retrieve pool statistics */
+void qres_tg_pool_get_stat(qres_tg_pool_stat_t *p_stat);
+
+#endif
+
+#endif  //  _QRES_TG_POOL_H_
+
+/** @} */
@@ -0,0 +1,8 @@
+/** @file
+ ** @brief Instantiation of the tracepoints declared in qres_trace.h.
+ **/
+
+#include "qres_config.h"
+
+#define CREATE_TRACE_POINTS
+#include "qres_trace.h"
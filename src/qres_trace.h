@@ -0,0 +1,310 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Static tracepoints of the QRES and QSUP modules.
+ *
+ * Reservation lifecycle, admission and supervisor events, exported
+ * through ftrace and perf under the aquosa subsystem, e.g.:
+ *
+ * @code
+ *   echo 1 > /sys/kernel/debug/tracing/events/aquosa/enable
+ *   perf record -e 'aquosa:*' -a
+ * @endcode
+ *
+ * Tracepoints cost a not-taken branch when disabled, so that they may
+ * be left in hot paths, where qos_log_debug() would flood the log.
+ * In user-space builds (e.g., of the qsup tests) they expand to
+ * nothing.
+ */
+
+#ifndef QOS_KS
+
+#ifndef _QRES_TRACE_H_
+#define _QRES_TRACE_H_
+
+#define trace_qres_server_create(sid, parent_sid, Q, Q_min, P, flags) do { } while (0)
+#define trace_qres_server_destroy(sid) do { } while (0)
+#define trace_qres_task_attach(sid, pid, rv) do { } while (0)
+#define trace_qres_task_detach(sid, pid, rv) do { } while (0)
+#define trace_qres_set_params(sid, Q, Q_min, P) do { } while (0)
+#define trace_qres_admission_reject(sid, rv, reason) do { } while (0)
+#define trace_qres_sched_budget(sid, period, budget, tasks_budget) do { } while (0)
+#define trace_qsup_set_required_bw(sid, req, user_req, level_req) do { } while (0)
+#define trace_qsup_user_coeff(uid, user_req, user_gua, coeff) do { } while (0)
+#define trace_qsup_level_coeff(level, level_req, level_gua, level_sum, coeff) do { } while (0)
+#define trace_qsup_reject(uid, gid, min_bw, rv, reason) do { } while (0)
+
+#endif /* _QRES_TRACE_H_ */
+
+#else
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM aquosa
+
+#if !defined(_QRES_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _QRES_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(qres_server_create,
+
+	TP_PROTO(int sid, int parent_sid, long Q, long Q_min, long P, int flags),
+
+	TP_ARGS(sid, parent_sid, Q, Q_min, P, flags),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(int, parent_sid)
+		__field(long, Q)
+		__field(long, Q_min)
+		__field(long, P)
+		__field(int, flags)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->parent_sid = parent_sid;
+		__entry->Q = Q;
+		__entry->Q_min = Q_min;
+		__entry->P = P;
+		__entry->flags = flags;
+	),
+
+	TP_printk("sid=%d parent=%d Q=%ld Q_min=%ld P=%ld flags=0x%x",
+		  __entry->sid, __entry->parent_sid, __entry->Q,
+		  __entry->Q_min, __entry->P, __entry->flags)
+);
+
+TRACE_EVENT(qres_server_destroy,
+
+	TP_PROTO(int sid),
+
+	TP_ARGS(sid),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+	),
+
+	TP_printk("sid=%d", __entry->sid)
+);
+
+DECLARE_EVENT_CLASS(qres_task,
+
+	TP_PROTO(int sid, pid_t pid, int rv),
+
+	TP_ARGS(sid, pid, rv),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(pid_t, pid)
+		__field(int, rv)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->pid = pid;
+		__entry->rv = rv;
+	),
+
+	TP_printk("sid=%d pid=%d rv=%d", __entry->sid, __entry->pid, __entry->rv)
+);
+
+DEFINE_EVENT(qres_task, qres_task_attach,
+	TP_PROTO(int sid, pid_t pid, int rv),
+	TP_ARGS(sid, pid, rv)
+);
+
+DEFINE_EVENT(qres_task, qres_task_detach,
+	TP_PROTO(int sid, pid_t pid, int rv),
+	TP_ARGS(sid, pid, rv)
+);
+
+TRACE_EVENT(qres_set_params,
+
+	TP_PROTO(int sid, long Q, long Q_min, long P),
+
+	TP_ARGS(sid, Q, Q_min, P),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(long, Q)
+		__field(long, Q_min)
+		__field(long, P)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->Q = Q;
+		__entry->Q_min = Q_min;
+		__entry->P = P;
+	),
+
+	TP_printk("sid=%d Q=%ld Q_min=%ld P=%ld",
+		  __entry->sid, __entry->Q, __entry->Q_min, __entry->P)
+);
+
+TRACE_EVENT(qres_admission_reject,
+
+	TP_PROTO(int sid, int rv, const char *reason),
+
+	TP_ARGS(sid, rv, reason),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(int, rv)
+		__string(reason, reason)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->rv = rv;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("sid=%d rv=%d reason=%s", __entry->sid, __entry->rv, __get_str(reason))
+);
+
+TRACE_EVENT(qres_sched_budget,
+
+	TP_PROTO(int sid, long period, long budget, long tasks_budget),
+
+	TP_ARGS(sid, period, budget, tasks_budget),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(long, period)
+		__field(long, budget)
+		__field(long, tasks_budget)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->period = period;
+		__entry->budget = budget;
+		__entry->tasks_budget = tasks_budget;
+	),
+
+	TP_printk("sid=%d period=%ld budget=%ld tasks_budget=%ld",
+		  __entry->sid, __entry->period, __entry->budget, __entry->tasks_budget)
+);
+
+TRACE_EVENT(qsup_set_required_bw,
+
+	TP_PROTO(int sid, u64 req, u64 user_req, u64 level_req),
+
+	TP_ARGS(sid, req, user_req, level_req),
+
+	TP_STRUCT__entry(
+		__field(int, sid)
+		__field(u64, req)
+		__field(u64, user_req)
+		__field(u64, level_req)
+	),
+
+	TP_fast_assign(
+		__entry->sid = sid;
+		__entry->req = req;
+		__entry->user_req = user_req;
+		__entry->level_req = level_req;
+	),
+
+	TP_printk("sid=%d req=%llu user_req=%llu level_req=%llu",
+		  __entry->sid, __entry->req, __entry->user_req, __entry->level_req)
+);
+
+TRACE_EVENT(qsup_user_coeff,
+
+	TP_PROTO(int uid, u64 user_req, u64 user_gua, u64 coeff),
+
+	TP_ARGS(uid, user_req, user_gua, coeff),
+
+	TP_STRUCT__entry(
+		__field(int, uid)
+		__field(u64, user_req)
+		__field(u64, user_gua)
+		__field(u64, coeff)
+	),
+
+	TP_fast_assign(
+		__entry->uid = uid;
+		__entry->user_req = user_req;
+		__entry->user_gua = user_gua;
+		__entry->coeff = coeff;
+	),
+
+	TP_printk("uid=%d user_req=%llu user_gua=%llu coeff=%llu",
+		  __entry->uid, __entry->user_req, __entry->user_gua, __entry->coeff)
+);
+
+TRACE_EVENT(qsup_level_coeff,
+
+	TP_PROTO(int level, u64 level_req, u64 level_gua, u64 level_sum, u64 coeff),
+
+	TP_ARGS(level, level_req, level_gua, level_sum, coeff),
+
+	TP_STRUCT__entry(
+		__field(int, level)
+		__field(u64, level_req)
+		__field(u64, level_gua)
+		__field(u64, level_sum)
+		__field(u64, coeff)
+	),
+
+	TP_fast_assign(
+		__entry->level = level;
+		__entry->level_req = level_req;
+		__entry->level_gua = level_gua;
+		__entry->level_sum = level_sum;
+		__entry->coeff = coeff;
+	),
+
+	TP_printk("level=%d req=%llu gua=%llu sum=%llu coeff=%llu",
+		  __entry->level, __entry->level_req, __entry->level_gua,
+		  __entry->level_sum, __entry->coeff)
+);
+
+TRACE_EVENT(qsup_reject,
+
+	TP_PROTO(int uid, int gid, u64 min_bw, int rv, const char *reason),
+
+	TP_ARGS(uid, gid, min_bw, rv, reason),
+
+	TP_STRUCT__entry(
+		__field(int, uid)
+		__field(int, gid)
+		__field(u64, min_bw)
+		__field(int, rv)
+		__string(reason, reason)
+	),
+
+	TP_fast_assign(
+		__entry->uid = uid;
+		__entry->gid = gid;
+		__entry->min_bw = min_bw;
+		__entry->rv = rv;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("uid=%d gid=%d min_bw=%llu rv=%d reason=%s",
+		  __entry->uid, __entry->gid, __entry->min_bw, __entry->rv,
+		  __get_str(reason))
+);
+
+#endif /* _QRES_TRACE_H_ */
+
+/* This part must be outside the multi-read protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE qres_trace
+#include <trace/define_trace.h>
+
+#endif /* QOS_KS */
+
+/** @} */
@@ -0,0 +1,136 @@
+/** @file
+ ** @brief Watchdog garbage-collecting empty QRES servers.
+ **
+ ** A single kal_timer fires every QRES_WATCHDOG_PERIOD usecs and has
+ ** the server set scanned, so that all expirations falling within the
+ ** same tick are handled in one pass, with one bandwidth recomputation
+ ** overall. Destroying servers may sleep, so the scan is done by a work
+ ** item, in process context and under qres_lock(), as device operations
+ ** are. The scan is skipped when no group became empty since the last
+ ** tick (as notified by the scheduler) and no empty server is waiting
+ ** for its timeout to elapse.
+ **
+ ** A server is reaped when no tasks are attached to it and:
+ ** <ul>
+ **   <li>it is not QOS_F_PERSISTENT and it hosted at least one task
+ **       (e.g., its last task exited without detaching);
+ **   <li>it is QOS_F_PERSISTENT and it has been empty for longer than
+ **       its timeout parameter (QRES_WATCHDOG_DEF_TIMEOUT if null),
+ **       whether or not it ever hosted a task.
+ ** </ul>
+ ** A non-persistent server that never hosted any task is left alone, as
+ ** its creator may attach to it at any later time.
+ **/
+
+#include "rres_config.h"
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qres_watchdog.h"
+#include "qres_interface.h"
+#include "rres.h"
+#include "kal_timer.h"
+#include <asm/atomic.h>
+#include <linux/workqueue.h>
+
+#ifdef QRES_WATCHDOG
+
+static kal_timer_t qres_watchdog_timer;
+static volatile qos_bool_t qres_watchdog_stopped = 1;
+static atomic_t qres_watchdog_kicked = ATOMIC_INIT(0);
+static int qres_watchdog_waiting = 0;  /**< Empty servers not reaped yet */
+
+static void qres_watchdog_work_fn(struct work_struct *work);
+static DECLARE_WORK(qres_watchdog_work, qres_watchdog_work_fn);
+
+/** Return non-zero if the empty server qres may be destroyed at time now */
+static qos_bool_t qres_watchdog_expired(qres_server_t *qres, kal_time_t now) {
+  qres_time_t timeout = QRES_WATCHDOG_DEF_TIMEOUT;
+
+  if (! (qres->params.flags & QOS_F_PERSISTENT))
+    return qres->used;
+  if (! qres->empty) {
+    qres->empty = 1;
+    qres->empty_since = now;
+  }
+  if (qres->params.timeout != 0)
+    timeout = qres->params.timeout;
+  return kal_time_le(kal_time_add(qres->empty_since, kal_usec2time(timeout)), now);
+}
+
+int qres_watchdog_reap(void) {
+  struct list_head *pos, *tmp;
+  server_t *srv;
+  kal_time_t now = kal_time_now();
+  int reaped = 0;
+
+  if (atomic_xchg(&qres_watchdog_kicked, 0) == 0 && qres_watchdog_waiting == 0)
+    return 0;
+
+  qres_watchdog_waiting = 0;
+  for_each_server_safe(srv, pos, tmp) {
+    qres_server_t *qres = qres_find_by_rres(srv);
+    if (! qres_is_empty(qres)) {
+      qres->empty = 0;
+      continue;
+    }
+    if (! qres_watchdog_expired(qres, now)) {
+      /* Only persistent servers have a timeout to wait for */
+      if (qres->params.flags & QOS_F_PERSISTENT)
+        ++qres_watchdog_waiting;
+      continue;
+    }
+    qos_log_debug("Watchdog reaping empty server %d", srv->id);
+    if (qres_reap_server(qres) != QOS_OK)
+      qos_log_err("Could not reap empty server %d", srv->id);
+    else
+      ++reaped;
+  }
+
+  /* Give the reaped bandwidth back to the surviving servers at once */
+  if (reaped > 0)
+    qres_update_bandwidths();
+
+  return reaped;
+}
+
+void qres_watchdog_kick(void) {
+  atomic_set(&qres_watchdog_kicked, 1);
+}
+
+void qres_watchdog_empty_notify(struct task_group *tg) {
+  qres_watchdog_kick();
+}
+
+static void qres_watchdog_work_fn(struct work_struct *work) {
+  qres_lock();
+  qres_watchdog_reap();
+  qres_unlock();
+}
+
+static void qres_watchdog_handler(kal_arg_t arg) {
+  if (qres_watchdog_stopped)
+    return;
+  /* A mere hint: the work item checks both again under the lock */
+  if (atomic_read(&qres_watchdog_kicked) || qres_watchdog_waiting)
+    schedule_work(&qres_watchdog_work);
+  kal_timer_forward(&qres_watchdog_timer, kal_usec2time(QRES_WATCHDOG_PERIOD));
+}
+
+qos_rv qres_watchdog_init(void) {
+  qos_log_debug("Starting watchdog with period %ld us", QRES_WATCHDOG_PERIOD);
+  qres_watchdog_stopped = 0;
+  kal_timer_init(&qres_watchdog_timer, qres_watchdog_handler, kal_voidptr_arg(NULL));
+  kal_timer_set(&qres_watchdog_timer,
+                kal_time_add(kal_time_now(), kal_usec2time(QRES_WATCHDOG_PERIOD)));
+  return QOS_OK;
+}
+
+void qres_watchdog_cleanup(void) {
+  qres_watchdog_stopped = 1;
+  /* The handler does not re-arm the timer, nor queue the work, anymore */
+  kal_timer_del_sync(&qres_watchdog_timer);
+  cancel_work_sync(&qres_watchdog_work);
+}
+
+#endif /* QRES_WATCHDOG */
@@ -0,0 +1,50 @@
+/** @addtogroup QRES_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Watchdog garbage-collecting empty QRES servers.
+ *
+ */
+
+#ifndef _QRES_WATCHDOG_H_
+#define _QRES_WATCHDOG_H_
+
+#include "qres_config.h"
+#include "qos_types.h"
+
+struct task_group;
+
+#ifdef QRES_WATCHDOG
+
+/** Start the periodic watchdog timer */
+qos_rv qres_watchdog_init(void);
+
+/** Stop the watchdog timer, leaving all servers in place. Not to be
+ ** called with qres_lock() held, as it waits for a running scan.
+ **/
+void qres_watchdog_cleanup(void);
+
+/** Reap all the empty servers whose timeout has elapsed, then recompute
+ ** bandwidths once if any server has been destroyed. To be called in
+ ** process context, with qres_lock() held.
+ **
+ ** @return the number of servers destroyed
+ **/
+int qres_watchdog_reap(void);
+
+/** Have the watchdog scan all servers at its next tick.
+ **
+ ** Ticks with no kicks skip the scan, unless some empty server is
+ ** still waiting for its timeout.
+ **/
+void qres_watchdog_kick(void);
+
+/** Hook called by the scheduler when the last task leaves a group */
+void qres_watchdog_empty_notify(struct task_group *tg);
+
+#endif
+
+#endif  //  _QRES_WATCHDOG_H_
+
+/** @} */
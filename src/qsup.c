@@ -11,6 +11,9 @@
 
 #include "qos_memory.h"
 #include "qos_ul.h"
+#include "qres_trace.h"
+#include "qsup_rec.h"
+#include "qsup_rules.h"
 
 /** @addtogroup QSUP
  * @{
@@ -29,24 +32,14 @@
  *		one time for each RR-enabled processor, for SMP systems.
  */
 
-qsup_group_rule_t *group_rules = 0;
-int num_group_rules = 0;
-
-qsup_user_rule_t *user_rules = 0;
-int num_user_rules = 0;
-
 qos_bw_t spare_bw = 0;
 
-/** Bandwidth coefficients are stored as fixed-point integers.	*/
-typedef long int qsup_coeff_t;
-
-/** Number of binary decimal digits in qsup_coeff_t	*/
-#define QSUP_COEFF_BITS 16
+#ifndef QOS_BW_WIDE
 
 /** This corresponds to a qsup_coeff_t of 1.0		*/
 #define QSUP_COEFF_ONE (1ul << QSUP_COEFF_BITS)
 
-/** Scale (multiply) a bandwidth value by a coefficient	*/
+/** Scale (multiply) a bandwidth value a by a coefficient b	*/
 //#define coeff_apply(a, b) ( ((a) * (b)) >> QSUP_COEFF_BITS )
 #define coeff_apply(a, b) ((unsigned long) ul_mul_shr((__u32) (a), (__u32) (b), QSUP_COEFF_BITS) )
 
@@ -54,7 +47,26 @@ typedef long int qsup_coeff_t;
 //#define coeff_compute(a, b) ( (((qsup_coeff_t) (a)) << QSUP_COEFF_BITS) / (b) )
 #define coeff_compute(a, b) ((unsigned long) ul_shl_div((__u32) (a), QSUP_COEFF_BITS, (__u32) (b)) )
 
-#define MAX_NUM_LEVELS 2
+#else
+
+#define QSUP_COEFF_ONE (1ull << QSUP_COEFF_BITS)
+
+#define coeff_apply(a, b) ((qos_bw_t) ((((__u64) (a)) * (b)) >> QSUP_COEFF_BITS))
+
+#define coeff_compute(a, b) ((qsup_coeff_t) ull_div64(((__u64) (a)) << QSUP_COEFF_BITS, (b)))
+
+#endif
+
+#ifdef QOS_KS
+#include <linux/module.h>
+#endif
+
+/** Number of levels, allocated by qsup_init() */
+static int qsup_num_levels = QSUP_NUM_LEVELS;
+#ifdef QOS_KS
+module_param_named(levels, qsup_num_levels, int, S_IRUGO);
+MODULE_PARM_DESC(levels, "Number of supervisor levels");
+#endif
 
 static qsup_constraints_t default_constraint = {
   .level = 0,
@@ -70,35 +82,57 @@ qsup_server_t *qsup_servers;
 /** Id assigned to the next created qsup_server_t	*/
 int next_server_id;
 
-/** QoS Sup related data for each user	*/
-typedef struct qsup_user_t {
-  int uid;			/**< UID of user			*/
-  qos_bw_t user_req;		/**< Sum of all (saturated) requests	*/
-  qsup_coeff_t user_coeff;	/**< Used when user_req > max_user_bw	*/
-  qos_bw_t user_gua;		/**< Sum of all guaranteed minimums	*/
-  qos_bw_t user_used_gua;	/**< Sum of actually used guaranteed min*/
-  struct qsup_user_t *next;	/**< Pointer to next item in list	*/
-} qsup_user_t;
-
-/** QoS Sup related data for each level	*/
-typedef struct qsup_level_t {
-  qos_bw_t level_max;		/**< Maximum bw allowed per-level	*/
-  qos_bw_t level_req;		/**< Total requested per-level		*/
-  qos_bw_t level_sum;		/**< Total approved per-level		*/
-  qsup_coeff_t level_coeff;	/**< Level coefficient			*/
-  qos_bw_t level_gua;		/**< Total guaranteed bw per-level	*/
-} qsup_level_t;
-
-/** User related data	*/
-static qsup_user_t *qsup_users;
-/** Level related data	*/
-static qsup_level_t qsup_levels[MAX_NUM_LEVELS];
-
-/** Sum of guaranteed bandwidths of accepted servers	*/
-static qos_bw_t tot_gua_bw = 0;
+/** QoS Sup related data for the users, one array per field, indexed by
+ ** qsup_server_t::user. Users are never removed, and the arrays double
+ ** when full.
+ **/
+static struct {
+  qos_bw_t *req;		/**< Sum of all (saturated) requests	*/
+  qos_bw_t *used_gua;		/**< Sum of actually used guaranteed min*/
+  qsup_coeff_t *coeff;		/**< Used when req > max_user_bw	*/
+  unsigned long *gen;		/**< Increased at each coeff change	*/
+  qsup_server_t **servers;	/**< Servers of the user		*/
+  qos_bw_t *gua;		/**< Sum of all guaranteed minimums	*/
+  int *uid;			/**< UID of user			*/
+  int num;			/**< Users in use			*/
+  int max;			/**< Room in the arrays			*/
+} qsup_users;
+
+/** Room for users in the arrays first allocated */
+#define QSUP_USERS_INIT 16
+
+/** QoS Sup related data for the levels, one array per field, indexed by
+ ** level.
+ **/
+static struct {
+  qos_bw_t *max;		/**< Maximum bw allowed per-level	*/
+  qos_bw_t *req;		/**< Total requested per-level		*/
+  qos_bw_t *sum;		/**< Total approved per-level		*/
+  qos_bw_t *gua;		/**< Total guaranteed bw per-level	*/
+  qos_bw_t *avail;		/**< Left by higher-priority levels	*/
+  qos_bw_t *lower_gua;		/**< Guaranteed in lower-priority levels*/
+  qsup_coeff_t *coeff;		/**< Level coefficient			*/
+  unsigned long *gen;		/**< Increased at each coeff change	*/
+  qsup_server_t **servers;	/**< Servers in the level		*/
+  qsup_compress_t *policy;	/**< How servers are compressed		*/
+} qsup_levels;
+
+/** Guaranteed bandwidths of accepted servers, and their admission test */
+static qsup_adm_set_t qsup_adm;
 /** Sum of actually used guaranteed bw by all servers	*/
 static qos_bw_t tot_used_gua_bw = 0;
 
+/** Nesting depth of qsup_batch_begin() calls, deferring level updates */
+static int qsup_batch_depth = 0;
+
+/** Range of levels to be recomputed by the next qsup_update_levels(),
+ ** empty when qsup_dirty_min > qsup_dirty_max.
+ **/
+static int qsup_dirty_min = 0, qsup_dirty_max = -1;
+
+/** Servers whose approved bandwidth may have changed */
+static qsup_server_t *qsup_dirty = NULL;
+
 /** Global QSUP coefficients lock
  * @todo  use one for each CPU ? */
 /* spinlock_t qsup_lock __cacheline_aligned = SPIN_LOCK_UNLOCKED; */
@@ -126,66 +160,308 @@ static inline void qsup_unlock_coeffs_write(unsigned long flags) {
 
 static inline qos_bw_t bw_min(qos_bw_t a, qos_bw_t b) { return ((a < b) ? (a) : (b)); }
 
+/** Insert srv at the head of the list linked through its field##_next */
+#define qsup_link(head, srv, field) do {			\
+    (srv)->field##_next = *(head);				\
+    if (*(head) != NULL)					\
+      (*(head))->field##_pprev = &(srv)->field##_next;		\
+    (srv)->field##_pprev = (head);				\
+    *(head) = (srv);						\
+  } while (0)
+
+/** Remove srv from the list linked through its field##_next */
+#define qsup_unlink(srv, field) do {				\
+    *(srv)->field##_pprev = (srv)->field##_next;		\
+    if ((srv)->field##_next != NULL)				\
+      (srv)->field##_next->field##_pprev = (srv)->field##_pprev;	\
+    (srv)->field##_pprev = NULL;				\
+  } while (0)
+
+/** Queue srv for qsup_pop_dirty(), unless already queued */
+static inline void qsup_mark_dirty(qsup_server_t *srv) {
+  if (srv->dirty_pprev == NULL)
+    qsup_link(&qsup_dirty, srv, dirty);
+}
+
+/** Drop the approved bandwidth cached for srv */
+static inline void qsup_invalidate(qsup_server_t *srv) {
+  srv->user_gen = qsup_users.gen[srv->user] - 1;
+  qsup_mark_dirty(srv);
+}
+
+/** Queue all servers in level l */
+static void qsup_mark_level_dirty(int l) {
+  qsup_server_t *srv;
+  for (srv = qsup_levels.servers[l]; srv != NULL; srv = srv->level_next)
+    qsup_mark_dirty(srv);
+}
+
+qsup_server_t *qsup_pop_dirty(void) {
+  qsup_server_t *srv = qsup_dirty;
+  if (srv != NULL)
+    qsup_unlink(srv, dirty);
+  return srv;
+}
+
+/** Have level l recomputed by the next qsup_update_levels() */
+static inline void qsup_mark_level(int l) {
+  if (l < qsup_dirty_min)
+    qsup_dirty_min = l;
+  if (l > qsup_dirty_max)
+    qsup_dirty_max = l;
+}
+
 qos_rv qsup_add_level_rule(int level, qos_bw_t max_bw) {
-  if (level < 0 || level >= MAX_NUM_LEVELS)
+  if (level < 0 || level >= qsup_num_levels)
     return QOS_E_INVALID_PARAM;
 
   /* Make new rule active */
-  qsup_levels[level].level_max = bw_min(max_bw, U_LUB);
+  qsup_levels.max[level] = bw_min(max_bw, U_LUB);
+  qsup_mark_level(level);
 
   return QOS_OK;
 }
 
+/** Elasticity of the servers of a rule with the given weight */
+static inline unsigned int qsup_weight_elasticity(int weight) {
+  if (weight < 0)
+    return 0;
+  return weight > QSUP_MAX_ELASTICITY ? QSUP_MAX_ELASTICITY : weight;
+}
+
+/** Move the servers whose rule changed to the constraints now in force.
+ ** The request of each is withdrawn, and submitted again as made before
+ ** any saturation, so that the per-user and per-level partials stay
+ ** consistent. Guarantees already admitted are kept, and the levels are
+ ** recomputed once at the end.
+ **/
+static void qsup_apply_rules(void) {
+  qsup_server_t *srv;
+  qsup_constraints_t constr;
+  unsigned int elasticity;
+  qos_bw_t req_bw;
+
+  qsup_batch_begin();
+  for (srv = qsup_servers; srv != 0; srv = srv->next) {
+    qsup_find_constr(srv->uid, srv->gid, &constr);
+    if (constr.level == srv->level && constr.weight == srv->weight
+	&& constr.max_bw == srv->max_user_bw)
+      continue;
+    req_bw = srv->asked_bw;
+    qsup_set_required_bw(srv, 0);
+
+    qsup_unlink(srv, level);
+    srv->level = constr.level;
+    qsup_link(&qsup_levels.servers[srv->level], srv, level);
+    srv->max_user_bw = constr.max_bw;
+    srv->max_level_bw = qsup_levels.max[srv->level];
+    /* Elasticities left to the rule default follow the new weight */
+    elasticity = qsup_weight_elasticity(constr.weight);
+    if (srv->elasticity == qsup_weight_elasticity(srv->weight) || srv->elasticity < elasticity)
+      srv->elasticity = elasticity;
+    srv->weight = constr.weight;
+
+    qsup_set_required_bw(srv, req_bw);
+  }
+  qsup_batch_end();
+}
+
+/** Rules may only refer to the existing levels */
+static qos_bool_t qsup_constr_valid(const qsup_constraints_t *constr) {
+  return constr->level >= 0 && constr->level < qsup_num_levels;
+}
+
+static qos_bool_t qsup_rules_valid(const qsup_rule_t *rules, unsigned int num) {
+  unsigned int i;
+  for (i = 0; i < num; ++i)
+    if (! qsup_constr_valid(&rules[i].constr))
+      return 0;
+  return 1;
+}
+
+/** Replaces the rule already in force for gid, if any */
 qos_rv qsup_add_group_constraints(int gid, qsup_constraints_t *constr) {
-  qsup_group_rule_t *rule = qos_create(qsup_group_rule_t);
-  if (rule == 0)
-    return QOS_E_NO_MEMORY;
-  rule->gid = gid;
-  rule->constr = *constr;
-  /* Insert new rule at head of group_rules list */
-  rule->next = group_rules;
-  group_rules = rule;
-  /* Increment group_rule counter       */
-  num_group_rules++;
+  qos_rv rv;
+
+  if (! qsup_constr_valid(constr))
+    return QOS_E_INVALID_PARAM;
+  rv = qsup_rules_put(QSUP_RULE_GROUP, gid, constr);
+  if (rv != QOS_OK)
+    return rv;
+  qsup_apply_rules();
   return QOS_OK;
 }
 
+/** Replaces the rule already in force for uid, if any */
 qos_rv qsup_add_user_constraints(int uid, qsup_constraints_t *constr) {
-  qsup_user_rule_t *rule = qos_malloc(sizeof(qsup_user_rule_t));
-  if (rule == 0)
-    return QOS_E_NO_MEMORY;
-  rule->uid = uid;
-  rule->constr = *constr;
-  /* Insert new rule at head of user_rules list */
-  rule->next = user_rules;
-  user_rules = rule;
-  /* Increment user_rule counter        */
-  num_user_rules++;
+  qos_rv rv;
+
+  if (! qsup_constr_valid(constr))
+    return QOS_E_INVALID_PARAM;
+  rv = qsup_rules_put(QSUP_RULE_USER, uid, constr);
+  if (rv != QOS_OK)
+    return rv;
+  qsup_apply_rules();
   return QOS_OK;
 }
 
-qos_rv qsup_init() {
+qos_rv qsup_del_group_rule(int gid) {
+  qos_rv rv = qsup_rules_del(QSUP_RULE_GROUP, gid);
+  if (rv != QOS_OK)
+    return rv;
+  qsup_apply_rules();
+  return QOS_OK;
+}
+
+qos_rv qsup_del_user_rule(int uid) {
+  qos_rv rv = qsup_rules_del(QSUP_RULE_USER, uid);
+  if (rv != QOS_OK)
+    return rv;
+  qsup_apply_rules();
+  return QOS_OK;
+}
+
+qos_rv qsup_set_rules(const qsup_rule_t *users, unsigned int num_users,
+		      const qsup_rule_t *groups, unsigned int num_groups,
+		      unsigned long *p_version) {
+  qos_rv rv;
+
+  if (! qsup_rules_valid(users, num_users) || ! qsup_rules_valid(groups, num_groups))
+    return QOS_E_INVALID_PARAM;
+  rv = qsup_rules_set(users, num_users, groups, num_groups);
+  if (rv != QOS_OK)
+    return rv;
+  qsup_apply_rules();
+  if (p_version != NULL)
+    *p_version = qsup_rules_version();
+  return QOS_OK;
+}
+
+/** Take the next array of num elements of the given size from *p_mem.
+ ** Arrays are taken in order of decreasing alignment, from a block
+ ** allocated to hold all of them.
+ **/
+static inline void *qsup_carve(char **p_mem, size_t size, int num) {
+  void *arr = *p_mem;
+  *p_mem += size * num;
+  return arr;
+}
+
+/** Allocate num empty levels, in place of the current ones */
+static qos_rv qsup_alloc_levels(int num) {
+  char *mem;
   int l;
-  group_rules = 0;
-  num_group_rules = 0;
-  user_rules = 0;
-  num_user_rules = 0;
+
+  if (num < 1 || num > QSUP_MAX_LEVELS)
+    return QOS_E_INVALID_PARAM;
+  mem = qos_malloc(num * (6 * sizeof(qos_bw_t) + sizeof(qsup_coeff_t) + sizeof(unsigned long)
+			  + sizeof(qsup_server_t *) + sizeof(qsup_compress_t)));
+  qos_chk_rv(mem != NULL, QOS_E_NO_MEMORY);
+  if (qsup_levels.max != NULL)
+    qos_free(qsup_levels.max);
+  qsup_levels.max = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.req = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.sum = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.gua = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.avail = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.lower_gua = qsup_carve(&mem, sizeof(qos_bw_t), num);
+  qsup_levels.coeff = qsup_carve(&mem, sizeof(qsup_coeff_t), num);
+  qsup_levels.gen = qsup_carve(&mem, sizeof(unsigned long), num);
+  qsup_levels.servers = qsup_carve(&mem, sizeof(qsup_server_t *), num);
+  qsup_levels.policy = qsup_carve(&mem, sizeof(qsup_compress_t), num);
+  for (l=0; l<num; l++) {
+    qsup_levels.max[l] = U_LUB;
+    qsup_levels.req[l] = 0;
+    qsup_levels.sum[l] = 0;
+    qsup_levels.gua[l] = 0;
+    qsup_levels.avail[l] = 0;
+    qsup_levels.lower_gua[l] = 0;
+    qsup_levels.coeff[l] = QSUP_COEFF_ONE;
+    qsup_levels.gen[l] = 0;
+    qsup_levels.servers[l] = NULL;
+    qsup_levels.policy[l] = QSUP_COMPRESS_PROPORTIONAL;
+  }
+  qsup_num_levels = num;
+  qsup_dirty_min = 0;
+  qsup_dirty_max = num - 1;
+  return QOS_OK;
+}
+
+/** Make room for at least one more user, moving the arrays of users to
+ ** a block twice as large when full.
+ **/
+static qos_rv qsup_grow_users(void) {
+  int max = qsup_users.max > 0 ? 2 * qsup_users.max : QSUP_USERS_INIT;
+  int num = qsup_users.num, u;
+  char *mem;
+  qos_bw_t *req, *used_gua, *gua;
+  qsup_coeff_t *coeff;
+  unsigned long *gen;
+  qsup_server_t **servers;
+  int *uid;
+
+  if (num < qsup_users.max)
+    return QOS_OK;
+  mem = qos_malloc(max * (3 * sizeof(qos_bw_t) + sizeof(qsup_coeff_t) + sizeof(unsigned long)
+			  + sizeof(qsup_server_t *) + sizeof(int)));
+  qos_chk_rv(mem != NULL, QOS_E_NO_MEMORY);
+  req = qsup_carve(&mem, sizeof(qos_bw_t), max);
+  used_gua = qsup_carve(&mem, sizeof(qos_bw_t), max);
+  gua = qsup_carve(&mem, sizeof(qos_bw_t), max);
+  coeff = qsup_carve(&mem, sizeof(qsup_coeff_t), max);
+  gen = qsup_carve(&mem, sizeof(unsigned long), max);
+  servers = qsup_carve(&mem, sizeof(qsup_server_t *), max);
+  uid = qsup_carve(&mem, sizeof(int), max);
+  for (u = 0; u < num; u++) {
+    req[u] = qsup_users.req[u];
+    used_gua[u] = qsup_users.used_gua[u];
+    gua[u] = qsup_users.gua[u];
+    coeff[u] = qsup_users.coeff[u];
+    gen[u] = qsup_users.gen[u];
+    servers[u] = qsup_users.servers[u];
+    uid[u] = qsup_users.uid[u];
+    /* The first server of each user points back to the list head */
+    if (servers[u] != NULL)
+      servers[u]->user_pprev = &servers[u];
+  }
+  if (qsup_users.req != NULL)
+    qos_free(qsup_users.req);
+  qsup_users.req = req;
+  qsup_users.used_gua = used_gua;
+  qsup_users.gua = gua;
+  qsup_users.coeff = coeff;
+  qsup_users.gen = gen;
+  qsup_users.servers = servers;
+  qsup_users.uid = uid;
+  qsup_users.max = max;
+  return QOS_OK;
+}
+
+qos_rv qsup_set_num_levels(int num) {
+  if (qsup_servers != NULL)
+    return QOS_E_INCONSISTENT_STATE;
+  return qsup_alloc_levels(num);
+}
+
+int qsup_get_num_levels(void) {
+  return qsup_num_levels;
+}
+
+qos_rv qsup_init() {
   qsup_servers = 0;
   next_server_id = 0;
 
-  for (l=0; l<MAX_NUM_LEVELS; l++) {
-    qsup_levels[l].level_coeff = QSUP_COEFF_ONE;
-    qsup_levels[l].level_max = U_LUB;
-  }
-  tot_gua_bw = 0;
+  qsup_dirty = NULL;
+  qos_chk_ok_ret(qsup_alloc_levels(qsup_num_levels));
+  qsup_adm_init(&qsup_adm, QSUP_ADM_UTIL, U_LUB - spare_bw);
   tot_used_gua_bw = 0;
 
-  return QOS_OK;
+  qos_chk_ok_ret(qsup_rules_init());
+  return qsup_rec_init();
 }
 
 qos_rv qsup_cleanup() {
   qsup_server_t *srv = qsup_servers;
-  qsup_user_t *usr = qsup_users;
 
   /* Cleanup qsup_server_t */
   while (srv != 0) {
@@ -193,24 +469,15 @@ qos_rv qsup_cleanup() {
     srv = srv->next;
     qos_free(tmp);
   }
-  /* Cleanup qsup_user_t */
-  while (usr != 0) {
-    qsup_user_t *tmp = usr;
-    usr = usr->next;
-    qos_free(tmp);
-  }
-  /* Cleanup group rules */
-  while (group_rules != 0) {
-    qsup_group_rule_t *tmp = group_rules;
-    group_rules = group_rules->next;
-    qos_free(tmp);
-  }
-  /* Cleanup user rules */
-  while (user_rules != 0) {
-    qsup_user_rule_t *tmp = user_rules;
-    user_rules = user_rules->next;
-    qos_free(tmp);
-  }
+  /* Cleanup users and levels */
+  if (qsup_users.req != NULL)
+    qos_free(qsup_users.req);
+  qsup_users.req = NULL;
+  qsup_users.num = qsup_users.max = 0;
+  qsup_rules_cleanup();
+  qsup_rec_cleanup();
+  qos_free(qsup_levels.max);
+  qsup_levels.max = NULL;
   return QOS_OK;
 }
 
@@ -219,28 +486,11 @@ qos_rv qsup_cleanup() {
  * First, search for a user-rule matching the specified uid.
  * Then, search for a group-rule matching the specified gid
  * (i.e. user-rules override group-rules). If no rules match,
- * then return a pointer to the default_constraint.
- *
- * @return	Pointer to the matching qsup_constraints_t.
+ * then copy the default_constraint.
  */
-qsup_constraints_t *qsup_find_constr(int uid, int gid) {
-  qsup_user_rule_t *urule = user_rules;
-  qsup_group_rule_t *grule;
-  /* First, search user-rules	*/
-  while (urule != 0)
-    if (urule->uid == uid)
-      return &urule->constr;
-    else
-      urule = urule->next;
-  /* No matching user-rule found. Search group-rules	*/
-  grule = group_rules;
-  while (grule != 0)
-    if (grule->gid == gid)
-      return &grule->constr;
-    else
-      grule = grule->next;
-  /* No matching group-rule found. Return default const	*/
-  return &default_constraint;
+void qsup_find_constr(int uid, int gid, qsup_constraints_t *p_constr) {
+  if (! qsup_rules_find(uid, gid, p_constr))
+    *p_constr = default_constraint;
 }
 
 /** Return qsup_server_t structure for specified server_id,
@@ -252,48 +502,46 @@ qsup_server_t *qsup_find_server_by_id(int server_id) {
   return srv;
 }
 
-/** Retrieve a qsup_user_t structure for the specified uid.
- * If structure does not exist, create it and fill static
- * parameters from the user and group rules.
+/** Retrieve in *p_user the index of the user with the specified uid.
+ * If the user does not exist yet, add it with empty partials.
  */
-qos_rv get_user_info(qsup_user_t **pp, int uid) {
-  qsup_user_t *usr = qsup_users;
-  while ((usr != 0) && (usr->uid != uid))
-    usr = usr->next;
-  if (usr == 0) {
-    /** Not found: create a new qsup_user_t */
-    usr = qos_malloc(sizeof(qsup_user_t));
-    if (usr == 0)
-      return QOS_E_NO_MEMORY;
-    /** Add to head of qsup_users list */
-    usr->next = qsup_users;
-    qsup_users = usr;
-    /** Fill in static data ?!? */
-    usr->uid = uid;
-    usr->user_req = 0;
-    usr->user_gua = 0;
-    usr->user_used_gua = 0;
-    usr->user_coeff = QSUP_COEFF_ONE;
-  }
-  *pp = usr;
+qos_rv get_user_info(int *p_user, int uid) {
+  int u;
+  for (u = 0; u < qsup_users.num; u++)
+    if (qsup_users.uid[u] == uid) {
+      *p_user = u;
+      return QOS_OK;
+    }
+  /** Not found: add a new user */
+  if (qsup_grow_users() != QOS_OK)
+    return QOS_E_NO_MEMORY;
+  u = qsup_users.num++;
+  qsup_users.uid[u] = uid;
+  qsup_users.req[u] = 0;
+  qsup_users.gua[u] = 0;
+  qsup_users.used_gua[u] = 0;
+  qsup_users.coeff[u] = QSUP_COEFF_ONE;
+  qsup_users.gen[u] = 0;
+  qsup_users.servers[u] = NULL;
+  *p_user = u;
   return QOS_OK;
 }
 
 qos_bw_t qsup_get_max_gua_bw(int uid, int gid) {
-  qsup_constraints_t *constr;
-  constr = qsup_find_constr(uid, gid);
-  return constr->max_min_bw;
+  qsup_constraints_t constr;
+  qsup_find_constr(uid, gid, &constr);
+  return constr.max_min_bw;
 }
 
 qos_rv qsup_get_avail_gua_bw(int uid, int gid, qos_bw_t *p_avail_bw) {
   qos_rv rv = QOS_OK;
-  qsup_constraints_t *constr;
-  qsup_user_t *usr;
+  qsup_constraints_t constr;
+  int u;
 
-  constr = qsup_find_constr(uid, gid);
-  rv = get_user_info(&usr, uid);
+  qsup_find_constr(uid, gid, &constr);
+  rv = get_user_info(&u, uid);
   qos_chk_go_msg(rv == QOS_OK, end, "get_user_info() failed");
-  *p_avail_bw = constr->max_min_bw - usr->user_gua;
+  *p_avail_bw = constr.max_min_bw - qsup_users.gua[u];
 
 end:
 
@@ -302,87 +550,147 @@ end:
 
 qos_rv qsup_get_avail_bw(int uid, int gid, qos_bw_t *p_avail_bw) {
   qos_rv rv = QOS_OK;
-  qsup_constraints_t *constr;
-  qsup_user_t *usr;
+  qsup_constraints_t constr;
+  int u;
 
-  constr = qsup_find_constr(uid, gid);
-  rv = get_user_info(&usr, uid);
+  qsup_find_constr(uid, gid, &constr);
+  rv = get_user_info(&u, uid);
   qos_chk_go_msg(rv == QOS_OK, end, "get_user_info() failed");
-  *p_avail_bw = constr->max_bw - usr->user_req;
+  *p_avail_bw = constr.max_bw - qsup_users.req[u];
 
 end:
 
   return rv;
 }
 
+#ifdef QSUP_REC
+
+/** Record in the flight recorder a decision taken about srv */
+static void qsup_rec_server(qsup_decision_op_t op, qsup_server_t *srv, int flags, qos_rv rv) {
+  qsup_decision_t dec;
+
+  dec.req_bw = srv->req_bw;
+  dec.gua_bw = srv->gua_bw;
+  dec.approved_bw = qsup_get_approved_bw(srv);
+  dec.level_coeff = qsup_levels.coeff[srv->level];
+  dec.user_coeff = qsup_users.coeff[srv->user];
+  dec.uid = srv->uid;
+  dec.gid = srv->gid;
+  dec.server_id = srv->server_id;
+  dec.rv = qos_rv_int(rv);
+  dec.op = op;
+  dec.level = srv->level;
+  if (dec.approved_bw < dec.req_bw)
+    flags |= QSUP_DEC_F_COMPRESSED;
+  dec.flags = flags;
+  qsup_rec_add(&dec);
+}
+
+#else
+
+#define qsup_rec_server(op, srv, flags, rv) do { } while (0)
+
+#endif
+
+/** Trace and record the rejection of a new server, returning rv	*/
+static qos_rv qsup_reject(int uid, int gid, qsup_constraints_t *constr, qres_params_t *param,
+			  qos_bw_t min_bw, qos_rv rv, const char *reason) {
+#ifdef QSUP_REC
+  qsup_decision_t dec;
+
+  dec.req_bw = r2bw(param->Q, param->P);
+  dec.gua_bw = min_bw;
+  dec.approved_bw = 0;
+  dec.level_coeff = qsup_levels.coeff[constr->level];
+  dec.user_coeff = 0;
+  dec.uid = uid;
+  dec.gid = gid;
+  dec.server_id = -1;
+  dec.rv = qos_rv_int(rv);
+  dec.op = QSUP_DEC_INIT;
+  dec.level = constr->level;
+  dec.flags = 0;
+  qsup_rec_add(&dec);
+#endif
+  trace_qsup_reject(uid, gid, min_bw, qos_rv_int(rv), reason);
+  return rv;
+}
+
 /** Initialize a new qsup_server_t structure. **/
 qos_rv qsup_init_server(qsup_server_t *srv, int uid, int gid, qres_params_t *param) {
-  qsup_user_t *usr;
-  qsup_constraints_t *constr;
-  qos_bw_t new_tot_gua;
+  int u;
+  qsup_constraints_t c, *constr = &c;
   qos_bw_t min_bw;
 
   min_bw = r2bw_ceil(param->Q_min, param->P);
 
   /** @todo  lock qsup_servers list ? */
-  qos_log_debug("Adding server: uid=%d gid=%d min_bw=%ld", uid, gid, min_bw);
-  constr = qsup_find_constr(uid, gid);
+  qos_log_debug("Adding server: uid=%d gid=%d min_bw=" QOS_BW_FMT, uid, gid, min_bw);
+  qsup_find_constr(uid, gid, constr);
+  if (constr->level >= qsup_num_levels) {
+    qos_log_err("Rule for user/group refers to a missing level");
+    return QOS_E_INVALID_PARAM;
+  }
 
   if (param->flags & constr->flags_mask) {
     qos_log_err("Required flags violates configured mask for user/group");
-    return QOS_E_UNAUTHORIZED;
+    return qsup_reject(uid, gid, constr, param, min_bw, QOS_E_UNAUTHORIZED, "flags");
   }
 
   if (min_bw > constr->max_min_bw) {
     qos_log_err("Minimum guaranteed requested violates max_min");
     /* @todo  should we allow saturation policy instead of reject ? */
-    return QOS_E_UNAUTHORIZED;
+    return qsup_reject(uid, gid, constr, param, min_bw, QOS_E_UNAUTHORIZED, "max_min_bw");
   }
 
-  /* Schedulability test: \sum min_bw_i <= U_LUB - spare_bw */
-  new_tot_gua = tot_gua_bw + min_bw;
-  if (new_tot_gua > U_LUB - spare_bw) {
+  /* Schedulability test, at least \sum min_bw_i <= U_LUB - spare_bw */
+  qsup_adm_task_init(&qsup_adm, &srv->adm, param->Q_min, param->P);
+  if (! qsup_adm_admit(&qsup_adm, &srv->adm)) {
     qos_log_err("New guaranteed task rejected");
-    return QOS_E_SYSTEM_OVERLOAD;
+    return qsup_reject(uid, gid, constr, param, min_bw, QOS_E_SYSTEM_OVERLOAD,
+		       qsup_adm.kind == QSUP_ADM_UTIL ? "total_gua" : "sched_test");
   }
 
-  qos_chk_ok_ret(get_user_info(&usr, uid));
+  qos_chk_ok_ret(get_user_info(&u, uid));
 
-  if (usr->user_gua + min_bw > U_LUB - spare_bw) {
+  if (qsup_users.gua[u] + min_bw > U_LUB - spare_bw) {
     qos_log_err("Minimum guaranteed requested by all user apps violates U_LUB - spare_bw");
-    return QOS_E_SYSTEM_OVERLOAD;
+    return qsup_reject(uid, gid, constr, param, min_bw, QOS_E_SYSTEM_OVERLOAD, "user_gua");
   }
 
-  if (usr->user_gua + min_bw > constr->max_min_bw) {
+  if (qsup_users.gua[u] + min_bw > constr->max_min_bw) {
     qos_log_err("Minimum guaranteed requested by all user apps violates max_min");
-    return QOS_E_UNAUTHORIZED;
+    return qsup_reject(uid, gid, constr, param, min_bw, QOS_E_UNAUTHORIZED, "user_max_min_bw");
   }
 
   srv->server_id = next_server_id++;
   srv->tg = NULL;
   srv->level = constr->level;
   srv->weight = constr->weight;
+  srv->elasticity = qsup_weight_elasticity(constr->weight);
+  srv->elastic_bw = 0;
   srv->max_user_bw = constr->max_bw;
-  srv->max_level_bw = qsup_levels[srv->level].level_max;
+  srv->max_level_bw = qsup_levels.max[srv->level];
   srv->uid = uid;
   srv->gid = gid;
   srv->req_bw = 0;
+  srv->asked_bw = 0;
   srv->gua_bw = min_bw;
   srv->used_gua_bw = 0;		/**< Guaranteed minimum not used yet */
-  srv->p_level_sum   = &qsup_levels[srv->level].level_sum;
-  srv->p_level_req   = &qsup_levels[srv->level].level_req;
-  srv->p_level_coeff = &qsup_levels[srv->level].level_coeff;
-  srv->p_level_gua   = &qsup_levels[srv->level].level_gua;
-  srv->p_user_req = &usr->user_req;
-  srv->p_user_coeff = &usr->user_coeff;
-  srv->p_user_gua = &usr->user_used_gua;
+  srv->user = u;
+  srv->dirty_pprev = NULL;
+  qsup_invalidate(srv);
 
   /* Add to head of qsup_servers list */
   srv->next = qsup_servers;
   qsup_servers = srv;
+  qsup_link(&qsup_users.servers[u], srv, user);
+  qsup_link(&qsup_levels.servers[srv->level], srv, level);
 
   /** Update sum of guaranteed bw to all servers */
-  tot_gua_bw = new_tot_gua;
+  qsup_adm_add(&qsup_adm, &srv->adm);
+
+  qsup_rec_server(QSUP_DEC_INIT, srv, 0, QOS_OK);
 
   return QOS_OK;
 }
@@ -420,7 +728,7 @@ qos_rv qsup_cleanup_server(qsup_server_t *srv) {
   }
 
   /* The only total that has not been updated is gua_bw */
-  tot_gua_bw -= srv->gua_bw;
+  qsup_adm_remove(&qsup_adm, &srv->adm);
 
   /* Remove srv from list	*/
   if (srv == qsup_servers)
@@ -432,6 +740,10 @@ qos_rv qsup_cleanup_server(qsup_server_t *srv) {
       prof_return(QOS_E_INVALID_PARAM);
     tmp->next = srv->next;
   }
+  qsup_unlink(srv, user);
+  qsup_unlink(srv, level);
+  if (srv->dirty_pprev != NULL)
+    qsup_unlink(srv, dirty);
 
   prof_end();
 
@@ -445,22 +757,203 @@ qos_rv qsup_destroy_server(qsup_server_t *srv) {
   return rv;
 }
 
+/** Amount by which srv may be compressed, in elastic levels */
+static inline qos_bw_t qsup_elastic_range(qsup_server_t *srv) {
+  return srv->elastic_bw - srv->used_gua_bw;
+}
+
+/** Merge two lists linked through el_next, sorted by increasing
+ ** compression per unit of elasticity that brings a server to its
+ ** minimum, i.e., range / elasticity.
+ **/
+static qsup_server_t *qsup_elastic_merge(qsup_server_t *a, qsup_server_t *b) {
+  qsup_server_t *head = NULL, **pp = &head;
+  while (a != NULL && b != NULL) {
+    if ((__u64) qsup_elastic_range(a) * b->elasticity
+	<= (__u64) qsup_elastic_range(b) * a->elasticity) {
+      *pp = a;
+      a = a->el_next;
+    } else {
+      *pp = b;
+      b = b->el_next;
+    }
+    pp = &(*pp)->el_next;
+  }
+  *pp = (a != NULL) ? a : b;
+  return head;
+}
+
+/** Merge sort of a list linked through el_next, in O(N log N) */
+static qsup_server_t *qsup_elastic_sort(qsup_server_t *list) {
+  qsup_server_t *slow, *fast, *half;
+  if (list == NULL || list->el_next == NULL)
+    return list;
+  slow = list;
+  fast = list->el_next;
+  while (fast != NULL && fast->el_next != NULL) {
+    slow = slow->el_next;
+    fast = fast->el_next->el_next;
+  }
+  half = slow->el_next;
+  slow->el_next = NULL;
+  return qsup_elastic_merge(qsup_elastic_sort(list), qsup_elastic_sort(half));
+}
+
+/** Compress the servers in level l within avail_bw, taking bandwidth
+ ** from them in proportion to their elasticities, down to their
+ ** guarantees. Only if that does not suffice, the inelastic ones are
+ ** compressed as well, in proportion to their non-guaranteed requests.
+ **
+ ** The bandwidth of each server before the compression is the one
+ ** approved after the per-user compression.
+ **/
+static void qsup_elastic_compress(int l, qos_bw_t avail_bw) {
+  qsup_server_t *srv, *elastic = NULL, *inelastic = NULL;
+  qos_bw_t tot = 0, excess, taken = 0, inelastic_range = 0;
+  __u64 E = 0;
+
+  for (srv = qsup_levels.servers[l]; srv != NULL; srv = srv->level_next) {
+    /* Cheaper than telling which ones change */
+    qsup_mark_dirty(srv);
+    srv->elastic_bw = srv->used_gua_bw
+      + coeff_apply(srv->req_bw - srv->used_gua_bw, qsup_users.coeff[srv->user]);
+    tot += srv->elastic_bw;
+    if (qsup_elastic_range(srv) == 0)
+      continue;
+    if (srv->elasticity > 0) {
+      srv->el_next = elastic;
+      elastic = srv;
+      E += srv->elasticity;
+    } else {
+      srv->el_next = inelastic;
+      inelastic = srv;
+      inelastic_range += qsup_elastic_range(srv);
+    }
+  }
+  if (tot <= avail_bw)
+    return;
+  excess = tot - avail_bw;
+
+  /* Servers reach their minimum in order: the first one that does not
+   * determines the compression per unit of elasticity of all the others */
+  for (srv = qsup_elastic_sort(elastic); srv != NULL; srv = srv->el_next) {
+    qos_bw_t range = qsup_elastic_range(srv);
+    if ((__u64) taken * srv->elasticity + (__u64) range * E >= (__u64) excess * srv->elasticity) {
+      qos_bw_t left = excess - taken;
+      for (; srv != NULL; srv = srv->el_next)
+	srv->elastic_bw -= bw_min(qsup_elastic_range(srv),
+				  (qos_bw_t) ull_div64((__u64) left * srv->elasticity + E - 1, E));
+      return;
+    }
+    srv->elastic_bw = srv->used_gua_bw;
+    taken += range;
+    E -= srv->elasticity;
+  }
+
+  if (inelastic_range == 0)
+    return;
+  excess -= taken;
+  for (srv = inelastic; srv != NULL; srv = srv->el_next) {
+    qos_bw_t range = qsup_elastic_range(srv);
+    srv->elastic_bw -= bw_min(range,
+			      (qos_bw_t) ull_div64((__u64) excess * range + inelastic_range - 1, inelastic_range));
+  }
+}
+
+/** Recompute the bandwidth assigned to each level, and the level
+ ** coefficients, from the per-level requests and guarantees.
+ **
+ ** Levels share what is not reserved as spare. The guarantees in use by
+ ** lower-priority levels are set aside before serving each level, and
+ ** those of the level itself are always assigned.
+ **
+ ** Only the levels marked with qsup_mark_level() are recomputed, along
+ ** with the lower-priority ones after them that are left a different
+ ** bandwidth. Guarantees in use by a level change what is set aside for
+ ** all the higher-priority ones, so changing them marks level 0.
+ **/
+static void qsup_update_levels(void) {
+  int l = qsup_dirty_min;
+  qos_bw_t avail_bw, lower_gua;
+
+  if (l > qsup_dirty_max)
+    return;
+  if (l == 0) {
+    avail_bw = U_LUB - spare_bw;
+    lower_gua = tot_used_gua_bw;
+  } else {
+    avail_bw = qsup_levels.avail[l];
+    lower_gua = qsup_levels.lower_gua[l - 1];
+  }
+  for (; l<qsup_num_levels; l++) {
+    //qos_log_debug("Level %d: avail_bw=%ld", l, avail_bw);
+    /* Will get the actually assigned bw to the level */
+    qos_bw_t assigned, req = qsup_levels.req[l], gua = qsup_levels.gua[l];
+    qsup_coeff_t coeff;
+    /* Nothing changes from here on */
+    if (l > qsup_dirty_max && avail_bw == qsup_levels.avail[l])
+      break;
+    lower_gua -= gua;
+    qsup_levels.avail[l] = avail_bw;
+    qsup_levels.lower_gua[l] = lower_gua;
+    /* Actual level bw is saturated with maximum configured per-level
+     * and maximum available for the level and all lower-priority ones	*/
+    assigned = bw_min(bw_min(req, qsup_levels.max[l]),
+		      avail_bw > lower_gua ? avail_bw - lower_gua : 0);
+    if (assigned < gua)
+      assigned = gua;
+    //qos_log_debug("Level %d: Assigned=%ld", l, assigned);
+
+    /* Update actually assigned bw to the level	*/
+    qsup_levels.sum[l] = assigned;
+    //qos_log_debug("Level %d: req=%ld, gua=%ld, sum=%ld", l, req, gua, assigned);
+    /* Prevent division-by-zero on empty levels */
+    if (req > gua) {
+      //qos_log_debug("Level %d: Dividing by %ld", l, req - gua);
+      coeff = coeff_compute(assigned - gua, req - gua);
+    } else
+      coeff = QSUP_COEFF_ONE;
+    if (coeff != qsup_levels.coeff[l]) {
+      qsup_levels.coeff[l] = coeff;
+      qsup_levels.gen[l]++;
+      if (qsup_levels.policy[l] != QSUP_COMPRESS_ELASTIC)
+	qsup_mark_level_dirty(l);
+    }
+    trace_qsup_level_coeff(l, req, gua, assigned, coeff);
+    if (qsup_levels.policy[l] == QSUP_COMPRESS_ELASTIC)
+      qsup_elastic_compress(l, assigned);
+    /* Update available bandwidth for next level */
+    avail_bw = avail_bw > assigned ? avail_bw - assigned : 0;
+  }
+  qsup_dirty_min = qsup_num_levels;
+  qsup_dirty_max = -1;
+}
+
+void qsup_batch_begin(void) {
+  qsup_batch_depth++;
+}
+
+void qsup_batch_end(void) {
+  if (--qsup_batch_depth == 0)
+    qsup_update_levels();
+}
+
 qos_rv qsup_set_required_bw(qsup_server_t *srv, qos_bw_t server_req) {
   qos_bw_t user_req;	/* New requested total per-user		*/
   qos_bw_t level_req;	/* New requested total per-level	*/
-  int l;
-  qos_bw_t avail_bw;
   qos_bw_t used_gua_bw;
+  int u = srv->user;
+  qsup_coeff_t user_coeff = qsup_users.coeff[u];
+  int rec_flags = 0;
   prof_vars;
 
-  qos_log_debug("Changing required bw of server %d from " QOS_BW_FMT " to " QOS_BW_FMT,
-		srv->server_id, srv->req_bw, server_req);
-
   prof_func();
 
+  srv->asked_bw = server_req;
   /* Check violation of single-process max_bw. If server_req > max,
    * then saturate request. @todo  should we reject request ? */
   if (server_req > srv->max_user_bw) {
+    rec_flags |= QSUP_DEC_F_SATURATED;
     qos_log_debug("Saturating request from " QOS_BW_FMT " to " QOS_BW_FMT,
 		  server_req, srv->max_user_bw);
     server_req = srv->max_user_bw;
@@ -468,76 +961,69 @@ qos_rv qsup_set_required_bw(qsup_server_t *srv, qos_bw_t server_req) {
 
   /* First, compute new minimum guaranteed if requested */
   used_gua_bw = bw_min(server_req, srv->gua_bw);
+  if (used_gua_bw != srv->used_gua_bw)
+    qsup_mark_level(0);
+  qsup_mark_level(srv->level);
   /* Then, update affected guaranteed partials		*/
-  *(srv->p_user_gua)	+= used_gua_bw - srv->used_gua_bw;
-  *(srv->p_level_gua)	+= used_gua_bw - srv->used_gua_bw;
-  tot_used_gua_bw	+= used_gua_bw - srv->used_gua_bw;
+  qsup_users.used_gua[u] += used_gua_bw - srv->used_gua_bw;
+  qsup_levels.gua[srv->level] += used_gua_bw - srv->used_gua_bw;
+  tot_used_gua_bw += used_gua_bw - srv->used_gua_bw;
   /* Finally, update new minimum guaranteed		*/
   srv->used_gua_bw = used_gua_bw;
 
   /* Compute updated sum of per-user requests	*/
-  user_req = *(srv->p_user_req) - srv->req_bw + server_req;
-
-  qos_log_debug("Updated sum of user-reqs: " QOS_BW_FMT, user_req);
+  user_req = qsup_users.req[u] - srv->req_bw + server_req;
 
   /* Check violation of per-user max_bw while	*
    * updating user-compression coefficient	*/
   if (user_req > srv->max_user_bw) {
     qos_log_debug("Rescaling per-user request of " QOS_BW_FMT " to max=" QOS_BW_FMT,
 		  user_req, srv->max_user_bw);
-    *(srv->p_user_coeff) = coeff_compute(srv->max_user_bw - *(srv->p_user_gua), user_req - *(srv->p_user_gua));
+    qsup_users.coeff[u] = coeff_compute(srv->max_user_bw - qsup_users.used_gua[u], user_req - qsup_users.used_gua[u]);
   } else {
 #ifndef QSUP_EXPAND
-    *(srv->p_user_coeff) = QSUP_COEFF_ONE;
+    qsup_users.coeff[u] = QSUP_COEFF_ONE;
 #else
     /* A request of zero cannot be expanded */
-    if (user_req - *(srv->p_user_gua) == 0)
-      *(srv->p_user_coeff) = QSUP_COEFF_ONE;
+    if (user_req - qsup_users.used_gua[u] == 0)
+      qsup_users.coeff[u] = QSUP_COEFF_ONE;
     else
-      *(srv->p_user_coeff) = coeff_compute(srv->max_user_bw - *(srv->p_user_gua), user_req - *(srv->p_user_gua));
+      qsup_users.coeff[u] = coeff_compute(srv->max_user_bw - qsup_users.used_gua[u], user_req - qsup_users.used_gua[u]);
 #endif
   }
 
+  trace_qsup_user_coeff(srv->uid, user_req, qsup_users.used_gua[u], qsup_users.coeff[u]);
+  qsup_invalidate(srv);
+  if (qsup_users.coeff[u] != user_coeff) {
+    qsup_server_t *other;
+    qsup_users.gen[u]++;
+    for (other = qsup_users.servers[u]; other != NULL; other = other->user_next) {
+      qsup_mark_dirty(other);
+      /* Elastic levels start from the bandwidths after the user coefficient */
+      if (qsup_levels.policy[other->level] == QSUP_COMPRESS_ELASTIC)
+	qsup_mark_level(other->level);
+    }
+  }
+
   /* Compute new request for the level */
-  level_req = (*(srv->p_level_req)) - bw_min(*(srv->p_user_req), srv->max_user_bw) + bw_min(user_req, srv->max_user_bw);
+  level_req = qsup_levels.req[srv->level] - bw_min(qsup_users.req[u], srv->max_user_bw) + bw_min(user_req, srv->max_user_bw);
 
   /* Update required bw for server, user and level */
   srv->req_bw = server_req;
-  *(srv->p_user_req) = user_req;
-  *(srv->p_level_req) = level_req;
+  qsup_users.req[u] = user_req;
+  qsup_levels.req[srv->level] = level_req;
 
-  //qos_log_debug("Server %d requirements: srv=%ld, usr=%ld, lev=%ld",
-  //	srv->server_id, srv->req_bw, user_req, level_req);
+  trace_qsup_set_required_bw(srv->server_id, server_req, user_req, level_req);
 
   /* level_req is the new required bw for level, which must be
    * compared with available residual bw from higher priority levels;
    * change in minimum of one level could potentially affect all
    * higher and lower levels, so we need to go through all of them.
    */
-  avail_bw = U_LUB;
-  for (l=0; l<MAX_NUM_LEVELS; l++) {
-    qsup_level_t *lev = &qsup_levels[l];
-    //qos_log_debug("Level %d: avail_bw=%ld", l, avail_bw);
-    /* Will get the actually assigned bw to the level */
-    qos_bw_t assigned;
-    /* Actual level bw is saturated with maximum configured per-level
-     * and maximum available for the level and all lower-priority ones	*/
-    assigned = bw_min(bw_min(lev->level_req, lev->level_max), avail_bw);
-    //qos_log_debug("Level %d: Assigned=%ld", l, assigned);
+  if (qsup_batch_depth == 0)
+    qsup_update_levels();
 
-    /* Update actually assigned bw to the level	*/
-    lev->level_sum = assigned;
-    //qos_log_debug("Level %d: req=%ld, gua=%ld, sum=%ld",
-    //	  l, lev->level_req, lev->level_gua, lev->level_sum);
-    /* Prevent division-by-zero on empty levels */
-    if (lev->level_req > lev->level_gua) {
-      //qos_log_debug("Level %d: Dividing by %ld", l, lev->level_req - lev->level_gua);
-      lev->level_coeff = coeff_compute(assigned - lev->level_gua, lev->level_req - lev->level_gua);
-    } else
-      lev->level_coeff = QSUP_COEFF_ONE;
-    /* Update available bandwidth for next level */
-    avail_bw -= assigned;
-  }
+  qsup_rec_server(QSUP_DEC_SET_REQ, srv, rec_flags, QOS_OK);
 
   prof_end();
 
@@ -553,17 +1039,16 @@ qos_bw_t qsup_get_guaranteed_bw(qsup_server_t *srv) {
 }
 
 void qsup_dump(void) {
-  int l;
-  qsup_user_t *usr;
+  int l, u;
   qsup_server_t *srv;
 
   qos_log_debug("Current user coefficients:");
-  for (usr = qsup_users; usr != 0; usr = usr->next)
-    qos_log_debug("User %d: coeff=%lu/1000", usr->uid, coeff_apply(usr->user_coeff, 1000));
+  for (u = 0; u < qsup_users.num; u++)
+    qos_log_debug("User %d: coeff=" QOS_BW_FMT "/1000", qsup_users.uid[u], (qos_bw_t) coeff_apply(1000, qsup_users.coeff[u]));
 
   qos_log_debug("Current level coefficients:");
-  for (l = 0; l < MAX_NUM_LEVELS; l++)
-    qos_log_debug("Level %d: coeff=%lu/1000", l, coeff_apply(qsup_levels[l].level_coeff, 1000));
+  for (l = 0; l < qsup_num_levels; l++)
+    qos_log_debug("Level %d: coeff=" QOS_BW_FMT "/1000", l, (qos_bw_t) coeff_apply(1000, qsup_levels.coeff[l]));
 
   qos_log_debug("Current list of servers:");
   for (srv = qsup_servers; srv != 0; srv = srv->next) {
@@ -581,25 +1066,70 @@ qos_bw_t qsup_get_approved_bw(qsup_server_t *srv) {
   prof_vars;
 
   prof_func();
+  if (qsup_levels.policy[srv->level] == QSUP_COMPRESS_ELASTIC)
+    prof_return(srv->elastic_bw);
+  if (srv->user_gen == qsup_users.gen[srv->user] && srv->level_gen == qsup_levels.gen[srv->level])
+    prof_return(srv->approved_bw);
   bw = srv->used_gua_bw;
-  c1 = *(srv->p_level_coeff);
-  c2 = *(srv->p_user_coeff);
+  c1 = qsup_levels.coeff[srv->level];
+  c2 = qsup_users.coeff[srv->user];
 
   bw += coeff_apply(coeff_apply(srv->req_bw - srv->used_gua_bw, c2), c1);
+  srv->approved_bw = bw;
+  srv->user_gen = qsup_users.gen[srv->user];
+  srv->level_gen = qsup_levels.gen[srv->level];
   prof_return(bw);
 }
 
-/** Cannot reserve more than U_LUB as spare, and cannot change the
- ** reserved spare when servers are already active.
+/** Cannot reserve more than U_LUB as spare, nor so much that the
+ ** guarantees already admitted no longer pass the admission test.
  **/
 qos_rv qsup_reserve_spare(qos_bw_t bw) {
   if (bw > U_LUB)
     return QOS_E_INVALID_PARAM;
-  if (qsup_servers != NULL)
-    return QOS_E_INCONSISTENT_STATE;
+  if (qsup_adm_set_cap(&qsup_adm, U_LUB - bw) != QOS_OK)
+    return QOS_E_SYSTEM_OVERLOAD;
   spare_bw = bw;
+  qsup_mark_level(0);
+  if (qsup_batch_depth == 0)
+    qsup_update_levels();
+
+  return QOS_OK;
+}
+
+qos_rv qsup_set_adm_test(qsup_adm_kind_t kind) {
+  return qsup_adm_set_kind(&qsup_adm, kind);
+}
+
+qos_rv qsup_set_level_policy(int level, qsup_compress_t policy) {
+  if (level < 0 || level >= qsup_num_levels)
+    return QOS_E_INVALID_PARAM;
+  if (policy != QSUP_COMPRESS_PROPORTIONAL && policy != QSUP_COMPRESS_ELASTIC)
+    return QOS_E_INVALID_PARAM;
+  qsup_levels.policy[level] = policy;
+  qsup_levels.gen[level]++;
+  qsup_mark_level_dirty(level);
+  qsup_mark_level(level);
+  if (qsup_batch_depth == 0)
+    qsup_update_levels();
+  return QOS_OK;
+}
 
+/** Users may only make their servers more elastic than their rule says */
+qos_rv qsup_set_elasticity(qsup_server_t *srv, unsigned int elasticity) {
+  if (elasticity > QSUP_MAX_ELASTICITY)
+    return QOS_E_INVALID_PARAM;
+  if ((int) elasticity < srv->weight)
+    return QOS_E_UNAUTHORIZED;
+  srv->elasticity = elasticity;
+  qsup_mark_level(srv->level);
+  if (qsup_batch_depth == 0)
+    qsup_update_levels();
   return QOS_OK;
 }
 
+unsigned int qsup_get_elasticity(qsup_server_t *srv) {
+  return srv->elasticity;
+}
+
 /** @} */
@@ -20,6 +20,7 @@
  */
 
 #include "qsup_gw.h"
+#include "qsup_adm.h"
 #include "qres_gw.h"
 #include "qos_debug.h"
 #include "qos_types.h"
@@ -32,19 +33,19 @@ typedef struct qsup_level_rule_t {
   struct qsup_level_rule_t *next;	/**< Pointer to next qsup_level_rule_t	*/
 } qsup_level_rule_t;
 
-/** Group rule: applies to all users in the group	*/
-typedef struct qsup_group_rule_t {
-  int gid;				/**< Group Id of users to which rule applies	*/
-  qsup_constraints_t constr;		/**< Constraints enforced for all group users	*/
-  struct qsup_group_rule_t *next;	/**< Pointer to next qsup_group_rule_t		*/
-} qsup_group_rule_t;
-
-/** User rule: applies to one user only			*/
-typedef struct qsup_user_rule_t {
-  int uid;				/**< User Id of user to which rule applies	*/
-  qsup_constraints_t constr;		/**< Constraints enforced for all group users	*/
-  struct qsup_user_rule_t *next;	/**< Pointer to next qsup_user_rule_t		*/
-} qsup_user_rule_t;
+/** Bandwidth coefficients are stored as fixed-point integers.	*/
+#ifdef QOS_BW_WIDE
+typedef __u64 qsup_coeff_t;
+/** With QOS_BW_WIDE, coefficients have 30 fractional bits, so that
+ ** coeff_compute() does not overflow for numerators up to 4.0, and
+ ** coeff_apply() for products up to 4.0.
+ **/
+#define QSUP_COEFF_BITS 30
+#else
+typedef long int qsup_coeff_t;
+/** Number of binary decimal digits in qsup_coeff_t	*/
+#define QSUP_COEFF_BITS 16
+#endif
 
 /** QoS Sup related data for each server */
 typedef struct qsup_server_t {
@@ -52,22 +53,30 @@ typedef struct qsup_server_t {
   int server_id;	/**< Unique ID of this server		*/
   int level;		/**< Level where this server resides	*/
   int weight;		/**< w.r.t. other servers in same level	*/
+  unsigned int elasticity; /**< Share of compression in elastic levels	*/
   qos_bw_t gua_bw;	/**< Minimum guaranteed requested	*/
   qos_bw_t max_user_bw;	/**< Maximum per-user total request	*/
   qos_bw_t max_level_bw;/**< Maximum per-level total request	*/
   int uid, gid;		/**< UID and GID of this server		*/
+  qsup_adm_task_t adm;	/**< Guarantee, as seen by admission tests	*/
 
   /* Dynamically changing data */
   struct task_group *tg;
   qos_bw_t req_bw;	/**< Non-guaranteed required bandwidth		*/
+  qos_bw_t asked_bw;	/**< Required bandwidth, before saturation	*/
   qos_bw_t used_gua_bw;	/**< Current guaranteed bandwidth to the server	*/
-  qos_bw_t *p_level_sum;	/**< Total approved for level	*/
-  qos_bw_t *p_user_req;		/**< Total request for user	*/
-  qos_bw_t *p_level_req;	/**< Total request for level	*/
-  long int *p_user_coeff;	/**< Coefficient for user	*/
-  long int *p_level_coeff;	/**< Coefficient for level	*/
-  qos_bw_t *p_user_gua;		/**< Total guaranteed for user	*/
-  qos_bw_t *p_level_gua;	/**< Total guaranteed for level	*/
+  int user;		/**< Index of the user among the supervisor ones */
+  qos_bw_t elastic_bw;		/**< Approved bw, in elastic levels	*/
+  struct qsup_server_t *el_next;	/**< Used while compressing a level */
+
+  /* Approved bandwidth, valid while the coefficients it was computed
+   * from keep the same generations */
+  qos_bw_t approved_bw;		/**< Cached qsup_get_approved_bw()	*/
+  unsigned long user_gen;	/**< User generation for approved_bw	*/
+  unsigned long level_gen;	/**< Level generation for approved_bw	*/
+  struct qsup_server_t *user_next, **user_pprev;	/**< Servers of the user    */
+  struct qsup_server_t *level_next, **level_pprev;	/**< Servers of the level   */
+  struct qsup_server_t *dirty_next, **dirty_pprev;	/**< See qsup_pop_dirty()   */
   struct qsup_server_t *next;	/**< Next qsup_server_t struct in global qsup_servers list */
 } qsup_server_t;
 
@@ -89,15 +98,40 @@ qos_rv qsup_cleanup(void);
 //int qsup_set_user(int user_id, qsup_constraints_t * rule);
 //qsup_constraints_t * qsup_get_user(int user_id);
 
+/** Replace the levels of the QSUP with num empty ones, only while no
+ ** server exists. qsup_init() allocates QSUP_NUM_LEVELS of them, or the
+ ** number given through the levels module parameter.
+ **/
+qos_rv qsup_set_num_levels(int num);
+
+/** Number of levels of the QSUP */
+int qsup_get_num_levels(void);
+
 /** Add a level rule to the QSUP */
 qos_rv qsup_add_level_rule(int level, qos_bw_t max_bw);
 
-/** Add a group rule to the QSUP */
+/** Add a group rule to the QSUP, or replace the one in force for gid.
+ ** Servers already created move to the new constraints, keeping the
+ ** guaranteed bandwidth they were admitted with.
+ **/
 qos_rv qsup_add_group_constraints(int gid, qsup_constraints_t *constr);
 
-/** Add a user rule to the QSUP */
+/** Add a user rule to the QSUP, or replace the one in force for uid */
 qos_rv qsup_add_user_constraints(int uid, qsup_constraints_t *constr);
 
+/** Remove the group rule in force for gid */
+qos_rv qsup_del_group_rule(int gid);
+
+/** Remove the user rule in force for uid */
+qos_rv qsup_del_user_rule(int uid);
+
+/** Replace all the user and group rules at once, returning in *p_version,
+ ** if not NULL, the version of the new rules.
+ **/
+qos_rv qsup_set_rules(const qsup_rule_t *users, unsigned int num_users,
+		      const qsup_rule_t *groups, unsigned int num_groups,
+		      unsigned long *p_version);
+
 /** Create a new qsup_server_t structure
  *
  * @return	The server_id of the new server, if greater than or equal to zero,
@@ -115,15 +149,38 @@ qos_rv qsup_cleanup_server(qsup_server_t *srv);
 /** Sets the required bandwidth for the specified server	*/
 qos_rv qsup_set_required_bw(qsup_server_t *srv, qos_bw_t server_req);
 
+/** Defer the recomputation of the per-level bandwidths, done by each
+ ** qsup_set_required_bw(), until the matching qsup_batch_end(). Calls
+ ** may nest. Approved bandwidths are stale in the meantime.
+ **
+ ** As all of the supervisor state, the nesting depth is protected by
+ ** the caller, i.e., by qres_lock() in the kernel.
+ **/
+void qsup_batch_begin(void);
+
+/** Recompute the per-level bandwidths once, for all the requests changed
+ ** since the outermost qsup_batch_begin().
+ **/
+void qsup_batch_end(void);
+
 /** Gets the required bandwidth for the specified server	*/
 qos_bw_t qsup_get_required_bw(qsup_server_t *srv);
 
 /** Gets the minimum granted bandwidth for the specified server	*/
 qos_bw_t qsup_get_guaranteed_bw(qsup_server_t *srv);
 
-/** Returns the bandwidth approved for the specified server	*/
+/** Returns the bandwidth approved for the specified server, cached
+ ** until the request or the coefficients applying to it change.
+ **/
 qos_bw_t qsup_get_approved_bw(qsup_server_t *srv);
 
+/** Take one of the servers whose approved bandwidth may have changed
+ ** since it was last taken, or since its creation.
+ **
+ ** @return NULL once no such server is left
+ **/
+qsup_server_t *qsup_pop_dirty(void);
+
 /** Returns the maximum guaranteed bandwidth for the specified user */
 qos_bw_t qsup_get_max_gua_bw(int uid, int gid);
 
@@ -136,12 +193,37 @@ qos_rv qsup_get_avail_bw(int uid, int gid, qos_bw_t *p_avail_bw);
 /** Dumps into the log system the QSUP server complete state	*/
 void qsup_dump(void);
 
-/** Find the constraints in force for the supplied uid/gid pair */
-qsup_constraints_t *qsup_find_constr(int uid, int gid);
-
-/** Set the spare bandwidth for admission control purposes	*/
+/** Copy into *p_constr the constraints in force for the uid/gid pair */
+void qsup_find_constr(int uid, int gid, qsup_constraints_t *p_constr);
+
+/** Set the spare bandwidth, left to non-reserved work, at any time.
+ **
+ ** Approved bandwidths are recompressed to the new total left to the
+ ** levels, while guaranteed minimums are never reduced.
+ **
+ ** @return QOS_E_SYSTEM_OVERLOAD if the admitted guarantees would not
+ **         fit in what is left, and the spare is not changed
+ **/
 qos_rv qsup_reserve_spare(qos_bw_t spare_bw);
 
+/** Select the schedulability test used to admit guaranteed bandwidths.
+ **
+ ** @return QOS_E_SYSTEM_OVERLOAD if the already admitted servers do not
+ **         pass the new test, that is not selected
+ **/
+qos_rv qsup_set_adm_test(qsup_adm_kind_t kind);
+
+/** Select how the servers of a level are compressed on overload */
+qos_rv qsup_set_level_policy(int level, qsup_compress_t policy);
+
+/** Set the elasticity of srv, that cannot be lower than the weight of
+ ** the rule in force for its user, nor exceed QSUP_MAX_ELASTICITY.
+ **/
+qos_rv qsup_set_elasticity(qsup_server_t *srv, unsigned int elasticity);
+
+/** Get the elasticity of srv */
+unsigned int qsup_get_elasticity(qsup_server_t *srv);
+
 /** @} */
 
 #endif
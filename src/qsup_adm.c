@@ -0,0 +1,224 @@
+/** @file
+ ** @brief Pluggable schedulability tests for the admission of guaranteed
+ ** bandwidths.
+ **
+ ** All tests see the capacity of the set as a whole processor: budgets
+ ** are scaled by 1/cap, rounding up, before being analysed.
+ **/
+
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qsup_adm.h"
+#include "qos_ul.h"
+
+/** Number of fractional bits of the hyperbolic product */
+#define QSUP_ADM_HYP_BITS 16
+
+#define QSUP_ADM_HYP_ONE (1ull << QSUP_ADM_HYP_BITS)
+
+/** Return bw / cap, rounded up, with QSUP_ADM_HYP_BITS fractional bits */
+static inline __u64 qsup_adm_hyp_factor(qsup_adm_set_t *set, qos_bw_t bw) {
+  if (set->cap == 0)
+    return (bw == 0) ? QSUP_ADM_HYP_ONE : 3 * QSUP_ADM_HYP_ONE;
+  return QSUP_ADM_HYP_ONE + ull_div64((((__u64) bw) << QSUP_ADM_HYP_BITS) + set->cap - 1, set->cap);
+}
+
+static inline __u64 qsup_adm_hyp_mul(__u64 hyper, __u64 factor) {
+  return (hyper * factor + QSUP_ADM_HYP_ONE - 1) >> QSUP_ADM_HYP_BITS;
+}
+
+static inline qres_time_t qsup_adm_ceil(qres_time_t t, qres_time_t P) {
+  return (t + P - 1) / P;
+}
+
+/** Iterate the response time of t, starting from R, interfered by the
+ ** tasks from hp up to stop excluded, and by extra if not NULL.
+ **
+ ** R must not exceed the actual response time, so that the iteration
+ ** only grows. It stops as soon as R exceeds the deadline of t.
+ **/
+static qres_time_t qsup_adm_rta(qsup_adm_task_t *hp, qsup_adm_task_t *stop,
+				qsup_adm_task_t *t, qsup_adm_task_t *extra, qres_time_t R) {
+  qres_time_t R_prev;
+  do {
+    qsup_adm_task_t *j;
+    R_prev = R;
+    R = t->C;
+    for (j = hp; j != stop; j = j->next)
+      R += qsup_adm_ceil(R_prev, j->P) * j->C;
+    if (extra != NULL)
+      R += qsup_adm_ceil(R_prev, extra->P) * extra->C;
+  } while (R != R_prev && R <= t->P);
+  return R;
+}
+
+/** Sum of the budgets of the tasks from hp up to stop excluded */
+static qres_time_t qsup_adm_sum_C(qsup_adm_task_t *hp, qsup_adm_task_t *stop) {
+  qres_time_t sum = 0;
+  for (; hp != stop; hp = hp->next)
+    sum += hp->C;
+  return sum;
+}
+
+/** First task in set with a lower priority than t, ties going to the oldest */
+static qsup_adm_task_t *qsup_adm_find_pos(qsup_adm_set_t *set, qsup_adm_task_t *t) {
+  qsup_adm_task_t *pos = set->tasks;
+  while (pos != NULL && pos->P <= t->P)
+    pos = pos->next;
+  return pos;
+}
+
+/** Recompute the response times of the tasks from i onwards, from scratch */
+static qos_bool_t qsup_adm_rta_from(qsup_adm_set_t *set, qsup_adm_task_t *i) {
+  qos_bool_t ok = 1;
+  for (; i != NULL; i = i->next) {
+    i->R = qsup_adm_rta(set->tasks, i, i, NULL, i->C + qsup_adm_sum_C(set->tasks, i));
+    if (i->R > i->P)
+      ok = 0;
+  }
+  return ok;
+}
+
+static __u64 qsup_adm_hyp_product(qsup_adm_set_t *set) {
+  qsup_adm_task_t *t;
+  __u64 hyper = QSUP_ADM_HYP_ONE;
+  for (t = set->tasks; t != NULL; t = t->next)
+    hyper = qsup_adm_hyp_mul(hyper, qsup_adm_hyp_factor(set, t->bw));
+  return hyper;
+}
+
+void qsup_adm_init(qsup_adm_set_t *set, qsup_adm_kind_t kind, qos_bw_t cap) {
+  set->kind = kind;
+  set->cap = cap;
+  set->gua = 0;
+  set->hyper = QSUP_ADM_HYP_ONE;
+  set->tasks = NULL;
+}
+
+/** Scale the budget of t to the capacity of set */
+static void qsup_adm_scale(qsup_adm_set_t *set, qsup_adm_task_t *t) {
+  if (set->cap == 0)
+    /* Whatever the test, no budget fits */
+    t->C = (t->Q_min == 0) ? 0 : t->P + 1;
+  else
+    t->C = (qres_time_t) ull_div64((((__u64) t->Q_min) << QOS_BW_BITS) + set->cap - 1, set->cap);
+}
+
+void qsup_adm_task_init(qsup_adm_set_t *set, qsup_adm_task_t *t, qres_time_t Q_min, qres_time_t P) {
+  t->bw = r2bw_ceil(Q_min, P);
+  t->Q_min = Q_min;
+  t->P = P;
+  qsup_adm_scale(set, t);
+  t->R = t->R_new = t->C;
+  t->next = NULL;
+}
+
+qos_bool_t qsup_adm_admit(qsup_adm_set_t *set, qsup_adm_task_t *t) {
+  qsup_adm_task_t *pos, *i;
+
+  if (set->gua + t->bw > set->cap)
+    return 0;
+  switch (set->kind) {
+  case QSUP_ADM_UTIL:
+    return 1;
+  case QSUP_ADM_HYPERBOLIC:
+    return qsup_adm_hyp_mul(set->hyper, qsup_adm_hyp_factor(set, t->bw)) <= 2 * QSUP_ADM_HYP_ONE;
+  case QSUP_ADM_RTA:
+    /* Only t and the tasks it preempts need to be analysed, the latter
+     * starting from their cached response times, that can only grow */
+    pos = qsup_adm_find_pos(set, t);
+    t->R_new = qsup_adm_rta(set->tasks, pos, t, NULL, t->C + qsup_adm_sum_C(set->tasks, pos));
+    if (t->R_new > t->P)
+      return 0;
+    for (i = pos; i != NULL; i = i->next) {
+      i->R_new = qsup_adm_rta(set->tasks, i, i, t, i->R);
+      if (i->R_new > i->P)
+	return 0;
+    }
+    return 1;
+  default:
+    break;
+  }
+  return 0;
+}
+
+void qsup_adm_add(qsup_adm_set_t *set, qsup_adm_task_t *t) {
+  qsup_adm_task_t **pp = &set->tasks;
+
+  while (*pp != NULL && (*pp)->P <= t->P)
+    pp = &(*pp)->next;
+  t->next = *pp;
+  *pp = t;
+  set->gua += t->bw;
+  set->hyper = qsup_adm_hyp_mul(set->hyper, qsup_adm_hyp_factor(set, t->bw));
+  if (set->kind == QSUP_ADM_RTA) {
+    qsup_adm_task_t *i;
+    for (i = t; i != NULL; i = i->next)
+      i->R = i->R_new;
+  }
+}
+
+void qsup_adm_remove(qsup_adm_set_t *set, qsup_adm_task_t *t) {
+  qsup_adm_task_t **pp = &set->tasks;
+
+  while (*pp != NULL && *pp != t)
+    pp = &(*pp)->next;
+  if (*pp == NULL) {
+    qos_log_err("Removing task not in set");
+    return;
+  }
+  *pp = t->next;
+  t->next = NULL;
+  set->gua -= t->bw;
+  /* Dividing would accumulate rounding errors */
+  set->hyper = qsup_adm_hyp_product(set);
+  if (set->kind == QSUP_ADM_RTA)
+    qsup_adm_rta_from(set, *pp);
+}
+
+/** Check whether the tasks of set pass the test kind, refreshing the
+ ** response times cached for it.
+ **/
+static qos_bool_t qsup_adm_passes(qsup_adm_set_t *set, qsup_adm_kind_t kind) {
+  switch (kind) {
+  case QSUP_ADM_UTIL:
+    return set->gua <= set->cap;
+  case QSUP_ADM_HYPERBOLIC:
+    return set->gua <= set->cap && set->hyper <= 2 * QSUP_ADM_HYP_ONE;
+  case QSUP_ADM_RTA:
+    return qsup_adm_rta_from(set, set->tasks) && set->gua <= set->cap;
+  default:
+    break;
+  }
+  return 0;
+}
+
+/** Rescale all the tasks of set to its current capacity */
+static void qsup_adm_rescale(qsup_adm_set_t *set) {
+  qsup_adm_task_t *t;
+  for (t = set->tasks; t != NULL; t = t->next)
+    qsup_adm_scale(set, t);
+  set->hyper = qsup_adm_hyp_product(set);
+}
+
+qos_rv qsup_adm_set_cap(qsup_adm_set_t *set, qos_bw_t cap) {
+  qos_bw_t old_cap = set->cap;
+
+  set->cap = cap;
+  qsup_adm_rescale(set);
+  if (qsup_adm_passes(set, set->kind))
+    return QOS_OK;
+  set->cap = old_cap;
+  qsup_adm_rescale(set);
+  qsup_adm_passes(set, set->kind);
+  return QOS_E_SYSTEM_OVERLOAD;
+}
+
+qos_rv qsup_adm_set_kind(qsup_adm_set_t *set, qsup_adm_kind_t kind) {
+  qos_chk_rv(kind >= 0 && kind < QSUP_ADM_NUM, QOS_E_INVALID_PARAM);
+  if (kind != QSUP_ADM_UTIL && ! qsup_adm_passes(set, kind))
+    return QOS_E_SYSTEM_OVERLOAD;
+  set->kind = kind;
+  return QOS_OK;
+}
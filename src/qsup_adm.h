@@ -0,0 +1,76 @@
+/** @addtogroup QSUP_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Pluggable schedulability tests for the admission of guaranteed
+ * bandwidths.
+ *
+ * A qsup_adm_set_t is a partition of the processing capacity, together
+ * with the guaranteed reservations admitted on it and the state cached
+ * by the tests, so that admitting one more reservation costs far less
+ * than re-analysing the whole set. Each partition has its own test,
+ * that may be changed at run-time if the admitted set passes the new one.
+ */
+
+#ifndef __QSUP_ADM_H__
+#define __QSUP_ADM_H__
+
+#include "qsup_gw.h"
+#include "qos_types.h"
+
+/** A guaranteed reservation, as seen by the schedulability tests */
+typedef struct qsup_adm_task_t {
+  qos_bw_t bw;		/**< Guaranteed bandwidth, r2bw_ceil(Q_min, P)	*/
+  qres_time_t Q_min;	/**< Guaranteed budget				*/
+  qres_time_t C;	/**< Q_min scaled to the capacity of the set	*/
+  qres_time_t P;	/**< Period					*/
+  qres_time_t R;	/**< Cached response time (RTA only)		*/
+  qres_time_t R_new;	/**< Response time if the last admit() succeeds	*/
+  struct qsup_adm_task_t *next;	/**< Next task, by increasing period	*/
+} qsup_adm_task_t;
+
+/** A partition of the processing capacity */
+typedef struct qsup_adm_set_t {
+  qsup_adm_kind_t kind;	/**< Test in use				*/
+  qos_bw_t cap;		/**< Capacity available to guarantees		*/
+  qos_bw_t gua;		/**< Sum of the admitted guarantees		*/
+  __u64 hyper;		/**< prod(bw_i / cap + 1), see QSUP_ADM_HYP_BITS */
+  qsup_adm_task_t *tasks;	/**< Admitted tasks, by increasing period */
+} qsup_adm_set_t;
+
+/** Initialize an empty set with the supplied test and capacity */
+void qsup_adm_init(qsup_adm_set_t *set, qsup_adm_kind_t kind, qos_bw_t cap);
+
+/** Fill in t for a reservation guaranteeing Q_min every P on set */
+void qsup_adm_task_init(qsup_adm_set_t *set, qsup_adm_task_t *t, qres_time_t Q_min, qres_time_t P);
+
+/** Check whether t may be added to set without breaking its test.
+ **
+ ** The outcome is cached for a qsup_adm_add() of the same task, that
+ ** must follow with no other change to the set in between.
+ **/
+qos_bool_t qsup_adm_admit(qsup_adm_set_t *set, qsup_adm_task_t *t);
+
+/** Add to set a task just accepted by qsup_adm_admit() */
+void qsup_adm_add(qsup_adm_set_t *set, qsup_adm_task_t *t);
+
+/** Remove from set a previously added task */
+void qsup_adm_remove(qsup_adm_set_t *set, qsup_adm_task_t *t);
+
+/** Change the capacity of set, provided its tasks pass its test with
+ ** the new capacity
+ **
+ ** @return QOS_E_SYSTEM_OVERLOAD, leaving the capacity unchanged, if they don't
+ **/
+qos_rv qsup_adm_set_cap(qsup_adm_set_t *set, qos_bw_t cap);
+
+/** Switch set to a different test, provided its tasks pass it
+ **
+ ** @return QOS_E_SYSTEM_OVERLOAD, leaving the test unchanged, if they don't
+ **/
+qos_rv qsup_adm_set_kind(qsup_adm_set_t *set, qsup_adm_kind_t kind);
+
+#endif
+
+/** @} */
@@ -24,6 +24,80 @@ typedef struct qsup_constraints_t {
   unsigned int flags_mask; /**< Mask of unallowed flags         */
 } qsup_constraints_t;
 
+/** Maximum number of levels of the supervisor */
+#define QSUP_MAX_LEVELS 256
+
+/** Rule applying to all servers of a user, or of a group	*/
+typedef struct qsup_rule_t {
+  int id;			/**< UID or GID the rule applies to	*/
+  qsup_constraints_t constr;	/**< Constraints enforced		*/
+} qsup_rule_t;
+
+/** Maximum number of user rules, and of group rules, in force */
+#define QSUP_MAX_RULES 1024
+
+/** Schedulability tests for the admission of guaranteed bandwidths.
+ **
+ ** Server deadlines equal their periods, so QSUP_ADM_UTIL is also the
+ ** exact processor-demand test for EDF. The others assume fixed
+ ** priorities assigned by period (Rate Monotonic).
+ **/
+typedef enum {
+  QSUP_ADM_UTIL,	/**< Sum of guarantees within the capacity	*/
+  QSUP_ADM_HYPERBOLIC,	/**< Hyperbolic bound, prod(U_i + 1) <= 2	*/
+  QSUP_ADM_RTA,		/**< Exact response-time analysis		*/
+  QSUP_ADM_NUM		/**< Number of available tests			*/
+} qsup_adm_kind_t;
+
+/** Compression policies of the servers within a level, on overload.
+ **
+ ** With QSUP_COMPRESS_ELASTIC, bandwidth is taken first from servers in
+ ** proportion to their elasticity, initially the weight of the rule in
+ ** force for their user, down to their guaranteed minimum.
+ **/
+typedef enum {
+  QSUP_COMPRESS_PROPORTIONAL,	/**< Same coefficient for all servers	*/
+  QSUP_COMPRESS_ELASTIC,	/**< Elastic task model			*/
+} qsup_compress_t;
+
+/** Maximum elasticity of a server */
+#define QSUP_MAX_ELASTICITY 1024
+
+/** Kinds of admission decision recorded by the supervisor */
+typedef enum {
+  QSUP_DEC_INIT,	/**< Admission of a new server, qsup_init_server() */
+  QSUP_DEC_SET_REQ,	/**< Change of request, qsup_set_required_bw()	*/
+} qsup_decision_op_t;
+
+/** The request was saturated to the per-user maximum */
+#define QSUP_DEC_F_SATURATED	0x01
+/** The approved bandwidth is lower than the requested one */
+#define QSUP_DEC_F_COMPRESSED	0x02
+
+/** Compact record of an admission decision of the supervisor.
+ **
+ ** Bandwidths and coefficients are fixed-point numbers, whose number of
+ ** fractional bits is returned along with the records.
+ **/
+typedef struct qsup_decision_t {
+  __u64 timestamp;	/**< Time of the decision (ns, monotonic)	*/
+  __u64 req_bw;		/**< Requested bandwidth			*/
+  __u64 gua_bw;		/**< Guaranteed bandwidth			*/
+  __u64 approved_bw;	/**< Approved bandwidth, after the decision	*/
+  __u64 level_coeff;	/**< Compression coefficient of the level	*/
+  __u64 user_coeff;	/**< Compression coefficient of the user	*/
+  __s32 uid;
+  __s32 gid;
+  __s32 server_id;	/**< Supervisor server id, -1 if not admitted	*/
+  __s8 rv;		/**< Outcome, as a qos_rv integer		*/
+  __u8 op;		/**< One of qsup_decision_op_t			*/
+  __u8 level;		/**< Level of the server			*/
+  __u8 flags;		/**< Mask of QSUP_DEC_F_* flags			*/
+} qsup_decision_t;
+
+/** Maximum number of records retrieved by QSUP_OP_GET_DECISIONS */
+#define QSUP_MAX_DECISIONS 1024
+
 /** Types of operation that can be requested to the QSUP module */
 typedef enum {
   QSUP_OP_ADD_LEVEL_RULE,
@@ -32,6 +106,12 @@ typedef enum {
   QSUP_OP_FIND_CONSTR,
   QSUP_OP_GET_AVAIL_GUA_BW,
   QSUP_OP_RESERVE_SPARE,
+  QSUP_OP_GET_DECISIONS,
+  QSUP_OP_SET_ADM_TEST,
+  QSUP_OP_SET_LEVEL_POLICY,
+  QSUP_OP_DEL_GROUP_RULE,
+  QSUP_OP_DEL_USER_RULE,
+  QSUP_OP_SET_RULES,
 } qsup_op_t;
 
 typedef struct qsup_iparams_t {
@@ -57,9 +137,102 @@ typedef struct qsup_iparams_t {
       qos_bw_t avail_gua_bw;
     } avail;
     qos_bw_t spare_bw;
+    struct {
+      unsigned int num;		/**< In: room in p_recs, out: records	*/
+      unsigned int bw_bits;	/**< Fractional bits of bandwidths	*/
+      unsigned int coeff_bits;	/**< Fractional bits of coefficients	*/
+      qsup_decision_t *p_recs;	/**< Records, most recent first		*/
+    } decisions;
+    qsup_adm_kind_t adm_test;
+    struct {
+      int level_id;
+      qsup_compress_t policy;
+    } level_policy;
   } u;
 } qsup_iparams_t;
 
+/** Flag or-ed into the operation code by callers exchanging a
+ ** qsup_iparams_t, with bandwidths in the configured qos_bw_t format.
+ **
+ ** Requests without it carry a qsup_iparams24_t, as issued by callers
+ ** built before QOS_BW_WIDE was available. QSUP_OP_SET_RULES ignores
+ ** it, see qsup_rules_iparams_t.
+ **/
+#define QSUP_OP_BW_WIDE 0x80
+
+/** Legacy layout of qsup_constraints_t, with 24-bit bandwidths */
+typedef struct qsup_constraints24_t {
+  int level;
+  int weight;
+  qos_bw24_t max_bw;
+  qos_bw24_t max_min_bw;
+  unsigned int flags_mask;
+} qsup_constraints24_t;
+
+/** Legacy layout of qsup_iparams_t, with 24-bit bandwidths */
+typedef struct qsup_iparams24_t {
+  union {
+    struct {
+      int level_id;
+      qos_bw24_t max_level_bw;
+    } level_rule;
+    struct {
+      int gid;
+      qsup_constraints24_t constr;
+    } group_rule;
+    struct {
+      int uid;
+      qsup_constraints24_t constr;
+    } user_rule;
+    struct {
+      int uid, gid;
+      qsup_constraints24_t constr;
+    } found_rule;
+    struct {
+      int uid, gid;
+      qos_bw24_t avail_gua_bw;
+    } avail;
+    qos_bw24_t spare_bw;
+    struct {
+      unsigned int num;
+      unsigned int bw_bits;
+      unsigned int coeff_bits;
+      qsup_decision_t *p_recs;
+    } decisions;
+    qsup_adm_kind_t adm_test;
+    struct {
+      int level_id;
+      qsup_compress_t policy;
+    } level_policy;
+  } u;
+} qsup_iparams24_t;
+
+/** A rule of QSUP_OP_SET_RULES, with bandwidths of any precision */
+typedef struct qsup_rule_arg_t {
+  __s32 id;			/**< UID or GID the rule applies to	*/
+  __s32 level;			/**< Level of the user/group processes	*/
+  __s32 weight;			/**< Weight of the user/group processes	*/
+  __u32 flags_mask;		/**< Mask of unallowed flags		*/
+  __u64 max_bw;			/**< Maximum per-user bandwidth		*/
+  __u64 max_min_bw;		/**< Max per-process guaranteed bw	*/
+} qsup_rule_arg_t;
+
+/** Parameters of QSUP_OP_SET_RULES.
+ **
+ ** Unlike the other operations, the layout does not depend on
+ ** QSUP_OP_BW_WIDE, that is ignored: bandwidths in the rules have the
+ ** number of fractional bits stated by the caller.
+ **/
+typedef struct qsup_rules_iparams_t {
+  __u32 num_users;		/**< Entries in p_users			*/
+  __u32 num_groups;		/**< Entries in p_groups		*/
+  __u32 bw_bits;		/**< Fractional bits of bandwidths	*/
+  __u32 reserved;
+  qsup_rule_arg_t *p_users;	/**< User rules, in any order		*/
+  qsup_rule_arg_t *p_groups;	/**< Group rules, in any order		*/
+  __u64 version;		/**< Out: version of the new rules	*/
+} qsup_rules_iparams_t;
+
 /** Name of the QoS Supervisor device used to	*
  * communicate with the kernel module		*/
 #define QSUP_DEV_NAME "qossup"
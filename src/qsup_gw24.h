@@ -0,0 +1,107 @@
+#ifndef __QSUP_GW24_H__
+#define __QSUP_GW24_H__
+
+/** @file
+ *
+ * @brief Conversions between the qsup_iparams_t layout and the legacy
+ * qsup_iparams24_t one, with 24-bit bandwidths.
+ *
+ * @ingroup QSUP_MOD
+ */
+
+#include "qsup_gw.h"
+
+#ifdef QOS_KS
+#  include <linux/string.h>
+#else
+#  include <string.h>
+#endif
+
+/** Convert constraints from the legacy 24-bit layout */
+static inline void qsup_constr_from24(qsup_constraints_t *p, const qsup_constraints24_t *p24) {
+  p->level = p24->level;
+  p->weight = p24->weight;
+  p->max_bw = bw24_to_bw(p24->max_bw);
+  p->max_min_bw = bw24_to_bw(p24->max_min_bw);
+  p->flags_mask = p24->flags_mask;
+}
+
+/** Convert constraints to the legacy 24-bit layout, lower-rounding them */
+static inline void qsup_constr_to24(qsup_constraints24_t *p24, const qsup_constraints_t *p) {
+  p24->level = p->level;
+  p24->weight = p->weight;
+  p24->max_bw = bw_to_bw24(p->max_bw);
+  p24->max_min_bw = bw_to_bw24(p->max_min_bw);
+  p24->flags_mask = p->flags_mask;
+}
+
+/** Convert the parameters of op from the legacy 24-bit layout */
+static inline void qsup_iparams_from24(qsup_op_t op, qsup_iparams_t *p, const qsup_iparams24_t *p24) {
+  memset(p, 0, sizeof(*p));
+  switch (op) {
+  case QSUP_OP_ADD_LEVEL_RULE:
+    p->u.level_rule.level_id = p24->u.level_rule.level_id;
+    p->u.level_rule.max_level_bw = bw24_to_bw(p24->u.level_rule.max_level_bw);
+    break;
+  case QSUP_OP_ADD_GROUP_RULE:
+    p->u.group_rule.gid = p24->u.group_rule.gid;
+    qsup_constr_from24(&p->u.group_rule.constr, &p24->u.group_rule.constr);
+    break;
+  case QSUP_OP_ADD_USER_RULE:
+    p->u.user_rule.uid = p24->u.user_rule.uid;
+    qsup_constr_from24(&p->u.user_rule.constr, &p24->u.user_rule.constr);
+    break;
+  case QSUP_OP_DEL_GROUP_RULE:
+    p->u.group_rule.gid = p24->u.group_rule.gid;
+    break;
+  case QSUP_OP_DEL_USER_RULE:
+    p->u.user_rule.uid = p24->u.user_rule.uid;
+    break;
+  case QSUP_OP_FIND_CONSTR:
+    p->u.found_rule.uid = p24->u.found_rule.uid;
+    p->u.found_rule.gid = p24->u.found_rule.gid;
+    break;
+  case QSUP_OP_GET_AVAIL_GUA_BW:
+    p->u.avail.uid = p24->u.avail.uid;
+    p->u.avail.gid = p24->u.avail.gid;
+    break;
+  case QSUP_OP_RESERVE_SPARE:
+    p->u.spare_bw = bw24_to_bw(p24->u.spare_bw);
+    break;
+  case QSUP_OP_GET_DECISIONS:
+    p->u.decisions.num = p24->u.decisions.num;
+    p->u.decisions.p_recs = p24->u.decisions.p_recs;
+    break;
+  case QSUP_OP_SET_ADM_TEST:
+    p->u.adm_test = p24->u.adm_test;
+    break;
+  case QSUP_OP_SET_LEVEL_POLICY:
+    p->u.level_policy.level_id = p24->u.level_policy.level_id;
+    p->u.level_policy.policy = p24->u.level_policy.policy;
+    break;
+  default:
+    break;
+  }
+}
+
+/** Convert the results of op to the legacy 24-bit layout */
+static inline void qsup_iparams_to24(qsup_op_t op, qsup_iparams24_t *p24, const qsup_iparams_t *p) {
+  memset(p24, 0, sizeof(*p24));
+  if (op == QSUP_OP_FIND_CONSTR) {
+    p24->u.found_rule.uid = p->u.found_rule.uid;
+    p24->u.found_rule.gid = p->u.found_rule.gid;
+    qsup_constr_to24(&p24->u.found_rule.constr, &p->u.found_rule.constr);
+  } else if (op == QSUP_OP_GET_AVAIL_GUA_BW) {
+    p24->u.avail.uid = p->u.avail.uid;
+    p24->u.avail.gid = p->u.avail.gid;
+    p24->u.avail.avail_gua_bw = bw_to_bw24(p->u.avail.avail_gua_bw);
+  } else if (op == QSUP_OP_GET_DECISIONS) {
+    /* Records are self-describing, so they are never converted */
+    p24->u.decisions.num = p->u.decisions.num;
+    p24->u.decisions.bw_bits = p->u.decisions.bw_bits;
+    p24->u.decisions.coeff_bits = p->u.decisions.coeff_bits;
+    p24->u.decisions.p_recs = p->u.decisions.p_recs;
+  }
+}
+
+#endif
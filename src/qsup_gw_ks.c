@@ -8,20 +8,30 @@
 #include "qos_prof.h"
 
 #include "qsup_gw_ks.h"
+#include "qsup_gw24.h"
 #include "qsup.h"
+#include "qsup_rec.h"
 #include "kal_sched.h"
 #include "qos_memory.h"
 #include "rres_interface.h"
+#include "qres_interface.h"
 
 #include <linux/kernel.h>
 #include <linux/version.h>
 #include <linux/module.h>
 #include <asm/uaccess.h>
 #include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
 
 #define QSUP_DEFAULT_SRV_MAX_BW r2bw(45000, 50000)
 #define QSUP_DEFAULT_SRV_MAX_MIN_BW r2bw(40000, 50000)
 
+/** Decisions copied to US at a time by QSUP_OP_GET_DECISIONS */
+#define QSUP_DEC_CHUNK 16
+/** Rules copied from US at a time by QSUP_OP_SET_RULES */
+#define QSUP_RULES_CHUNK 8
+
 qos_rv qsup_init_ks(void) {
   qos_log_debug("Starting function");
 
@@ -35,6 +45,138 @@ qos_rv qsup_cleanup_ks(void) {
   return qsup_cleanup();
 }
 
+/** Copy the results of op back to US, in the layout used by the caller */
+static qos_rv qsup_gw_copy_out(qsup_op_t op, void __user *up_iparams, qsup_iparams_t *p, qos_bool_t legacy) {
+  qsup_iparams24_t iparams24;
+
+  if (! legacy) {
+    if (copy_to_user(up_iparams, p, sizeof(qsup_iparams_t)))
+      return QOS_E_INTERNAL_ERROR;
+    return QOS_OK;
+  }
+  qsup_iparams_to24(op, &iparams24, p);
+  if (copy_to_user(up_iparams, &iparams24, sizeof(qsup_iparams24_t)))
+    return QOS_E_INTERNAL_ERROR;
+  return QOS_OK;
+}
+
+/** Copy to US up to p->u.decisions.num records of the flight recorder,
+ ** the most recent first, updating num to the number of copied ones.
+ **/
+static qos_rv qsup_gw_get_decisions(qsup_iparams_t *p) {
+#ifdef QSUP_REC
+  qsup_decision_t *recs;
+  qsup_rec_iter_t it;
+  unsigned int num = p->u.decisions.num, copied = 0;
+  qos_rv rv = QOS_OK;
+
+  p->u.decisions.bw_bits = QOS_BW_BITS;
+  p->u.decisions.coeff_bits = QSUP_COEFF_BITS;
+  if (num > QSUP_MAX_DECISIONS)
+    num = QSUP_MAX_DECISIONS;
+  p->u.decisions.num = 0;
+  if (num == 0)
+    return QOS_OK;
+  /* Records go out a chunk at a time, through a small buffer */
+  recs = qos_malloc(QSUP_DEC_CHUNK * sizeof(qsup_decision_t));
+  qos_chk_rv(recs != NULL, QOS_E_NO_MEMORY);
+  rv = qsup_rec_iter_init(&it);
+  while (rv == QOS_OK && copied < num) {
+    int n = qsup_rec_iter_next(&it, recs, min_t(unsigned int, num - copied, QSUP_DEC_CHUNK));
+    if (n == 0)
+      break;
+    if (copy_to_user(p->u.decisions.p_recs + copied, recs, n * sizeof(qsup_decision_t)))
+      rv = QOS_E_INVALID_PARAM;
+    else
+      copied += n;
+  }
+  qsup_rec_iter_cleanup(&it);
+  qos_free(recs);
+  if (rv == QOS_OK)
+    p->u.decisions.num = copied;
+  return rv;
+#else
+  return QOS_E_UNIMPLEMENTED;
+#endif
+}
+
+/** Convert a bandwidth with bits fractional bits to a qos_bw_t */
+static qos_rv qsup_gw_bw_from_arg(qos_bw_t *p_bw, __u64 bw, unsigned int bits) {
+  if (bits == 0 || bits > 62 || bw > (1ull << bits))
+    return QOS_E_INVALID_PARAM;
+  if (bits <= QOS_BW_BITS)
+    *p_bw = (qos_bw_t) (bw << (QOS_BW_BITS - bits));
+  else
+    *p_bw = (qos_bw_t) (bw >> (bits - QOS_BW_BITS));
+  return QOS_OK;
+}
+
+/** Copy from US num rules with bits fractional bits, into rules */
+static qos_rv qsup_gw_copy_rules(qsup_rule_t *rules, const qsup_rule_arg_t __user *up_args,
+				 unsigned int num, unsigned int bits) {
+  qsup_rule_arg_t args[QSUP_RULES_CHUNK];
+  unsigned int i, n;
+
+  for (; num > 0; num -= n, up_args += n, rules += n) {
+    n = min_t(unsigned int, num, QSUP_RULES_CHUNK);
+    if (copy_from_user(args, up_args, n * sizeof(qsup_rule_arg_t)))
+      return QOS_E_INVALID_PARAM;
+    for (i = 0; i < n; i++) {
+      rules[i].id = args[i].id;
+      rules[i].constr.level = args[i].level;
+      rules[i].constr.weight = args[i].weight;
+      rules[i].constr.flags_mask = args[i].flags_mask;
+      qos_chk_ok_ret(qsup_gw_bw_from_arg(&rules[i].constr.max_bw, args[i].max_bw, bits));
+      qos_chk_ok_ret(qsup_gw_bw_from_arg(&rules[i].constr.max_min_bw, args[i].max_min_bw, bits));
+    }
+  }
+  return QOS_OK;
+}
+
+/** Copy from US the user and group rules of QSUP_OP_SET_RULES, and put
+ ** them in force in place of all the ones currently in force.
+ **/
+static qos_rv qsup_gw_set_rules(void __user *up_iparams, unsigned long size) {
+  qsup_rules_iparams_t iparams;
+  qsup_rule_t *rules = NULL;
+  unsigned long version;
+  qos_rv rv = QOS_OK;
+
+  if (size != sizeof(qsup_rules_iparams_t)) {
+    qos_log_err("Wrong size");
+    return QOS_E_INTERNAL_ERROR;
+  }
+  if (copy_from_user(&iparams, up_iparams, sizeof(iparams)))
+    return QOS_E_INVALID_PARAM;
+  if (iparams.num_users > QSUP_MAX_RULES || iparams.num_groups > QSUP_MAX_RULES)
+    return QOS_E_INVALID_PARAM;
+  if (iparams.num_users + iparams.num_groups > 0) {
+    /* Up to some tens of KB, in process context */
+    rules = vmalloc((iparams.num_users + iparams.num_groups) * sizeof(qsup_rule_t));
+    qos_chk_rv(rules != NULL, QOS_E_NO_MEMORY);
+    rv = qsup_gw_copy_rules(rules, iparams.p_users, iparams.num_users, iparams.bw_bits);
+    if (rv == QOS_OK)
+      rv = qsup_gw_copy_rules(rules + iparams.num_users, iparams.p_groups,
+			      iparams.num_groups, iparams.bw_bits);
+  }
+  if (rv == QOS_OK) {
+    qres_lock();
+    rv = qsup_set_rules(rules, iparams.num_users, rules + iparams.num_users,
+			iparams.num_groups, &version);
+    if (rv == QOS_OK)
+      qres_update_bandwidths();
+    qres_unlock();
+  }
+  if (rules != NULL)
+    vfree(rules);
+  if (rv == QOS_OK) {
+    iparams.version = version;
+    if (copy_to_user(up_iparams, &iparams, sizeof(iparams)))
+      rv = QOS_E_INTERNAL_ERROR;
+  }
+  return rv;
+}
+
 /** Main US-to-KS gateway function.
  *
  * Copies parameters from US to KS, checks if requested operation is
@@ -42,31 +184,58 @@ qos_rv qsup_cleanup_ks(void) {
  * of requests, calling appropriate per-request functions. If needed,
  * copies return parameters back from KS to US.
  *
+ * Requests without QSUP_OP_BW_WIDE in op come with the legacy layout
+ * qsup_iparams24_t, that is converted to and from qsup_iparams_t,
+ * except QSUP_OP_SET_RULES, whose qsup_rules_iparams_t is the same
+ * in both cases.
+ *
  * @todo  avoid copy_from_user and copy_to_user with entire iparams struct
  *        when unneeded.
  */
 qos_rv qsup_gw_ks(qsup_op_t op, void __user *up_iparams, unsigned long size) {
   qsup_iparams_t iparams;
+  qsup_iparams24_t iparams24;
+  qos_bool_t legacy = ! (op & QSUP_OP_BW_WIDE);
+  qos_bool_t copy_out = 0;
   qos_rv err = QOS_OK;
-  kal_irq_state flags;
 
   qos_log_debug("Starting qsup_gw_ks()");
 
-  if (size != sizeof(qsup_iparams_t)) {
+  op = (qsup_op_t) (op & ~QSUP_OP_BW_WIDE);
+  if (op == QSUP_OP_SET_RULES) {
+    /* Same layout in both modes, see qsup_rules_iparams_t */
+    if (! qsup_authorize_op(NULL))
+      return QOS_E_UNAUTHORIZED;
+    return qsup_gw_set_rules(up_iparams, size);
+  }
+  if (size != (legacy ? sizeof(qsup_iparams24_t) : sizeof(qsup_iparams_t))) {
     qos_log_err("Wrong size");
     return QOS_E_INTERNAL_ERROR;
   }
 
-  if (copy_from_user(&iparams, up_iparams, sizeof(qsup_iparams_t)))
+  if (legacy) {
+    if (copy_from_user(&iparams24, up_iparams, sizeof(qsup_iparams24_t)))
+      return QOS_E_INVALID_PARAM;
+    qsup_iparams_from24(op, &iparams, &iparams24);
+  } else if (copy_from_user(&iparams, up_iparams, sizeof(qsup_iparams_t)))
     return QOS_E_INVALID_PARAM;
 
-  //kal_|spin_lock_irqsave(rres_get_spinlock(), &flags);
-
-  if (! qsup_authorize_op(&iparams)) {
-    //kal_spin_unlock_irqrestore(rres_get_spinlock(), &flags);
+  if (! qsup_authorize_op(&iparams))
     return QOS_E_UNAUTHORIZED;
+
+  /* Operations copying to US arrays, that lock by themselves */
+  switch (op) {
+  case QSUP_OP_GET_DECISIONS:
+    /* The flight recorder is read without the lock, see qsup_rec_get() */
+    err = qsup_gw_get_decisions(&iparams);
+    if (err == QOS_OK && qsup_gw_copy_out(op, up_iparams, &iparams, legacy) != QOS_OK)
+      err = QOS_E_INTERNAL_ERROR;
+    return err;
+  default:
+    break;
   }
 
+  qres_lock();
   switch (op) {
   case QSUP_OP_ADD_LEVEL_RULE:
     err = qsup_add_level_rule(iparams.u.level_rule.level_id, iparams.u.level_rule.max_level_bw);
@@ -74,36 +243,55 @@ qos_rv qsup_gw_ks(qsup_op_t op, void __user *up_iparams, unsigned long size) {
   case QSUP_OP_ADD_GROUP_RULE:
     err = qsup_add_group_constraints(iparams.u.group_rule.gid,
 				     &iparams.u.group_rule.constr);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
     break;
   case QSUP_OP_ADD_USER_RULE:
-    err = qsup_add_group_constraints(iparams.u.user_rule.uid,
-				     &iparams.u.user_rule.constr);
+    err = qsup_add_user_constraints(iparams.u.user_rule.uid,
+				    &iparams.u.user_rule.constr);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
+    break;
+  case QSUP_OP_DEL_GROUP_RULE:
+    err = qsup_del_group_rule(iparams.u.group_rule.gid);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
+    break;
+  case QSUP_OP_DEL_USER_RULE:
+    err = qsup_del_user_rule(iparams.u.user_rule.uid);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
+    break;
   case QSUP_OP_FIND_CONSTR:
-    iparams.u.found_rule.constr = 
-      *(qsup_find_constr(iparams.u.found_rule.uid, iparams.u.found_rule.gid));
-    //kal_spin_unlock_irqrestore(rres_get_spinlock(), &flags);
-    if (copy_to_user(up_iparams, &iparams, sizeof(qsup_iparams_t)))
-      err = QOS_E_INTERNAL_ERROR;
-    return err;
+    qsup_find_constr(iparams.u.found_rule.uid, iparams.u.found_rule.gid,
+		     &iparams.u.found_rule.constr);
+    copy_out = 1;
     break;
   case QSUP_OP_GET_AVAIL_GUA_BW:
     err = qsup_get_avail_gua_bw(iparams.u.avail.uid, iparams.u.avail.gid,
                                   &iparams.u.avail.avail_gua_bw);
-    if (err == QOS_OK) {
-      //kal_spin_unlock_irqrestore(rres_get_spinlock(), &flags);
-      if (copy_to_user(up_iparams, &iparams, sizeof(qsup_iparams_t)))
-        err = QOS_E_INTERNAL_ERROR;
-      return err;
-    }
+    copy_out = (err == QOS_OK);
     break;
   case QSUP_OP_RESERVE_SPARE:
     err = qsup_reserve_spare(iparams.u.spare_bw);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
+    break;
+  case QSUP_OP_SET_ADM_TEST:
+    err = qsup_set_adm_test(iparams.u.adm_test);
+    break;
+  case QSUP_OP_SET_LEVEL_POLICY:
+    err = qsup_set_level_policy(iparams.u.level_policy.level_id, iparams.u.level_policy.policy);
+    if (err == QOS_OK)
+      qres_update_bandwidths();
     break;
   default:
     qos_log_err("Unhandled operation code");
     err = QOS_E_INTERNAL_ERROR;	/* For debugging purposes */
   }
+  qres_unlock();
 
-  //kal_spin_unlock_irqrestore(rres_get_spinlock(), &flags);
+  if (copy_out && qsup_gw_copy_out(op, up_iparams, &iparams, legacy) != QOS_OK)
+    err = QOS_E_INTERNAL_ERROR;
   return err;
 }
@@ -25,7 +25,8 @@
  *
  * Operations on QSUP rules may only be done by root.
  *
- * @param iparams	Ptr to the iparams struct, in kernel-space.
+ * @param iparams	Ptr to the iparams struct, in kernel-space, or NULL
+ *			for QSUP_OP_SET_RULES.
  *
  * @return		1 on success, 0 otherwise.
  */
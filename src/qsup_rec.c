@@ -0,0 +1,203 @@
+/** @file
+ ** @brief Flight recorder of the admission decisions of the supervisor.
+ **
+ ** Each CPU appends the decisions taken on it to its own ring of the last
+ ** QSUP_REC_SIZE records, so that recording needs no locks and a single
+ ** atomic increment, and the recorder may be always on. Readers copy the
+ ** rings while they are being written, discarding the records that might
+ ** have been overwritten during the copy.
+ **
+ ** Clocks of different CPUs need not agree, so records are merged on a
+ ** global sequence number rather than on their timestamps, which are for
+ ** display only. Decisions are taken under qres_lock(), so the sequence
+ ** follows the order in which they were taken.
+ **/
+
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qsup_rec.h"
+#include "qos_memory.h"
+
+#ifdef QSUP_REC
+
+/** Slots of a ring: one more than the records kept, that may be being
+ ** overwritten while the others are read.
+ **/
+#define QSUP_REC_SLOTS (QSUP_REC_SIZE + 1)
+
+/** A recorded decision, along with its place in the global sequence */
+typedef struct qsup_rec_entry_t {
+  unsigned long seq;			/**< Global sequence number	*/
+  qsup_decision_t dec;
+} qsup_rec_entry_t;
+
+typedef struct qsup_rec_ring_t {
+  unsigned long head;			/**< Number of records ever added */
+  qsup_rec_entry_t recs[QSUP_REC_SLOTS];	/**< Record i is at i % QSUP_REC_SLOTS */
+} qsup_rec_ring_t;
+
+#ifdef QOS_KS
+
+#include <asm/atomic.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+
+static qsup_rec_ring_t *qsup_rec_rings = NULL;
+static atomic_long_t qsup_rec_seq = ATOMIC_LONG_INIT(0);
+
+#define qsup_rec_next_seq() ((unsigned long) atomic_long_inc_return(&qsup_rec_seq))
+
+#define qsup_rec_nr_rings() nr_cpu_ids
+#define qsup_rec_ring(cpu) per_cpu_ptr(qsup_rec_rings, (cpu))
+#define qsup_rec_ring_valid(cpu) cpu_possible(cpu)
+
+#else
+
+#include <string.h>
+#include <time.h>
+
+static qsup_rec_ring_t qsup_rec_ring0;
+static unsigned long qsup_rec_seq = 0;
+
+#define qsup_rec_next_seq() __sync_add_and_fetch(&qsup_rec_seq, 1)
+
+#define qsup_rec_nr_rings() 1
+#define qsup_rec_ring(cpu) (&qsup_rec_ring0)
+#define qsup_rec_ring_valid(cpu) 1
+#define smp_wmb() __sync_synchronize()
+#define smp_rmb() __sync_synchronize()
+#define ACCESS_ONCE(x) (*(volatile typeof(x) *) &(x))
+
+#endif
+
+qos_rv qsup_rec_init(void) {
+#ifdef QOS_KS
+  qsup_rec_rings = alloc_percpu(qsup_rec_ring_t);
+  qos_chk_rv(qsup_rec_rings != NULL, QOS_E_NO_MEMORY);
+#else
+  memset(&qsup_rec_ring0, 0, sizeof(qsup_rec_ring0));
+  qsup_rec_seq = 0;
+#endif
+  return QOS_OK;
+}
+
+void qsup_rec_cleanup(void) {
+#ifdef QOS_KS
+  if (qsup_rec_rings != NULL)
+    free_percpu(qsup_rec_rings);
+  qsup_rec_rings = NULL;
+#endif
+}
+
+void qsup_rec_add(qsup_decision_t *p_dec) {
+  qsup_rec_ring_t *ring;
+  qsup_rec_entry_t *entry;
+#ifdef QOS_KS
+  int cpu;
+
+  if (qsup_rec_rings == NULL)
+    return;
+  cpu = get_cpu();
+  ring = qsup_rec_ring(cpu);
+  p_dec->timestamp = cpu_clock(cpu);
+#else
+  struct timespec ts;
+
+  ring = qsup_rec_ring(0);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  p_dec->timestamp = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+  /* Readers seeing the slot overwritten must see the head making room */
+  smp_wmb();
+  entry = &ring->recs[ring->head % QSUP_REC_SLOTS];
+  entry->seq = qsup_rec_next_seq();
+  entry->dec = *p_dec;
+  /* Readers seeing the new head must see the record too */
+  smp_wmb();
+  ring->head++;
+#ifdef QOS_KS
+  put_cpu();
+#endif
+}
+
+qos_rv qsup_rec_iter_init(qsup_rec_iter_t *p_it) {
+  int cpu;
+
+  p_it->nr = qsup_rec_nr_rings();
+#ifdef QOS_KS
+  if (qsup_rec_rings == NULL)
+    p_it->nr = 0;
+#endif
+  p_it->next = NULL;
+  if (p_it->nr == 0)
+    return QOS_OK;
+  p_it->next = qos_malloc(2 * p_it->nr * sizeof(*p_it->next));
+  qos_chk_rv(p_it->next != NULL, QOS_E_NO_MEMORY);
+  p_it->low = p_it->next + p_it->nr;
+  for (cpu = 0; cpu < p_it->nr; ++cpu) {
+    unsigned long head = 0;
+    if (qsup_rec_ring_valid(cpu))
+      head = ACCESS_ONCE(qsup_rec_ring(cpu)->head);
+    p_it->next[cpu] = head;
+    p_it->low[cpu] = head > QSUP_REC_SIZE ? head - QSUP_REC_SIZE : 0;
+  }
+  return QOS_OK;
+}
+
+int qsup_rec_iter_next(qsup_rec_iter_t *p_it, qsup_decision_t *recs, int max) {
+  unsigned long *next = p_it->next, *low = p_it->low;
+  int cpu, n = 0;
+
+  /* Merge the rings, each one ordered by sequence, the most recent first */
+  while (n < max) {
+    int best = -1;
+    qsup_rec_ring_t *ring;
+    for (cpu = 0; cpu < p_it->nr; ++cpu) {
+      if (next[cpu] == low[cpu])
+        continue;
+      ring = qsup_rec_ring(cpu);
+      if (best == -1 || ring->recs[(next[cpu] - 1) % QSUP_REC_SLOTS].seq
+          > qsup_rec_ring(best)->recs[(next[best] - 1) % QSUP_REC_SLOTS].seq)
+        best = cpu;
+    }
+    if (best == -1)
+      break;
+    ring = qsup_rec_ring(best);
+    /* Copy the record no earlier than the heads were read... */
+    smp_rmb();
+    recs[n] = ring->recs[(next[best] - 1) % QSUP_REC_SLOTS].dec;
+    /* ...and check it against a head read after the copy: once the head
+     * reaches the next record in its slot, the copy may be torn.
+     */
+    smp_rmb();
+    if (ACCESS_ONCE(ring->head) - (next[best] - 1) >= QSUP_REC_SLOTS) {
+      /* Overwritten while copying, as all of the older ones */
+      low[best] = next[best];
+      continue;
+    }
+    --next[best];
+    ++n;
+  }
+  return n;
+}
+
+void qsup_rec_iter_cleanup(qsup_rec_iter_t *p_it) {
+  if (p_it->next != NULL)
+    qos_free(p_it->next);
+  p_it->next = NULL;
+}
+
+int qsup_rec_get(qsup_decision_t *recs, int max) {
+  qsup_rec_iter_t it;
+  int n;
+
+  if (qsup_rec_iter_init(&it) != QOS_OK)
+    return 0;
+  n = qsup_rec_iter_next(&it, recs, max);
+  qsup_rec_iter_cleanup(&it);
+  return n;
+}
+
+#endif /* QSUP_REC */
@@ -0,0 +1,66 @@
+/** @addtogroup QSUP_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Flight recorder of the admission decisions of the supervisor.
+ */
+
+#ifndef __QSUP_REC_H__
+#define __QSUP_REC_H__
+
+#include "qres_config.h"
+#include "qsup_gw.h"
+
+#ifdef QSUP_REC
+
+/** Allocate the per-CPU rings of the recorder, all empty */
+qos_rv qsup_rec_init(void);
+
+/** Free the rings of the recorder */
+void qsup_rec_cleanup(void);
+
+/** Append a decision to the ring of the current CPU, overwriting the
+ ** oldest one if full. The timestamp of *p_dec is set by this function.
+ **/
+void qsup_rec_add(qsup_decision_t *p_dec);
+
+/** Copy into recs up to max of the recorded decisions of all CPUs, the
+ ** most recent first.
+ **
+ ** @return the number of copied decisions
+ **/
+int qsup_rec_get(qsup_decision_t *recs, int max);
+
+/** Position of a reader merging the rings, that retrieves the decisions
+ ** of qsup_rec_get() a few at a time.
+ **/
+typedef struct qsup_rec_iter_t {
+  int nr;			/**< Number of rings			*/
+  unsigned long *next;		/**< Next record to copy, per ring	*/
+  unsigned long *low;		/**< Oldest record to copy, per ring	*/
+} qsup_rec_iter_t;
+
+/** Start reading the decisions recorded so far, the most recent first */
+qos_rv qsup_rec_iter_init(qsup_rec_iter_t *p_it);
+
+/** Copy into recs up to max of the decisions following the ones already
+ ** read through *p_it.
+ **
+ ** @return the number of copied decisions, 0 once all have been read
+ **/
+int qsup_rec_iter_next(qsup_rec_iter_t *p_it, qsup_decision_t *recs, int max);
+
+/** Release the resources of a reader */
+void qsup_rec_iter_cleanup(qsup_rec_iter_t *p_it);
+
+#else
+
+static inline qos_rv qsup_rec_init(void) { return QOS_OK; }
+static inline void qsup_rec_cleanup(void) { }
+
+#endif
+
+#endif
+
+/** @} */
@@ -0,0 +1,270 @@
+/** @file
+ ** @brief Versioned tables of the user and group rules of the supervisor.
+ **
+ ** Writers serialize among themselves, copy the table in force with their
+ ** change applied, and publish the copy with rcu_assign_pointer(). The old
+ ** table is freed by an RCU callback after a grace period, once no reader
+ ** can be using it, so that writers never wait for it: they run under
+ ** qres_lock(), that all QRES and QSUP operations take. Each change costs
+ ** O(rules), each lookup O(log(rules)).
+ **/
+
+#include "qres_config.h"
+#include "qos_debug.h"
+
+#include "qsup_rules.h"
+#include "qos_memory.h"
+
+#ifdef QOS_KS
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/rcupdate.h>
+#include <linux/mutex.h>
+#include <linux/sort.h>
+
+/** Serializes writers */
+static DEFINE_MUTEX(qsup_rules_lock);
+
+#define qsup_rules_write_lock() mutex_lock(&qsup_rules_lock)
+#define qsup_rules_write_unlock() mutex_unlock(&qsup_rules_lock)
+#define qsup_rules_sort(base, num) \
+  sort((base), (num), sizeof(qsup_rule_t), qsup_rule_cmp, NULL)
+
+#else
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define qsup_rules_write_lock() do { } while (0)
+#define qsup_rules_write_unlock() do { } while (0)
+#define qsup_rules_sort(base, num) \
+  qsort((base), (num), sizeof(qsup_rule_t), qsup_rule_cmp)
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define rcu_dereference(p) (p)
+#define rcu_assign_pointer(p, v) ((p) = (v))
+#define call_rcu(head, func) (func)(head)
+#define rcu_barrier() do { } while (0)
+
+struct rcu_head { void *next; };
+
+#ifndef container_of
+#define container_of(ptr, type, member) ((type *) ((char *) (ptr) - offsetof(type, member)))
+#endif
+
+#endif
+
+/** Immutable table of rules */
+typedef struct qsup_rules_t {
+  struct rcu_head rcu;			/**< Frees the table once unused */
+  unsigned long version;		/**< Increased by each change	*/
+  unsigned int num[QSUP_RULE_KINDS];	/**< Rules of each kind		*/
+  qsup_rule_t *rules[QSUP_RULE_KINDS];	/**< Sorted by id, within buf	*/
+  qsup_rule_t buf[0];
+} qsup_rules_t;
+
+/** Table in force, NULL before qsup_rules_init() */
+static qsup_rules_t *qsup_rules = NULL;
+
+static int qsup_rule_cmp(const void *a, const void *b) {
+  int id_a = ((const qsup_rule_t *) a)->id;
+  int id_b = ((const qsup_rule_t *) b)->id;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+static qsup_rules_t *qsup_rules_alloc(unsigned int num_users, unsigned int num_groups) {
+  qsup_rules_t *t = qos_malloc(sizeof(qsup_rules_t) + (num_users + num_groups) * sizeof(qsup_rule_t));
+  if (t == NULL)
+    return NULL;
+  t->version = 0;
+  t->num[QSUP_RULE_USER] = num_users;
+  t->num[QSUP_RULE_GROUP] = num_groups;
+  t->rules[QSUP_RULE_USER] = t->buf;
+  t->rules[QSUP_RULE_GROUP] = t->buf + num_users;
+  return t;
+}
+
+/** Index of the first rule of kind in t whose id is not lower than id */
+static unsigned int qsup_rules_search(const qsup_rules_t *t, qsup_rule_kind_t kind, int id) {
+  unsigned int lo = 0, hi = t->num[kind];
+  while (lo < hi) {
+    unsigned int mid = lo + (hi - lo) / 2;
+    if (t->rules[kind][mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static const qsup_rule_t *qsup_rules_lookup(const qsup_rules_t *t, qsup_rule_kind_t kind, int id) {
+  unsigned int i = qsup_rules_search(t, kind, id);
+  if (i < t->num[kind] && t->rules[kind][i].id == id)
+    return &t->rules[kind][i];
+  return NULL;
+}
+
+/** RCU callback freeing a table no reader can be using anymore */
+static void qsup_rules_free_rcu(struct rcu_head *head) {
+  qos_free(container_of(head, qsup_rules_t, rcu));
+}
+
+/** Make t the table in force, and free the old one once unused, without
+ ** waiting for it. To be called with the write lock held.
+ **/
+static void qsup_rules_install(qsup_rules_t *t) {
+  qsup_rules_t *old = qsup_rules;
+
+  t->version = (old != NULL) ? old->version + 1 : 0;
+  rcu_assign_pointer(qsup_rules, t);
+  if (old != NULL)
+    call_rcu(&old->rcu, qsup_rules_free_rcu);
+}
+
+qos_rv qsup_rules_init(void) {
+  qsup_rules_t *t = qsup_rules_alloc(0, 0);
+  qos_chk_rv(t != NULL, QOS_E_NO_MEMORY);
+  qsup_rules_write_lock();
+  qsup_rules_install(t);
+  qsup_rules_write_unlock();
+  return QOS_OK;
+}
+
+void qsup_rules_cleanup(void) {
+  qsup_rules_t *old;
+
+  qsup_rules_write_lock();
+  old = qsup_rules;
+  rcu_assign_pointer(qsup_rules, NULL);
+  if (old != NULL)
+    call_rcu(&old->rcu, qsup_rules_free_rcu);
+  qsup_rules_write_unlock();
+  /* No callback may run once the module is gone */
+  rcu_barrier();
+}
+
+/** Return non-zero if two rules in the sorted rules[] have the same id */
+static qos_bool_t qsup_rules_dup(const qsup_rule_t *rules, unsigned int num) {
+  unsigned int i;
+  for (i = 1; i < num; ++i)
+    if (rules[i].id == rules[i - 1].id)
+      return 1;
+  return 0;
+}
+
+qos_rv qsup_rules_set(const qsup_rule_t *users, unsigned int num_users,
+		      const qsup_rule_t *groups, unsigned int num_groups) {
+  qsup_rules_t *t;
+
+  if (num_users > QSUP_MAX_RULES || num_groups > QSUP_MAX_RULES)
+    return QOS_E_INVALID_PARAM;
+  t = qsup_rules_alloc(num_users, num_groups);
+  qos_chk_rv(t != NULL, QOS_E_NO_MEMORY);
+  memcpy(t->rules[QSUP_RULE_USER], users, num_users * sizeof(qsup_rule_t));
+  memcpy(t->rules[QSUP_RULE_GROUP], groups, num_groups * sizeof(qsup_rule_t));
+  qsup_rules_sort(t->rules[QSUP_RULE_USER], num_users);
+  qsup_rules_sort(t->rules[QSUP_RULE_GROUP], num_groups);
+  if (qsup_rules_dup(t->rules[QSUP_RULE_USER], num_users)
+      || qsup_rules_dup(t->rules[QSUP_RULE_GROUP], num_groups)) {
+    qos_free(t);
+    return QOS_E_INVALID_PARAM;
+  }
+
+  qsup_rules_write_lock();
+  qsup_rules_install(t);
+  qsup_rules_write_unlock();
+  return QOS_OK;
+}
+
+/** Install a copy of the table in force, with the rule of kind for id
+ ** replaced by constr, or removed if constr is NULL.
+ **/
+static qos_rv qsup_rules_change(qsup_rule_kind_t kind, int id, const qsup_constraints_t *constr) {
+  qsup_rules_t *old, *t;
+  qsup_rule_t *dst;
+  unsigned int num[QSUP_RULE_KINDS], i, n_old;
+  qos_bool_t found;
+  int k;
+
+  qsup_rules_write_lock();
+  old = qsup_rules;
+  if (old == NULL) {
+    qsup_rules_write_unlock();
+    return QOS_E_INCONSISTENT_STATE;
+  }
+  n_old = old->num[kind];
+  i = qsup_rules_search(old, kind, id);
+  found = (i < n_old && old->rules[kind][i].id == id);
+  if (constr == NULL && ! found) {
+    qsup_rules_write_unlock();
+    return QOS_E_NOT_FOUND;
+  }
+  if (constr != NULL && ! found && n_old >= QSUP_MAX_RULES) {
+    qsup_rules_write_unlock();
+    return QOS_E_FULL;
+  }
+
+  for (k = 0; k < QSUP_RULE_KINDS; ++k)
+    num[k] = old->num[k];
+  num[kind] = n_old - found + (constr != NULL);
+  t = qsup_rules_alloc(num[QSUP_RULE_USER], num[QSUP_RULE_GROUP]);
+  if (t == NULL) {
+    qsup_rules_write_unlock();
+    return QOS_E_NO_MEMORY;
+  }
+  for (k = 0; k < QSUP_RULE_KINDS; ++k)
+    if (k != (int) kind)
+      memcpy(t->rules[k], old->rules[k], num[k] * sizeof(qsup_rule_t));
+  dst = t->rules[kind];
+  memcpy(dst, old->rules[kind], i * sizeof(qsup_rule_t));
+  dst += i;
+  if (constr != NULL) {
+    dst->id = id;
+    dst->constr = *constr;
+    ++dst;
+  }
+  memcpy(dst, old->rules[kind] + i + found, (n_old - i - found) * sizeof(qsup_rule_t));
+
+  qsup_rules_install(t);
+  qsup_rules_write_unlock();
+  return QOS_OK;
+}
+
+qos_rv qsup_rules_put(qsup_rule_kind_t kind, int id, const qsup_constraints_t *constr) {
+  return qsup_rules_change(kind, id, constr);
+}
+
+qos_rv qsup_rules_del(qsup_rule_kind_t kind, int id) {
+  return qsup_rules_change(kind, id, NULL);
+}
+
+qos_bool_t qsup_rules_find(int uid, int gid, qsup_constraints_t *p_constr) {
+  const qsup_rules_t *t;
+  const qsup_rule_t *r = NULL;
+
+  rcu_read_lock();
+  t = rcu_dereference(qsup_rules);
+  if (t != NULL) {
+    r = qsup_rules_lookup(t, QSUP_RULE_USER, uid);
+    if (r == NULL)
+      r = qsup_rules_lookup(t, QSUP_RULE_GROUP, gid);
+    if (r != NULL)
+      *p_constr = r->constr;
+  }
+  rcu_read_unlock();
+  return r != NULL;
+}
+
+unsigned long qsup_rules_version(void) {
+  unsigned long version = 0;
+  const qsup_rules_t *t;
+
+  rcu_read_lock();
+  t = rcu_dereference(qsup_rules);
+  if (t != NULL)
+    version = t->version;
+  rcu_read_unlock();
+  return version;
+}
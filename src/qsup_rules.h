@@ -0,0 +1,66 @@
+/** @addtogroup QSUP_MOD
+ * @{
+ */
+
+/** @file
+ * @brief Versioned tables of the user and group rules of the supervisor.
+ *
+ * The rules in force are an immutable table, with the user rules and the
+ * group rules in two arrays sorted by id, so that finding the rule of a
+ * server is a binary search. Any change builds a new table, with a higher
+ * version number, that replaces the old one atomically: readers never
+ * take locks, and see either table as a whole.
+ */
+
+#ifndef __QSUP_RULES_H__
+#define __QSUP_RULES_H__
+
+#include "qsup_gw.h"
+#include "qos_types.h"
+
+/** Kinds of rule in a table */
+typedef enum {
+  QSUP_RULE_USER,	/**< Rules by UID				*/
+  QSUP_RULE_GROUP,	/**< Rules by GID				*/
+  QSUP_RULE_KINDS	/**< Number of kinds				*/
+} qsup_rule_kind_t;
+
+/** Start with no rules in force */
+qos_rv qsup_rules_init(void);
+
+/** Drop the rules in force */
+void qsup_rules_cleanup(void);
+
+/** Replace all the rules in force with the supplied ones.
+ **
+ ** @return QOS_E_INVALID_PARAM if an id appears twice in the same array,
+ **         or either array has more than QSUP_MAX_RULES entries
+ **/
+qos_rv qsup_rules_set(const qsup_rule_t *users, unsigned int num_users,
+		      const qsup_rule_t *groups, unsigned int num_groups);
+
+/** Add the rule of kind for id, or replace the one in force.
+ **
+ ** @return QOS_E_FULL if QSUP_MAX_RULES rules of kind are in force
+ **/
+qos_rv qsup_rules_put(qsup_rule_kind_t kind, int id, const qsup_constraints_t *constr);
+
+/** Remove the rule of kind for id.
+ **
+ ** @return QOS_E_NOT_FOUND if no such rule is in force
+ **/
+qos_rv qsup_rules_del(qsup_rule_kind_t kind, int id);
+
+/** Copy into *p_constr the constraints of the rule for uid or, if there
+ ** is none, of the rule for gid.
+ **
+ ** @return 0 if neither rule is in force, leaving *p_constr untouched
+ **/
+qos_bool_t qsup_rules_find(int uid, int gid, qsup_constraints_t *p_constr);
+
+/** Version of the rules in force, increased by each change */
+unsigned long qsup_rules_version(void);
+
+/** @} */
+
+#endif
@@ -84,6 +84,18 @@ qos_rv rres_on_task_unblock(struct task_struct *task);
         (srv) = (list_entry((pos), server_t, list_field)), (pos) != (head); \
                 (pos) = (pos)->next, prefetch((pos)->next))
 
+/** Macro used to iterate over the server list, from the tail to the head
+ * 
+ *  @param srv  (server_t *)            variable for "current" server (used inside the loop)
+ *  @param head (struct list_head *)    head of the list of servers (ready, recharging etc.)
+ *  @param list_field ("name of field") name of field used to insert the object in the list(e.g. slist)
+ *  @param pos  (struct list_head *)    temporal variable used to iterate (not used in following loop block)
+ */
+#define for_each_srv_reverse(srv, head, list_field, pos) \
+        for ((pos) = (head)->prev, prefetch((pos)->prev); \
+        (srv) = (list_entry((pos), server_t, list_field)), (pos) != (head); \
+                (pos) = (pos)->prev, prefetch((pos)->prev))
+
 /** Macro used against removal risks to iterate over the server list
  * 
  *  @param srv    (server_t *)           variable for "current" server (used inside the loop)
@@ -103,6 +115,15 @@ qos_rv rres_on_task_unblock(struct task_struct *task);
  *  @param pos (struct list_head *)     temporal variable used to iterate (not used in following loop block) */
 #define for_each_server(srv, pos)        for_each_srv((srv), &server_list, slist,    (pos))
 
+/** Iterate over all servers in the system, from the oldest to the newest one
+ *
+ *  Servers are added at the head of the list, so any server is visited
+ *  after the one it is nested within.
+ *
+ *  @param srv (server_t *)             variable for "current" server (used inside the loop)\n
+ *  @param pos (struct list_head *)     temporal variable used to iterate (not used in following loop block) */
+#define for_each_server_reverse(srv, pos) for_each_srv_reverse((srv), &server_list, slist, (pos))
+
 /** Iterate over all servers in the system - safe against removal
  * 
  *  @param srv    (server_t *)             variable for "current" server (used inside the loop)\n
@@ -172,6 +193,11 @@ static inline void rres_add_to_srv_set(server_t * srv) {
   list_add(&(srv->slist), &server_list);
 }
 
+/** Remove the server from the set of servers */
+static inline void rres_del_from_srv_set(server_t * srv) {
+  list_del(&(srv->slist));
+}
+
 /*********** DISPATCH RELATED ****************/
 
 /** Stop all tasks handled by the server */
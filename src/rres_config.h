@@ -49,7 +49,10 @@
 /** Enable wrappers for functions defined with qos_func.h macros */
 #undef QOS_FUNC_WRAPPERS
 
-/** Enable use of hrtimers **/
+/** Enable use of hrtimers: kal_timer_t is implemented by kal_timer_hrtimer.h
+ ** and kal_time_t by kal_time_timespec.h (nanosecond resolution), instead of
+ ** jiffies-based kal_timer_wheel.h and kal_time_jiffies.h.
+ **/
 #undef KAL_USE_HRTIMER
 
 /** Enable memory checks in qos_memory.c **/
@@ -65,6 +68,12 @@
 /** Enable SHRUB reclaiming */
 #undef SHRUB
 
+/** Represent bandwidths with 32 fractional bits on 64 bits, instead of
+ ** 24 bits on an unsigned long (see qos_bw_t). Kernel interfaces keep
+ ** accepting the legacy 24-bit format from callers unaware of it.
+ **/
+#undef QOS_BW_WIDE
+
 /** Utilization limit for all AQuoSA tasks, as integer < 100 **/
 #define RRES_U_LUB 95
 
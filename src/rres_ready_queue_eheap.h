@@ -26,8 +26,8 @@ typedef kal_eheap_iterator_t(kal_time_t, server_p) rq_placeholder_t;
 
 #include "rres_server.h"
 
-#define RRES_MAX_NUM_SERVERS_BITS 12
-#define RRES_MAX_NUM_SERVERS (1 << RRES_MAX_NUM_SERVERS_BITS)
+/** Initial capacity of the ready queue (log2), grown on demand */
+#define RRES_READY_QUEUE_INIT_BITS 6
 
 /** Inititalize a ready queue placeholder as invalid (item not enqueued) */
 #define rq_placeholder_init(p_it) kal_eheap_iterator_init(p_it)
@@ -51,7 +51,7 @@ static inline server_t *get_highest_priority_server(void) {
 #define for_each_ready_server(srv, it) \
   for ( \
     kal_eheap_begin(&eheap, &(it)); \
-    && (kal_eheap_next(&eheap, &(it), NULL, &(srv)) == QOS_OK); \
+    kal_eheap_next(&eheap, &(it), NULL, &(srv)) == QOS_OK; \
     /* Increment not necessary, already made by kal_eheap_next */ \
   )
 
@@ -85,7 +85,7 @@ static qos_func_define(void, ready_queue_remove, server_t *srv) {
 }
 
 static inline qos_rv rres_edf_init(void) {
-   qos_chk_ok_ret(kal_eheap_init(&eheap, RRES_MAX_NUM_SERVERS_BITS));
+   qos_chk_ok_ret(kal_eheap_init(&eheap, RRES_READY_QUEUE_INIT_BITS));
    return QOS_OK;
 }
 
@@ -15,8 +15,8 @@ typedef struct server_t *server_p;
 
 #ifdef RRES_USE_HEAP
 
-#define RRES_MAX_NUM_SERVERS_BITS 12
-#define RRES_MAX_NUM_SERVERS (1 << RRES_MAX_NUM_SERVERS_BITS)
+/** Initial capacity of the ready queue (log2), grown on demand */
+#define RRES_READY_QUEUE_INIT_BITS 6
 
 #include "kal_timer.h"
 #define kal_eheap_key_lt kal_time_lt
@@ -0,0 +1,175 @@
+#include <linux/aquosa/kal_eheap.h>
+#include <linux/aquosa/qos_list.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
+/*
+ * Checks kal_eheap against a brute-force reference under random add/del
+ * operations, then benchmarks it against the sorted list used by
+ * rres_ready_queue_list.h, on an EDF-like workload: the earliest deadline
+ * item is extracted and reinserted with a later deadline, while a random
+ * item is removed through its handle and reinserted.
+ */
+
+typedef unsigned long dl_t;
+typedef struct item *item_p;
+
+kal_define_eheap(dl_t, item_p);
+
+struct item {
+  dl_t dl;
+  kal_eheap_iterator_t(dl_t, item_p) ph;   /**< Heap handle */
+  struct list_head rq;                      /**< Sorted list placeholder */
+};
+
+/* list_add_ordered() compares deadlines through kal_time_lt() */
+#define kal_time_lt(a, b) ((a) < (b))
+
+#define MAX_ITEMS 100000
+
+struct item items[MAX_ITEMS];
+kal_eheap_t(dl_t, item_p) heap;
+struct list_head queue;
+
+static double now_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static int check_heap(int n) {
+  int i, num = 0;
+  dl_t min = 0, dl;
+  item_p it;
+  kal_eheap_iterator_t(dl_t, item_p) pos;
+
+  for (i = 0; i < n; ++i) {
+    if (! kal_eheap_iterator_valid(&items[i].ph))
+      continue;
+    if (heap.nodes[items[i].ph.pos].val != &items[i])
+      return -1;
+    if (num == 0 || items[i].dl < min)
+      min = items[i].dl;
+    ++num;
+  }
+  if (num != kal_eheap_size(&heap))
+    return -1;
+  if (num == 0)
+    return kal_eheap_get_min(&heap, &dl, &it) == QOS_E_EMPTY ? 0 : -1;
+  if (kal_eheap_get_min(&heap, &dl, &it) != QOS_OK || dl != min || it->dl != min)
+    return -1;
+  i = 0;
+  for (kal_eheap_begin(&heap, &pos); kal_eheap_next(&heap, &pos, NULL, &it) == QOS_OK; )
+    ++i;
+  return i == num ? 0 : -1;
+}
+
+static int test_correctness(void) {
+  int i, n = 1000;
+
+  qos_chk_ok_exit(kal_eheap_init(&heap, 2));
+  for (i = 0; i < n; ++i)
+    kal_eheap_iterator_init(&items[i].ph);
+
+  for (i = 0; i < 100000; ++i) {
+    struct item *p = &items[rand() % n];
+    if (kal_eheap_iterator_valid(&p->ph)) {
+      qos_chk_ok_exit(kal_eheap_del(&heap, &p->ph));
+      if (kal_eheap_del(&heap, &p->ph) != QOS_E_NOT_FOUND)
+        return -1;
+    } else {
+      p->dl = rand() % 10000;
+      qos_chk_ok_exit(kal_eheap_add(&heap, p->dl, p, &p->ph));
+    }
+    if (i % 97 == 0 && check_heap(n) != 0) {
+      qos_log_err("Heap inconsistent after %d operations", i);
+      return -1;
+    }
+  }
+  kal_eheap_cleanup(&heap);
+  return 0;
+}
+
+static double bench_heap(int n, int ops) {
+  int i;
+  double t;
+  dl_t dl;
+  item_p p;
+
+  qos_chk_ok_exit(kal_eheap_init(&heap, 4));
+  for (i = 0; i < n; ++i) {
+    items[i].dl = rand() % 100000;
+    qos_chk_ok_exit(kal_eheap_add(&heap, items[i].dl, &items[i], &items[i].ph));
+  }
+  t = now_us();
+  for (i = 0; i < ops; ++i) {
+    qos_chk_ok_exit(kal_eheap_get_min(&heap, &dl, &p));
+    kal_eheap_del(&heap, &p->ph);
+    p->dl += 1 + rand() % 100000;
+    kal_eheap_add(&heap, p->dl, p, &p->ph);
+    p = &items[rand() % n];
+    kal_eheap_del(&heap, &p->ph);
+    kal_eheap_add(&heap, p->dl, p, &p->ph);
+  }
+  t = now_us() - t;
+  kal_eheap_cleanup(&heap);
+  return t * 1000.0 / ops;
+}
+
+/* list_add_ordered() may be expanded only once per function */
+static int list_insert(struct item *p) {
+  int ret;
+  list_add_ordered(queue, item, p, rq, dl, ret);
+  return ret;
+}
+
+static double bench_list(int n, int ops) {
+  int i;
+  double t;
+  struct item *p;
+
+  INIT_LIST_HEAD(&queue);
+  for (i = 0; i < n; ++i) {
+    items[i].dl = rand() % 100000;
+    list_insert(&items[i]);
+  }
+  t = now_us();
+  for (i = 0; i < ops; ++i) {
+    p = list_entry(queue.next, struct item, rq);
+    list_del(&p->rq);
+    p->dl += 1 + rand() % 100000;
+    list_insert(p);
+    p = &items[rand() % n];
+    list_del(&p->rq);
+    list_insert(p);
+  }
+  t = now_us() - t;
+  return t * 1000.0 / ops;
+}
+
+int main(int argc, char *argv[]) {
+  int sizes[] = { 10, 100, 1000, 10000, 100000 };
+  unsigned int n;
+
+  srand(1);
+  if (test_correctness() != 0) {
+    qos_log_err("Correctness test failed");
+    return -1;
+  }
+
+  printf("# %8s %8s %14s %14s\n", "items", "ops", "heap (ns/op)", "list (ns/op)");
+  for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    int ops = sizes[n] <= 1000 ? 100000 : 100000000 / sizes[n] / 10;
+    double th = bench_heap(sizes[n], ops);
+    double tl = bench_list(sizes[n], ops);
+    printf("  %8d %8d %14.1f %14.1f\n", sizes[n], ops, th, tl);
+  }
+
+  return 0;
+}
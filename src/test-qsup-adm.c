@@ -0,0 +1,105 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+/*
+ * Each server belongs to a different user, with default constraints, so
+ * that only the schedulability test limits the admitted guarantees.
+ * Utilizations are relative to the whole U_LUB capacity.
+ *
+ * Harmonic set: 0.5/10ms, 0.25/20ms, 0.24/40ms.
+ *   RTA admits all of them, the hyperbolic bound only the first two.
+ * Non-harmonic set: 0.5/10ms, 0.45/14ms.
+ *   The utilization test admits both, RTA only the first one.
+ */
+
+#define NUM_SERVERS 3
+
+double harmonic[NUM_SERVERS][2] = {
+  { 0.5, 10000 },
+  { 0.25, 20000 },
+  { 0.24, 40000 },
+};
+
+double non_harmonic[2][2] = {
+  { 0.5, 10000 },
+  { 0.45, 14000 },
+};
+
+qsup_server_t *srv[NUM_SERVERS];
+
+/** Create servers 0..num-1 of set, returning how many were admitted */
+int create_set(double set[][2], int num) {
+  int i;
+  for (i = 0; i < num; i++) {
+    qres_time_t P = (qres_time_t) set[i][1];
+    qres_time_t Q = (qres_time_t) (set[i][0] * bw2d(U_LUB) * P);
+    qos_rv rv = qsup_create_server(&srv[i], i, 0, & ((qres_params_t) { Q, Q, P, 0 }) );
+    if (rv != QOS_OK) {
+      qos_chk_exit(rv == QOS_E_SYSTEM_OVERLOAD);
+      break;
+    }
+  }
+  return i;
+}
+
+void destroy_set(int num) {
+  int i;
+  for (i = 0; i < num; i++)
+    qos_chk_ok_exit(qsup_destroy_server(srv[i]));
+}
+
+int check(const char *name, qsup_adm_kind_t kind, double set[][2], int num, int expected) {
+  int n;
+  qos_chk_ok_exit(qsup_set_adm_test(kind));
+  n = create_set(set, num);
+  destroy_set(n);
+  if (n != expected) {
+    qos_log_err("%s: expecting %d admitted servers, got %d", name, expected, n);
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  int n;
+  qsup_server_t *first;
+
+  qos_chk_ok_exit(qsup_init());
+
+  err |= check("util, harmonic", QSUP_ADM_UTIL, harmonic, 3, 3);
+  err |= check("hyperbolic, harmonic", QSUP_ADM_HYPERBOLIC, harmonic, 3, 2);
+  err |= check("rta, harmonic", QSUP_ADM_RTA, harmonic, 3, 3);
+  err |= check("util, non-harmonic", QSUP_ADM_UTIL, non_harmonic, 2, 2);
+  err |= check("rta, non-harmonic", QSUP_ADM_RTA, non_harmonic, 2, 1);
+
+  /* Cannot switch to a test that the admitted servers do not pass */
+  qos_chk_ok_exit(qsup_set_adm_test(QSUP_ADM_UTIL));
+  n = create_set(non_harmonic, 2);
+  qos_chk_exit(n == 2);
+  if (qsup_set_adm_test(QSUP_ADM_RTA) != QOS_E_SYSTEM_OVERLOAD) {
+    qos_log_err("Switched to a test not passed by the admitted servers");
+    err = -1;
+  }
+
+  /* Once the offending server leaves, the switch succeeds, and the
+   * cached response times are used to admit the harmonic ones */
+  qos_chk_ok_exit(qsup_destroy_server(srv[1]));
+  qos_chk_ok_exit(qsup_set_adm_test(QSUP_ADM_RTA));
+  first = srv[0];
+  n = create_set(harmonic + 1, 2);
+  if (n != 2) {
+    qos_log_err("rta: cannot add harmonic servers after removal");
+    err = -1;
+  }
+  destroy_set(n);
+  qos_chk_ok_exit(qsup_destroy_server(first));
+
+  qos_chk_exit(qsup_set_adm_test(QSUP_ADM_NUM) == QOS_E_INVALID_PARAM);
+
+  qsup_cleanup();
+
+  return err;
+}
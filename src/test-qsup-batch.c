@@ -0,0 +1,74 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * Same configuration as test-qsup-level, but the requests of both servers
+ * are changed within a qsup_batch_begin()/qsup_batch_end() pair: the
+ * approved bandwidths must be the same as if they were changed one by one.
+ */
+
+typedef double pair_t[2];
+
+pair_t bw_requests[] = {
+  { 0.2, 0.2 },
+  { 0.5, 0.5 },
+  { 0.4, 0.5 },
+  { 0.2, 0.6 },
+  { 0.4, 0.6 },
+  { 0.0, 0.0 },
+};
+
+pair_t bw_approved[] = {
+  { 0.2, 0.2 },
+  { 0.5/(0.5+0.5)*0.75, 0.5/(0.5+0.5)*0.75},
+  { 0.4/(0.4+0.5)*0.75, 0.5/(0.4+0.5)*0.75},
+  { 0.2, 0.5 },
+  { 0.4/(0.4+0.5)*0.75, 0.5/(0.4+0.5)*0.75},
+  { 0.0, 0.0 },
+};
+
+double tolerance = 0.0001;
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  unsigned int n;
+  qsup_server_t *srv0, *srv1;
+
+  qsup_init();
+
+  qsup_add_level_rule(0, d2bw(0.75));
+
+  qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.5), d2bw(0.0), 0 }) );
+
+  qos_chk_ok_exit(qsup_create_server(&srv0, 0, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qos_chk_ok_exit(qsup_create_server(&srv1, 1, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+
+  for (n = 0; n < sizeof(bw_requests) / sizeof(pair_t); n++) {
+    qsup_batch_begin();
+    qsup_batch_begin();
+    qsup_set_required_bw(srv0, d2bw(bw_requests[n][0]));
+    qsup_batch_end();
+    qsup_set_required_bw(srv1, d2bw(bw_requests[n][1]));
+    qsup_batch_end();
+    if (
+	(fabs(bw2d(qsup_get_approved_bw(srv0)) - bw_approved[n][0]) > tolerance)
+	|| (fabs(bw2d(qsup_get_approved_bw(srv1)) - bw_approved[n][1]) > tolerance)
+	) {
+      qos_log_err("Requests were %g, %g. Expecting %g, %g while got %g, %g.",
+		  bw_requests[n][0], bw_requests[n][1],
+		  bw_approved[n][0], bw_approved[n][1],
+		  bw2d(qsup_get_approved_bw(srv0)), bw2d(qsup_get_approved_bw(srv1)));
+      err = -1;
+    }
+  }
+
+  qos_chk_ok_exit(qsup_destroy_server(srv0));
+  qos_chk_ok_exit(qsup_destroy_server(srv1));
+  qsup_cleanup();
+
+  return err;
+}
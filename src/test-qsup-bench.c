@@ -0,0 +1,127 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/*
+ * Benchmarks the supervisor recompute path, i.e., a change in the
+ * request of one server followed by the retrieval of the approved
+ * bandwidths of all servers, as done by qres_update_bandwidths(), with
+ * servers spread over multiple users and two levels, and a change of the
+ * spare bandwidth, that recompresses all of them at once. The servers of
+ * each run are added to the ones of the previous runs. It also compares
+ * the conversions r2bw() and r2bw_recip(), the latter being used with
+ * the periods of the servers.
+ */
+
+#define MAX_SERVERS 1000
+#define NUM_USERS 50
+#define NUM_CONV 1000000
+
+qsup_server_t *servers[MAX_SERVERS];
+qres_time_t budgets[NUM_CONV];
+qres_time_t periods[NUM_CONV];
+qos_recip_t recips[NUM_CONV];
+
+static double now_us(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000.0 + tv.tv_usec;
+}
+
+static int num_servers = 0;
+
+/** Sum of the approved bandwidths of the first n servers */
+static qos_bw_t approved_sum(int n) {
+  int j;
+  qos_bw_t tot = 0;
+  for (j = 0; j < n; ++j)
+    tot += qsup_get_approved_bw(servers[j]);
+  return tot;
+}
+
+static int bench_qsup(int n, int iters) {
+  int i;
+  double t, t_spare;
+  qos_bw_t tot = 0;
+
+  for (i = num_servers; i < n; ++i) {
+    int uid = i % NUM_USERS;
+    qos_chk_ok_exit(qsup_create_server(&servers[i], uid, 0, & ((qres_params_t) { 0, 0, 10000 + i, 0 }) ));
+  }
+
+  t = now_us();
+  for (i = 0; i < iters; ++i) {
+    qsup_set_required_bw(servers[rand() % n], rand() % d2bw(0.1));
+    tot = approved_sum(n);
+  }
+  t = now_us() - t;
+
+  t_spare = now_us();
+  for (i = 0; i < iters; ++i) {
+    qos_chk_ok_exit(qsup_reserve_spare(d2bw(0.05) * (i & 3)));
+    tot = approved_sum(n);
+  }
+  t_spare = now_us() - t_spare;
+  qos_chk_ok_exit(qsup_reserve_spare(0));
+  num_servers = n;
+
+  printf("  %8d %8d %16.1f %16.1f\n", n, iters, t * 1000.0 / iters, t_spare * 1000.0 / iters);
+  if (tot > U_LUB + n) {
+    qos_log_err("Approved bandwidths exceed U_LUB");
+    return -1;
+  }
+  return 0;
+}
+
+static void bench_conv(void) {
+  int i;
+  double t, t_div, t_recip;
+  qos_bw_t sum = 0, sum_recip = 0;
+
+  for (i = 0; i < NUM_CONV; ++i) {
+    periods[i] = 1000 + rand() % 1000000;
+    budgets[i] = rand() % periods[i];
+    qos_recip_init(&recips[i], periods[i]);
+  }
+  t = now_us();
+  for (i = 0; i < NUM_CONV; ++i)
+    sum += r2bw(budgets[i], periods[i]);
+  t_div = now_us() - t;
+  t = now_us();
+  for (i = 0; i < NUM_CONV; ++i)
+    sum_recip += r2bw_recip(budgets[i], &recips[i]);
+  t_recip = now_us() - t;
+  printf("# r2bw: %.2f ns/op, r2bw_recip: %.2f ns/op%s\n", t_div * 1000.0 / NUM_CONV,
+         t_recip * 1000.0 / NUM_CONV, sum == sum_recip ? "" : " (MISMATCH)");
+}
+
+int main(int argc, char *argv[]) {
+  int sizes[] = { 10, 100, 1000 };
+  unsigned int n;
+
+  int i, err = 0;
+
+  srand(1);
+  bench_conv();
+
+  qsup_init();
+  qsup_add_level_rule(0, d2bw(0.5));
+  qsup_add_level_rule(1, d2bw(0.95));
+  for (i = 0; i < NUM_USERS; ++i)
+    qsup_add_user_constraints(i, & ((qsup_constraints_t) { i % 2, 1, d2bw(0.2), d2bw(0.01), 0 }) );
+
+  printf("# %8s %8s %16s %16s\n", "servers", "iters", "update (ns/op)", "spare (ns/op)");
+  for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]) && err == 0; ++n)
+    err = bench_qsup(sizes[n], 10000000 / sizes[n] / 10);
+
+  for (i = 0; i < num_servers; ++i)
+    qos_chk_ok_exit(qsup_destroy_server(servers[i]));
+  qsup_cleanup();
+
+  return err;
+}
@@ -0,0 +1,85 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * Servers 0 and 1 of user 0, and server 2 of user 1, in a level limited
+ * to 0.75, with users limited to 0.5 each. After each change of request,
+ * only the servers whose user or level coefficient changed, besides the
+ * one changing its request, must be found dirty, while the cached
+ * approved bandwidths must follow the coefficients.
+ */
+
+#define NUM_SERVERS 3
+
+typedef struct {
+  int server;
+  double request;
+  int dirty[NUM_SERVERS];
+  double approved[NUM_SERVERS];
+} step_t;
+
+step_t steps[] = {
+  /* Nothing compressed */
+  { 2, 0.2, { 0, 0, 1 }, { 0.1, 0.1, 0.2 } },
+  /* User 0 compressed */
+  { 0, 0.45, { 1, 1, 0 }, { 0.45 / 0.55 * 0.5, 0.1 / 0.55 * 0.5, 0.2 } },
+  /* Level compressed too */
+  { 2, 0.5, { 1, 1, 1 }, { 0.45 / 0.55 * 0.5 * 0.75, 0.1 / 0.55 * 0.5 * 0.75, 0.5 * 0.75 } },
+};
+
+double tolerance = 0.0001;
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  unsigned int n;
+  int s, dirty[NUM_SERVERS];
+  qsup_server_t *srv[NUM_SERVERS], *qsup;
+
+  qos_chk_ok_exit(qsup_init());
+
+  qsup_add_level_rule(0, d2bw(0.75));
+  qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.5), d2bw(0.0), 0 }) );
+
+  for (s = 0; s < NUM_SERVERS; s++) {
+    qos_chk_ok_exit(qsup_create_server(&srv[s], s / 2, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+    qsup_set_required_bw(srv[s], d2bw(0.1));
+  }
+  while (qsup_pop_dirty() != NULL)
+    ;
+
+  for (n = 0; n < sizeof(steps) / sizeof(step_t); n++) {
+    qsup_set_required_bw(srv[steps[n].server], d2bw(steps[n].request));
+    for (s = 0; s < NUM_SERVERS; s++)
+      dirty[s] = 0;
+    while ((qsup = qsup_pop_dirty()) != NULL)
+      for (s = 0; s < NUM_SERVERS; s++)
+	if (qsup == srv[s])
+	  dirty[s]++;
+    for (s = 0; s < NUM_SERVERS; s++) {
+      if (dirty[s] != steps[n].dirty[s]) {
+	qos_log_err("Step %u: server %d found dirty %d times, expecting %d.",
+		    n, s, dirty[s], steps[n].dirty[s]);
+	err = -1;
+      }
+      if (fabs(bw2d(qsup_get_approved_bw(srv[s])) - steps[n].approved[s]) > tolerance) {
+	qos_log_err("Step %u: expecting %g for server %d while got %g.",
+		    n, steps[n].approved[s], s, bw2d(qsup_get_approved_bw(srv[s])));
+	err = -1;
+      }
+    }
+  }
+
+  for (s = 0; s < NUM_SERVERS; s++)
+    qos_chk_ok_exit(qsup_destroy_server(srv[s]));
+  if (qsup_pop_dirty() != NULL) {
+    qos_log_err("Destroyed server left dirty");
+    err = -1;
+  }
+  qsup_cleanup();
+
+  return err;
+}
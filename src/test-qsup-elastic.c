@@ -0,0 +1,100 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * One elastic level, with max = 0.75, and three servers of different
+ * users in group 0, each one guaranteed 0.1:
+ *   server 0: inelastic (rule weight 0)
+ *   server 1: elasticity 1
+ *   server 2: elasticity 3
+ *
+ * Server 2 reaches its minimum first, then server 1 absorbs the rest of
+ * the excess. Server 0 is compressed only once both are at their minimum.
+ */
+
+typedef double triple_t[3];
+
+triple_t bw_requests[] = {
+  { 0.2, 0.2, 0.2 },
+  { 0.4, 0.4, 0.4 },
+  { 0.4, 0.3, 0.3 },
+  { 0.6, 0.4, 0.4 },
+  { 0.0, 0.0, 0.0 },
+};
+
+triple_t bw_approved[] = {
+  { 0.2, 0.2, 0.2 },
+  /* Excess 0.45: 0.3 from server 2 would take 0.1 from server 1 */
+  { 0.4, 0.4 - (0.45 - 0.3), 0.1 },
+  /* Excess 0.25, split 1:3 */
+  { 0.4, 0.3 - 0.25 * 1 / 4, 0.3 - 0.25 * 3 / 4 },
+  /* Excess 0.65, 0.6 from the elastic ones */
+  { 0.6 - 0.05, 0.1, 0.1 },
+  { 0.0, 0.0, 0.0 },
+};
+
+double tolerance = 0.0001;
+
+#define P 10000
+/* Guaranteed 0.1 */
+#define build_params() (& ((qres_params_t) { P / 10, P / 10, P, 0 }) )
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  unsigned int n;
+  int i;
+  qsup_server_t *srv[3];
+
+  qos_chk_ok_exit(qsup_init());
+
+  qsup_add_level_rule(0, d2bw(0.75));
+  qos_chk_ok_exit(qsup_set_level_policy(0, QSUP_COMPRESS_ELASTIC));
+
+  qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 0, d2bw(0.75), d2bw(0.3), 0 }) );
+
+  for (i = 0; i < 3; i++)
+    qos_chk_ok_exit(qsup_create_server(&srv[i], i, 0, build_params()));
+  qos_chk_ok_exit(qsup_set_elasticity(srv[1], 1));
+  qos_chk_ok_exit(qsup_set_elasticity(srv[2], 3));
+  qos_chk_exit(qsup_set_elasticity(srv[2], QSUP_MAX_ELASTICITY + 1) == QOS_E_INVALID_PARAM);
+
+  for (n = 0; n < sizeof(bw_requests) / sizeof(triple_t); n++) {
+    for (i = 0; i < 3; i++)
+      qsup_set_required_bw(srv[i], d2bw(bw_requests[n][i]));
+    for (i = 0; i < 3; i++)
+      if (fabs(bw2d(qsup_get_approved_bw(srv[i])) - bw_approved[n][i]) > tolerance) {
+	qos_log_err("Step %d: server %d expecting %g, got %g", n, i,
+		    bw_approved[n][i], bw2d(qsup_get_approved_bw(srv[i])));
+	err = -1;
+      }
+  }
+
+  /* Back to the proportional policy, as in test-qsup-level */
+  qos_chk_ok_exit(qsup_set_level_policy(0, QSUP_COMPRESS_PROPORTIONAL));
+  qsup_set_required_bw(srv[0], d2bw(0.5));
+  qsup_set_required_bw(srv[1], d2bw(0.5));
+  if (fabs(bw2d(qsup_get_approved_bw(srv[0])) - 0.375) > tolerance
+      || fabs(bw2d(qsup_get_approved_bw(srv[1])) - 0.375) > tolerance) {
+    qos_log_err("Proportional compression: expecting 0.375, got %g, %g",
+		bw2d(qsup_get_approved_bw(srv[0])), bw2d(qsup_get_approved_bw(srv[1])));
+    err = -1;
+  }
+
+  for (i = 0; i < 3; i++)
+    qos_chk_ok_exit(qsup_destroy_server(srv[i]));
+
+  /* Users cannot make their servers less elastic than their rule */
+  qsup_add_user_constraints(5, & ((qsup_constraints_t) { 0, 2, d2bw(0.75), d2bw(0.3), 0 }) );
+  qos_chk_ok_exit(qsup_create_server(&srv[0], 5, 0, build_params()));
+  qos_chk_exit(qsup_get_elasticity(srv[0]) == 2);
+  qos_chk_exit(qsup_set_elasticity(srv[0], 1) == QOS_E_UNAUTHORIZED);
+  qos_chk_ok_exit(qsup_destroy_server(srv[0]));
+
+  qsup_cleanup();
+
+  return err;
+}
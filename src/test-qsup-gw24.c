@@ -0,0 +1,146 @@
+#include <linux/aquosa/qsup_gw24.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+/*
+ * Requests in the legacy layout, with 24-bit bandwidths, must reach the
+ * supervisor unchanged once converted to the qos_bw_t format, and the
+ * results must come back to the caller as they were, or lower-rounded
+ * to the 24-bit precision when the qos_bw_t format is wider.
+ */
+
+static int err = 0;
+
+#define check(cond, ...) do {				\
+  if (! (cond)) {					\
+    qos_log_err(__VA_ARGS__);				\
+    err = -1;						\
+  }							\
+} while (0)
+
+/* Some 24-bit bandwidths, from zero up to 1.0 */
+qos_bw24_t bws24[] = { 0, 1, 0x7fff, 0x800000, 0xabcdef, 0xfffffe, 0xffffff, 0x1000000 };
+
+#define NUM_BWS (sizeof(bws24) / sizeof(bws24[0]))
+
+static void check_bw(qos_bw24_t bw24) {
+  qos_bw_t bw = bw24_to_bw(bw24);
+  qos_bw_t step = ((qos_bw_t) 1) << (QOS_BW_BITS - QOS_BW24_BITS);
+
+  check(bw_to_bw24(bw) == bw24, "bw24 %lu converted back to %lu", bw24, bw_to_bw24(bw));
+  check(bw * (1ull << QOS_BW24_BITS) == bw24 * (unsigned long long) MAX_BW,
+        "bw24 %lu converted to " QOS_BW_FMT, bw24, bw);
+  /* Wider bandwidths in between are lower-rounded */
+  check(bw_to_bw24(bw + step - 1) == bw24, "bw " QOS_BW_FMT " converted to %lu",
+        bw + step - 1, bw_to_bw24(bw + step - 1));
+}
+
+static void check_constr(const qsup_constraints24_t *p24, const qsup_constraints_t *p) {
+  check(p->level == p24->level && p->weight == p24->weight && p->flags_mask == p24->flags_mask,
+        "constraints (%d, %d, %u) converted to (%d, %d, %u)",
+        p24->level, p24->weight, p24->flags_mask, p->level, p->weight, p->flags_mask);
+  check(p->max_bw == bw24_to_bw(p24->max_bw) && p->max_min_bw == bw24_to_bw(p24->max_min_bw),
+        "constraints (%lu, %lu) converted to (" QOS_BW_FMT ", " QOS_BW_FMT ")",
+        p24->max_bw, p24->max_min_bw, p->max_bw, p->max_min_bw);
+}
+
+/* Convert iparams24 for op and back, as the gateway does for a legacy caller */
+static void round_trip(qsup_op_t op, const qsup_iparams24_t *p_in, qsup_iparams24_t *p_out, qsup_iparams_t *p) {
+  qsup_iparams_from24(op, p, p_in);
+  qsup_iparams_to24(op, p_out, p);
+}
+
+int main(int argc, char *argv[]) {
+  qsup_iparams24_t in, out;
+  qsup_iparams_t iparams;
+  qsup_decision_t recs[1];
+  unsigned int i;
+
+  for (i = 0; i < NUM_BWS; i++)
+    check_bw(bws24[i]);
+
+  for (i = 0; i < NUM_BWS; i++) {
+    qos_bw24_t bw24 = bws24[i], other24 = bws24[NUM_BWS - 1 - i];
+
+    memset(&in, 0, sizeof(in));
+    in.u.level_rule.level_id = i;
+    in.u.level_rule.max_level_bw = bw24;
+    round_trip(QSUP_OP_ADD_LEVEL_RULE, &in, &out, &iparams);
+    check(iparams.u.level_rule.level_id == (int) i, "Level %d converted to %d", i, iparams.u.level_rule.level_id);
+    check(iparams.u.level_rule.max_level_bw == bw24_to_bw(bw24), "Level bw %lu converted to " QOS_BW_FMT,
+          bw24, iparams.u.level_rule.max_level_bw);
+
+    memset(&in, 0, sizeof(in));
+    in.u.group_rule.gid = 100 + i;
+    in.u.group_rule.constr = (qsup_constraints24_t) { i, 2 * i + 1, bw24, other24, QOS_F_SOFT };
+    round_trip(QSUP_OP_ADD_GROUP_RULE, &in, &out, &iparams);
+    check(iparams.u.group_rule.gid == 100 + (int) i, "Gid %d converted to %d", 100 + i, iparams.u.group_rule.gid);
+    check_constr(&in.u.group_rule.constr, &iparams.u.group_rule.constr);
+
+    memset(&in, 0, sizeof(in));
+    in.u.user_rule.uid = 1000 + i;
+    in.u.user_rule.constr = (qsup_constraints24_t) { i, i, other24, bw24, QOS_F_PERSISTENT };
+    round_trip(QSUP_OP_ADD_USER_RULE, &in, &out, &iparams);
+    check(iparams.u.user_rule.uid == 1000 + (int) i, "Uid %d converted to %d", 1000 + i, iparams.u.user_rule.uid);
+    check_constr(&in.u.user_rule.constr, &iparams.u.user_rule.constr);
+
+    memset(&in, 0, sizeof(in));
+    in.u.spare_bw = bw24;
+    round_trip(QSUP_OP_RESERVE_SPARE, &in, &out, &iparams);
+    check(iparams.u.spare_bw == bw24_to_bw(bw24), "Spare bw %lu converted to " QOS_BW_FMT,
+          bw24, iparams.u.spare_bw);
+
+    /* Results found by the supervisor go back to the caller unchanged */
+    memset(&in, 0, sizeof(in));
+    in.u.found_rule.uid = 1000 + i;
+    in.u.found_rule.gid = 100 + i;
+    qsup_iparams_from24(QSUP_OP_FIND_CONSTR, &iparams, &in);
+    check(iparams.u.found_rule.uid == 1000 + (int) i && iparams.u.found_rule.gid == 100 + (int) i,
+          "Ids (%d, %d) converted to (%d, %d)", 1000 + i, 100 + i,
+          iparams.u.found_rule.uid, iparams.u.found_rule.gid);
+    iparams.u.found_rule.constr = (qsup_constraints_t) { i, i + 1, bw24_to_bw(bw24), bw24_to_bw(other24), QOS_F_SOFT };
+    qsup_iparams_to24(QSUP_OP_FIND_CONSTR, &out, &iparams);
+    check(out.u.found_rule.uid == 1000 + (int) i && out.u.found_rule.gid == 100 + (int) i,
+          "Ids (%d, %d) converted back to (%d, %d)", 1000 + i, 100 + i,
+          out.u.found_rule.uid, out.u.found_rule.gid);
+    check_constr(&out.u.found_rule.constr, &iparams.u.found_rule.constr);
+
+    memset(&in, 0, sizeof(in));
+    in.u.avail.uid = 1000 + i;
+    in.u.avail.gid = 100 + i;
+    qsup_iparams_from24(QSUP_OP_GET_AVAIL_GUA_BW, &iparams, &in);
+    iparams.u.avail.avail_gua_bw = bw24_to_bw(bw24);
+    qsup_iparams_to24(QSUP_OP_GET_AVAIL_GUA_BW, &out, &iparams);
+    check(out.u.avail.uid == 1000 + (int) i && out.u.avail.gid == 100 + (int) i,
+          "Ids (%d, %d) converted back to (%d, %d)", 1000 + i, 100 + i, out.u.avail.uid, out.u.avail.gid);
+    check(out.u.avail.avail_gua_bw == bw24, "Available bw %lu converted back to %lu", bw24, out.u.avail.avail_gua_bw);
+  }
+
+  memset(&in, 0, sizeof(in));
+  in.u.decisions.num = 1;
+  in.u.decisions.p_recs = recs;
+  qsup_iparams_from24(QSUP_OP_GET_DECISIONS, &iparams, &in);
+  check(iparams.u.decisions.num == 1 && iparams.u.decisions.p_recs == recs, "Decisions request not converted");
+  iparams.u.decisions.bw_bits = QOS_BW_BITS;
+  iparams.u.decisions.coeff_bits = 16;
+  qsup_iparams_to24(QSUP_OP_GET_DECISIONS, &out, &iparams);
+  check(out.u.decisions.num == 1 && out.u.decisions.p_recs == recs, "Decisions not converted back");
+  check(out.u.decisions.bw_bits == QOS_BW_BITS && out.u.decisions.coeff_bits == 16,
+        "Decisions format (%u, %u) converted back to (%u, %u)",
+        QOS_BW_BITS, 16, out.u.decisions.bw_bits, out.u.decisions.coeff_bits);
+
+  memset(&in, 0, sizeof(in));
+  in.u.level_policy.level_id = 3;
+  in.u.level_policy.policy = QSUP_COMPRESS_ELASTIC;
+  qsup_iparams_from24(QSUP_OP_SET_LEVEL_POLICY, &iparams, &in);
+  check(iparams.u.level_policy.level_id == 3 && iparams.u.level_policy.policy == QSUP_COMPRESS_ELASTIC,
+        "Level policy not converted");
+
+  memset(&in, 0, sizeof(in));
+  in.u.adm_test = QSUP_ADM_RTA;
+  qsup_iparams_from24(QSUP_OP_SET_ADM_TEST, &iparams, &in);
+  check(iparams.u.adm_test == QSUP_ADM_RTA, "Admission test not converted");
+
+  return err;
+}
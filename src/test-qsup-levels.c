@@ -0,0 +1,70 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * Four levels, with one server each, user l having its server in level
+ * l. Requests of servers in different levels change one at a time: the
+ * lower-priority levels must get what is left by the higher-priority
+ * ones, whichever level the change started from.
+ */
+
+#define NUM_LEVELS 4
+
+typedef double row_t[NUM_LEVELS];
+
+/* Server changing its request at each step, and its new request */
+int changed[] = { -1, 3, 1, 2, 0 };
+double request[] = { 0.0, 0.1, 0.1, 0.6, 0.0 };
+
+row_t bw_approved[] = {
+  { 0.3, 0.3, 0.3, 0.05 },
+  { 0.3, 0.3, 0.3, 0.05 },
+  { 0.3, 0.1, 0.3, 0.1 },
+  { 0.3, 0.1, 0.55, 0.0 },
+  { 0.0, 0.1, 0.6, 0.1 },
+};
+
+double tolerance = 0.0001;
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  unsigned int n;
+  int l;
+  qsup_server_t *srv[NUM_LEVELS];
+
+  qos_chk_ok_exit(qsup_init());
+  qos_chk_ok_exit(qsup_set_num_levels(NUM_LEVELS));
+
+  for (l = 0; l < NUM_LEVELS; l++) {
+    qos_chk_ok_exit(qsup_add_user_constraints(l, & ((qsup_constraints_t) { l, 1, U_LUB, d2bw(0.0), 0 }) ));
+    qos_chk_ok_exit(qsup_create_server(&srv[l], l, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+    qsup_set_required_bw(srv[l], d2bw(0.3));
+  }
+
+  if (qsup_set_num_levels(2) != QOS_E_INCONSISTENT_STATE
+      || qsup_add_user_constraints(NUM_LEVELS, & ((qsup_constraints_t) { NUM_LEVELS, 1, U_LUB, d2bw(0.0), 0 }) ) != QOS_E_INVALID_PARAM) {
+    qos_log_err("Levels changed with servers active");
+    err = -1;
+  }
+
+  for (n = 0; n < sizeof(bw_approved) / sizeof(row_t); n++) {
+    if (changed[n] >= 0)
+      qsup_set_required_bw(srv[changed[n]], d2bw(request[n]));
+    for (l = 0; l < NUM_LEVELS; l++)
+      if (fabs(bw2d(qsup_get_approved_bw(srv[l])) - bw_approved[n][l]) > tolerance) {
+	qos_log_err("Step %u: expecting %g for level %d while got %g.",
+		    n, bw_approved[n][l], l, bw2d(qsup_get_approved_bw(srv[l])));
+	err = -1;
+      }
+  }
+
+  for (l = 0; l < NUM_LEVELS; l++)
+    qos_chk_ok_exit(qsup_destroy_server(srv[l]));
+  qsup_cleanup();
+
+  return err;
+}
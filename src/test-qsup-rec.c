@@ -0,0 +1,124 @@
+#include <linux/aquosa/qsup.h>
+#include <linux/aquosa/qsup_rec.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+/*
+ * Admission decisions of the supervisor must be found in the flight
+ * recorder, the most recent first, with rejects and saturated and
+ * compressed requests flagged. Once the ring wraps around, only the
+ * last QSUP_REC_SIZE decisions are kept.
+ */
+
+typedef struct exp_rec_t {
+  int op;
+  int server_id;		/**< Negative for a rejected server	*/
+  int flags;
+} exp_rec_t;
+
+exp_rec_t expected[] = {
+  { QSUP_DEC_SET_REQ, 1, QSUP_DEC_F_COMPRESSED },
+  { QSUP_DEC_SET_REQ, 0, QSUP_DEC_F_SATURATED },
+  { QSUP_DEC_INIT, 1, 0 },
+  { QSUP_DEC_INIT, -1, 0 },
+  { QSUP_DEC_INIT, 0, 0 },
+};
+
+#define NUM_EXPECTED (sizeof(expected) / sizeof(expected[0]))
+
+qsup_decision_t recs[2 * QSUP_REC_SIZE];
+
+int check_order(int n) {
+  int i;
+  for (i = 1; i < n; i++)
+    if (recs[i].timestamp > recs[i - 1].timestamp) {
+      qos_log_err("Record %d is more recent than record %d", i, i - 1);
+      return -1;
+    }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  int i, n;
+  qsup_server_t *srv0, *srv1, *srv2;
+
+  qos_chk_ok_exit(qsup_init());
+
+  qsup_add_level_rule(0, d2bw(0.75));
+
+  qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.5), d2bw(0.1), 0 }) );
+
+  qos_chk_ok_exit(qsup_create_server(&srv0, 0, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qos_chk_exit(qsup_create_server(&srv2, 0, 0, & ((qres_params_t) { 2000, 2000, 10000, 0 }) )
+	       == QOS_E_UNAUTHORIZED);
+  qos_chk_ok_exit(qsup_create_server(&srv1, 1, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qsup_set_required_bw(srv0, d2bw(0.6));
+  qsup_set_required_bw(srv1, d2bw(0.5));
+
+  n = qsup_rec_get(recs, 2 * QSUP_REC_SIZE);
+  if (n != NUM_EXPECTED) {
+    qos_log_err("Expecting %d records, got %d", (int) NUM_EXPECTED, n);
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    int rv = expected[i].server_id < 0 ? qos_rv_int(QOS_E_UNAUTHORIZED) : 0;
+    if (recs[i].op != expected[i].op || recs[i].server_id != expected[i].server_id
+	|| recs[i].rv != rv || recs[i].flags != expected[i].flags) {
+      qos_log_err("Record %d: expecting op=%d sid=%d rv=%d flags=%d, got op=%d sid=%d rv=%d flags=%d",
+		  i, expected[i].op, expected[i].server_id, rv, expected[i].flags,
+		  recs[i].op, recs[i].server_id, recs[i].rv, recs[i].flags);
+      err = -1;
+    }
+  }
+  if (recs[1].req_bw != d2bw(0.5) || recs[0].approved_bw >= recs[0].req_bw) {
+    qos_log_err("Wrong bandwidths recorded");
+    err = -1;
+  }
+  if (check_order(n) != 0)
+    err = -1;
+
+  /* Overflow the ring */
+  for (i = 0; i < 2 * QSUP_REC_SIZE; i++)
+    qsup_set_required_bw(srv0, d2bw(0.0005) * (i + 1));
+
+  n = qsup_rec_get(recs, 2 * QSUP_REC_SIZE);
+  if (n != QSUP_REC_SIZE) {
+    qos_log_err("Expecting %d records, got %d", QSUP_REC_SIZE, n);
+    return -1;
+  }
+  if (recs[0].req_bw != d2bw(0.0005) * 2 * QSUP_REC_SIZE
+      || recs[n - 1].req_bw != d2bw(0.0005) * (QSUP_REC_SIZE + 1)) {
+    qos_log_err("Lost the most recent records");
+    err = -1;
+  }
+  if (check_order(n) != 0)
+    err = -1;
+
+  /* Reading a few records at a time gives the same ones */
+  {
+    qsup_rec_iter_t it;
+    qsup_decision_t chunk[7];
+    int m, j, k = 0;
+
+    qos_chk_ok_exit(qsup_rec_iter_init(&it));
+    while ((m = qsup_rec_iter_next(&it, chunk, 7)) > 0)
+      for (j = 0; j < m; j++, k++)
+        if (k >= n || chunk[j].req_bw != recs[k].req_bw) {
+          qos_log_err("Record %d differs when read in chunks", k);
+          err = -1;
+        }
+    qsup_rec_iter_cleanup(&it);
+    if (k != n) {
+      qos_log_err("Expecting %d records in chunks, got %d", n, k);
+      err = -1;
+    }
+  }
+
+  qos_chk_ok_exit(qsup_destroy_server(srv0));
+  qos_chk_ok_exit(qsup_destroy_server(srv1));
+  qsup_cleanup();
+
+  return err;
+}
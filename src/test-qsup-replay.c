@@ -0,0 +1,578 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Replays at full speed a trace of reservation operations, as recorded
+ * by qreslib/qres_record.c, against the supervisor, doing on each server
+ * the same calls as the QRES module. Policies may differ from the ones
+ * in force when the trace was recorded:
+ *
+ *   test-qsup-replay [-l levels] [-s spare] [-m level:max_bw]
+ *                    [-u uid:level:weight:max_bw:max_min_bw]
+ *                    [-g gid:level:weight:max_bw:max_min_bw]
+ *                    [-e level] [-x] [trace]
+ *
+ * where -e makes a level elastic. Bandwidths are fractions of the CPU.
+ * Without a trace, a synthetic one is generated and replayed. The
+ * throughput of the replay is printed, along with the operations whose
+ * outcome differs from the recorded one, and the approved bandwidths
+ * must fit in what is not reserved as spare once the trace is over.
+ *
+ * With -x, or with the synthetic trace and the default policies, every
+ * outcome must be the recorded one.
+ */
+
+/* Limits enforced by the QRES module, see rres_interface.h and qsup_gw_ks.h */
+#define REPLAY_MIN_PERIOD 1000
+#define REPLAY_MIN_BUDGET 0
+#define REPLAY_DEFAULT_SRV_UID 0
+#define REPLAY_DEFAULT_SRV_GID 0
+
+typedef enum {
+  OP_CREATE, OP_SUB, OP_SET, OP_ATTACH, OP_DETACH, OP_DESTROY, OP_CPU
+} op_kind_t;
+
+static const char *op_names[] = { "create", "sub", "set", "attach", "detach", "destroy", "cpu" };
+
+typedef struct op_t {
+  op_kind_t kind;
+  int sid;
+  int uid, gid;
+  qres_params_t params;
+  unsigned int cpu_mask;	/**< CPUs of a cpu change		*/
+  int num_cpus;			/**< CPUs in cpu_mask			*/
+  qres_time_t Q_tot, Q_max;	/**< Sum and max of the per-CPU budgets	*/
+  int rv;			/**< Recorded outcome			*/
+} op_t;
+
+static op_t *ops = NULL;
+static int num_ops = 0, max_ops = 0;
+
+/** State of a replayed server, as kept by the QRES module */
+typedef struct replay_srv_t {
+  qsup_server_t *qsup;		/**< NULL if not existing		*/
+  qres_params_t params;		/**< Requested parameters, rounded	*/
+  unsigned int cpu_mask;	/**< CPUs the budget is spread over	*/
+  qos_bw_t max_share;		/**< Largest share of it on one CPU	*/
+} replay_srv_t;
+
+/** Replayed servers, indexed by recorded sid */
+static replay_srv_t *servers = NULL;
+static int max_sid = 0;
+
+static int admitted = 0, rejected = 0, mismatches = 0, skipped = 0;
+
+/** Parse a cpu line, listing a budget for each CPU in the mask */
+static int parse_cpu(const char *line, op_t *op) {
+  char *end;
+  int cpu, skip = 0;
+
+  if (sscanf(line, "%*u %*s %d %u %n", &op->sid, &op->cpu_mask, &skip) != 2 || skip == 0)
+    return 0;
+  line += skip;
+  for (cpu = 0; cpu < QRES_MAX_CPUS; cpu++) {
+    qres_time_t Q;
+    if (! (op->cpu_mask & (1u << cpu)))
+      continue;
+    Q = strtol(line, &end, 10);
+    if (end == line)
+      return 0;
+    line = end;
+    op->Q_tot += Q;
+    if (Q > op->Q_max)
+      op->Q_max = Q;
+    op->num_cpus++;
+  }
+  op->rv = strtol(line, &end, 10);
+  return end != line;
+}
+
+/** Parse a line of the trace into a new entry of ops[] */
+static int parse_line(const char *line) {
+  op_t op;
+  char name[16];
+  unsigned long long usec;
+  int k, n = 0;
+  long Q_min = 0, Q = 0, P = 0;
+
+  memset(&op, 0, sizeof(op));
+  if (sscanf(line, "%llu %15s", &usec, name) != 2)
+    return -1;
+  for (k = 0; k <= OP_CPU; k++)
+    if (strcmp(name, op_names[k]) == 0)
+      break;
+  op.kind = k;
+  switch (op.kind) {
+  case OP_CREATE:
+    n = sscanf(line, "%*u %*s %d %d %d %ld %ld %ld %u %d", &op.sid, &op.uid, &op.gid,
+	       &Q_min, &Q, &P, &op.params.flags, &op.rv) == 8;
+    break;
+  case OP_SUB:
+    n = sscanf(line, "%*u %*s %d %*d %ld %ld %ld %u %d", &op.sid,
+	       &Q_min, &Q, &P, &op.params.flags, &op.rv) == 6;
+    break;
+  case OP_SET:
+    n = sscanf(line, "%*u %*s %d %ld %ld %ld %u %d", &op.sid,
+	       &Q_min, &Q, &P, &op.params.flags, &op.rv) == 6;
+    break;
+  case OP_ATTACH:
+  case OP_DETACH:
+    n = sscanf(line, "%*u %*s %d %*d %*d %d", &op.sid, &op.rv) == 2;
+    break;
+  case OP_DESTROY:
+    n = sscanf(line, "%*u %*s %d %d", &op.sid, &op.rv) == 2;
+    break;
+  case OP_CPU:
+    n = parse_cpu(line, &op);
+    break;
+  default:
+    n = 0;
+  }
+  if (! n || op.sid >= 1000000)
+    return -1;
+  op.params.Q_min = Q_min;
+  op.params.Q = Q;
+  op.params.P = P;
+
+  if (num_ops == max_ops) {
+    max_ops = max_ops > 0 ? 2 * max_ops : 1024;
+    ops = realloc(ops, max_ops * sizeof(*ops));
+    qos_chk_exit(ops != NULL);
+  }
+  ops[num_ops++] = op;
+  if (op.sid >= max_sid) {
+    int old = max_sid;
+    max_sid = 2 * op.sid + 1;
+    servers = realloc(servers, max_sid * sizeof(*servers));
+    qos_chk_exit(servers != NULL);
+    memset(servers + old, 0, (max_sid - old) * sizeof(*servers));
+  }
+  return 0;
+}
+
+static int load(FILE *f) {
+  char line[256];
+  int lineno = 0;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (parse_line(line) != 0) {
+      qos_log_err("Could not parse line %d: %s", lineno, line);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** Server of the synthetic trace */
+typedef struct gen_srv_t {
+  int sid;
+  long Q_min, P;		/**< As last requested			*/
+  double gua;			/**< Guarantee admitted by the supervisor */
+  int spread;			/**< Budget spread over CPUs		*/
+} gen_srv_t;
+
+/** Margin around the capacity, within which guarantees are not asked
+ ** for, as their outcome would depend on roundings */
+#define GEN_MARGIN 0.001
+
+/** Guarantee asked for by (Q_min, P), or zero if too close to the
+ ** capacity left, given the total tot of the other guarantees */
+static double gen_gua(long *p_Q_min, long P, double tot) {
+  double gua = *p_Q_min / (double) P, cap = RRES_U_LUB / 100.0;
+
+  if (tot + gua > cap - GEN_MARGIN && tot + gua < cap + GEN_MARGIN) {
+    *p_Q_min = 0;
+    return 0.0;
+  }
+  return gua;
+}
+
+/** Write a synthetic trace, of servers created, changed and destroyed
+ ** by a few users, along with the outcomes expected from the QRES module
+ ** under the default policies of the supervisor */
+static void generate(FILE *f) {
+  gen_srv_t live[256], *srv;
+  int num_live = 0, next_sid = 0, i;
+  double tot = 0.0, cap = RRES_U_LUB / 100.0;
+  unsigned long long usec = 0;
+
+  srand(1);
+  for (i = 0; i < 20000; i++) {
+    int r = rand() % 8, bad = (rand() % 50 == 0);
+    long P = 10000 * (1 + rand() % 10);
+    long Q = P * (rand() % 20) / 100;
+    long Q_min = (rand() % 8 == 0) ? Q / 4 : 0;
+    double gua;
+
+    usec += rand() % 1000;
+    if (num_live == 0 || (r < 2 && num_live < 256)) {
+      int uid = 1000 + rand() % 20, gid = 100 + rand() % 3;
+      if (bad) {
+	fprintf(f, "%llu create -1 %d %d %ld %ld %d 0 %d\n", usec, uid, gid,
+		Q_min, Q, REPLAY_MIN_PERIOD / 2, qos_rv_int(QOS_E_INVALID_PARAM));
+	continue;
+      }
+      gua = gen_gua(&Q_min, P, tot);
+      if (tot + gua > cap) {
+	fprintf(f, "%llu create -1 %d %d %ld %ld %ld 0 %d\n", usec, uid, gid,
+		Q_min, Q, P, qos_rv_int(QOS_E_SYSTEM_OVERLOAD));
+	continue;
+      }
+      srv = &live[num_live++];
+      srv->sid = next_sid++;
+      srv->Q_min = Q_min;
+      srv->P = P;
+      srv->gua = gua;
+      srv->spread = 0;
+      tot += gua;
+      fprintf(f, "%llu create %d %d %d %ld %ld %ld 0 0\n", usec, srv->sid, uid, gid, Q_min, Q, P);
+      continue;
+    }
+    srv = &live[rand() % num_live];
+    if (r < 3) {
+      fprintf(f, "%llu destroy %d 0\n", usec, srv->sid);
+      tot -= srv->gua;
+      *srv = live[--num_live];
+    } else if (r < 4)
+      fprintf(f, "%llu attach %d 0 0 0\n", usec, srv->sid);
+    else if (r == 4 && srv->Q_min == 0) {
+      /* Spread over two CPUs, over one, or back over all of them */
+      long Q0 = srv->P * (rand() % 20) / 100, Q1 = srv->P * (rand() % 20) / 100;
+      switch (rand() % 3) {
+      case 0:
+	fprintf(f, "%llu cpu %d 3 %ld %ld %d\n", usec, srv->sid, bad ? srv->P + 1 : Q0, Q1,
+		bad ? qos_rv_int(QOS_E_INVALID_PARAM) : 0);
+	srv->spread |= ! bad;
+	break;
+      case 1:
+	fprintf(f, "%llu cpu %d 1 %ld 0\n", usec, srv->sid, Q0);
+	srv->spread = 1;
+	break;
+      default:
+	fprintf(f, "%llu cpu %d 0 0\n", usec, srv->sid);
+      }
+    } else if (bad)
+      fprintf(f, "%llu set %d %ld %ld %d 0 %d\n", usec, srv->sid, Q_min, Q,
+	      REPLAY_MIN_PERIOD / 2, qos_rv_int(QOS_E_INVALID_PARAM));
+    else if (r == 5 && rand() % 16 == 0)
+      fprintf(f, "%llu set %d %ld %ld %ld %u %d\n", usec, srv->sid, Q_min, Q, P,
+	      QOS_F_SOFT, qos_rv_int(QOS_E_UNIMPLEMENTED));
+    else {
+      /* Guarantees are charged on one CPU only, keep them out of the way */
+      if (srv->spread)
+	Q_min = 0;
+      if (Q_min != srv->Q_min || P != srv->P) {
+	tot -= srv->gua;
+	gua = gen_gua(&Q_min, P, tot);
+	/* A guarantee not fitting leaves the old one in force */
+	if (tot + gua <= cap)
+	  srv->gua = gua;
+	tot += srv->gua;
+      }
+      srv->Q_min = Q_min;
+      srv->P = P;
+      fprintf(f, "%llu set %d %ld %ld %ld 0 0\n", usec, srv->sid, Q_min, Q, P);
+    }
+  }
+}
+
+/** Count an operation, and whether its outcome differs from the trace */
+static void account(op_t *op, qos_rv rv) {
+  if (rv == QOS_OK)
+    admitted++;
+  else
+    rejected++;
+  if (qos_rv_int(rv) != op->rv) {
+    if (mismatches++ < 10)
+      qos_log_err("%s of server %d: got %d, recorded %d", op_names[op->kind], op->sid,
+		  qos_rv_int(rv), op->rv);
+  }
+}
+
+/** Round the requested values as the QRES module, i.e., according to
+ ** the qos_bw_t granularity */
+static void replay_round(qres_params_t *p) {
+  p->Q_min = bw2Q(r2bw_ceil(p->Q_min, p->P), p->P);
+  p->Q = bw2Q(r2bw_ceil(p->Q, p->P), p->P);
+}
+
+/** Parameters the supervisor is charged with for p, on the CPU with
+ ** the largest share of the budget, as in qres_charged_params() */
+static qres_params_t replay_charged(unsigned int cpu_mask, qos_bw_t share, const qres_params_t *p) {
+  qres_params_t charged = *p;
+
+  if (cpu_mask != 0) {
+    charged.Q = mul_by_bw(p->Q, share);
+    charged.Q_min = mul_by_bw(p->Q_min, share);
+  }
+  return charged;
+}
+
+/** Same supervisor calls as qres_qsup_update() */
+static qos_rv replay_qsup_update(replay_srv_t *srv, qres_params_t *old, qres_params_t *p) {
+  qsup_server_t *qsup = srv->qsup;
+
+  if (p->Q_min != old->Q_min || p->P != old->P) {
+    qos_chk_ok_ret(qsup_cleanup_server(qsup));
+    if (qsup_init_server(qsup, qsup->uid, qsup->gid, p) != QOS_OK)
+      qos_chk_ok_ret(qsup_init_server(qsup, qsup->uid, qsup->gid, old));
+  }
+  return qsup_set_required_bw(qsup, r2bw(p->Q, p->P));
+}
+
+/** Same checks and supervisor calls as qres_create_server() */
+static qos_rv replay_create(op_t *op) {
+  qres_params_t p = op->params;
+  qsup_server_t *qsup;
+  qos_rv rv;
+
+  if (p.P < REPLAY_MIN_PERIOD || p.Q > p.P || p.Q < REPLAY_MIN_BUDGET)
+    return QOS_E_INVALID_PARAM;
+  replay_round(&p);
+  if ((p.flags & QOS_F_DEFAULT) && op->uid != 0
+      && op->uid != REPLAY_DEFAULT_SRV_UID && op->gid != REPLAY_DEFAULT_SRV_GID)
+    return QOS_E_UNAUTHORIZED;
+  rv = qsup_create_server(&qsup, op->uid, op->gid, &p);
+  if (rv != QOS_OK)
+    return rv;
+  rv = qsup_set_required_bw(qsup, r2bw(p.Q, p.P));
+  if (rv != QOS_OK || op->sid < 0) {
+    /* Servers refused when recorded are never referred to again */
+    qsup_destroy_server(qsup);
+    return rv;
+  }
+  servers[op->sid].qsup = qsup;
+  servers[op->sid].params = p;
+  servers[op->sid].cpu_mask = 0;
+  servers[op->sid].max_share = MAX_BW;
+  return QOS_OK;
+}
+
+/** Same checks and supervisor calls as qres_set_params() */
+static qos_rv replay_set(op_t *op, replay_srv_t *srv) {
+  qres_params_t p = op->params, charged, old_charged;
+
+  charged = replay_charged(srv->cpu_mask, srv->max_share, &p);
+  if (p.P < REPLAY_MIN_PERIOD || charged.Q > p.P || p.Q < REPLAY_MIN_BUDGET)
+    return QOS_E_INVALID_PARAM;
+  if (p.flags != srv->params.flags)
+    return QOS_E_UNIMPLEMENTED;
+  replay_round(&p);
+  charged = replay_charged(srv->cpu_mask, srv->max_share, &p);
+  old_charged = replay_charged(srv->cpu_mask, srv->max_share, &srv->params);
+  qos_chk_ok_ret(replay_qsup_update(srv, &old_charged, &charged));
+  srv->params = p;
+  return QOS_OK;
+}
+
+/** Same checks and supervisor calls as qres_set_cpu_params(), for CPUs
+ ** that were online when recorded */
+static qos_rv replay_cpu(op_t *op, replay_srv_t *srv) {
+  qres_params_t p = srv->params, charged, old_charged;
+  qos_bw_t share;
+
+  if (op->Q_max > p.P)
+    return QOS_E_INVALID_PARAM;
+  if (op->cpu_mask == 0)
+    share = MAX_BW;
+  else if (op->Q_tot != 0)
+    share = r2bw(op->Q_max, op->Q_tot);
+  else
+    share = MAX_BW / op->num_cpus;
+  if (op->Q_tot != 0)
+    p.Q = op->Q_tot;
+  if (p.Q_min > p.Q)
+    return QOS_E_INVALID_PARAM;
+  old_charged = replay_charged(srv->cpu_mask, srv->max_share, &srv->params);
+  charged = replay_charged(op->cpu_mask, share, &p);
+  if (charged.Q > p.P)
+    return QOS_E_INVALID_PARAM;
+  qos_chk_ok_ret(replay_qsup_update(srv, &old_charged, &charged));
+  srv->params = p;
+  srv->cpu_mask = op->cpu_mask;
+  srv->max_share = share;
+  return QOS_OK;
+}
+
+static void replay(void) {
+  int i;
+
+  for (i = 0; i < num_ops; i++) {
+    op_t *op = &ops[i];
+    replay_srv_t *srv = (op->sid >= 0 && servers[op->sid].qsup != NULL) ? &servers[op->sid] : NULL;
+
+    switch (op->kind) {
+    case OP_CREATE:
+      account(op, replay_create(op));
+      break;
+    case OP_SET:
+      if (srv == NULL)
+	skipped++;
+      else
+	account(op, replay_set(op, srv));
+      break;
+    case OP_CPU:
+      if (srv == NULL)
+	skipped++;
+      else
+	account(op, replay_cpu(op, srv));
+      break;
+    case OP_DESTROY:
+      if (srv == NULL)
+	skipped++;
+      else {
+	qsup_destroy_server(srv->qsup);
+	srv->qsup = NULL;
+      }
+      break;
+    default:
+      /* Sub-reservations are not known to the supervisor */
+      skipped++;
+    }
+    /* Dirty servers would be taken by qres_update_bandwidths() */
+    while (qsup_pop_dirty() != NULL)
+      ;
+  }
+}
+
+/** Approved bandwidths of the servers left must fit in U_LUB - spare */
+static int check_total(qos_bw_t spare) {
+  qos_bw_t tot = 0;
+  int sid, num = 0;
+
+  for (sid = 0; sid < max_sid; sid++)
+    if (servers[sid].qsup != NULL) {
+      tot += qsup_get_approved_bw(servers[sid].qsup);
+      num++;
+    }
+  printf("# %d servers left, approved %g\n", num, bw2d(tot));
+  /* One unit of rounding per server */
+  if (tot > U_LUB - spare + num) {
+    qos_log_err("Approved bandwidths %g exceed %g", bw2d(tot), bw2d(U_LUB - spare));
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_rule(const char *arg, qsup_rule_t *rule) {
+  double max_bw, max_min_bw;
+
+  if (sscanf(arg, "%d:%d:%d:%lf:%lf", &rule->id, &rule->constr.level, &rule->constr.weight,
+	     &max_bw, &max_min_bw) != 5)
+    return -1;
+  rule->constr.max_bw = d2bw(max_bw);
+  rule->constr.max_min_bw = d2bw(max_min_bw);
+  rule->constr.flags_mask = 0;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  qsup_rule_t users[16], groups[16], rule;
+  int num_users = 0, num_groups = 0, num_levels = 0;
+  int elastic[16], num_elastic = 0, level_max[16], num_level_max = 0;
+  double level_max_bw[16], spare = 0.0, t;
+  struct timeval tv0, tv1;
+  int opt, err = 0, i, strict = 0, policies = 0;
+  FILE *f;
+
+  while ((opt = getopt(argc, argv, "l:s:m:u:g:e:x")) != -1) {
+    policies += (opt != 'x');
+    switch (opt) {
+    case 'l':
+      num_levels = atoi(optarg);
+      break;
+    case 's':
+      spare = atof(optarg);
+      break;
+    case 'm':
+      qos_chk_exit(num_level_max < 16);
+      if (sscanf(optarg, "%d:%lf", &level_max[num_level_max], &level_max_bw[num_level_max]) != 2) {
+	qos_log_err("Wrong level rule: %s", optarg);
+	return -1;
+      }
+      num_level_max++;
+      break;
+    case 'u':
+    case 'g':
+      qos_chk_exit(parse_rule(optarg, &rule) == 0);
+      if (opt == 'u' && num_users < 16)
+	users[num_users++] = rule;
+      else if (opt == 'g' && num_groups < 16)
+	groups[num_groups++] = rule;
+      break;
+    case 'e':
+      qos_chk_exit(num_elastic < 16);
+      elastic[num_elastic++] = atoi(optarg);
+      break;
+    case 'x':
+      strict = 1;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-l levels] [-s spare] [-m level:max_bw]"
+	      " [-u|-g id:level:weight:max_bw:max_min_bw] [-e level] [-x] [trace]\n", argv[0]);
+      return -1;
+    }
+  }
+
+  if (optind < argc) {
+    f = fopen(argv[optind], "r");
+    if (f == NULL) {
+      qos_log_err("Could not open %s", argv[optind]);
+      return -1;
+    }
+  } else {
+    f = tmpfile();
+    qos_chk_exit(f != NULL);
+    generate(f);
+    rewind(f);
+    /* Its outcomes are the ones of the default policies */
+    strict |= (policies == 0);
+  }
+  err = load(f);
+  fclose(f);
+  if (err != 0)
+    return err;
+
+  if (num_levels > 0)
+    qos_chk_ok_exit(qsup_set_num_levels(num_levels));
+  qos_chk_ok_exit(qsup_init());
+  qos_chk_ok_exit(qsup_reserve_spare(d2bw(spare)));
+  for (i = 0; i < num_level_max; i++)
+    qos_chk_ok_exit(qsup_add_level_rule(level_max[i], d2bw(level_max_bw[i])));
+  qos_chk_ok_exit(qsup_set_rules(users, num_users, groups, num_groups, NULL));
+  for (i = 0; i < num_elastic; i++)
+    qos_chk_ok_exit(qsup_set_level_policy(elastic[i], QSUP_COMPRESS_ELASTIC));
+
+  gettimeofday(&tv0, NULL);
+  replay();
+  gettimeofday(&tv1, NULL);
+  t = (tv1.tv_sec - tv0.tv_sec) * 1000000.0 + (tv1.tv_usec - tv0.tv_usec);
+
+  printf("# %d ops in %.0f us, %.0f ops/s\n", num_ops, t, t > 0 ? num_ops * 1000000.0 / t : 0.0);
+  printf("# admitted %d, rejected %d, differing from the trace %d, skipped %d\n",
+	 admitted, rejected, mismatches, skipped);
+  err = check_total(d2bw(spare));
+  if (strict && mismatches != 0) {
+    qos_log_err("%d outcomes differ from the trace", mismatches);
+    err = -1;
+  }
+
+  for (i = 0; i < max_sid; i++)
+    if (servers[i].qsup != NULL)
+      qsup_destroy_server(servers[i].qsup);
+  qsup_cleanup();
+  free(ops);
+  free(servers);
+  return err;
+}
@@ -0,0 +1,101 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * Two servers of two users in group 0, each requesting 0.4. Rules are
+ * added, replaced, deleted and swapped as a whole while the servers
+ * exist: the approved bandwidths must follow the rules in force, with
+ * requests saturated to the per-user maximum of the current rule only.
+ */
+
+double tolerance = 0.0001;
+
+static int check(const char *step, qsup_server_t *srv0, double bw0, qsup_server_t *srv1, double bw1) {
+  if (
+      (fabs(bw2d(qsup_get_approved_bw(srv0)) - bw0) > tolerance)
+      || (fabs(bw2d(qsup_get_approved_bw(srv1)) - bw1) > tolerance)
+      ) {
+    qos_log_err("%s: expecting %g, %g while got %g, %g.", step, bw0, bw1,
+		bw2d(qsup_get_approved_bw(srv0)), bw2d(qsup_get_approved_bw(srv1)));
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  unsigned long version;
+  qsup_server_t *srv0, *srv1;
+  qsup_constraints_t constr;
+  qsup_rule_t users[] = {
+    { 1, { 0, 1, d2bw(0.1), d2bw(0.0), 0 } },
+    { 0, { 1, 1, d2bw(0.5), d2bw(0.0), 0 } },
+  };
+  qsup_rule_t groups[] = {
+    { 0, { 0, 1, d2bw(0.3), d2bw(0.0), 0 } },
+  };
+  qsup_rule_t dups[] = {
+    { 2, { 0, 1, d2bw(0.1), d2bw(0.0), 0 } },
+    { 2, { 0, 1, d2bw(0.2), d2bw(0.0), 0 } },
+  };
+
+  qos_chk_ok_exit(qsup_init());
+
+  qsup_add_level_rule(0, d2bw(0.75));
+
+  qos_chk_ok_exit(qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.2), d2bw(0.0), 0 }) ));
+
+  qos_chk_ok_exit(qsup_create_server(&srv0, 0, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qos_chk_ok_exit(qsup_create_server(&srv1, 1, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qsup_set_required_bw(srv0, d2bw(0.4));
+  qsup_set_required_bw(srv1, d2bw(0.4));
+  err |= check("group rule", srv0, 0.2, srv1, 0.2);
+
+  /* Replacing the group rule must not leave the old one in force */
+  qos_chk_ok_exit(qsup_add_group_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.3), d2bw(0.0), 0 }) ));
+  err |= check("replaced group rule", srv0, 0.3, srv1, 0.3);
+
+  qos_chk_ok_exit(qsup_add_user_constraints(0, & ((qsup_constraints_t) { 0, 1, d2bw(0.6), d2bw(0.0), 0 }) ));
+  err |= check("user rule", srv0, 0.4, srv1, 0.3);
+  qsup_find_constr(0, 0, &constr);
+  if (constr.max_bw != d2bw(0.6)) {
+    qos_log_err("User rule not found");
+    err = -1;
+  }
+
+  qos_chk_ok_exit(qsup_del_user_rule(0));
+  err |= check("deleted user rule", srv0, 0.3, srv1, 0.3);
+  if (qsup_del_user_rule(0) != QOS_E_NOT_FOUND) {
+    qos_log_err("Deleted a missing rule");
+    err = -1;
+  }
+
+  /* Server 0 moves to level 1, server 1 gets a lower maximum */
+  qos_chk_ok_exit(qsup_set_rules(users, 2, groups, 1, &version));
+  err |= check("swapped rules", srv0, 0.4, srv1, 0.1);
+  qsup_set_required_bw(srv1, d2bw(0.05));
+  err |= check("request after swap", srv0, 0.4, srv1, 0.05);
+
+  if (qsup_set_rules(dups, 2, groups, 1, NULL) != QOS_E_INVALID_PARAM
+      || qsup_add_user_constraints(3, & ((qsup_constraints_t) { 2, 1, d2bw(0.1), d2bw(0.0), 0 }) ) != QOS_E_INVALID_PARAM) {
+    qos_log_err("Accepted invalid rules");
+    err = -1;
+  }
+  qos_chk_ok_exit(qsup_del_group_rule(0));
+  qsup_find_constr(2, 0, &constr);
+  if (constr.max_bw != U_LUB) {
+    qos_log_err("Default constraints not in force");
+    err = -1;
+  }
+  err |= check("rejected rules", srv0, 0.4, srv1, 0.05);
+
+  qos_chk_ok_exit(qsup_destroy_server(srv0));
+  qos_chk_ok_exit(qsup_destroy_server(srv1));
+  qsup_cleanup();
+
+  return err;
+}
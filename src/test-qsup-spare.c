@@ -0,0 +1,67 @@
+#include <linux/aquosa/qsup.h>
+
+#include <linux/aquosa/qos_debug.h>
+#include <linux/aquosa/qos_types.h>
+
+#include <math.h>
+
+/*
+ * Two servers, the first with a guarantee of 0.2, both requesting 0.4,
+ * while the spare bandwidth is changed: growing it must compress the
+ * non-guaranteed part of the requests, and be refused when the admitted
+ * guarantees would not fit, while shrinking it must admit more.
+ */
+
+double tolerance = 0.0001;
+
+static int check(const char *step, qsup_server_t *srv0, double bw0, qsup_server_t *srv1, double bw1) {
+  if (
+      (fabs(bw2d(qsup_get_approved_bw(srv0)) - bw0) > tolerance)
+      || (fabs(bw2d(qsup_get_approved_bw(srv1)) - bw1) > tolerance)
+      ) {
+    qos_log_err("%s: expecting %g, %g while got %g, %g.", step, bw0, bw1,
+		bw2d(qsup_get_approved_bw(srv0)), bw2d(qsup_get_approved_bw(srv1)));
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int err = 0;
+  qsup_server_t *srv0, *srv1, *srv2;
+
+  qos_chk_ok_exit(qsup_init());
+
+  qos_chk_ok_exit(qsup_create_server(&srv0, 0, 0, & ((qres_params_t) { 2000, 0, 10000, 0 }) ));
+  qos_chk_ok_exit(qsup_create_server(&srv1, 1, 0, & ((qres_params_t) { 0, 0, 10000, 0 }) ));
+  qsup_set_required_bw(srv0, d2bw(0.4));
+  qsup_set_required_bw(srv1, d2bw(0.4));
+  err |= check("no spare", srv0, 0.4, srv1, 0.4);
+
+  /* 0.5 left: the guarantee of 0.2, plus half of the remaining 0.6 */
+  qos_chk_ok_exit(qsup_reserve_spare(d2bw(0.45)));
+  err |= check("grown spare", srv0, 0.2 + 0.2 * 0.5, srv1, 0.4 * 0.5);
+
+  if (qsup_reserve_spare(d2bw(0.8)) != QOS_E_SYSTEM_OVERLOAD) {
+    qos_log_err("Spare bandwidth overlapping guarantees accepted");
+    err = -1;
+  }
+  err |= check("refused spare", srv0, 0.2 + 0.2 * 0.5, srv1, 0.4 * 0.5);
+
+  qos_chk_ok_exit(qsup_reserve_spare(d2bw(0.1)));
+  err |= check("shrunk spare", srv0, 0.4, srv1, 0.4);
+
+  if (qsup_create_server(&srv2, 2, 0, & ((qres_params_t) { 7000, 0, 10000, 0 }) ) != QOS_E_SYSTEM_OVERLOAD) {
+    qos_log_err("Guarantee overlapping spare bandwidth accepted");
+    err = -1;
+  }
+  qos_chk_ok_exit(qsup_reserve_spare(0));
+  qos_chk_ok_exit(qsup_create_server(&srv2, 2, 0, & ((qres_params_t) { 7000, 0, 10000, 0 }) ));
+
+  qos_chk_ok_exit(qsup_destroy_server(srv2));
+  qos_chk_ok_exit(qsup_destroy_server(srv0));
+  qos_chk_ok_exit(qsup_destroy_server(srv1));
+  qsup_cleanup();
+
+  return err;
+}
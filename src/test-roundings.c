@@ -3,6 +3,8 @@
 #include <linux/aquosa/qos_types.h>
 #include <aquosa/qres_lib.h>
 
+#include <stdlib.h>
+
 void test(qres_time_t Q, qres_time_t Q_min, qres_time_t P) {
   qos_log_debug("(Q, Q_min, P): (" QRES_TIME_FMT ", " QRES_TIME_FMT ", " QRES_TIME_FMT ")", Q, Q_min, P);
   qos_bw_t bw_min;
@@ -11,7 +13,7 @@ void test(qres_time_t Q, qres_time_t Q_min, qres_time_t P) {
    * available due to qos_bw_t granularity
    */
   bw_min = r2bw_ceil(Q_min, P);
-  qos_log_debug("bw_min=%g", bw_min / (double) (1ul<<QOS_BW_BITS));
+  qos_log_debug("bw_min=%g", bw_min / (double) MAX_BW);
 
   /* Round the requested values according to the qos_bw_t granularity */
   Q_min = bw2Q(bw_min, P);
@@ -19,9 +21,115 @@ void test(qres_time_t Q, qres_time_t Q_min, qres_time_t P) {
   qos_log_debug("Rounded (Q, Q_min, P): (" QRES_TIME_FMT ", " QRES_TIME_FMT ", " QRES_TIME_FMT ")", Q, Q_min, P);
 }
 
+static int errors = 0;
+
+#define check(cond, ...) do {				\
+  if (! (cond) && errors++ < 10)			\
+    qos_log_err(__VA_ARGS__);				\
+} while (0)
+
+static unsigned long rand32(void) {
+  return ((unsigned long) (rand() & 0xffff) << 16) | (rand() & 0xffff);
+}
+
+/* Check the conversions of (Q, P) against exact 64-bit arithmetics */
+static void check_conv(unsigned long Q, unsigned long P, const qos_recip_t *p_r) {
+  unsigned long long num = ((unsigned long long) Q) << QOS_BW_BITS;
+  qos_bw_t bw = num / P;
+  qos_bw_t bw_ceil = (num + P - 1) / P;
+
+  check(r2bw(Q, P) == bw, "r2bw(%lu, %lu) = " QOS_BW_FMT ", expecting " QOS_BW_FMT,
+        Q, P, r2bw(Q, P), bw);
+  check(r2bw_ceil(Q, P) == bw_ceil, "r2bw_ceil(%lu, %lu) = " QOS_BW_FMT ", expecting " QOS_BW_FMT,
+        Q, P, r2bw_ceil(Q, P), bw_ceil);
+  check(r2bw_recip(Q, p_r) == bw, "r2bw_recip(%lu, %lu) = " QOS_BW_FMT ", expecting " QOS_BW_FMT,
+        Q, P, r2bw_recip(Q, p_r), bw);
+  check(r2bw_ceil_recip(Q, p_r) == bw_ceil, "r2bw_ceil_recip(%lu, %lu) = " QOS_BW_FMT ", expecting " QOS_BW_FMT,
+        Q, P, r2bw_ceil_recip(Q, p_r), bw_ceil);
+  /* Rounding up the bandwidth never rounds down the budget */
+  check(bw2Q(bw_ceil, P) >= Q, "bw2Q(r2bw_ceil(%lu, %lu)) = %ld", Q, P, bw2Q(bw_ceil, P));
+}
+
+/* Check the composite operations against exact 64-bit arithmetics */
+static void check_ul(unsigned long x, unsigned long y, unsigned long z) {
+  unsigned long long xy = (unsigned long long) x * y;
+
+  check(ul_mul_shr(x, y, 16) == (__u32) (xy >> 16), "ul_mul_shr(%lu, %lu, 16)", x, y);
+  check(ul_mul_shr(x, y, QOS_BW_BITS) == (__u32) (xy >> QOS_BW_BITS), "ul_mul_shr(%lu, %lu)", x, y);
+  if (z == 0)
+    return;
+  if (xy / z <= 0xfffffffful)
+    check(ul_mul_div(x, y, z) == xy / z, "ul_mul_div(%lu, %lu, %lu)", x, y, z);
+  if ((((unsigned long long) x) << 16) / z <= 0xfffffffful) {
+    check(ul_shl_div(x, 16, z) == (((unsigned long long) x) << 16) / z, "ul_shl_div(%lu, 16, %lu)", x, z);
+    check(ul_shl_ceil(x, 16, z) == ((((unsigned long long) x) << 16) + z - 1) / z, "ul_shl_ceil(%lu, 16, %lu)", x, z);
+  }
+}
+
+/* Check the 64x32-bit multiply against the split computation */
+static void check_ull(unsigned long long x, unsigned long y) {
+  unsigned long long hi = (x >> 32) * y;
+  unsigned long long lo = ((x & 0xffffffffull) * y) >> 32;
+
+  check(ull_mul_shr32(x, y) == hi + lo, "ull_mul_shr32(%llu, %lu)", x, y);
+}
+
+#if defined(QOS_BW_WIDE) && defined(__SIZEOF_INT128__)
+/* Check the scaling by a ratio of bandwidths against exact 128-bit arithmetics */
+static void check_scale(unsigned long long x, qos_bw_t num, qos_bw_t den) {
+  unsigned long long exp = (unsigned long long) (((unsigned __int128) x * num) / den);
+
+  check(bw_scale(x, num, den) == exp, "bw_scale(%llu, " QOS_BW_FMT ", " QOS_BW_FMT ")", x, num, den);
+}
+#endif
+
 int main() {
+  unsigned long P, Q;
+  qos_recip_t r;
+  long i;
+
   test(10, 0, 20);
   test(10000, 0, 20000);
   test(19999, 0, 20000);
+
+  /* All budgets up to the period, for all small periods */
+  for (P = 1; P <= 2000; ++P) {
+    qos_recip_init(&r, P);
+    for (Q = 0; Q <= P; ++Q)
+      check_conv(Q, P, &r);
+  }
+  /* Budgets around the period, for periods around powers of two */
+  for (i = 11; i < 32; ++i) {
+    unsigned long base = 1ul << i;
+    for (P = base - 3; P <= base + 3; ++P) {
+      qos_recip_init(&r, P);
+      for (Q = 0; Q < 1000; ++Q) {
+        check_conv(Q, P, &r);
+        check_conv(P - Q, P, &r);
+      }
+    }
+  }
+  /* Random (Q, P) pairs, with budgets up to four times the period */
+  srand(1);
+  for (i = 0; i < 10000000; ++i) {
+    P = 1 + rand32() % 0x7fffffff;
+    Q = rand32() % (P > 0x3fffffff ? P : 4 * P + 1);
+    qos_recip_init(&r, P);
+    check_conv(Q, P, &r);
+    check_ul(rand32(), rand32(), rand32());
+    check_ull(((unsigned long long) rand32() << 32) | rand32(), rand32());
+#if defined(QOS_BW_WIDE) && defined(__SIZEOF_INT128__)
+    {
+      qos_bw_t den = 1 + rand32() % MAX_BW;
+      check_scale(((unsigned long long) rand32() << 32) | rand32(), rand32() % (den + 1), den);
+      check_scale(~0ull, den, den);
+    }
+#endif
+  }
+
+  if (errors != 0) {
+    qos_log_err("%d rounding errors", errors);
+    return -1;
+  }
   return 0;
 }